@@ -21,6 +21,9 @@
 #define mul24 __mul24
 #define __inline __host__ __device__
 #define atomic_add atomicAdd
+#include <cuda_fp16.h>
+#define vload_half(i,p) __half2float(((const __half *)(p))[i])
+#define vstore_half(v,i,p) (((__half *)(p))[i]=__float2half_rn(v))
 
 #elif defined(cl_khr_global_int32_base_atomics) // if it's in .cl file
 
@@ -77,6 +80,7 @@ const char * OpenCl_AddStr =
 #include "ocl_kernel.h"
 #include "ocl_macros.h"
 #include "ocl_memory.h"
+#include "ocl_prims.h"
 #include "ocl_texture.h"
 #include "ocl_timer.h"
 using namespace ucl_opencl;
@@ -89,6 +93,7 @@ using namespace ucl_opencl;
 #include "nvd_kernel.h"
 #include "nvd_macros.h"
 #include "nvd_memory.h"
+#include "nvd_prims.h"
 #include "nvd_texture.h"
 #include "nvd_timer.h"
 using namespace ucl_cudadr;
@@ -101,15 +106,40 @@ using namespace ucl_cudadr;
 
 // Standard ucl headers
 #include "ucl_basemat.h"
+#include "ucl_batched.h"
+#include "ucl_blas1.h"
+#include "ucl_checkpoint.h"
 #include "ucl_copy.h"
+#include "ucl_d_colmat.h"
 #include "ucl_d_mat.h"
 #include "ucl_d_vec.h"
+#include "ucl_dirty.h"
+#include "ucl_format.h"
+#include "ucl_gather.h"
+#include "ucl_gemm.h"
+#include "ucl_h_colmat.h"
 #include "ucl_h_mat.h"
 #include "ucl_h_vec.h"
+#include "ucl_half.h"
+#include "ucl_half_convert.h"
+#include "ucl_hash.h"
+#include "ucl_host_alloc.h"
+#include "ucl_host_copy.h"
 // #include "ucl_image.h"
+#include "ucl_kernel_cache.h"
 #include "ucl_matrix.h"
+#include "ucl_mem_tracker.h"
+#include "ucl_npy.h"
+#include "ucl_npy_io.h"
 #include "ucl_nv_kernel.h"
 #include "ucl_print.h"
+#include "ucl_prims.h"
+#include "ucl_reduce.h"
+#include "ucl_scan.h"
+#include "ucl_soa.h"
+#include "ucl_sort.h"
+#include "ucl_thread.h"
+#include "ucl_transpose.h"
 #include "ucl_types.h"
 #include "ucl_vector.h"
 // #include "ucl_version.h"
@@ -27,9 +27,25 @@
 #include <string>
 #include <vector>
 #include <iostream>
+#include <vector_types.h>
 #include "nvd_macros.h"
 #include "ucl_types.h"
 
+// CUDA vector types are copied in bulk and named as in kernel code
+_UCL_REGISTER_DATA_ID(int2,12,"int2",12)
+_UCL_REGISTER_DATA_ID(uint2,13,"uint2",12)
+_UCL_REGISTER_DATA_ID(float2,14,"float2",12)
+_UCL_REGISTER_DATA_ID(float4,15,"float4",12)
+_UCL_REGISTER_DATA_ID(double2,16,"double2",12)
+_UCL_REGISTER_DATA_ID(double4,17,"double4",12)
+_UCL_REGISTER_DATA_ID(int4,18,"int4",12)
+_UCL_REGISTER_DATA_ID(uint4,19,"uint4",12)
+
+#include "ucl_half.h"
+#include "ucl_mem_tracker.h"
+#include "ucl_kernel_cache.h"
+#include "ucl_host_alloc.h"
+
 namespace ucl_cudadr {
 
 // --------------------------------------------------------------------------
@@ -41,6 +57,62 @@ inline void ucl_sync(CUstream &stream) {
   CU_SAFE_CALL(cuStreamSynchronize(stream));
 }
 
+/// Marker for the completion of commands in a command queue
+class UCL_Event {
+ public:
+  UCL_Event() : _created(false) {}
+  ~UCL_Event() { clear(); }
+
+  /// Destroy the event
+  inline void clear() {
+    if (_created)
+      CU_DESTRUCT_CALL(cuEventDestroy(_event));
+    _created=false;
+  }
+
+  /// Mark the completion of all commands enqueued so far in cq
+  inline void record(command_queue &cq) {
+    if (!_created) {
+      CU_SAFE_CALL(cuEventCreate(&_event,CU_EVENT_DISABLE_TIMING));
+      _created=true;
+    }
+    CU_SAFE_CALL(cuCtxGetCurrent(&_context));
+    CU_SAFE_CALL(cuEventRecord(_event,cq));
+  }
+
+  /// True if the commands before the event have finished (does not block)
+  inline bool query() {
+    if (!_created)
+      return true;
+    CU_SAFE_CALL(cuCtxPushCurrent(_context));
+    CUresult err=cuEventQuery(_event);
+    CUcontext old;
+    CU_SAFE_CALL(cuCtxPopCurrent(&old));
+    if (err==CUDA_ERROR_NOT_READY)
+      return false;
+    CU_SAFE_CALL(err);
+    return true;
+  }
+
+  /// Block until the commands before the event have finished
+  /** May be called from a different host thread than record() **/
+  inline void sync() {
+    if (!_created)
+      return;
+    CU_SAFE_CALL(cuCtxPushCurrent(_context));
+    CU_SAFE_CALL(cuEventSynchronize(_event));
+    CUcontext old;
+    CU_SAFE_CALL(cuCtxPopCurrent(&old));
+  }
+
+ private:
+  CUevent _event;
+  CUcontext _context;
+  bool _created;
+  UCL_Event(const UCL_Event &);
+  UCL_Event & operator=(const UCL_Event &);
+};
+
 struct NVDProperties {
   int device_id;
   std::string name;
@@ -232,6 +304,12 @@ class UCL_Device {
   inline size_t group_size(const int i)
     { return _properties[i].maxThreadsPerBlock; }
 
+  /// Get the bytes of shared memory available to a block
+  inline size_t local_bytes() { return local_bytes(_device); }
+  /// Get the bytes of shared memory available to a block
+  inline size_t local_bytes(const int i)
+    { return _properties[i].sharedMemPerBlock; }
+
   /// Return the maximum memory pitch in bytes for current device
   inline size_t max_pitch() { return max_pitch(_device); }
   /// Return the maximum memory pitch in bytes
@@ -277,12 +355,27 @@ class UCL_Device {
   /// Select the platform that has accelerators (for compatibility with OpenCL)
   inline int set_platform_accelerator(int pid=-1) { return UCL_SUCCESS; }
 
+  /// Memory accounting for allocations made with this device
+  /** \sa UCL_MemTracker **/
+  inline UCL_MemTracker & mem_tracker() { return _mem_tracker; }
+
+  /// Kernels generated and compiled for this device by the primitives
+  /** \sa UCL_KernelCache **/
+  inline UCL_KernelCache & kernel_cache() { return _kernel_cache; }
+
+  /// Default placement policy for pinned host allocations with this device
+  /** \sa UCL_HostPolicy **/
+  inline UCL_HostPolicy & host_policy() { return _host_policy; }
+
  private:
   int _device, _num_devices;
   std::vector<NVDProperties> _properties;
   std::vector<CUstream> _cq;
   CUdevice _cu_device;
   CUcontext _context;
+  UCL_MemTracker _mem_tracker;
+  UCL_KernelCache _kernel_cache;
+  UCL_HostPolicy _host_policy;
 };
 
 // Grabs the properties for all devices
@@ -373,6 +466,7 @@ int UCL_Device::set(int num) {
 }
 
 void UCL_Device::clear() {
+  _kernel_cache.clear();
   if (_device>-1) {
     for (int i=1; i<num_queues(); i++) pop_command_queue();
     cuCtxDestroy(_context);
@@ -197,7 +197,7 @@ class UCL_Kernel {
       add_arg(arg);
     else if (index<_num_args)
       #if CUDA_VERSION >= 4000
-      _kernel_args[index]=arg;
+      _kernel_args[index]=const_cast<dtype * const>(arg);
       #else
       CU_SAFE_CALL(cuParamSetv(_kernel, _offsets[index], arg, sizeof(dtype)));
       #endif
@@ -208,22 +208,22 @@ class UCL_Kernel {
   /// Set a geryon container as a kernel argument.
   template <class numtyp>
   inline void set_arg(const UCL_D_Vec<numtyp> * const arg)
-    { set_arg(&arg->begin()); }
+    { arg->touch(); set_arg(&arg->begin()); }
 
   /// Set a geryon container as a kernel argument.
   template <class numtyp>
   inline void set_arg(const UCL_D_Mat<numtyp> * const arg)
-    { set_arg(&arg->begin()); }
+    { arg->touch(); set_arg(&arg->begin()); }
 
   /// Set a geryon container as a kernel argument.
   template <class hosttype, class devtype>
   inline void set_arg(const UCL_Vector<hosttype, devtype> * const arg)
-    { set_arg(&arg->device.begin()); }
+    { arg->device.touch(); set_arg(&arg->device.begin()); }
 
   /// Set a geryon container as a kernel argument.
   template <class hosttype, class devtype>
   inline void set_arg(const UCL_Matrix<hosttype, devtype> * const arg)
-    { set_arg(&arg->device.begin()); }
+    { arg->device.touch(); set_arg(&arg->device.begin()); }
 
   /// Add a kernel argument.
   inline void add_arg(const CUdeviceptr* const arg) {
@@ -258,22 +258,22 @@ class UCL_Kernel {
   /// Add a geryon container as a kernel argument.
   template <class numtyp>
   inline void add_arg(const UCL_D_Vec<numtyp> * const arg)
-    { add_arg(&arg->begin()); }
+    { arg->touch(); add_arg(&arg->begin()); }
 
   /// Add a geryon container as a kernel argument.
   template <class numtyp>
   inline void add_arg(const UCL_D_Mat<numtyp> * const arg)
-    { add_arg(&arg->begin()); }
+    { arg->touch(); add_arg(&arg->begin()); }
 
   /// Add a geryon container as a kernel argument.
   template <class hosttype, class devtype>
   inline void add_arg(const UCL_Vector<hosttype, devtype> * const arg)
-    { add_arg(&arg->device.begin()); }
+    { arg->device.touch(); add_arg(&arg->device.begin()); }
 
   /// Add a geryon container as a kernel argument.
   template <class hosttype, class devtype>
   inline void add_arg(const UCL_Matrix<hosttype, devtype> * const arg)
-    { add_arg(&arg->device.begin()); }
+    { arg->device.touch(); add_arg(&arg->device.begin()); }
 
   /// Set the number of thread blocks and the number of threads in each block
   /** \note This should be called before any arguments have been added
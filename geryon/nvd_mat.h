@@ -27,6 +27,11 @@
 #define NVD_MAT_H
 
 #include "nvd_memory.h"
+#include "ucl_format.h"
+#include "ucl_hash.h"
+#include "ucl_npy.h"
+#include "ucl_thread.h"
+#include "ucl_host_copy.h"
 
 /// Namespace for CUDA Driver routines
 namespace ucl_cudadr {
@@ -36,8 +41,11 @@ namespace ucl_cudadr {
 #include "ucl_basemat.h"
 #include "ucl_h_vec.h"
 #include "ucl_h_mat.h"
+#include "ucl_h_colmat.h"
 #include "ucl_d_vec.h"
 #include "ucl_d_mat.h"
+#include "ucl_d_colmat.h"
+#include "ucl_dirty.h"
 #include "ucl_s_obj_help.h"
 #include "ucl_vector.h"
 #include "ucl_matrix.h"
@@ -48,10 +56,22 @@ namespace ucl_cudadr {
 #include "ucl_copy.h"
 #undef UCL_COPY_ALLOW
 
+#define UCL_MANAGED_ALLOW
+#include "ucl_managed.h"
+#undef UCL_MANAGED_ALLOW
+
 #define UCL_PRINT_ALLOW
 #include "ucl_print.h"
 #undef UCL_PRINT_ALLOW
 
+#define UCL_NPY_ALLOW
+#include "ucl_npy_io.h"
+#undef UCL_NPY_ALLOW
+
+#define UCL_CHECKPOINT_ALLOW
+#include "ucl_checkpoint.h"
+#undef UCL_CHECKPOINT_ALLOW
+
 } // namespace ucl_cudadr
 
 #endif
@@ -29,6 +29,7 @@
 #include <cstring>
 #include "nvd_macros.h"
 #include "ucl_types.h"
+#include "ucl_mem_tracker.h"
 
 namespace ucl_cudadr {
 
@@ -42,22 +43,75 @@ namespace ucl_cudadr {
 // --------------------------------------------------------------------------
 typedef CUdeviceptr device_ptr;
 
+// --------------------------------------------------------------------------
+// - MEMORY ACCOUNTING
+// --------------------------------------------------------------------------
+
+// Tracker for allocations made with a device or with another container
+inline UCL_MemTracker * _ucl_mem_tracker(UCL_Device &dev)
+  { return &dev.mem_tracker(); }
+
+template <class copy_type>
+inline UCL_MemTracker * _ucl_mem_tracker(copy_type &cm)
+  { return cm.mem_record().tracker; }
+
+// Kind of host allocation for accounting
+inline int _ucl_host_mem_kind(const enum UCL_MEMOPT kind) {
+  if (kind==UCL_NOT_PINNED)
+    return UCL_MEM_PAGEABLE_HOST;
+  return UCL_MEM_PINNED_HOST;
+}
+
+// Kind to allocate with, UCL_NOT_PINNED if the pinned limit is exceeded
+inline enum UCL_MEMOPT _ucl_host_pin_kind(UCL_MemTracker *tracker,
+                                          const size_t n,
+                                          const enum UCL_MEMOPT kind) {
+  if (kind!=UCL_NOT_PINNED && _ucl_pinned_demote(tracker,n))
+    return UCL_NOT_PINNED;
+  return kind;
+}
+
 // --------------------------------------------------------------------------
 // - HOST MEMORY ALLOCATION ROUTINES
 // --------------------------------------------------------------------------
+// Map host memory with the placement policy of mat and page-lock it
+// cuMemHostRegister has no write-combining flag, so UCL_WRITE_ONLY memory
+// allocated this way is cached (unlike cuMemHostAlloc allocations)
+template <class mat_type>
+inline int _host_policy_alloc(mat_type &mat, const size_t n,
+                              const enum UCL_MEMOPT kind) {
+  size_t mapped;
+  void *ptr=ucl_host_map(n,mat.host_policy(),mapped);
+  if (ptr==NULL)
+    return UCL_MEMORY_ERROR;
+  if (kind!=UCL_NOT_PINNED && cuMemHostRegister(ptr,mapped,0)!=CUDA_SUCCESS) {
+    ucl_host_unmap(ptr,mapped);
+    return UCL_MEMORY_ERROR;
+  }
+  *(mat.host_ptr())=(typename mat_type::data_type*)ptr;
+  mat.host_mapped()=mapped;
+  return UCL_SUCCESS;
+}
+
 template <class mat_type, class copy_type>
 inline int _host_alloc(mat_type &mat, copy_type &cm, const size_t n,
                        const enum UCL_MEMOPT kind, const enum UCL_MEMOPT kind2){
   CUresult err=CUDA_SUCCESS;
-  if (kind==UCL_NOT_PINNED)
+  UCL_MemTracker *tracker=_ucl_mem_tracker(cm);
+  const enum UCL_MEMOPT k=_ucl_host_pin_kind(tracker,n,kind);
+  if (!mat.host_policy().driver()) {
+    if (_host_policy_alloc(mat,n,k)!=UCL_SUCCESS)
+      return UCL_MEMORY_ERROR;
+  } else if (k==UCL_NOT_PINNED)
     *(mat.host_ptr())=(typename mat_type::data_type*)malloc(n);
-  else if (kind==UCL_WRITE_ONLY)
+  else if (k==UCL_WRITE_ONLY)
     err=cuMemHostAlloc((void **)mat.host_ptr(),n,CU_MEMHOSTALLOC_WRITECOMBINED);
   else
     err=cuMemAllocHost((void **)mat.host_ptr(),n);
   if (err!=CUDA_SUCCESS || *(mat.host_ptr())==NULL)
     return UCL_MEMORY_ERROR;
   mat.cq()=cm.cq();
+  _ucl_track_alloc(mat,tracker,n,_ucl_host_mem_kind(k));
   return UCL_SUCCESS;
 }
 
@@ -65,23 +119,38 @@ template <class mat_type>
 inline int _host_alloc(mat_type &mat, UCL_Device &dev, const size_t n,
                        const enum UCL_MEMOPT kind, const enum UCL_MEMOPT kind2){
   CUresult err=CUDA_SUCCESS;
-  if (kind==UCL_NOT_PINNED)
+  if (mat.host_policy().placement==UCL_HOST_DEFAULT &&
+      !dev.host_policy().driver())
+    mat.host_policy()=dev.host_policy();
+  UCL_MemTracker *tracker=_ucl_mem_tracker(dev);
+  const enum UCL_MEMOPT k=_ucl_host_pin_kind(tracker,n,kind);
+  if (!mat.host_policy().driver()) {
+    if (_host_policy_alloc(mat,n,k)!=UCL_SUCCESS)
+      return UCL_MEMORY_ERROR;
+  } else if (k==UCL_NOT_PINNED)
     *(mat.host_ptr())=(typename mat_type::data_type*)malloc(n);
-  else if (kind==UCL_WRITE_ONLY)
+  else if (k==UCL_WRITE_ONLY)
     err=cuMemHostAlloc((void **)mat.host_ptr(),n,CU_MEMHOSTALLOC_WRITECOMBINED);
   else
     err=cuMemAllocHost((void **)mat.host_ptr(),n);
   if (err!=CUDA_SUCCESS || *(mat.host_ptr())==NULL)
     return UCL_MEMORY_ERROR;
   mat.cq()=dev.cq();
+  _ucl_track_alloc(mat,tracker,n,_ucl_host_mem_kind(k));
   return UCL_SUCCESS;
 }
 
 template <class mat_type>
 inline void _host_free(mat_type &mat) {
+  _ucl_track_free(mat);
   if (mat.kind()==UCL_VIEW)
     return;
-  else if (mat.kind()!=UCL_NOT_PINNED)
+  else if (mat.host_mapped()>0) {
+    if (mat.kind()!=UCL_NOT_PINNED)
+      CU_DESTRUCT_CALL(cuMemHostUnregister(mat.begin()));
+    ucl_host_unmap(mat.begin(),mat.host_mapped());
+    mat.host_mapped()=0;
+  } else if (mat.kind()!=UCL_NOT_PINNED)
     CU_DESTRUCT_CALL(cuMemFreeHost(mat.begin()));
   else
     free(mat.begin());
@@ -89,16 +158,23 @@ inline void _host_free(mat_type &mat) {
 
 template <class mat_type>
 inline int _host_resize(mat_type &mat, const size_t n) {
+  UCL_MemRecord record=mat.mem_record();
+  const bool policy=(mat.host_mapped()>0);
   _host_free(mat);
   CUresult err=CUDA_SUCCESS;
-  if (mat.kind()==UCL_NOT_PINNED)
+  const enum UCL_MEMOPT k=_ucl_host_pin_kind(record.tracker,n,mat.kind());
+  if (policy) {
+    if (_host_policy_alloc(mat,n,k)!=UCL_SUCCESS)
+      return UCL_MEMORY_ERROR;
+  } else if (k==UCL_NOT_PINNED)
     *(mat.host_ptr())=(typename mat_type::data_type*)malloc(n);
-  else if (mat.kind()==UCL_WRITE_ONLY)
+  else if (k==UCL_WRITE_ONLY)
     err=cuMemHostAlloc((void **)mat.host_ptr(),n,CU_MEMHOSTALLOC_WRITECOMBINED);
   else
     err=cuMemAllocHost((void **)mat.host_ptr(),n);
   if (err!=CUDA_SUCCESS || *(mat.host_ptr())==NULL)
     return UCL_MEMORY_ERROR;
+  _ucl_track_alloc(mat,record.tracker,n,_ucl_host_mem_kind(k),record.tag);
   return UCL_SUCCESS;
 }
 
@@ -108,20 +184,30 @@ inline int _host_resize(mat_type &mat, const size_t n) {
 template <class mat_type, class copy_type>
 inline int _device_alloc(mat_type &mat, copy_type &cm, const size_t n,
                          const enum UCL_MEMOPT kind) {
+  UCL_MemTracker *tracker=_ucl_mem_tracker(cm);
+  _ucl_managed_reserve(tracker,n);
   CUresult err=cuMemAlloc(&mat.cbegin(),n);
+  while (err!=CUDA_SUCCESS && _ucl_managed_retry(tracker,n))
+    err=cuMemAlloc(&mat.cbegin(),n);
   if (err!=CUDA_SUCCESS)
     return UCL_MEMORY_ERROR;
   mat.cq()=cm.cq();
+  _ucl_track_alloc(mat,tracker,n,UCL_MEM_DEVICE);
   return UCL_SUCCESS;
 }
 
 template <class mat_type>
 inline int _device_alloc(mat_type &mat, UCL_Device &dev, const size_t n,
                          const enum UCL_MEMOPT kind) {
+  UCL_MemTracker *tracker=_ucl_mem_tracker(dev);
+  _ucl_managed_reserve(tracker,n);
   CUresult err=cuMemAlloc(&mat.cbegin(),n);
+  while (err!=CUDA_SUCCESS && _ucl_managed_retry(tracker,n))
+    err=cuMemAlloc(&mat.cbegin(),n);
   if (err!=CUDA_SUCCESS)
     return UCL_MEMORY_ERROR;
   mat.cq()=dev.cq();
+  _ucl_track_alloc(mat,tracker,n,UCL_MEM_DEVICE);
   return UCL_SUCCESS;
 }
 
@@ -131,12 +217,17 @@ inline int _device_alloc(mat_type &mat, copy_type &cm, const size_t rows,
                          const enum UCL_MEMOPT kind) {
   CUresult err;
   CUDA_INT_TYPE upitch;
-  err=cuMemAllocPitch(&mat.cbegin(),&upitch,
-                      cols*sizeof(typename mat_type::data_type),rows,16);
+  UCL_MemTracker *tracker=_ucl_mem_tracker(cm);
+  const size_t row_bytes=cols*sizeof(typename mat_type::data_type);
+  _ucl_managed_reserve(tracker,row_bytes*rows);
+  err=cuMemAllocPitch(&mat.cbegin(),&upitch,row_bytes,rows,16);
+  while (err!=CUDA_SUCCESS && _ucl_managed_retry(tracker,row_bytes*rows))
+    err=cuMemAllocPitch(&mat.cbegin(),&upitch,row_bytes,rows,16);
   pitch=static_cast<size_t>(upitch);
   if (err!=CUDA_SUCCESS)
     return UCL_MEMORY_ERROR;
   mat.cq()=cm.cq();
+  _ucl_track_alloc(mat,tracker,pitch*rows,UCL_MEM_DEVICE);
   return UCL_SUCCESS;
 }
 
@@ -146,41 +237,66 @@ inline int _device_alloc(mat_type &mat, UCL_Device &d, const size_t rows,
                          const enum UCL_MEMOPT kind) {
   CUresult err;
   unsigned upitch;
-  err=cuMemAllocPitch(&mat.cbegin(),&upitch,
-                      cols*sizeof(typename mat_type::data_type),rows,16);
+  UCL_MemTracker *tracker=_ucl_mem_tracker(d);
+  const size_t row_bytes=cols*sizeof(typename mat_type::data_type);
+  _ucl_managed_reserve(tracker,row_bytes*rows);
+  err=cuMemAllocPitch(&mat.cbegin(),&upitch,row_bytes,rows,16);
+  while (err!=CUDA_SUCCESS && _ucl_managed_retry(tracker,row_bytes*rows))
+    err=cuMemAllocPitch(&mat.cbegin(),&upitch,row_bytes,rows,16);
   pitch=static_cast<size_t>(upitch);
   if (err!=CUDA_SUCCESS)
     return UCL_MEMORY_ERROR;
   mat.cq()=d.cq();
+  _ucl_track_alloc(mat,tracker,pitch*rows,UCL_MEM_DEVICE);
   return UCL_SUCCESS;
 }
 
 template <class mat_type>
 inline void _device_free(mat_type &mat) {
+  _ucl_track_free(mat);
+  if (_ucl_managed_free(mat))
+    return;
   if (mat.kind()!=UCL_VIEW)
     CU_DESTRUCT_CALL(cuMemFree(mat.cbegin()));
 }
 
 template <class mat_type>
 inline int _device_resize(mat_type &mat, const size_t n) {
+  mat.touch();
+  UCL_MemRecord record=mat.mem_record();
   _device_free(mat);
+  _ucl_managed_hold(mat,true);
+  _ucl_managed_reserve(record.tracker,n);
   CUresult err=cuMemAlloc(&mat.cbegin(),n);
+  while (err!=CUDA_SUCCESS && _ucl_managed_retry(record.tracker,n))
+    err=cuMemAlloc(&mat.cbegin(),n);
+  _ucl_managed_hold(mat,false);
   if (err!=CUDA_SUCCESS)
     return UCL_MEMORY_ERROR;
+  _ucl_track_alloc(mat,record.tracker,n,record.kind,record.tag);
   return UCL_SUCCESS;
 }
 
 template <class mat_type>
 inline int _device_resize(mat_type &mat, const size_t rows,
                           const size_t cols, size_t &pitch) {
+  mat.touch();
+  UCL_MemRecord record=mat.mem_record();
   _device_free(mat);
+  _ucl_managed_hold(mat,true);
   CUresult err;
   CUDA_INT_TYPE upitch;
-  err=cuMemAllocPitch(&mat.cbegin(),&upitch,
-                      cols*sizeof(typename mat_type::data_type),rows,16);
+  const size_t row_bytes=cols*sizeof(typename mat_type::data_type);
+  _ucl_managed_reserve(record.tracker,row_bytes*rows);
+  err=cuMemAllocPitch(&mat.cbegin(),&upitch,row_bytes,rows,16);
+  while (err!=CUDA_SUCCESS &&
+         _ucl_managed_retry(record.tracker,row_bytes*rows))
+    err=cuMemAllocPitch(&mat.cbegin(),&upitch,row_bytes,rows,16);
+  _ucl_managed_hold(mat,false);
   pitch=static_cast<size_t>(upitch);
   if (err!=CUDA_SUCCESS)
     return UCL_MEMORY_ERROR;
+  _ucl_track_alloc(mat,record.tracker,pitch*rows,record.kind,record.tag);
   return UCL_SUCCESS;
 }
 
@@ -233,6 +349,7 @@ inline void _host_zero(void *ptr, const size_t n) {
 
 template <class mat_type>
 inline void _device_zero(mat_type &mat, const size_t n, command_queue &cq) {
+  mat.touch();
   if (n%32==0)
     CU_SAFE_CALL(cuMemsetD32Async(mat.cbegin(),0,n/4,cq));
   else if (n%16==0)
@@ -266,6 +383,29 @@ template <> struct _nvd_set_2D_mem<2>
 template <int mem> struct _nvd_set_2D_mem
   { static CUmemorytype a() { return CU_MEMORYTYPE_DEVICE; } };
 
+template <int mem> struct _nvd_set_2D_ptr;
+template <> struct _nvd_set_2D_ptr<1> {
+  template <class p1>
+  static void dst(CUDA_MEMCPY2D &ins, p1 &mat) { ins.dstHost=mat.begin(); }
+  template <class p2>
+  static void src(CUDA_MEMCPY2D &ins, const p2 &mat)
+    { ins.srcHost=mat.begin(); }
+};
+template <> struct _nvd_set_2D_ptr<2> {
+  template <class p1>
+  static void dst(CUDA_MEMCPY2D &ins, p1 &mat) { ins.dstArray=mat.cbegin(); }
+  template <class p2>
+  static void src(CUDA_MEMCPY2D &ins, const p2 &mat)
+    { ins.srcArray=mat.cbegin(); }
+};
+template <int mem> struct _nvd_set_2D_ptr {
+  template <class p1>
+  static void dst(CUDA_MEMCPY2D &ins, p1 &mat) { ins.dstDevice=mat.cbegin(); }
+  template <class p2>
+  static void src(CUDA_MEMCPY2D &ins, const p2 &mat)
+    { ins.srcDevice=mat.cbegin(); }
+};
+
 
 // --------------------------------------------------------------------------
 // - MEMCPY ROUTINES
@@ -536,11 +676,11 @@ template <> struct _ucl_memcpy<0,1> {
 template <> struct _ucl_memcpy<1,1> {
   template <class p1, class p2>
   static inline void mc(p1 &dst, const p2 &src, const size_t n)
-    { memcpy(dst.begin(),src.begin(),n); }
+    { memcpy((void *)dst.begin(),src.begin(),n); }
   template <class p1, class p2>
   static inline void mc(p1 &dst, const p2 &src, const size_t n,
                         CUstream &cq)
-    { memcpy(dst.begin(),src.begin(),n); }
+    { memcpy((void *)dst.begin(),src.begin(),n); }
   template <class p1, class p2>
       static inline void mc(p1 &dst, const size_t dpitch, const p2 &src,
                             const size_t spitch, const size_t cols,
@@ -626,12 +766,16 @@ template <int mem1, int mem2> struct _ucl_memcpy {
 
 template<class mat1, class mat2>
 inline void ucl_mv_cpy(mat1 &dst, const mat2 &src, const size_t n) {
+  dst.touch();
+  src.touch();
   _ucl_memcpy<mat1::MEM_TYPE,mat2::MEM_TYPE>::mc(dst,src,n);
 }
 
 template<class mat1, class mat2>
 inline void ucl_mv_cpy(mat1 &dst, const mat2 &src, const size_t n,
                        CUstream &cq) {
+  dst.touch();
+  src.touch();
   _ucl_memcpy<mat1::MEM_TYPE,mat2::MEM_TYPE>::mc(dst,src,n,cq);
 }
 
@@ -639,6 +783,8 @@ template<class mat1, class mat2>
 inline void ucl_mv_cpy(mat1 &dst, const size_t dpitch, const mat2 &src,
                        const size_t spitch, const size_t cols,
                        const size_t rows) {
+  dst.touch();
+  src.touch();
   _ucl_memcpy<mat1::MEM_TYPE,mat2::MEM_TYPE>::mc(dst,dpitch,src,spitch,cols,
                                                  rows);
 }
@@ -647,10 +793,32 @@ template<class mat1, class mat2>
 inline void ucl_mv_cpy(mat1 &dst, const size_t dpitch, const mat2 &src,
                        const size_t spitch, const size_t cols,
                        const size_t rows,CUstream &cq) {
+  dst.touch();
+  src.touch();
   _ucl_memcpy<mat1::MEM_TYPE,mat2::MEM_TYPE>::mc(dst,dpitch,src,spitch,cols,
                                                  rows,cq);
 }
 
+template<class mat1, class mat2>
+inline void ucl_mv_cpy(mat1 &dst, const size_t dst_offset,
+                       const size_t dpitch, const mat2 &src,
+                       const size_t src_offset, const size_t spitch,
+                       const size_t cols, const size_t rows, CUstream &cq) {
+  dst.touch();
+  src.touch();
+  CUDA_MEMCPY2D ins;
+  _nvd_set_2D_loc(ins,dpitch,spitch,cols,rows);
+  ins.dstXInBytes=dst_offset%dpitch;
+  ins.dstY=dst_offset/dpitch;
+  ins.srcXInBytes=src_offset%spitch;
+  ins.srcY=src_offset/spitch;
+  ins.dstMemoryType=_nvd_set_2D_mem<mat1::MEM_TYPE>::a();
+  ins.srcMemoryType=_nvd_set_2D_mem<mat2::MEM_TYPE>::a();
+  _nvd_set_2D_ptr<mat1::MEM_TYPE>::dst(ins,dst);
+  _nvd_set_2D_ptr<mat2::MEM_TYPE>::src(ins,src);
+  CU_SAFE_CALL(cuMemcpy2DAsync(&ins,cq));
+}
+
 } // namespace ucl_cudart
 
 #endif
@@ -0,0 +1,149 @@
+/***************************************************************************
+                                 nvd_prims.h
+                             -------------------
+
+  CUDA Driver Specific Device Primitives (Reductions, Scans, Sorts, ...)
+
+ __________________________________________________________________________
+    This file is part of the Geryon Unified Coprocessor Library (UCL)
+ __________________________________________________________________________
+
+ ***************************************************************************/
+
+/* -----------------------------------------------------------------------
+   Copyright (2010) Sandia Corporation.  Under the terms of Contract
+   DE-AC04-94AL85000 with Sandia Corporation, the U.S. Government retains
+   certain rights in this software.  This software is distributed under
+   the Simplified BSD License.
+   ----------------------------------------------------------------------- */
+
+/*! \file */
+
+/***************************************************************************
+   The primitives generate CUDA C source at run time. It is compiled to PTX
+   with NVRTC when UCL_NVRTC is defined (link with -lnvrtc). Without
+   UCL_NVRTC, the primitives return UCL_COMPILE_ERROR.
+ ***************************************************************************/
+
+#ifndef NVD_PRIMS_H
+#define NVD_PRIMS_H
+
+#include "nvd_mat.h"
+#include "nvd_kernel.h"
+#include <limits>
+#include <sstream>
+#ifdef UCL_NVRTC
+#include <nvrtc.h>
+#endif
+
+namespace ucl_cudadr {
+
+// --------------------------------------------------------------------------
+// - API SPECIFIC ROUTINES USED BY THE PRIMITIVES
+// --------------------------------------------------------------------------
+
+/// Definitions prepended to the generated source of device primitives
+inline const char * _ucl_prims_prelude() {
+  return
+    "#define GLOBAL_ID_X (threadIdx.x+blockIdx.x*blockDim.x)\n"
+    "#define THREAD_ID_X threadIdx.x\n"
+    "#define BLOCK_ID_X blockIdx.x\n"
+    "#define BLOCK_SIZE_X blockDim.x\n"
+    "#define GRID_SIZE_X gridDim.x\n"
+    "#define __kernel extern \"C\" __global__\n"
+    "#define __global\n"
+    "#define __local __shared__\n"
+    "#define ucl_inline static __inline__ __device__\n"
+    "#define ucl_as_uint(x) __float_as_uint(x)\n"
+    "#define ucl_as_ulong(x) ((unsigned long long)__double_as_longlong(x))\n"
+    "#define ucl_local_inc(p) atomicAdd(p,1)\n"
+    "typedef unsigned short half;\n"
+    "static __inline__ __device__ float vload_half(const int i,\n"
+    "                                              const half *p) {\n"
+    "  float f;\n"
+    "  asm(\"cvt.f32.f16 %0, %1;\" : \"=f\"(f) : \"h\"(p[i]));\n"
+    "  return f;\n"
+    "}\n"
+    "static __inline__ __device__ void vstore_half(const float f,\n"
+    "                                              const int i, half *p) {\n"
+    "  half h;\n"
+    "  asm(\"cvt.rn.f16.f32 %0, %1;\" : \"=h\"(h) : \"f\"(f));\n"
+    "  p[i]=h;\n"
+    "}\n";
+}
+
+/// Compile generated source for the device primitives
+inline int _ucl_prims_compile(UCL_Device &dev, UCL_Program &program,
+                              const std::string &src, std::string *log) {
+  #ifdef UCL_NVRTC
+  std::string prog=std::string(_ucl_prims_prelude())+src;
+  nvrtcProgram nprog;
+  if (nvrtcCreateProgram(&nprog,prog.c_str(),"ucl_prims.cu",0,NULL,
+                         NULL)!=NVRTC_SUCCESS)
+    return UCL_COMPILE_ERROR;
+
+  std::ostringstream arch;
+  arch << "--gpu-architecture=compute_"
+       << static_cast<int>(dev.arch()*10.0+0.5);
+  std::string arch_opt=arch.str();
+  const char *opts[1]={arch_opt.c_str()};
+  nvrtcResult err=nvrtcCompileProgram(nprog,1,opts);
+
+  size_t log_size;
+  nvrtcGetProgramLogSize(nprog,&log_size);
+  std::vector<char> clog(log_size+1,'\0');
+  nvrtcGetProgramLog(nprog,&clog[0]);
+  if (log!=NULL)
+    *log=std::string(&clog[0]);
+
+  if (err!=NVRTC_SUCCESS) {
+    #ifndef UCL_NO_EXIT
+    std::cerr << std::endl
+              << "----------------------------------------------------------\n"
+              << " UCL Error: Error compiling CUDA Program...\n"
+              << "----------------------------------------------------------\n";
+    std::cerr << &clog[0] << std::endl;
+    #endif
+    nvrtcDestroyProgram(&nprog);
+    return UCL_COMPILE_ERROR;
+  }
+
+  size_t ptx_size;
+  nvrtcGetPTXSize(nprog,&ptx_size);
+  std::vector<char> ptx(ptx_size+1,'\0');
+  nvrtcGetPTX(nprog,&ptx[0]);
+  nvrtcDestroyProgram(&nprog);
+  return program.load_string(&ptx[0],"",log);
+  #else
+  (void)dev; (void)program; (void)src; (void)log;
+  #ifndef UCL_NO_EXIT
+  std::cerr << "UCL Error: Device primitives require UCL_NVRTC with the "
+            << "CUDA Driver API.\n";
+  UCL_GERYON_EXIT;
+  #endif
+  return UCL_COMPILE_ERROR;
+  #endif
+}
+
+/// True if the first element of mat is aligned for loads of bytes
+template <class mat_type>
+inline bool _ucl_prims_aligned(const mat_type &mat, const size_t bytes)
+  { return static_cast<size_t>(mat.cbegin())%bytes==0; }
+
+#define UCL_PRIMS_ALLOW
+#include "ucl_prims.h"
+#include "ucl_reduce.h"
+#include "ucl_scan.h"
+#include "ucl_sort.h"
+#include "ucl_gather.h"
+#include "ucl_blas1.h"
+#include "ucl_gemm.h"
+#include "ucl_batched.h"
+#include "ucl_transpose.h"
+#include "ucl_soa.h"
+#include "ucl_half_convert.h"
+#undef UCL_PRIMS_ALLOW
+
+} // namespace ucl_cudadr
+
+#endif
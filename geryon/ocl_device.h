@@ -27,6 +27,7 @@
 #include <string>
 #include <vector>
 #include <iostream>
+#include <cstring>
 
 #ifdef __APPLE__
 #include <OpenCL/cl.h>
@@ -39,6 +40,21 @@
 #include "ocl_macros.h"
 #include "ucl_types.h"
 
+// OpenCL vector types are copied in bulk and named as in kernel code
+_UCL_REGISTER_DATA_ID(cl_int2,12,"int2",12)
+_UCL_REGISTER_DATA_ID(cl_uint2,13,"uint2",12)
+_UCL_REGISTER_DATA_ID(cl_float2,14,"float2",12)
+_UCL_REGISTER_DATA_ID(cl_float4,15,"float4",12)
+_UCL_REGISTER_DATA_ID(cl_double2,16,"double2",12)
+_UCL_REGISTER_DATA_ID(cl_double4,17,"double4",12)
+_UCL_REGISTER_DATA_ID(cl_int4,18,"int4",12)
+_UCL_REGISTER_DATA_ID(cl_uint4,19,"uint4",12)
+
+#include "ucl_half.h"
+#include "ucl_mem_tracker.h"
+#include "ucl_kernel_cache.h"
+#include "ucl_host_alloc.h"
+
 namespace ucl_opencl {
 
 // --------------------------------------------------------------------------
@@ -51,6 +67,352 @@ inline void ucl_sync(cl_command_queue &cq) {
   CL_SAFE_CALL(clFinish(cq));
 }
 
+#ifdef CL_VERSION_1_2
+#define UCL_OCL_MARKER(cq,event) clEnqueueMarkerWithWaitList(cq,0,NULL,event)
+#else
+#define UCL_OCL_MARKER clEnqueueMarker
+#endif
+
+/// Marker for the completion of commands in a command queue
+class UCL_Event {
+ public:
+  UCL_Event() : _recorded(false) {}
+  ~UCL_Event() { clear(); }
+
+  /// Release the event
+  inline void clear() {
+    if (_recorded)
+      CL_DESTRUCT_CALL(clReleaseEvent(_event));
+    _recorded=false;
+  }
+
+  /// Mark the completion of all commands enqueued so far in cq
+  inline void record(command_queue &cq) {
+    clear();
+    CL_SAFE_CALL(UCL_OCL_MARKER(cq,&_event));
+    _recorded=true;
+  }
+
+  /// True if the commands before the event have finished (does not block)
+  inline bool query() {
+    if (!_recorded)
+      return true;
+    cl_int status;
+    CL_SAFE_CALL(clGetEventInfo(_event,CL_EVENT_COMMAND_EXECUTION_STATUS,
+                                sizeof(cl_int),&status,NULL));
+    return status==CL_COMPLETE;
+  }
+
+  /// Block until the commands before the event have finished
+  /** May be called from a different host thread than record() **/
+  inline void sync() {
+    if (_recorded)
+      CL_SAFE_CALL(clWaitForEvents(1,&_event));
+  }
+
+ private:
+  cl_event _event;
+  bool _recorded;
+  UCL_Event(const UCL_Event &);
+  UCL_Event & operator=(const UCL_Event &);
+};
+
+// --------------------------------------------------------------------------
+// - STAGING OF PAGEABLE HOST MEMORY
+// --------------------------------------------------------------------------
+
+/// Bytes in each pinned buffer used to stage pageable host transfers
+#ifndef UCL_STAGE_BYTES
+#define UCL_STAGE_BYTES 2097152
+#endif
+
+/// Number of pinned buffers used to stage pageable host transfers
+#ifndef UCL_STAGE_SLOTS
+#define UCL_STAGE_SLOTS 4
+#endif
+
+/// Ring of pinned buffers for transfers with pageable host memory
+/** Each UCL_Device owns one ring for its context. Transfers with
+  * UCL_NOT_PINNED host containers are split into pieces of at most
+  * UCL_STAGE_BYTES that are copied through the next buffer in the ring, so
+  * that host copies overlap with the transfers of earlier pieces.
+  * - Writes return once the data is in the ring; the host memory can be
+  *   reused immediately even if the copy is not blocking
+  * - Reads always block
+  * The buffers are allocated on first use and are not counted by the
+  * UCL_MemTracker. If they cannot be allocated, the driver is given the
+  * pageable memory directly. **/
+class _UCL_Stage {
+ public:
+  _UCL_Stage() : _context(NULL), _ready(false), _next(0) {
+    for (int i=0; i<UCL_STAGE_SLOTS; i++)
+      _pending[i]=false;
+  }
+  ~_UCL_Stage() { clear(); }
+
+  /// Use the ring for transfers in context
+  inline void init(cl_context context) {
+    clear();
+    _context=context;
+    UCL_Lock l(_stages_lock());
+    _stages().push_back(this);
+  }
+
+  /// Wait for transfers, free the buffers and stop using the ring
+  inline void clear() {
+    if (_context==NULL)
+      return;
+    {
+      UCL_Lock l(_stages_lock());
+      std::vector<_UCL_Stage *> &s=_stages();
+      for (size_t i=0; i<s.size(); i++)
+        if (s[i]==this) {
+          s.erase(s.begin()+i);
+          break;
+        }
+    }
+    UCL_Lock l(_lock);
+    for (int i=0; i<UCL_STAGE_SLOTS; i++)
+      _wait(i);
+    if (_ready)
+      for (int i=0; i<UCL_STAGE_SLOTS; i++)
+        CL_DESTRUCT_CALL(clReleaseMemObject(_buf[i]));
+    _ready=false;
+    _context=NULL;
+  }
+
+  /// Copy rows of cols bytes from pageable memory to a buffer
+  /** Uses the ring for the context of cq if there is one **/
+  static inline void write(cl_command_queue &cq, cl_mem dst,
+                           const size_t dst_offset, const size_t dpitch,
+                           const char *src, const size_t spitch,
+                           const size_t cols, const size_t rows,
+                           const cl_bool block) {
+    _Locked l(_find(cq));
+    _UCL_Stage *r=l.ring;
+    if (r==NULL || !r->_alloc(cq)) {
+      _enqueue_write(cq,dst,dst_offset,dpitch,src,spitch,cols,rows,block,
+                     NULL);
+      return;
+    }
+    std::vector<_Piece> piece;
+    _pieces(cols,rows,piece);
+    for (size_t i=0; i<piece.size(); i++) {
+      const _Piece &p=piece[i];
+      const int s=r->_next;
+      r->_next=(s+1)%UCL_STAGE_SLOTS;
+      r->_wait(s);
+      for (size_t j=0; j<p.rows; j++)
+        memcpy(r->_host[s]+j*p.cols,src+(p.row+j)*spitch+p.col,p.cols);
+      _enqueue_write(cq,dst,dst_offset+p.row*dpitch+p.col,dpitch,r->_host[s],
+                     p.cols,p.cols,p.rows,CL_FALSE,&r->_event[s]);
+      r->_pending[s]=true;
+    }
+    if (block)
+      for (int i=0; i<UCL_STAGE_SLOTS; i++)
+        r->_wait(i);
+  }
+
+  /// Copy rows of cols bytes from a buffer to pageable memory (blocking)
+  /** Uses the ring for the context of cq if there is one **/
+  static inline void read(cl_command_queue &cq, cl_mem src,
+                          const size_t src_offset, const size_t spitch,
+                          char *dst, const size_t dpitch, const size_t cols,
+                          const size_t rows) {
+    _Locked l(_find(cq));
+    _UCL_Stage *r=l.ring;
+    if (r==NULL || !r->_alloc(cq)) {
+      _enqueue_read(cq,src,src_offset,spitch,dst,dpitch,cols,rows,NULL);
+      return;
+    }
+    for (int i=0; i<UCL_STAGE_SLOTS; i++)
+      r->_wait(i);
+    // Keep up to UCL_STAGE_SLOTS pieces in flight; piece i uses slot
+    // i%UCL_STAGE_SLOTS and is copied out before the slot is reused
+    std::vector<_Piece> piece;
+    _pieces(cols,rows,piece);
+    const size_t n=piece.size();
+    for (size_t i=0; i<n+UCL_STAGE_SLOTS; i++) {
+      if (i>=UCL_STAGE_SLOTS) {
+        const _Piece &p=piece[i-UCL_STAGE_SLOTS];
+        const int s=(i-UCL_STAGE_SLOTS)%UCL_STAGE_SLOTS;
+        r->_wait(s);
+        for (size_t j=0; j<p.rows; j++)
+          memcpy(dst+(p.row+j)*dpitch+p.col,r->_host[s]+j*p.cols,p.cols);
+      }
+      if (i<n) {
+        const _Piece &p=piece[i];
+        const int s=i%UCL_STAGE_SLOTS;
+        _enqueue_read(cq,src,src_offset+p.row*spitch+p.col,spitch,
+                      r->_host[s],p.cols,p.cols,p.rows,&r->_event[s]);
+        r->_pending[s]=true;
+      }
+    }
+    r->_next=0;
+  }
+
+ private:
+  // Rows and bytes of a block of a transfer that fits in one buffer
+  struct _Piece {
+    size_t row, col, rows, cols;
+  };
+
+  cl_context _context;
+  bool _ready;
+  cl_mem _buf[UCL_STAGE_SLOTS];
+  char *_host[UCL_STAGE_SLOTS];
+  cl_event _event[UCL_STAGE_SLOTS];
+  bool _pending[UCL_STAGE_SLOTS];
+  int _next;
+  UCL_Mutex _lock;
+
+  _UCL_Stage(const _UCL_Stage &);
+  _UCL_Stage & operator=(const _UCL_Stage &);
+
+  static inline std::vector<_UCL_Stage *> & _stages() {
+    static std::vector<_UCL_Stage *> s;
+    return s;
+  }
+
+  static inline UCL_Mutex & _stages_lock() {
+    static UCL_Mutex m;
+    return m;
+  }
+
+  // Ring for the context of a command queue, returned locked (NULL if
+  // none). The registry stays locked until the ring is, so clear() cannot
+  // remove and free the ring in between.
+  static inline _UCL_Stage * _find(cl_command_queue &cq) {
+    cl_context context;
+    CL_SAFE_CALL(clGetCommandQueueInfo(cq,CL_QUEUE_CONTEXT,sizeof(context),
+                                       &context,NULL));
+    UCL_Lock l(_stages_lock());
+    std::vector<_UCL_Stage *> &s=_stages();
+    for (size_t i=0; i<s.size(); i++)
+      if (s[i]->_context==context) {
+        s[i]->_lock.lock();
+        return s[i];
+      }
+    return NULL;
+  }
+
+  // Unlocks a ring returned by _find() at the end of the scope
+  struct _Locked {
+    explicit _Locked(_UCL_Stage *r) : ring(r) {}
+    ~_Locked() { if (ring!=NULL) ring->_lock.unlock(); }
+    _UCL_Stage *ring;
+  };
+
+  // Allocate and map the buffers if needed; false on failure
+  inline bool _alloc(cl_command_queue &cq) {
+    if (_ready)
+      return true;
+    int i;
+    for (i=0; i<UCL_STAGE_SLOTS; i++) {
+      cl_int error_flag;
+      _buf[i]=clCreateBuffer(_context,CL_MEM_READ_WRITE |
+                             CL_MEM_ALLOC_HOST_PTR,UCL_STAGE_BYTES,NULL,
+                             &error_flag);
+      if (error_flag!=CL_SUCCESS)
+        break;
+      _host[i]=static_cast<char *>(clEnqueueMapBuffer(cq,_buf[i],CL_TRUE,
+                                   CL_MAP_READ | CL_MAP_WRITE,0,
+                                   UCL_STAGE_BYTES,0,NULL,NULL,&error_flag));
+      if (error_flag!=CL_SUCCESS) {
+        CL_DESTRUCT_CALL(clReleaseMemObject(_buf[i]));
+        break;
+      }
+    }
+    if (i<UCL_STAGE_SLOTS) {
+      for (int j=0; j<i; j++)
+        CL_DESTRUCT_CALL(clReleaseMemObject(_buf[j]));
+      return false;
+    }
+    _ready=true;
+    return true;
+  }
+
+  // Wait for the transfer using a buffer to finish
+  inline void _wait(const int s) {
+    if (!_pending[s])
+      return;
+    CL_SAFE_CALL(clWaitForEvents(1,&_event[s]));
+    CL_DESTRUCT_CALL(clReleaseEvent(_event[s]));
+    _pending[s]=false;
+  }
+
+  // Split rows of cols bytes into pieces that fit in one buffer
+  static inline void _pieces(const size_t cols, const size_t rows,
+                             std::vector<_Piece> &piece) {
+    if (cols==0)
+      return;
+    const size_t width=(cols<UCL_STAGE_BYTES) ? cols : UCL_STAGE_BYTES;
+    const size_t per=(cols<=UCL_STAGE_BYTES) ? UCL_STAGE_BYTES/cols : 1;
+    for (size_t row=0; row<rows; row+=per)
+      for (size_t col=0; col<cols; col+=width) {
+        _Piece p;
+        p.row=row;
+        p.col=col;
+        p.rows=(rows-row<per) ? rows-row : per;
+        p.cols=(cols-col<width) ? cols-col : width;
+        piece.push_back(p);
+      }
+  }
+
+  static inline void _enqueue_write(cl_command_queue &cq, cl_mem dst,
+                                    size_t dst_offset, const size_t dpitch,
+                                    const char *src, const size_t spitch,
+                                    const size_t cols, const size_t rows,
+                                    const cl_bool block, cl_event *event) {
+    if (rows==1 || (cols==dpitch && cols==spitch))
+      CL_SAFE_CALL(clEnqueueWriteBuffer(cq,dst,block,dst_offset,cols*rows,
+                                        src,0,NULL,event));
+    else {
+      #ifdef CL_VERSION_1_1
+      size_t buffer_origin[3]={dst_offset,0,0}, host_origin[3]={0,0,0};
+      size_t region[3]={cols,rows,1};
+      CL_SAFE_CALL(clEnqueueWriteBufferRect(cq,dst,block,buffer_origin,
+                                            host_origin,region,dpitch,0,
+                                            spitch,0,src,0,NULL,event));
+      #else
+      for (size_t i=0; i<rows; i++) {
+        CL_SAFE_CALL(clEnqueueWriteBuffer(cq,dst,block,dst_offset,cols,src,0,
+                                          NULL,(i==rows-1) ? event : NULL));
+        dst_offset+=dpitch;
+        src+=spitch;
+      }
+      #endif
+    }
+  }
+
+  static inline void _enqueue_read(cl_command_queue &cq, cl_mem src,
+                                   size_t src_offset, const size_t spitch,
+                                   char *dst, const size_t dpitch,
+                                   const size_t cols, const size_t rows,
+                                   cl_event *event) {
+    const cl_bool block=(event==NULL) ? CL_TRUE : CL_FALSE;
+    if (rows==1 || (cols==dpitch && cols==spitch))
+      CL_SAFE_CALL(clEnqueueReadBuffer(cq,src,block,src_offset,cols*rows,dst,
+                                       0,NULL,event));
+    else {
+      #ifdef CL_VERSION_1_1
+      size_t buffer_origin[3]={src_offset,0,0}, host_origin[3]={0,0,0};
+      size_t region[3]={cols,rows,1};
+      CL_SAFE_CALL(clEnqueueReadBufferRect(cq,src,block,buffer_origin,
+                                           host_origin,region,spitch,0,
+                                           dpitch,0,dst,0,NULL,event));
+      #else
+      for (size_t i=0; i<rows; i++) {
+        CL_SAFE_CALL(clEnqueueReadBuffer(cq,src,block,src_offset,cols,dst,0,
+                                         NULL,(i==rows-1) ? event : NULL));
+        src_offset+=spitch;
+        dst+=dpitch;
+      }
+      #endif
+    }
+  }
+};
+
 inline bool _shared_mem_device(cl_device_type &device_type) {
   return (device_type==CL_DEVICE_TYPE_CPU);
 }
@@ -235,6 +597,12 @@ class UCL_Device {
   inline size_t group_size(const int i)
     { return _properties[i].work_group_size; }
 
+  /// Get the bytes of local memory available to a work-group
+  inline size_t local_bytes() { return local_bytes(_device); }
+  /// Get the bytes of local memory available to a work-group
+  inline size_t local_bytes(const int i)
+    { return _properties[i].shared_mem; }
+
   /// Return the maximum memory pitch in bytes for current device
   inline size_t max_pitch() { return max_pitch(_device); }
   /// Return the maximum memory pitch in bytes
@@ -283,6 +651,18 @@ class UCL_Device {
   /// Select the platform that has accelerators
   inline int set_platform_accelerator(int pid=-1);
 
+  /// Memory accounting for allocations made with this device
+  /** \sa UCL_MemTracker **/
+  inline UCL_MemTracker & mem_tracker() { return _mem_tracker; }
+
+  /// Kernels generated and compiled for this device by the primitives
+  /** \sa UCL_KernelCache **/
+  inline UCL_KernelCache & kernel_cache() { return _kernel_cache; }
+
+  /// Default placement policy for pinned host allocations with this device
+  /** \sa UCL_HostPolicy **/
+  inline UCL_HostPolicy & host_policy() { return _host_policy; }
+
  private:
   int _num_platforms;          // Number of platforms
   int _platform;               // UCL_Device ID for current platform
@@ -299,6 +679,10 @@ class UCL_Device {
   inline void add_properties(cl_device_id);
   inline int create_context();
   int _default_cq;
+  UCL_MemTracker _mem_tracker;            // Memory accounting for containers
+  UCL_KernelCache _kernel_cache;          // Compiled device primitives
+  UCL_HostPolicy _host_policy;            // Placement of host allocations
+  _UCL_Stage _stage;                      // Pinned ring for pageable copies
 };
 
 // Grabs the properties for all devices
@@ -323,6 +707,7 @@ UCL_Device::~UCL_Device() {
 }
 
 void UCL_Device::clear() {
+  _kernel_cache.clear();
   _properties.clear();
   _cl_devices.clear();
   if (_device>-1) {
@@ -330,6 +715,7 @@ void UCL_Device::clear() {
       CL_DESTRUCT_CALL(clReleaseCommandQueue(_cq.back()));
       _cq.pop_back();
     }
+    _stage.clear();
     CL_DESTRUCT_CALL(clReleaseContext(_context));
   }
   _device=-1;
@@ -388,6 +774,7 @@ int UCL_Device::create_context() {
   }
   push_command_queue();
   _default_cq=0;
+  _stage.init(_context);
   return UCL_SUCCESS;
 }
 
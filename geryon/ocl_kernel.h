@@ -210,22 +210,22 @@ class UCL_Kernel {
   /// Set a geryon container as a kernel argument.
   template <class numtyp>
   inline void set_arg(const UCL_D_Vec<numtyp> * const arg)
-    { set_arg(&arg->begin()); }
+    { arg->touch(); set_arg(&arg->begin()); }
 
   /// Set a geryon container as a kernel argument.
   template <class numtyp>
   inline void set_arg(const UCL_D_Mat<numtyp> * const arg)
-    { set_arg(&arg->begin()); }
+    { arg->touch(); set_arg(&arg->begin()); }
 
   /// Set a geryon container as a kernel argument.
   template <class hosttype, class devtype>
   inline void set_arg(const UCL_Vector<hosttype, devtype> * const arg)
-    { set_arg(&arg->device.begin()); }
+    { arg->device.touch(); set_arg(&arg->device.begin()); }
 
   /// Set a geryon container as a kernel argument.
   template <class hosttype, class devtype>
   inline void set_arg(const UCL_Matrix<hosttype, devtype> * const arg)
-    { set_arg(&arg->device.begin()); }
+    { arg->device.touch(); set_arg(&arg->device.begin()); }
 
   /// Add a kernel argument.
   template <class dtype>
@@ -244,22 +244,22 @@ class UCL_Kernel {
   /// Add a geryon container as a kernel argument.
   template <class numtyp>
   inline void add_arg(const UCL_D_Vec<numtyp> * const arg)
-    { add_arg(&arg->begin()); }
+    { arg->touch(); add_arg(&arg->begin()); }
 
   /// Add a geryon container as a kernel argument.
   template <class numtyp>
   inline void add_arg(const UCL_D_Mat<numtyp> * const arg)
-    { add_arg(&arg->begin()); }
+    { arg->touch(); add_arg(&arg->begin()); }
 
   /// Add a geryon container as a kernel argument.
   template <class hosttype, class devtype>
   inline void add_arg(const UCL_Vector<hosttype, devtype> * const arg)
-    { add_arg(&arg->device.begin()); }
+    { arg->device.touch(); add_arg(&arg->device.begin()); }
 
   /// Add a geryon container as a kernel argument.
   template <class hosttype, class devtype>
   inline void add_arg(const UCL_Matrix<hosttype, devtype> * const arg)
-    { add_arg(&arg->device.begin()); }
+    { arg->device.touch(); add_arg(&arg->device.begin()); }
 
   /// Set the number of thread blocks and the number of threads in each block
   /** \note This should be called before any arguments have been added
@@ -275,7 +275,7 @@ class UCL_Kernel {
       \note The default command queue for the kernel is changed to cq **/
   inline void set_size(const size_t num_blocks, const size_t block_size,
                        command_queue &cq)
-    { _cq=cq; set_size(num_blocks,block_size); }
+    { _set_cq(cq); set_size(num_blocks,block_size); }
 
   /// Set the number of thread blocks and the number of threads in each block
   /** \note This should be called before any arguments have been added
@@ -295,7 +295,8 @@ class UCL_Kernel {
   inline void set_size(const size_t num_blocks_x, const size_t num_blocks_y,
                        const size_t block_size_x, const size_t block_size_y,
                        command_queue &cq)
-    {_cq=cq; set_size(num_blocks_x, num_blocks_y, block_size_x, block_size_y);}
+    { _set_cq(cq);
+      set_size(num_blocks_x, num_blocks_y, block_size_x, block_size_y); }
 
   /// Set the number of thread blocks and the number of threads in each block
   /** \note This should be called before any arguments have been added
@@ -319,7 +320,7 @@ class UCL_Kernel {
   inline void set_size(const size_t num_blocks_x, const size_t num_blocks_y,
                        const size_t block_size_x, const size_t block_size_y,
                        const size_t block_size_z, command_queue &cq) {
-    _cq=cq;
+    _set_cq(cq);
     set_size(num_blocks_x, num_blocks_y, block_size_x, block_size_y,
              block_size_z);
   }
@@ -333,7 +334,7 @@ class UCL_Kernel {
   /// Return the default command queue/stream associated with this data
   inline command_queue & cq() { return _cq; }
   /// Change the default command queue associated with matrix
-  inline void cq(command_queue &cq_in) { _cq=cq_in; }
+  inline void cq(command_queue &cq_in) { _set_cq(cq_in); }
   #include "ucl_arg_kludge.h"
 
  private:
@@ -347,6 +348,15 @@ class UCL_Kernel {
   cl_command_queue _cq;        // The default command queue for this kernel
   unsigned _num_args;
 
+  // Change the queue for execution keeping the reference counts balanced
+  inline void _set_cq(command_queue &cq_in) {
+    if (_function_set && cq_in!=_cq) {
+      CL_SAFE_CALL(clRetainCommandQueue(cq_in));
+      CL_DESTRUCT_CALL(clReleaseCommandQueue(_cq));
+    }
+    _cq=cq_in;
+  }
+
   #ifdef UCL_DEBUG
   std::string _kernel_info_name;
   unsigned _kernel_info_nargs;
@@ -27,6 +27,11 @@
 #define OCL_MAT_H
 
 #include "ocl_memory.h"
+#include "ucl_format.h"
+#include "ucl_hash.h"
+#include "ucl_npy.h"
+#include "ucl_thread.h"
+#include "ucl_host_copy.h"
 
 /// Namespace for OpenCL routines
 namespace ucl_opencl {
@@ -37,8 +42,11 @@ namespace ucl_opencl {
 #include "ucl_basemat.h"
 #include "ucl_h_vec.h"
 #include "ucl_h_mat.h"
+#include "ucl_h_colmat.h"
 #include "ucl_d_vec.h"
 #include "ucl_d_mat.h"
+#include "ucl_d_colmat.h"
+#include "ucl_dirty.h"
 #include "ucl_s_obj_help.h"
 #include "ucl_vector.h"
 #include "ucl_matrix.h"
@@ -50,10 +58,22 @@ namespace ucl_opencl {
 #include "ucl_copy.h"
 #undef UCL_COPY_ALLOW
 
+#define UCL_MANAGED_ALLOW
+#include "ucl_managed.h"
+#undef UCL_MANAGED_ALLOW
+
 #define UCL_PRINT_ALLOW
 #include "ucl_print.h"
 #undef UCL_PRINT_ALLOW
 
+#define UCL_NPY_ALLOW
+#include "ucl_npy_io.h"
+#undef UCL_NPY_ALLOW
+
+#define UCL_CHECKPOINT_ALLOW
+#include "ucl_checkpoint.h"
+#undef UCL_CHECKPOINT_ALLOW
+
 } // namespace ucl_cudart
 
 #endif
@@ -27,7 +27,10 @@
 #include <iostream>
 #include <cassert>
 #include <cstring>
+#include <cstdlib>
+#include <unistd.h>
 #include "ucl_types.h"
+#include "ucl_mem_tracker.h"
 
 namespace ucl_opencl {
 
@@ -48,10 +51,63 @@ typedef ocl_kernel_dim ucl_kernel_dim;
 // --------------------------------------------------------------------------
 typedef cl_mem device_ptr;
 
+// --------------------------------------------------------------------------
+// - MEMORY ACCOUNTING
+// --------------------------------------------------------------------------
+
+// Tracker for allocations made with a device or with another container
+inline UCL_MemTracker * _ucl_mem_tracker(UCL_Device &dev)
+  { return &dev.mem_tracker(); }
+
+template <class copy_type>
+inline UCL_MemTracker * _ucl_mem_tracker(copy_type &cm)
+  { return cm.mem_record().tracker; }
+
 // --------------------------------------------------------------------------
 // - HOST MEMORY ALLOCATION ROUTINES
 // --------------------------------------------------------------------------
 
+// Map host memory with the placement policy of mat and wrap it in a buffer
+template <class mat_type>
+inline int _host_policy_alloc(mat_type &mat, cl_context context,
+                              const size_t n, cl_mem_flags buffer_perm) {
+  size_t mapped;
+  void *ptr=ucl_host_map(n,mat.host_policy(),mapped);
+  if (ptr==NULL)
+    return UCL_MEMORY_ERROR;
+  buffer_perm=(buffer_perm & ~CL_MEM_ALLOC_HOST_PTR) | CL_MEM_USE_HOST_PTR;
+  cl_int error_flag;
+  mat.cbegin()=clCreateBuffer(context,buffer_perm,n,ptr,&error_flag);
+  if (error_flag != CL_SUCCESS) {
+    ucl_host_unmap(ptr,mapped);
+    return UCL_MEMORY_ERROR;
+  }
+  *mat.host_ptr()=(typename mat_type::data_type*)ptr;
+  mat.host_mapped()=mapped;
+  return UCL_SUCCESS;
+}
+
+// Allocate page aligned pageable host memory and wrap it in a buffer
+/** Transfers with the memory are staged by _UCL_Stage, so the buffer is
+  * only used by device views of the container **/
+template <class mat_type>
+inline int _host_pageable_alloc(mat_type &mat, cl_context context,
+                                const size_t n, cl_mem_flags buffer_perm) {
+  void *ptr;
+  if (posix_memalign(&ptr,static_cast<size_t>(sysconf(_SC_PAGESIZE)),
+                     (n>0) ? n : 1)!=0)
+    return UCL_MEMORY_ERROR;
+  buffer_perm=(buffer_perm & ~CL_MEM_ALLOC_HOST_PTR) | CL_MEM_USE_HOST_PTR;
+  cl_int error_flag;
+  mat.cbegin()=clCreateBuffer(context,buffer_perm,n,ptr,&error_flag);
+  if (error_flag != CL_SUCCESS) {
+    free(ptr);
+    return UCL_MEMORY_ERROR;
+  }
+  *mat.host_ptr()=(typename mat_type::data_type*)ptr;
+  return UCL_SUCCESS;
+}
+
 template <class mat_type, class copy_type>
 inline int _host_alloc(mat_type &mat, copy_type &cm, const size_t n,
                        const enum UCL_MEMOPT kind, const enum UCL_MEMOPT kind2){
@@ -103,15 +159,30 @@ inline int _host_alloc(mat_type &mat, copy_type &cm, const size_t n,
       map_perm=CL_MAP_READ | CL_MAP_WRITE;
   }
 
-  mat.cbegin()=clCreateBuffer(context,buffer_perm,n,NULL,&error_flag);
-  if (error_flag != CL_SUCCESS)
-    return UCL_MEMORY_ERROR;
+  UCL_MemTracker *tracker=_ucl_mem_tracker(cm);
+  // Memory mapped with a placement policy is not demoted by the pinned limit
+  const bool policy=!mat.host_policy().driver();
+  const bool pinned=(kind!=UCL_NOT_PINNED &&
+                     (policy || !_ucl_pinned_demote(tracker,n)));
+  if (policy) {
+    if (_host_policy_alloc(mat,context,n,buffer_perm)!=UCL_SUCCESS)
+      return UCL_MEMORY_ERROR;
+  } else if (!pinned) {
+    if (_host_pageable_alloc(mat,context,n,buffer_perm)!=UCL_SUCCESS)
+      return UCL_MEMORY_ERROR;
+  } else {
+    mat.cbegin()=clCreateBuffer(context,buffer_perm,n,NULL,&error_flag);
+    if (error_flag != CL_SUCCESS)
+      return UCL_MEMORY_ERROR;
     *mat.host_ptr() = (typename mat_type::data_type*)
                       clEnqueueMapBuffer(cm.cq(),mat.cbegin(),CL_TRUE,
                                          map_perm,0,n,0,NULL,NULL,NULL);
+  }
 
   mat.cq()=cm.cq();
   CL_SAFE_CALL(clRetainCommandQueue(mat.cq()));
+  _ucl_track_alloc(mat,tracker,n,
+                   pinned ? UCL_MEM_PINNED_HOST : UCL_MEM_PAGEABLE_HOST);
   return UCL_SUCCESS;
 }
 
@@ -131,6 +202,7 @@ inline int _host_view(mat_type &mat, copy_type &cm, const size_t n) {
 
   CL_CHECK_ERR(error_flag);
   CL_SAFE_CALL(clRetainCommandQueue(mat.cq()));
+  _ucl_track_alloc(mat,_ucl_mem_tracker(cm),n,UCL_MEM_VIEW);
   return UCL_SUCCESS;
 }
 
@@ -158,16 +230,34 @@ inline int _host_alloc(mat_type &mat, UCL_Device &dev, const size_t n,
     map_perm=CL_MAP_READ | CL_MAP_WRITE;
   }
 
-  cl_int error_flag;
-  mat.cbegin()=clCreateBuffer(dev.context(),buffer_perm,n,NULL,&error_flag);
-  if (error_flag != CL_SUCCESS)
-    return UCL_MEMORY_ERROR;
+  if (mat.host_policy().placement==UCL_HOST_DEFAULT &&
+      !dev.host_policy().driver())
+    mat.host_policy()=dev.host_policy();
+  UCL_MemTracker *tracker=_ucl_mem_tracker(dev);
+  // Memory mapped with a placement policy is not demoted by the pinned limit
+  const bool policy=!mat.host_policy().driver();
+  const bool pinned=(kind!=UCL_NOT_PINNED &&
+                     (policy || !_ucl_pinned_demote(tracker,n)));
+  if (policy) {
+    if (_host_policy_alloc(mat,dev.context(),n,buffer_perm)!=UCL_SUCCESS)
+      return UCL_MEMORY_ERROR;
+  } else if (!pinned) {
+    if (_host_pageable_alloc(mat,dev.context(),n,buffer_perm)!=UCL_SUCCESS)
+      return UCL_MEMORY_ERROR;
+  } else {
+    cl_int error_flag;
+    mat.cbegin()=clCreateBuffer(dev.context(),buffer_perm,n,NULL,&error_flag);
+    if (error_flag != CL_SUCCESS)
+      return UCL_MEMORY_ERROR;
 
-  *mat.host_ptr() = (typename mat_type::data_type*)
-                    clEnqueueMapBuffer(dev.cq(),mat.cbegin(),CL_TRUE,
-                                       map_perm,0,n,0,NULL,NULL,NULL);
+    *mat.host_ptr() = (typename mat_type::data_type*)
+                      clEnqueueMapBuffer(dev.cq(),mat.cbegin(),CL_TRUE,
+                                         map_perm,0,n,0,NULL,NULL,NULL);
+  }
   mat.cq()=dev.cq();
   CL_SAFE_CALL(clRetainCommandQueue(mat.cq()));
+  _ucl_track_alloc(mat,tracker,n,
+                   pinned ? UCL_MEM_PINNED_HOST : UCL_MEM_PAGEABLE_HOST);
   return UCL_SUCCESS;
 }
 
@@ -178,15 +268,32 @@ inline int _host_view(mat_type &mat, UCL_Device &dev, const size_t n) {
                               n,*mat.host_ptr(),&error_flag);
   CL_CHECK_ERR(error_flag);
   CL_SAFE_CALL(clRetainCommandQueue(mat.cq()));
+  _ucl_track_alloc(mat,_ucl_mem_tracker(dev),n,UCL_MEM_VIEW);
   return UCL_SUCCESS;
 }
 
 template <class mat_type>
 inline void _host_free(mat_type &mat) {
+  _ucl_track_free(mat);
   if (mat.cols()>0) {
     CL_DESTRUCT_CALL(clReleaseMemObject(mat.cbegin()));
     CL_DESTRUCT_CALL(clReleaseCommandQueue(mat.cq()));
   }
+  if (mat.host_mapped()>0) {
+    ucl_host_unmap(mat.begin(),mat.host_mapped());
+    mat.host_mapped()=0;
+  } else if (mat.kind()==UCL_NOT_PINNED)
+    free(mat.begin());
+}
+
+// Release what is left of a host allocation after a failed resize
+/** The old buffer and host memory are already gone; the container must
+  * be left cleared so that they are not freed again **/
+template <class mat_type>
+inline int _host_resize_fail(mat_type &mat) {
+  *mat.host_ptr()=NULL;
+  CL_DESTRUCT_CALL(clReleaseCommandQueue(mat.cq()));
+  return UCL_MEMORY_ERROR;
 }
 
 template <class mat_type>
@@ -199,8 +306,30 @@ inline int _host_resize(mat_type &mat, const size_t n) {
   CL_SAFE_CALL(clGetMemObjectInfo(mat.cbegin(),CL_MEM_FLAGS,sizeof(buffer_perm),
                                   &buffer_perm,NULL));
 
+  UCL_MemRecord record=mat.mem_record();
+  _ucl_track_free(mat);
   CL_DESTRUCT_CALL(clReleaseMemObject(mat.cbegin()));
 
+  const bool pinned=(mat.kind()!=UCL_NOT_PINNED && (mat.host_mapped()>0 ||
+                     !_ucl_pinned_demote(record.tracker,n)));
+  const int mem_kind=pinned ? UCL_MEM_PINNED_HOST : UCL_MEM_PAGEABLE_HOST;
+  if (mat.host_mapped()>0) {
+    ucl_host_unmap(mat.begin(),mat.host_mapped());
+    mat.host_mapped()=0;
+    if (_host_policy_alloc(mat,context,n,buffer_perm)!=UCL_SUCCESS)
+      return _host_resize_fail(mat);
+    _ucl_track_alloc(mat,record.tracker,n,mem_kind,record.tag);
+    return UCL_SUCCESS;
+  }
+  if (mat.kind()==UCL_NOT_PINNED)
+    free(mat.begin());
+  if (!pinned) {
+    if (_host_pageable_alloc(mat,context,n,buffer_perm)!=UCL_SUCCESS)
+      return _host_resize_fail(mat);
+    _ucl_track_alloc(mat,record.tracker,n,mem_kind,record.tag);
+    return UCL_SUCCESS;
+  }
+
   cl_map_flags map_perm;
   if (mat.kind()==UCL_READ_ONLY)
     map_perm=CL_MAP_READ;
@@ -211,10 +340,11 @@ inline int _host_resize(mat_type &mat, const size_t n) {
 
   mat.cbegin()=clCreateBuffer(context,buffer_perm,n,NULL,&error_flag);
   if (error_flag != CL_SUCCESS)
-    return UCL_MEMORY_ERROR;
+    return _host_resize_fail(mat);
   *mat.host_ptr() = (typename mat_type::data_type*)
                     clEnqueueMapBuffer(mat.cq(),mat.cbegin(),CL_TRUE,
                                        map_perm,0,n,0,NULL,NULL,NULL);
+  _ucl_track_alloc(mat,record.tracker,n,mem_kind,record.tag);
   return UCL_SUCCESS;
 }
 
@@ -247,11 +377,16 @@ inline int _device_alloc(mat_type &mat, copy_type &cm, const size_t n,
     #endif
   else
     assert(0==1);
+  UCL_MemTracker *tracker=_ucl_mem_tracker(cm);
+  _ucl_managed_reserve(tracker,n);
   mat.cbegin()=clCreateBuffer(context,flag,n,NULL,&error_flag);
+  while (error_flag != CL_SUCCESS && _ucl_managed_retry(tracker,n))
+    mat.cbegin()=clCreateBuffer(context,flag,n,NULL,&error_flag);
   if (error_flag != CL_SUCCESS)
     return UCL_MEMORY_ERROR;
   mat.cq()=cm.cq();
   CL_SAFE_CALL(clRetainCommandQueue(mat.cq()));
+  _ucl_track_alloc(mat,tracker,n,UCL_MEM_DEVICE);
   return UCL_SUCCESS;
 }
 
@@ -276,12 +411,17 @@ inline int _device_alloc(mat_type &mat, UCL_Device &dev, const size_t n,
     #endif
   else
     assert(0==1);
+  UCL_MemTracker *tracker=_ucl_mem_tracker(dev);
+  _ucl_managed_reserve(tracker,n);
   mat.cbegin()=clCreateBuffer(dev.context(),flag,n,NULL,
                               &error_flag);
+  while (error_flag != CL_SUCCESS && _ucl_managed_retry(tracker,n))
+    mat.cbegin()=clCreateBuffer(dev.context(),flag,n,NULL,&error_flag);
   if (error_flag != CL_SUCCESS)
     return UCL_MEMORY_ERROR;
   mat.cq()=dev.cq();
   CL_SAFE_CALL(clRetainCommandQueue(mat.cq()));
+  _ucl_track_alloc(mat,tracker,n,UCL_MEM_DEVICE);
   return UCL_SUCCESS;
 }
 
@@ -309,6 +449,9 @@ inline int _device_alloc(mat_type &mat, UCL_Device &dev, const size_t rows,
 
 template <class mat_type>
 inline void _device_free(mat_type &mat) {
+  _ucl_track_free(mat);
+  if (_ucl_managed_free(mat))
+    return;
   if (mat.cols()>0) {
     CL_DESTRUCT_CALL(clReleaseMemObject(mat.cbegin()));
     CL_DESTRUCT_CALL(clReleaseCommandQueue(mat.cq()));
@@ -319,9 +462,13 @@ template <class mat_type>
 inline int _device_resize(mat_type &mat, const size_t n) {
   cl_int error_flag;
 
+  mat.touch();
   cl_context context;
   CL_SAFE_CALL(clGetMemObjectInfo(mat.cbegin(),CL_MEM_CONTEXT,sizeof(context),
                &context,NULL));
+  UCL_MemRecord record=mat.mem_record();
+  _ucl_track_free(mat);
+  _ucl_managed_hold(mat,true);
   CL_DESTRUCT_CALL(clReleaseMemObject(mat.cbegin()));
 
   cl_mem_flags flag;
@@ -341,9 +488,14 @@ inline int _device_resize(mat_type &mat, const size_t n) {
     #endif
   else
     assert(0==1);
+  _ucl_managed_reserve(record.tracker,n);
   mat.cbegin()=clCreateBuffer(context,flag,n,NULL,&error_flag);
+  while (error_flag != CL_SUCCESS && _ucl_managed_retry(record.tracker,n))
+    mat.cbegin()=clCreateBuffer(context,flag,n,NULL,&error_flag);
+  _ucl_managed_hold(mat,false);
   if (error_flag != CL_SUCCESS)
     return UCL_MEMORY_ERROR;
+  _ucl_track_alloc(mat,record.tracker,n,record.kind,record.tag);
   return UCL_SUCCESS;
 }
 
@@ -357,9 +509,13 @@ inline int _device_resize(mat_type &mat, const size_t rows,
 
   cl_int error_flag;
 
+  mat.touch();
   cl_context context;
   CL_SAFE_CALL(clGetMemObjectInfo(mat.cbegin(),CL_MEM_CONTEXT,sizeof(context),
                &context,NULL));
+  UCL_MemRecord record=mat.mem_record();
+  _ucl_track_free(mat);
+  _ucl_managed_hold(mat,true);
   CL_DESTRUCT_CALL(clReleaseMemObject(mat.cbegin()));
 
   cl_mem_flags flag;
@@ -379,9 +535,15 @@ inline int _device_resize(mat_type &mat, const size_t rows,
     #endif
   else
     assert(0==1);
+  _ucl_managed_reserve(record.tracker,pitch*rows);
   mat.cbegin()=clCreateBuffer(context,flag,pitch*rows,NULL,&error_flag);
+  while (error_flag != CL_SUCCESS &&
+         _ucl_managed_retry(record.tracker,pitch*rows))
+    mat.cbegin()=clCreateBuffer(context,flag,pitch*rows,NULL,&error_flag);
+  _ucl_managed_hold(mat,false);
   if (error_flag != CL_SUCCESS)
     return UCL_MEMORY_ERROR;
+  _ucl_track_alloc(mat,record.tracker,pitch*rows,record.kind,record.tag);
   return UCL_SUCCESS;
 }
 
@@ -435,6 +597,7 @@ inline void _ocl_kernel_from_source(cl_context &context, cl_device_id &device,
 
 template <class mat_type>
 inline void _device_zero(mat_type &mat, const size_t n, command_queue &cq) {
+  mat.touch();
   #ifdef CL_VERSION_1_2
   #ifndef __APPLE__
   #define UCL_CL_ZERO
@@ -584,6 +747,11 @@ template <> struct _ucl_memcpy<1,0> {
     #ifdef UCL_DBG_MEM_TRACE
     std::cerr << "UCL_COPY 1NS\n";
     #endif
+    if (dst.kind()==UCL_NOT_PINNED) {
+      _UCL_Stage::read(cq,src.cbegin(),src_offset,n,(char *)dst.begin(),n,n,
+                       1);
+      return;
+    }
     CL_SAFE_CALL(clEnqueueReadBuffer(cq,src.cbegin(),block,src_offset,n,
                                      dst.begin(),0,NULL,NULL));
   }
@@ -603,13 +771,26 @@ template <> struct _ucl_memcpy<1,0> {
     #ifdef UCL_DBG_MEM_TRACE
     std::cerr << "UCL_COPY 2NS\n";
     #endif
+    if (dst.kind()==UCL_NOT_PINNED) {
+      _UCL_Stage::read(cq,src.cbegin(),src_offset,spitch,
+                       (char *)dst.begin()+dst_offset,dpitch,cols,rows);
+      return;
+    }
     if (spitch==dpitch && dst.cols()==src.cols() &&
         src.cols()==cols/src.element_size())
       CL_SAFE_CALL(clEnqueueReadBuffer(cq,src.cbegin(),block,src_offset,
                                        spitch*rows,
                                        (char *)dst.begin()+dst_offset,0,NULL,
                                        NULL));
-    else
+    else {
+      #ifdef CL_VERSION_1_1
+      size_t buffer_origin[3]={src_offset,0,0}, host_origin[3]={0,0,0};
+      size_t region[3]={cols,rows,1};
+      CL_SAFE_CALL(clEnqueueReadBufferRect(cq,src.cbegin(),block,buffer_origin,
+                                           host_origin,region,spitch,0,dpitch,
+                                           0,(char *)dst.begin()+dst_offset,0,
+                                           NULL,NULL));
+      #else
       for (size_t i=0; i<rows; i++) {
         CL_SAFE_CALL(clEnqueueReadBuffer(cq,src.cbegin(),block,src_offset,cols,
                                          (char *)dst.begin()+dst_offset,0,NULL,
@@ -617,6 +798,8 @@ template <> struct _ucl_memcpy<1,0> {
         src_offset+=spitch;
         dst_offset+=dpitch;
       }
+      #endif
+    }
   }
 };
 
@@ -636,6 +819,11 @@ template <> struct _ucl_memcpy<0,1> {
     #ifdef UCL_DBG_MEM_TRACE
     std::cerr << "UCL_COPY 3NS\n";
     #endif
+    if (src.kind()==UCL_NOT_PINNED) {
+      _UCL_Stage::write(cq,dst.cbegin(),dst_offset,n,(const char *)src.begin(),
+                        n,n,1,block);
+      return;
+    }
     CL_SAFE_CALL(clEnqueueWriteBuffer(cq,dst.cbegin(),block,dst_offset,n,
                                       src.begin(),0,NULL,NULL));
   }
@@ -655,13 +843,28 @@ template <> struct _ucl_memcpy<0,1> {
     #ifdef UCL_DBG_MEM_TRACE
     std::cerr << "UCL_COPY 4NS\n";
     #endif
+    if (src.kind()==UCL_NOT_PINNED) {
+      _UCL_Stage::write(cq,dst.cbegin(),dst_offset,dpitch,
+                        (const char *)src.begin()+src_offset,spitch,cols,rows,
+                        block);
+      return;
+    }
     if (spitch==dpitch && dst.cols()==src.cols() &&
         src.cols()==cols/src.element_size())
       CL_SAFE_CALL(clEnqueueWriteBuffer(cq,dst.cbegin(),block,dst_offset,
                                         spitch*rows,
                                         (char *)src.begin()+src_offset,0,NULL,
                                         NULL));
-    else
+    else {
+      #ifdef CL_VERSION_1_1
+      size_t buffer_origin[3]={dst_offset,0,0}, host_origin[3]={0,0,0};
+      size_t region[3]={cols,rows,1};
+      CL_SAFE_CALL(clEnqueueWriteBufferRect(cq,dst.cbegin(),block,
+                                            buffer_origin,host_origin,region,
+                                            dpitch,0,spitch,0,
+                                            (char *)src.begin()+src_offset,0,
+                                            NULL,NULL));
+      #else
       for (size_t i=0; i<rows; i++) {
         CL_SAFE_CALL(clEnqueueWriteBuffer(cq,dst.cbegin(),block,dst_offset,cols,
                                           (char *)src.begin()+src_offset,0,NULL,
@@ -669,6 +872,8 @@ template <> struct _ucl_memcpy<0,1> {
         src_offset+=spitch;
         dst_offset+=dpitch;
       }
+      #endif
+    }
   }
 };
 
@@ -705,7 +910,16 @@ template <int mem1, int mem2> struct _ucl_memcpy {
           src.cols()==cols/src.element_size())
         CL_SAFE_CALL(clEnqueueCopyBuffer(cq,src.cbegin(),dst.cbegin(),src_offset,
                                          dst_offset,spitch*rows,0,NULL,NULL));
-
+      // Rect copies within one buffer require equal pitches
+      #ifdef CL_VERSION_1_1
+      else if (src.cbegin()!=dst.cbegin() || spitch==dpitch) {
+        size_t src_origin[3]={src_offset,0,0}, dst_origin[3]={dst_offset,0,0};
+        size_t region[3]={cols,rows,1};
+        CL_SAFE_CALL(clEnqueueCopyBufferRect(cq,src.cbegin(),dst.cbegin(),
+                                             src_origin,dst_origin,region,
+                                             spitch,0,dpitch,0,0,NULL,NULL));
+      }
+      #endif
       else
         for (size_t i=0; i<rows; i++) {
           CL_SAFE_CALL(clEnqueueCopyBuffer(cq,src.cbegin(),dst.cbegin(),
@@ -725,6 +939,8 @@ template <int mem1, int mem2> struct _ucl_memcpy {
 
 template<class mat1, class mat2>
 inline void ucl_mv_cpy(mat1 &dst, const mat2 &src, const size_t n) {
+  dst.touch();
+  src.touch();
   _ucl_memcpy<mat1::MEM_TYPE,mat2::MEM_TYPE>::mc(dst,src,n,dst.cq(),CL_TRUE,
                                                  dst.byteoff(),src.byteoff());
 }
@@ -732,6 +948,8 @@ inline void ucl_mv_cpy(mat1 &dst, const mat2 &src, const size_t n) {
 template<class mat1, class mat2>
 inline void ucl_mv_cpy(mat1 &dst, const mat2 &src, const size_t n,
                        cl_command_queue &cq) {
+  dst.touch();
+  src.touch();
   _ucl_memcpy<mat1::MEM_TYPE,mat2::MEM_TYPE>::mc(dst,src,n,cq,CL_FALSE,
                                                  dst.byteoff(),src.byteoff());
 }
@@ -740,6 +958,8 @@ template<class mat1, class mat2>
 inline void ucl_mv_cpy(mat1 &dst, const size_t dpitch, const mat2 &src,
                        const size_t spitch, const size_t cols,
                        const size_t rows) {
+  dst.touch();
+  src.touch();
   _ucl_memcpy<mat1::MEM_TYPE,mat2::MEM_TYPE>::mc(dst,dpitch,src,spitch,cols,
                                                  rows,dst.cq(),CL_TRUE,
                                                  dst.byteoff(),src.byteoff());
@@ -749,11 +969,27 @@ template<class mat1, class mat2>
 inline void ucl_mv_cpy(mat1 &dst, const size_t dpitch, const mat2 &src,
                            const size_t spitch, const size_t cols,
                            const size_t rows,cl_command_queue &cq) {
+  dst.touch();
+  src.touch();
   _ucl_memcpy<mat1::MEM_TYPE,mat2::MEM_TYPE>::mc(dst,dpitch,src,spitch,cols,
                                                  rows,cq,CL_FALSE,
                                                  dst.byteoff(),src.byteoff());
 }
 
+template<class mat1, class mat2>
+inline void ucl_mv_cpy(mat1 &dst, const size_t dst_offset,
+                       const size_t dpitch, const mat2 &src,
+                       const size_t src_offset, const size_t spitch,
+                       const size_t cols, const size_t rows,
+                       cl_command_queue &cq) {
+  dst.touch();
+  src.touch();
+  _ucl_memcpy<mat1::MEM_TYPE,mat2::MEM_TYPE>::mc(dst,dpitch,src,spitch,cols,
+                                                 rows,cq,CL_FALSE,
+                                                 dst.byteoff()+dst_offset,
+                                                 src.byteoff()+src_offset);
+}
+
 } // namespace ucl_cudart
 
 #endif
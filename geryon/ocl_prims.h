@@ -0,0 +1,91 @@
+/***************************************************************************
+                                 ocl_prims.h
+                             -------------------
+
+  OpenCL Specific Device Primitives (Reductions, Scans, Sorts, ...)
+
+ __________________________________________________________________________
+    This file is part of the Geryon Unified Coprocessor Library (UCL)
+ __________________________________________________________________________
+
+ ***************************************************************************/
+
+/* -----------------------------------------------------------------------
+   Copyright (2010) Sandia Corporation.  Under the terms of Contract
+   DE-AC04-94AL85000 with Sandia Corporation, the U.S. Government retains
+   certain rights in this software.  This software is distributed under
+   the Simplified BSD License.
+   ----------------------------------------------------------------------- */
+
+/*! \file */
+
+#ifndef OCL_PRIMS_H
+#define OCL_PRIMS_H
+
+#include "ocl_mat.h"
+#include "ocl_kernel.h"
+#include <limits>
+#include <sstream>
+
+namespace ucl_opencl {
+
+// --------------------------------------------------------------------------
+// - API SPECIFIC ROUTINES USED BY THE PRIMITIVES
+// --------------------------------------------------------------------------
+
+/// Definitions prepended to the generated source of device primitives
+inline const char * _ucl_prims_prelude() {
+  return
+    "#ifndef GLOBAL_ID_X\n"
+    "#define GLOBAL_ID_X get_global_id(0)\n"
+    "#define THREAD_ID_X get_local_id(0)\n"
+    "#define BLOCK_ID_X get_group_id(0)\n"
+    "#define BLOCK_SIZE_X get_local_size(0)\n"
+    "#define __syncthreads() barrier(CLK_LOCAL_MEM_FENCE)\n"
+    "#endif\n"
+    "#define GRID_SIZE_X get_num_groups(0)\n"
+    "#define ucl_inline inline\n"
+    "#define ucl_as_uint(x) as_uint(x)\n"
+    "#define ucl_as_ulong(x) as_ulong(x)\n"
+    "#define ucl_local_inc(p) atomic_inc(p)\n"
+    "#ifdef cl_khr_local_int32_base_atomics\n"
+    "#pragma OPENCL EXTENSION cl_khr_local_int32_base_atomics : enable\n"
+    "#endif\n"
+    "#if defined(cl_khr_fp64)\n"
+    "#pragma OPENCL EXTENSION cl_khr_fp64 : enable\n"
+    "#elif defined(cl_amd_fp64)\n"
+    "#pragma OPENCL EXTENSION cl_amd_fp64 : enable\n"
+    "#endif\n";
+}
+
+/// Compile generated source for the device primitives
+inline int _ucl_prims_compile(UCL_Device &, UCL_Program &program,
+                              const std::string &src, std::string *log) {
+  std::string prog=std::string(_ucl_prims_prelude())+src;
+  return program.load_string(prog.c_str(),"",log);
+}
+
+/// True if the first element of mat is aligned for loads of bytes
+/** Buffers are aligned to at least the size of the largest vector type,
+  * so only the offset into the buffer must be checked **/
+template <class mat_type>
+inline bool _ucl_prims_aligned(const mat_type &mat, const size_t bytes)
+  { return mat.byteoff()%bytes==0; }
+
+#define UCL_PRIMS_ALLOW
+#include "ucl_prims.h"
+#include "ucl_reduce.h"
+#include "ucl_scan.h"
+#include "ucl_sort.h"
+#include "ucl_gather.h"
+#include "ucl_blas1.h"
+#include "ucl_gemm.h"
+#include "ucl_batched.h"
+#include "ucl_transpose.h"
+#include "ucl_soa.h"
+#include "ucl_half_convert.h"
+#undef UCL_PRIMS_ALLOW
+
+} // namespace ucl_opencl
+
+#endif
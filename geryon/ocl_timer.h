@@ -27,12 +27,6 @@
 #include "ocl_macros.h"
 #include "ocl_device.h"
 
-#ifdef CL_VERSION_1_2
-#define UCL_OCL_MARKER(cq,event) clEnqueueMarkerWithWaitList(cq,0,NULL,event)
-#else
-#define UCL_OCL_MARKER clEnqueueMarker
-#endif
-
 namespace ucl_opencl {
 
 /// Class for timing OpenCL events
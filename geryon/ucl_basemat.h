@@ -25,6 +25,7 @@
 #ifdef _UCL_MAT_ALLOW
 
 #include "ucl_types.h"
+#include "ucl_mem_tracker.h"
 
 #define UCL_H_VecT UCL_H_Vec<numtyp>
 #define UCL_H_VecD UCL_H_Vec<double>
@@ -58,8 +59,8 @@
   * calls for reserving and copying memory **/
 class UCL_BaseMat {
  public:
-  UCL_BaseMat() : _cq(0), _kind(UCL_VIEW) { }
-  virtual ~UCL_BaseMat() { }
+  UCL_BaseMat() : _cq(0), _kind(UCL_VIEW), _managed(NULL) { }
+  virtual ~UCL_BaseMat() { delete _managed; }
   /// Return the default command queue/stream associated with this data
   inline command_queue & cq() { return _cq; }
   /// Change the default command queue associated with matrix
@@ -85,9 +86,23 @@ class UCL_BaseMat {
     #endif
   }
 
+  /// Return the memory accounting record for the allocation (if any)
+  inline UCL_MemRecord & mem_record() { return _mem_record; }
+
+  /// Return the managed mode entry for the container (NULL if not managed)
+  inline UCL_ManagedBase * managed() const { return _managed; }
+  /// Set the managed mode entry (the container takes ownership)
+  /** \sa ucl_manage() **/
+  inline void managed(UCL_ManagedBase *m) { delete _managed; _managed=m; }
+  /// Page in the allocation if evicted and mark it as most recently used
+  /** Only has an effect on containers registered with ucl_manage() **/
+  inline void touch() const { if (_managed!=NULL) _managed->page_in(); }
+
  protected:
   command_queue _cq;
   enum UCL_MEMOPT _kind;
+  UCL_MemRecord _mem_record;
+  UCL_ManagedBase *_managed;
 };
 
 #endif
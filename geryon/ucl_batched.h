@@ -0,0 +1,415 @@
+/***************************************************************************
+                                ucl_batched.h
+                             -------------------
+
+  Batched operations on many small dense matrices (3x3 and 6x6)
+
+ __________________________________________________________________________
+    This file is part of the Geryon Unified Coprocessor Library (UCL)
+ __________________________________________________________________________
+
+ ***************************************************************************/
+
+/* -----------------------------------------------------------------------
+   Copyright (2010) Sandia Corporation.  Under the terms of Contract
+   DE-AC04-94AL85000 with Sandia Corporation, the U.S. Government retains
+   certain rights in this software.  This software is distributed under
+   the Simplified BSD License.
+   ----------------------------------------------------------------------- */
+
+/***************************************************************************
+   UCL_Batched applies an operation to every matrix in a batch of n small
+   DIMxDIM matrices (DIM is 3 or 6) with one work-item per matrix, so that
+   a single launch replaces one launch per matrix or per operation:
+
+     multiply     C=op(A)*op(B)
+     inverse      B=inv(A), optionally with det(A)
+     determinant  det(A)
+     eigen        eigenvalues (ascending) and eigenvectors of symmetric
+                  3x3 matrices by cyclic Jacobi rotations
+
+   A batch is stored in a UCL_D_Mat in one of two layouts. Element (r,c)
+   of matrix i is stored at:
+
+     UCL_BATCH_SOA  row r*DIM+c, column i   (DIM*DIM rows, n columns)
+     UCL_BATCH_AOS  row i, column r*DIM+c   (n rows, DIM*DIM columns)
+
+   With UCL_BATCH_SOA, neighboring work-items access neighboring memory,
+   so it should be used for large batches. Eigenvalues are stored in the
+   same way with 3 elements per matrix (3 rows or 3 columns) and the
+   eigenvectors are the columns of a 3x3 matrix in the batch layout.
+
+   Intended for float and double. No check is made for singular matrices.
+ ***************************************************************************/
+
+// Only allow this file to be included by nvd_prims.h and ocl_prims.h
+#ifdef UCL_PRIMS_ALLOW
+
+/// Storage of matrices in a batch (see UCL_Batched)
+enum UCL_BATCH_LAYOUT {UCL_BATCH_SOA, UCL_BATCH_AOS};
+
+/// Kernel source for batched matrix operations
+/** NUMTYP, DIM, BLOCK_SIZE and EPS (the machine epsilon) are defined
+  * first. Each batch argument is followed by the offset of the first
+  * element and the strides between elements and between matrices. **/
+inline const char * _ucl_batched_source() {
+  return
+    "#define BATCH_ARG(p) __global NUMTYP *p, const int p##_off, \\\n"
+    "                     const int p##_es, const int p##_ms\n"
+    "#define CBATCH_ARG(p) const __global NUMTYP *p, const int p##_off, \\\n"
+    "                      const int p##_es, const int p##_ms\n"
+    "#define EL(p,e) p[p##_off+(e)*p##_es+i*p##_ms]\n"
+    "#define DD (DIM*DIM)\n"
+    "\n"
+    "// Determinant and inverse by Gauss-Jordan with partial pivoting\n"
+    "ucl_inline NUMTYP ucl_gauss_jordan(NUMTYP m[DD], NUMTYP v[DD],\n"
+    "                                   const int want_inv) {\n"
+    "  NUMTYP det=(NUMTYP)1;\n"
+    "  for (int r=0; r<DD; r++)\n"
+    "    v[r]=(r%(DIM+1)==0) ? (NUMTYP)1 : (NUMTYP)0;\n"
+    "  for (int c=0; c<DIM; c++) {\n"
+    "    int p=c;\n"
+    "    for (int r=c+1; r<DIM; r++)\n"
+    "      if (fabs(m[r*DIM+c])>fabs(m[p*DIM+c])) p=r;\n"
+    "    if (p!=c) {\n"
+    "      det=-det;\n"
+    "      for (int k=0; k<DIM; k++) {\n"
+    "        NUMTYP t=m[c*DIM+k]; m[c*DIM+k]=m[p*DIM+k]; m[p*DIM+k]=t;\n"
+    "        t=v[c*DIM+k]; v[c*DIM+k]=v[p*DIM+k]; v[p*DIM+k]=t;\n"
+    "      }\n"
+    "    }\n"
+    "    const NUMTYP piv=m[c*DIM+c];\n"
+    "    det*=piv;\n"
+    "    const NUMTYP ipiv=(NUMTYP)1/piv;\n"
+    "    for (int k=0; k<DIM; k++) {\n"
+    "      m[c*DIM+k]*=ipiv;\n"
+    "      v[c*DIM+k]*=ipiv;\n"
+    "    }\n"
+    "    for (int r=0; r<DIM; r++)\n"
+    "      if (r!=c && (want_inv || r>c)) {\n"
+    "        const NUMTYP f=m[r*DIM+c];\n"
+    "        for (int k=0; k<DIM; k++) {\n"
+    "          m[r*DIM+k]-=f*m[c*DIM+k];\n"
+    "          v[r*DIM+k]-=f*v[c*DIM+k];\n"
+    "        }\n"
+    "      }\n"
+    "  }\n"
+    "  return det;\n"
+    "}\n"
+    "\n"
+    "__kernel void ucl_batched_mul(CBATCH_ARG(a), CBATCH_ARG(b),\n"
+    "                              BATCH_ARG(c), const int n,\n"
+    "                              const int ta, const int tb) {\n"
+    "  const int i=GLOBAL_ID_X;\n"
+    "  if (i>=n) return;\n"
+    "  NUMTYP ma[DD], mb[DD];\n"
+    "  for (int e=0; e<DD; e++) {\n"
+    "    ma[e]=EL(a,e);\n"
+    "    mb[e]=EL(b,e);\n"
+    "  }\n"
+    "  for (int r=0; r<DIM; r++)\n"
+    "    for (int q=0; q<DIM; q++) {\n"
+    "      NUMTYP s=(NUMTYP)0;\n"
+    "      for (int k=0; k<DIM; k++)\n"
+    "        s+=(ta ? ma[k*DIM+r] : ma[r*DIM+k])*\n"
+    "           (tb ? mb[q*DIM+k] : mb[k*DIM+q]);\n"
+    "      EL(c,r*DIM+q)=s;\n"
+    "    }\n"
+    "}\n"
+    "\n"
+    "__kernel void ucl_batched_inv(CBATCH_ARG(a), BATCH_ARG(b),\n"
+    "                              BATCH_ARG(d), const int n,\n"
+    "                              const int want_inv,\n"
+    "                              const int want_det) {\n"
+    "  const int i=GLOBAL_ID_X;\n"
+    "  if (i>=n) return;\n"
+    "  NUMTYP m[DD], v[DD];\n"
+    "  for (int e=0; e<DD; e++)\n"
+    "    m[e]=EL(a,e);\n"
+    "  NUMTYP det;\n"
+    "#if (DIM==3)\n"
+    "  v[0]=m[4]*m[8]-m[5]*m[7];\n"
+    "  v[3]=m[5]*m[6]-m[3]*m[8];\n"
+    "  v[6]=m[3]*m[7]-m[4]*m[6];\n"
+    "  det=m[0]*v[0]+m[1]*v[3]+m[2]*v[6];\n"
+    "  if (want_inv) {\n"
+    "    const NUMTYP idet=(NUMTYP)1/det;\n"
+    "    v[1]=m[2]*m[7]-m[1]*m[8];\n"
+    "    v[2]=m[1]*m[5]-m[2]*m[4];\n"
+    "    v[4]=m[0]*m[8]-m[2]*m[6];\n"
+    "    v[5]=m[2]*m[3]-m[0]*m[5];\n"
+    "    v[7]=m[1]*m[6]-m[0]*m[7];\n"
+    "    v[8]=m[0]*m[4]-m[1]*m[3];\n"
+    "    for (int e=0; e<DD; e++)\n"
+    "      v[e]*=idet;\n"
+    "  }\n"
+    "#else\n"
+    "  det=ucl_gauss_jordan(m,v,want_inv);\n"
+    "#endif\n"
+    "  if (want_inv)\n"
+    "    for (int e=0; e<DD; e++)\n"
+    "      EL(b,e)=v[e];\n"
+    "  if (want_det)\n"
+    "    EL(d,0)=det;\n"
+    "}\n"
+    "\n"
+    "#if (DIM==3)\n"
+    "__kernel void ucl_batched_eig3(CBATCH_ARG(a), BATCH_ARG(w),\n"
+    "                               BATCH_ARG(v), const int n,\n"
+    "                               const int want_vec) {\n"
+    "  const int i=GLOBAL_ID_X;\n"
+    "  if (i>=n) return;\n"
+    "  NUMTYP m[9], q[9];\n"
+    "  for (int e=0; e<9; e++) {\n"
+    "    m[e]=EL(a,e);\n"
+    "    q[e]=(e%4==0) ? (NUMTYP)1 : (NUMTYP)0;\n"
+    "  }\n"
+    "  for (int sweep=0; sweep<32; sweep++) {\n"
+    "    const NUMTYP off=fabs(m[1])+fabs(m[2])+fabs(m[5]);\n"
+    "    if (off<=EPS*(fabs(m[0])+fabs(m[4])+fabs(m[8])) || off==(NUMTYP)0)\n"
+    "      break;\n"
+    "    for (int pq=0; pq<3; pq++) {\n"
+    "      const int p=(pq==2) ? 1 : 0;\n"
+    "      const int r=(pq==0) ? 1 : 2;\n"
+    "      const NUMTYP apq=m[p*3+r];\n"
+    "      if (apq==(NUMTYP)0) continue;\n"
+    "      // Rotation that zeros m(p,r)\n"
+    "      const NUMTYP theta=(m[r*4]-m[p*4])/((NUMTYP)2*apq);\n"
+    "      NUMTYP t=(NUMTYP)1/(fabs(theta)+sqrt(theta*theta+(NUMTYP)1));\n"
+    "      if (theta<(NUMTYP)0) t=-t;\n"
+    "      const NUMTYP c=(NUMTYP)1/sqrt(t*t+(NUMTYP)1);\n"
+    "      const NUMTYP s=t*c;\n"
+    "      for (int k=0; k<3; k++) {\n"
+    "        const NUMTYP mp=m[k*3+p], mr=m[k*3+r];\n"
+    "        m[k*3+p]=c*mp-s*mr;\n"
+    "        m[k*3+r]=s*mp+c*mr;\n"
+    "      }\n"
+    "      for (int k=0; k<3; k++) {\n"
+    "        const NUMTYP mp=m[p*3+k], mr=m[r*3+k];\n"
+    "        m[p*3+k]=c*mp-s*mr;\n"
+    "        m[r*3+k]=s*mp+c*mr;\n"
+    "      }\n"
+    "      for (int k=0; k<3; k++) {\n"
+    "        const NUMTYP qp=q[k*3+p], qr=q[k*3+r];\n"
+    "        q[k*3+p]=c*qp-s*qr;\n"
+    "        q[k*3+r]=s*qp+c*qr;\n"
+    "      }\n"
+    "    }\n"
+    "  }\n"
+    "\n"
+    "  // Sort eigenvalues in ascending order along with the vectors\n"
+    "  int o0=0, o1=1, o2=2, t;\n"
+    "  if (m[o1*4]<m[o0*4]) { t=o0; o0=o1; o1=t; }\n"
+    "  if (m[o2*4]<m[o1*4]) { t=o1; o1=o2; o2=t; }\n"
+    "  if (m[o1*4]<m[o0*4]) { t=o0; o0=o1; o1=t; }\n"
+    "  EL(w,0)=m[o0*4];\n"
+    "  EL(w,1)=m[o1*4];\n"
+    "  EL(w,2)=m[o2*4];\n"
+    "  if (want_vec)\n"
+    "    for (int k=0; k<3; k++) {\n"
+    "      EL(v,k*3)=q[k*3+o0];\n"
+    "      EL(v,k*3+1)=q[k*3+o1];\n"
+    "      EL(v,k*3+2)=q[k*3+o2];\n"
+    "    }\n"
+    "}\n"
+    "#endif\n";
+}
+
+/// Batched operations on small dense matrices
+/** Kernels are compiled on first use and cached with the device **/
+template <class numtyp>
+class UCL_Batched {
+ public:
+  /// Set up batched operations on DIMxDIM matrices
+  /** \param dim Matrix dimension (3 or 6)
+    * \param layout Storage of the batches (see UCL_Batched)
+    * \param block_size Work-group size (0 for a default based on the
+    *                   device) **/
+  UCL_Batched(UCL_Device &dev, const int dim,
+              const enum UCL_BATCH_LAYOUT layout=UCL_BATCH_SOA,
+              const int block_size=0)
+    : _dev(&dev), _dim(dim), _layout(layout), _kernels(NULL) {
+    assert(dim==3 || dim==6);
+    _block_size=(block_size>0) ? _ucl_pow2_floor(block_size) :
+                                 _ucl_prim_block_size(dev);
+  }
+
+  /// Matrix dimension
+  inline int dim() const { return _dim; }
+  /// Storage of the batches
+  inline enum UCL_BATCH_LAYOUT layout() const { return _layout; }
+
+  /// Number of matrices stored in a batch
+  inline size_t count(const UCL_D_Mat<numtyp> &batch) const
+    { return (_layout==UCL_BATCH_SOA) ? batch.cols() : batch.rows(); }
+
+  /// c=op(a)*op(b) for the first n matrices
+  /** \param n Number of matrices (0 for all matrices in a)
+    * \note c must not overlap a or b
+    * \note Asynchronous with respect to the host **/
+  inline int multiply(UCL_D_Mat<numtyp> &c, const UCL_D_Mat<numtyp> &a,
+                      const UCL_D_Mat<numtyp> &b, command_queue &cq,
+                      const size_t n=0, const bool trans_a=false,
+                      const bool trans_b=false) {
+    int nm=_count(a,n);
+    assert(count(b)>=static_cast<size_t>(nm) &&
+           count(c)>=static_cast<size_t>(nm));
+    UCL_PrimKernels *k=_get_kernels();
+    if (k==NULL)
+      return UCL_COMPILE_ERROR;
+    if (nm==0)
+      return UCL_SUCCESS;
+    int ta=trans_a ? 1 : 0, tb=trans_b ? 1 : 0;
+    _BatchArg aa(a,_layout), ab(b,_layout), ac(c,_layout);
+    UCL_Kernel &km=(*k)[0];
+    km.set_size((nm+_block_size-1)/_block_size,_block_size,cq);
+    km.clear_args();
+    aa.add_args(km,a);
+    ab.add_args(km,b);
+    ac.add_args(km,c);
+    km.add_arg(&nm);
+    km.add_arg(&ta);
+    km.add_arg(&tb);
+    km.run();
+    return UCL_SUCCESS;
+  }
+
+  /// inv=inverse of a for the first n matrices
+  /** \param n Number of matrices (0 for all matrices in a)
+    * \param det If not NULL, det(a) is stored in (*det)[i] for matrix i
+    * \note inv can be the same as a
+    * \note Asynchronous with respect to the host **/
+  inline int inverse(UCL_D_Mat<numtyp> &inv, const UCL_D_Mat<numtyp> &a,
+                     command_queue &cq, const size_t n=0,
+                     UCL_D_Vec<numtyp> *det=NULL) {
+    int nm=_count(a,n);
+    assert(count(inv)>=static_cast<size_t>(nm));
+    assert(det==NULL || det->cols()>=static_cast<size_t>(nm));
+    return _inverse(&inv,a,det,nm,cq);
+  }
+
+  /// det[i]=determinant of matrix i for the first n matrices
+  /** \param n Number of matrices (0 for all matrices in a)
+    * \note Asynchronous with respect to the host **/
+  inline int determinant(UCL_D_Vec<numtyp> &det, const UCL_D_Mat<numtyp> &a,
+                         command_queue &cq, const size_t n=0) {
+    int nm=_count(a,n);
+    assert(det.cols()>=static_cast<size_t>(nm));
+    return _inverse(NULL,a,&det,nm,cq);
+  }
+
+  /// Eigenvalues and eigenvectors of the first n symmetric 3x3 matrices
+  /** \param values 3 eigenvalues per matrix in ascending order
+    * \param vectors If not NULL, the eigenvectors are stored as the
+    *                columns of a 3x3 matrix for each matrix
+    * \param n Number of matrices (0 for all matrices in a)
+    * \note Only the dim==3 case is supported
+    * \note Asynchronous with respect to the host **/
+  inline int eigen(UCL_D_Mat<numtyp> &values, UCL_D_Mat<numtyp> *vectors,
+                   const UCL_D_Mat<numtyp> &a, command_queue &cq,
+                   const size_t n=0) {
+    assert(_dim==3);
+    int nm=_count(a,n);
+    assert(count(values)>=static_cast<size_t>(nm));
+    assert(vectors==NULL || count(*vectors)>=static_cast<size_t>(nm));
+    UCL_PrimKernels *k=_get_kernels();
+    if (k==NULL || _dim!=3)
+      return UCL_COMPILE_ERROR;
+    if (nm==0)
+      return UCL_SUCCESS;
+    int want_vec=(vectors!=NULL) ? 1 : 0;
+    UCL_D_Mat<numtyp> &vec=(vectors!=NULL) ? *vectors : values;
+    _BatchArg aa(a,_layout), aw(values,_layout), av(vec,_layout);
+    UCL_Kernel &ke=(*k)[2];
+    ke.set_size((nm+_block_size-1)/_block_size,_block_size,cq);
+    ke.clear_args();
+    aa.add_args(ke,a);
+    aw.add_args(ke,values);
+    av.add_args(ke,vec);
+    ke.add_arg(&nm);
+    ke.add_arg(&want_vec);
+    ke.run();
+    return UCL_SUCCESS;
+  }
+
+ private:
+  UCL_Device *_dev;
+  int _dim, _block_size;
+  enum UCL_BATCH_LAYOUT _layout;
+  UCL_PrimKernels *_kernels;
+
+  // Offset and strides of a batch for kernel arguments
+  struct _BatchArg {
+    int off, es, ms;
+    _BatchArg(const UCL_D_Mat<numtyp> &mat,
+              const enum UCL_BATCH_LAYOUT layout) {
+      off=mat.offset();
+      const int pitch=static_cast<int>(mat.row_bytes()/sizeof(numtyp));
+      es=(layout==UCL_BATCH_SOA) ? pitch : 1;
+      ms=(layout==UCL_BATCH_SOA) ? 1 : pitch;
+    }
+    _BatchArg(const UCL_D_Vec<numtyp> &vec) :
+      off(vec.offset()), es(0), ms(1) {}
+    template <class mat_type>
+    inline void add_args(UCL_Kernel &k, const mat_type &mat) {
+      k.add_arg(&mat);
+      k.add_arg(&off);
+      k.add_arg(&es);
+      k.add_arg(&ms);
+    }
+  };
+
+  inline int _count(const UCL_D_Mat<numtyp> &a, const size_t n) const {
+    assert(n<=count(a));
+    assert((_layout==UCL_BATCH_SOA ? a.rows() : a.cols())>=
+           static_cast<size_t>(_dim*_dim));
+    return static_cast<int>((n==0) ? count(a) : n);
+  }
+
+  inline UCL_PrimKernels * _get_kernels() {
+    if (_kernels==NULL) {
+      std::ostringstream key, src;
+      key << "ucl_batched_" << _UCL_DATA_ID<numtyp>::name() << "_" << _dim
+          << "_" << _block_size;
+      src << _ucl_prim_defs<numtyp>(_block_size)
+          << "#define DIM " << _dim << "\n"
+          << "#define EPS ((NUMTYP)"
+          << std::numeric_limits<numtyp>::epsilon() << ")\n"
+          << _ucl_batched_source();
+      const char *names[3]={"ucl_batched_mul","ucl_batched_inv",
+                            "ucl_batched_eig3"};
+      _kernels=_ucl_prim_kernels(*_dev,key.str(),src.str(),names,
+                                 (_dim==3) ? 3 : 2);
+    }
+    return _kernels;
+  }
+
+  inline int _inverse(UCL_D_Mat<numtyp> *inv, const UCL_D_Mat<numtyp> &a,
+                      UCL_D_Vec<numtyp> *det, int nm, command_queue &cq) {
+    UCL_PrimKernels *k=_get_kernels();
+    if (k==NULL)
+      return UCL_COMPILE_ERROR;
+    if (nm==0)
+      return UCL_SUCCESS;
+    int want_inv=(inv!=NULL) ? 1 : 0, want_det=(det!=NULL) ? 1 : 0;
+    const UCL_D_Mat<numtyp> &b=(inv!=NULL) ? *inv : a;
+    _BatchArg aa(a,_layout), ab(b,_layout);
+    _BatchArg ad=(det!=NULL) ? _BatchArg(*det) : aa;
+    UCL_Kernel &ki=(*k)[1];
+    ki.set_size((nm+_block_size-1)/_block_size,_block_size,cq);
+    ki.clear_args();
+    aa.add_args(ki,a);
+    ab.add_args(ki,b);
+    if (det!=NULL)
+      ad.add_args(ki,*det);
+    else
+      ad.add_args(ki,a);
+    ki.add_arg(&nm);
+    ki.add_arg(&want_inv);
+    ki.add_arg(&want_det);
+    ki.run();
+    return UCL_SUCCESS;
+  }
+};
+
+#endif
@@ -0,0 +1,416 @@
+/***************************************************************************
+                                 ucl_blas1.h
+                             -------------------
+
+  BLAS level-1 operations on device vectors and matrix rows and columns
+
+ __________________________________________________________________________
+    This file is part of the Geryon Unified Coprocessor Library (UCL)
+ __________________________________________________________________________
+
+ ***************************************************************************/
+
+/* -----------------------------------------------------------------------
+   Copyright (2010) Sandia Corporation.  Under the terms of Contract
+   DE-AC04-94AL85000 with Sandia Corporation, the U.S. Government retains
+   certain rights in this software.  This software is distributed under
+   the Simplified BSD License.
+   ----------------------------------------------------------------------- */
+
+/***************************************************************************
+   UCL_Blas1 provides axpy, scal, copy, dot, nrm2 and asum for strided
+   vectors in device memory. A UCL_Strided refers to n elements with a
+   stride of inc in a UCL_D_Vec, or to a row or column of a pitched
+   UCL_D_Mat:
+
+     UCL_Blas1<double> blas(dev);
+     blas.axpy(dt,f,v,cq);                      // v+=dt*f
+     blas.dot(res,0,ucl_col(x,0),ucl_col(f,0),cq);  // res[0] on device
+     double fnorm=blas.nrm2(f);                 // blocks until complete
+
+   A UCL_D_Vec can be passed wherever a UCL_Strided is expected. Results
+   for dot, nrm2 and asum can be left in a UCL_D_Vec on the device so
+   that they can be used by later kernels without a copy to the host.
+   Intended for float and double; axpy, scal, copy, dot and asum can also
+   be used with integer types.
+ ***************************************************************************/
+
+// Only allow this file to be included by nvd_prims.h and ocl_prims.h
+#ifdef UCL_PRIMS_ALLOW
+
+/// Strided vector in a UCL_D_Vec or UCL_D_Mat for BLAS operations
+/** Holds a pointer to the container, which must outlive the object **/
+template <class numtyp>
+class UCL_Strided {
+ public:
+  /// n elements of a vector, starting at start, with a stride of inc
+  /** \param n Number of elements (0 for all elements after start) **/
+  UCL_Strided(UCL_D_Vec<numtyp> &vec, const size_t n=0,
+              const size_t start=0, const int inc=1) :
+    _vec(&vec), _mat(NULL), _inc(inc) {
+    assert(inc>0 && start<=vec.cols());
+    _n=static_cast<int>((n==0) ? (vec.cols()-start+inc-1)/inc : n);
+    _off=static_cast<int>(vec.offset()+start);
+    assert(_n==0 || start+static_cast<size_t>(_n-1)*inc<vec.cols());
+  }
+
+  /// n elements of a matrix (in pitched storage), starting at start
+  /** \param start Element offset from the first element of the matrix
+    * \param inc Stride in elements (use row_size() for columns) **/
+  UCL_Strided(UCL_D_Mat<numtyp> &mat, const size_t n, const size_t start,
+              const int inc) :
+    _vec(NULL), _mat(&mat), _n(static_cast<int>(n)), _inc(inc) {
+    assert(inc>0);
+    _off=static_cast<int>(mat.offset()+start);
+  }
+
+  /// Number of elements
+  inline int numel() const { return _n; }
+  /// Stride between elements
+  inline int inc() const { return _inc; }
+  /// Offset of the first element in the device buffer
+  inline int offset() const { return _off; }
+
+  /// Add the buffer, offset and stride as kernel arguments
+  inline void add_args(UCL_Kernel &k) {
+    if (_vec!=NULL)
+      k.add_arg(_vec);
+    else
+      k.add_arg(_mat);
+    k.add_arg(&_off);
+    k.add_arg(&_inc);
+  }
+
+ private:
+  UCL_D_Vec<numtyp> *_vec;
+  UCL_D_Mat<numtyp> *_mat;
+  int _n, _off, _inc;
+};
+
+/// Row of a device matrix as a strided vector
+template <class numtyp>
+inline UCL_Strided<numtyp> ucl_row(UCL_D_Mat<numtyp> &mat,
+                                   const size_t row) {
+  assert(row<mat.rows());
+  return UCL_Strided<numtyp>(mat,mat.cols(),row*mat.row_size(),1);
+}
+
+/// Column of a device matrix as a strided vector
+template <class numtyp>
+inline UCL_Strided<numtyp> ucl_col(UCL_D_Mat<numtyp> &mat,
+                                   const size_t col) {
+  assert(col<mat.cols());
+  return UCL_Strided<numtyp>(mat,mat.rows(),col,
+                             static_cast<int>(mat.row_size()));
+}
+
+/// Kernel source for BLAS level-1 operations
+/** ucl_blas_update: mode 0 is y+=alpha*x, 1 is y*=alpha, 2 is y=x
+  * ucl_blas_partial: op 0 is dot, 1 is sum of squares of x/scale, 2 is
+  * asum, 3 is max |x|
+  * ucl_blas_final: mode 0 is the sum, 1 is scale*sqrt(sum), 2 is the
+  * maximum **/
+inline const char * _ucl_blas1_source() {
+  return
+    "__kernel void ucl_blas_update(const __global NUMTYP *x, const int xoff,\n"
+    "                              const int incx, __global NUMTYP *y,\n"
+    "                              const int yoff, const int incy,\n"
+    "                              const int n, const NUMTYP alpha,\n"
+    "                              const int mode) {\n"
+    "  for (int i=GLOBAL_ID_X; i<n; i+=GRID_SIZE_X*BLOCK_SIZE) {\n"
+    "    const int yi=yoff+i*incy;\n"
+    "    if (mode==0)\n"
+    "      y[yi]+=alpha*x[xoff+i*incx];\n"
+    "    else if (mode==1)\n"
+    "      y[yi]*=alpha;\n"
+    "    else\n"
+    "      y[yi]=x[xoff+i*incx];\n"
+    "  }\n"
+    "}\n"
+    "\n"
+    "__kernel void ucl_blas_partial(const __global NUMTYP *x, const int xoff,\n"
+    "                               const int incx,\n"
+    "                               const __global NUMTYP *y,\n"
+    "                               const int yoff, const int incy,\n"
+    "                               const int n, const int op,\n"
+    "                               const __global NUMTYP *scale,\n"
+    "                               const int scale_off,\n"
+    "                               __global NUMTYP *partial) {\n"
+    "  __local NUMTYP sh[BLOCK_SIZE];\n"
+    "  const int tid=THREAD_ID_X;\n"
+    "  const NUMTYP sc=(op==1) ? scale[scale_off] : (NUMTYP)1;\n"
+    "  NUMTYP s=(NUMTYP)0;\n"
+    "  for (int i=GLOBAL_ID_X; i<n; i+=GRID_SIZE_X*BLOCK_SIZE) {\n"
+    "    const NUMTYP v=x[xoff+i*incx];\n"
+    "    const NUMTYP a=(v<(NUMTYP)0) ? -v : v;\n"
+    "    if (op==0)\n"
+    "      s+=v*y[yoff+i*incy];\n"
+    "    else if (op==1) {\n"
+    "      if (sc>(NUMTYP)0) {\n"
+    "        const NUMTYP q=a/sc;\n"
+    "        s+=q*q;\n"
+    "      }\n"
+    "    } else if (op==2)\n"
+    "      s+=a;\n"
+    "    else if (s<a)\n"
+    "      s=a;\n"
+    "  }\n"
+    "  sh[tid]=s;\n"
+    "  __syncthreads();\n"
+    "  for (int o=BLOCK_SIZE/2; o>0; o>>=1) {\n"
+    "    if (tid<o) {\n"
+    "      if (op!=3)\n"
+    "        sh[tid]+=sh[tid+o];\n"
+    "      else if (sh[tid]<sh[tid+o])\n"
+    "        sh[tid]=sh[tid+o];\n"
+    "    }\n"
+    "    __syncthreads();\n"
+    "  }\n"
+    "  if (tid==0)\n"
+    "    partial[BLOCK_ID_X]=sh[0];\n"
+    "}\n"
+    "\n"
+    "__kernel void ucl_blas_final(const __global NUMTYP *partial,\n"
+    "                             const int ngroups,\n"
+    "                             __global NUMTYP *result,\n"
+    "                             const int res_off, const int mode) {\n"
+    "  __local NUMTYP sh[BLOCK_SIZE];\n"
+    "  const int tid=THREAD_ID_X;\n"
+    "  NUMTYP s=(NUMTYP)0;\n"
+    "  for (int i=tid; i<ngroups; i+=BLOCK_SIZE) {\n"
+    "    if (mode!=2)\n"
+    "      s+=partial[i];\n"
+    "    else if (s<partial[i])\n"
+    "      s=partial[i];\n"
+    "  }\n"
+    "  sh[tid]=s;\n"
+    "  __syncthreads();\n"
+    "  for (int o=BLOCK_SIZE/2; o>0; o>>=1) {\n"
+    "    if (tid<o) {\n"
+    "      if (mode!=2)\n"
+    "        sh[tid]+=sh[tid+o];\n"
+    "      else if (sh[tid]<sh[tid+o])\n"
+    "        sh[tid]=sh[tid+o];\n"
+    "    }\n"
+    "    __syncthreads();\n"
+    "  }\n"
+    "  if (tid==0) {\n"
+    "    #ifdef BLAS_SQRT\n"
+    "    if (mode==1) {\n"
+    "      const NUMTYP sc=result[res_off];\n"
+    "      result[res_off]=(sh[0]>(NUMTYP)0) ? sc*sqrt(sh[0]) : sc;\n"
+    "      return;\n"
+    "    }\n"
+    "    #endif\n"
+    "    result[res_off]=sh[0];\n"
+    "  }\n"
+    "}\n";
+}
+
+/// BLAS level-1 operations on device vectors and matrix rows and columns
+/** Kernels are compiled on first use and cached with the device. Storage
+  * for partial sums is kept between calls. **/
+template <class numtyp>
+class UCL_Blas1 {
+ public:
+  /// Set up BLAS operations on a device
+  /** \param block_size Work-group size (rounded down to a power of 2;
+    *                   0 for a default based on the device)
+    * \param max_groups Maximum number of work-groups (0 for a default
+    *                   based on the device) **/
+  UCL_Blas1(UCL_Device &dev, const int block_size=0,
+            const int max_groups=0) : _dev(&dev), _kernels(NULL) {
+    _block_size=(block_size>0) ? _ucl_pow2_floor(block_size) :
+                                 _ucl_prim_block_size(dev);
+    _max_groups=(max_groups>0) ? max_groups : dev.cus()*8;
+    if (_max_groups<1)
+      _max_groups=1;
+  }
+
+  /// Work-group size used for the kernels
+  inline int block_size() const { return _block_size; }
+
+  /// y+=alpha*x
+  /** \note Asynchronous with respect to the host **/
+  inline int axpy(const numtyp alpha, UCL_Strided<numtyp> x,
+                  UCL_Strided<numtyp> y, command_queue &cq) {
+    assert(x.numel()==y.numel());
+    return _update(x,y,alpha,0,cq);
+  }
+
+  /// x*=alpha
+  /** \note Asynchronous with respect to the host **/
+  inline int scal(const numtyp alpha, UCL_Strided<numtyp> x,
+                  command_queue &cq)
+    { return _update(x,x,alpha,1,cq); }
+
+  /// y=x (for strided copies that ucl_copy cannot do)
+  /** \note x and y must not overlap
+    * \note Asynchronous with respect to the host **/
+  inline int copy(UCL_Strided<numtyp> y, UCL_Strided<numtyp> x,
+                  command_queue &cq) {
+    assert(x.numel()==y.numel());
+    return _update(x,y,static_cast<numtyp>(1),2,cq);
+  }
+
+  /// result[pos]=x.y on the device
+  /** \note Asynchronous with respect to the host **/
+  inline int dot(UCL_D_Vec<numtyp> &result, const size_t pos,
+                 UCL_Strided<numtyp> x, UCL_Strided<numtyp> y,
+                 command_queue &cq) {
+    assert(x.numel()==y.numel());
+    return _reduce(x,y,0,result,pos,cq);
+  }
+
+  /// result[pos]=sqrt(x.x) on the device
+  /** The elements are scaled by max |x[i]| first, so the result does not
+    * overflow or underflow unless the norm itself does (two passes over x)
+    * \note Asynchronous with respect to the host **/
+  inline int nrm2(UCL_D_Vec<numtyp> &result, const size_t pos,
+                  UCL_Strided<numtyp> x, command_queue &cq) {
+    assert(!std::numeric_limits<numtyp>::is_integer);
+    int err=_reduce(x,x,3,result,pos,cq);
+    if (err!=UCL_SUCCESS)
+      return err;
+    return _reduce(x,x,1,result,pos,cq);
+  }
+
+  /// result[pos]=sum of |x[i]| on the device
+  /** \note Asynchronous with respect to the host **/
+  inline int asum(UCL_D_Vec<numtyp> &result, const size_t pos,
+                  UCL_Strided<numtyp> x, command_queue &cq)
+    { return _reduce(x,x,2,result,pos,cq); }
+
+  /// Return x.y (blocks until complete)
+  inline numtyp dot(UCL_Strided<numtyp> x, UCL_Strided<numtyp> y) {
+    _host_alloc();
+    if (dot(_dres,0,x,y,_dres.cq())!=UCL_SUCCESS)
+      return static_cast<numtyp>(0);
+    ucl_copy(_hres,_dres,1,false);
+    return _hres[0];
+  }
+
+  /// Return sqrt(x.x) (blocks until complete)
+  inline numtyp nrm2(UCL_Strided<numtyp> x) {
+    _host_alloc();
+    if (nrm2(_dres,0,x,_dres.cq())!=UCL_SUCCESS)
+      return static_cast<numtyp>(0);
+    ucl_copy(_hres,_dres,1,false);
+    return _hres[0];
+  }
+
+  /// Return the sum of |x[i]| (blocks until complete)
+  inline numtyp asum(UCL_Strided<numtyp> x) {
+    _host_alloc();
+    if (asum(_dres,0,x,_dres.cq())!=UCL_SUCCESS)
+      return static_cast<numtyp>(0);
+    ucl_copy(_hres,_dres,1,false);
+    return _hres[0];
+  }
+
+  /// Free temporary storage
+  inline void clear() {
+    _partial.clear();
+    _dres.clear();
+    _hres.clear();
+  }
+
+ private:
+  UCL_Device *_dev;
+  int _block_size, _max_groups;
+  UCL_PrimKernels *_kernels;
+  UCL_D_Vec<numtyp> _partial, _dres;
+  UCL_H_Vec<numtyp> _hres;
+
+  inline int _groups(const int n) const {
+    int ngroups=(n+_block_size-1)/_block_size;
+    if (ngroups<1)
+      ngroups=1;
+    return (ngroups>_max_groups) ? _max_groups : ngroups;
+  }
+
+  inline void _host_alloc() {
+    if (_dres.cols()<1) {
+      _dres.alloc(1,*_dev);
+      _hres.alloc(1,*_dev);
+    }
+  }
+
+  inline UCL_PrimKernels * _get_kernels() {
+    if (_kernels==NULL) {
+      std::ostringstream key, src;
+      key << "ucl_blas1_" << _UCL_DATA_ID<numtyp>::name() << "_"
+          << _block_size;
+      src << _ucl_prim_defs<numtyp>(_block_size);
+      if (!std::numeric_limits<numtyp>::is_integer)
+        src << "#define BLAS_SQRT\n";
+      src << _ucl_blas1_source();
+      const char *names[3]={"ucl_blas_update","ucl_blas_partial",
+                            "ucl_blas_final"};
+      _kernels=_ucl_prim_kernels(*_dev,key.str(),src.str(),names,3);
+    }
+    return _kernels;
+  }
+
+  inline int _update(UCL_Strided<numtyp> &x, UCL_Strided<numtyp> &y,
+                     numtyp alpha, int mode, command_queue &cq) {
+    UCL_PrimKernels *k=_get_kernels();
+    if (k==NULL)
+      return UCL_COMPILE_ERROR;
+    int n=y.numel();
+    if (n==0)
+      return UCL_SUCCESS;
+    UCL_Kernel &ku=(*k)[0];
+    ku.set_size(_groups(n),_block_size,cq);
+    ku.clear_args();
+    x.add_args(ku);
+    y.add_args(ku);
+    ku.add_arg(&n);
+    ku.add_arg(&alpha);
+    ku.add_arg(&mode);
+    ku.run();
+    return UCL_SUCCESS;
+  }
+
+  // Reduce into result[pos]. For op 1, result[pos] holds the scale from a
+  // previous reduction with op 3 and is replaced by the norm.
+  inline int _reduce(UCL_Strided<numtyp> &x, UCL_Strided<numtyp> &y, int op,
+                     UCL_D_Vec<numtyp> &result, const size_t pos,
+                     command_queue &cq) {
+    UCL_PrimKernels *k=_get_kernels();
+    if (k==NULL)
+      return UCL_COMPILE_ERROR;
+    int n=x.numel();
+    int ngroups=_groups(n);
+    if (_partial.cols()<static_cast<size_t>(ngroups))
+      if (_partial.alloc(ngroups,*_dev)!=UCL_SUCCESS)
+        return UCL_MEMORY_ERROR;
+
+    UCL_Kernel &kp=(*k)[1];
+    kp.set_size(ngroups,_block_size,cq);
+    kp.clear_args();
+    x.add_args(kp);
+    y.add_args(kp);
+    int res_off=static_cast<int>(result.offset()+pos);
+    kp.add_arg(&n);
+    kp.add_arg(&op);
+    kp.add_arg(&result);
+    kp.add_arg(&res_off);
+    kp.add_arg(&_partial);
+    kp.run();
+
+    int mode=(op==1) ? 1 : ((op==3) ? 2 : 0);
+    UCL_Kernel &kf=(*k)[2];
+    kf.set_size(1,_block_size,cq);
+    kf.clear_args();
+    kf.add_arg(&_partial);
+    kf.add_arg(&ngroups);
+    kf.add_arg(&result);
+    kf.add_arg(&res_off);
+    kf.add_arg(&mode);
+    kf.run();
+    return UCL_SUCCESS;
+  }
+};
+
+#endif
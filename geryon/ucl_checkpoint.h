@@ -0,0 +1,365 @@
+/***************************************************************************
+                               ucl_checkpoint.h
+                             -------------------
+
+  Checkpoints of device containers written by a background host thread
+
+ __________________________________________________________________________
+    This file is part of the Geryon Unified Coprocessor Library (UCL)
+ __________________________________________________________________________
+
+ ***************************************************************************/
+
+/* -----------------------------------------------------------------------
+   Copyright (2010) Sandia Corporation.  Under the terms of Contract
+   DE-AC04-94AL85000 with Sandia Corporation, the U.S. Government retains
+   certain rights in this software.  This software is distributed under
+   the Simplified BSD License.
+   ----------------------------------------------------------------------- */
+
+/***************************************************************************
+   UCL_Checkpoint writes a set of device containers to a file without
+   blocking the thread that issues device work:
+
+     UCL_Checkpoint ckpt(dev);
+     ckpt.add("x",x);                   // UCL_D_Vec, UCL_D_Mat or s-object
+     ckpt.add("v",v);
+     ...
+     if (step%1000==0)
+       ckpt.snapshot("restart.ckpt");   // returns immediately
+     ...
+     ckpt.wait();                       // before exit
+
+   snapshot() enqueues non-blocking copies of all containers into a pinned
+   host buffer, followed by a UCL_Event. A writer thread waits on the event
+   and writes the buffer to the file. There are two buffers, so a snapshot
+   can be copied while the previous one is written; snapshot() only blocks
+   if both are in use.
+
+   Kernels enqueued in the same command queue after snapshot() can safely
+   overwrite the containers. When using other queues, check copied() or
+   call sync_copy() first. Write errors are returned by the next call to
+   snapshot() or wait().
+
+   File layout (little-endian):
+     8 bytes        "UCL_CKPT"
+     4 bytes        format version (1)
+     4 bytes        length of the text header
+     text header    "entries N\n", then one line for each container:
+                    "name dtype rows cols offset\n", padded with spaces so
+                    that the data starts on a 64 byte boundary. dtype is the
+                    NumPy type string (e.g. '<f8') and offset is the byte
+                    offset of the data from the end of the header.
+     data           each container as rows*cols packed elements, row-major,
+                    starting on a 64 byte boundary
+ ***************************************************************************/
+
+// Only allow this file to be included by nvd_mat.h and ocl_mat.h
+#ifdef UCL_CHECKPOINT_ALLOW
+
+// Device container in a checkpoint
+class _UCL_CkptEntry {
+ public:
+  virtual ~_UCL_CkptEntry() {}
+  // Get the current size of the container
+  virtual void shape(size_t &rows, size_t &cols) = 0;
+  // Enqueue a copy of the container to buf at offset
+  virtual void copy(UCL_H_Vec<char> &buf, const size_t offset,
+                    command_queue &cq) = 0;
+  std::string name, descr;
+  size_t element_size;
+};
+
+template <class mat_type>
+class _UCL_CkptMat : public _UCL_CkptEntry {
+ public:
+  typedef typename mat_type::data_type numtyp;
+
+  _UCL_CkptMat(const std::string &n, mat_type &mat) : _mat(mat) {
+    name=n;
+    descr=ucl_npy_descr<numtyp>();
+    element_size=sizeof(numtyp);
+  }
+
+  void shape(size_t &rows, size_t &cols) {
+    rows=_mat.rows();
+    cols=_mat.cols();
+  }
+
+  void copy(UCL_H_Vec<char> &buf, const size_t offset, command_queue &cq) {
+    const size_t width=_mat.cols()*sizeof(numtyp);
+    if (width==0 || _mat.rows()==0)
+      return;
+    ucl_mv_cpy(buf,offset,width,_mat,0,_mat.row_bytes(),width,_mat.rows(),
+               cq);
+  }
+
+ private:
+  mat_type &_mat;
+};
+
+/// Asynchronous checkpoint writer for device containers
+class UCL_Checkpoint {
+ public:
+  UCL_Checkpoint() : _dev(NULL), _head(0), _pending(0), _stop(false),
+                     _error(UCL_SUCCESS), _written(0), _last(-1) {}
+  UCL_Checkpoint(UCL_Device &dev) : _dev(NULL), _head(0), _pending(0),
+                     _stop(false), _error(UCL_SUCCESS), _written(0),
+                     _last(-1) { init(dev); }
+  ~UCL_Checkpoint() { clear(); }
+
+  /// Use the default command queue of dev for copies
+  inline int init(UCL_Device &dev) { return init(dev,dev.cq()); }
+
+  /// Use the command queue cq for copies
+  /** Containers already added are kept, so add() can be called before or
+    * after init(). Pending snapshots are written first.
+    * \return UCL_SUCCESS or UCL_ERROR if the writer thread could not be
+    *         started **/
+  inline int init(UCL_Device &dev, command_queue &cq) {
+    _release();
+    _dev=&dev;
+    _cq=cq;
+    _stop=false;
+    if (!_thread.start(_writer,this)) {
+      #ifndef UCL_NO_EXIT
+      std::cerr << "UCL Error: Could not start checkpoint writer thread.\n";
+      UCL_GERYON_EXIT;
+      #endif
+      return UCL_ERROR;
+    }
+    return UCL_SUCCESS;
+  }
+
+  /// Add a device container to the checkpoint
+  /** The name must not contain whitespace. The container is read at each
+    * snapshot, so it can be resized between snapshots. **/
+  template <class mat_type>
+  inline void add(const std::string &name, mat_type &mat)
+    { _entries.push_back(new _UCL_CkptMat<mat_type>(name,mat)); }
+
+  /// Add the device data of a vector s-object to the checkpoint
+  template <class hosttype, class devtype>
+  inline void add(const std::string &name, UCL_Vector<hosttype,devtype> &mat)
+    { add(name,mat.device); }
+
+  /// Add the device data of a matrix s-object to the checkpoint
+  template <class hosttype, class devtype>
+  inline void add(const std::string &name, UCL_Matrix<hosttype,devtype> &mat)
+    { add(name,mat.device); }
+
+  /// Number of containers in the checkpoint
+  inline size_t entries() const { return _entries.size(); }
+
+  /// Copy all containers to a host buffer and write them to filename
+  /** The copies are enqueued without blocking and the file is written by
+    * the writer thread once they finish. Blocks only when two snapshots
+    * are waiting to be written.
+    * \return UCL_SUCCESS, the error from a previous write, or the error
+    *         from allocating the host buffer **/
+  inline int snapshot(const std::string &filename) {
+    assert(_dev!=NULL);
+    _lock.lock();
+    while (_pending==2)
+      _cond.wait(_lock);
+    const int s=(_head+_pending)%2;
+    _lock.unlock();
+
+    _Slot &slot=_slot[s];
+    slot.filename=filename;
+    size_t bytes;
+    std::vector<size_t> offsets;
+    slot.header=_header(offsets,bytes);
+    slot.bytes=bytes;
+    if (slot.buffer.cols()<bytes) {
+      int err=slot.buffer.alloc(bytes,*_dev);
+      if (err!=UCL_SUCCESS)
+        return err;
+    }
+    for (size_t i=0; i<_entries.size(); i++)
+      _entries[i]->copy(slot.buffer,offsets[i],_cq);
+    slot.event.record(_cq);
+
+    _lock.lock();
+    _pending++;
+    _last=s;
+    _cond.broadcast();
+    _lock.unlock();
+    return _check_error();
+  }
+
+  /// True if the copies for the last snapshot have finished (non-blocking)
+  inline bool copied() {
+    if (_last<0)
+      return true;
+    return _slot[_last].event.query();
+  }
+
+  /// Block until the copies for the last snapshot have finished
+  inline void sync_copy() {
+    if (_last>=0)
+      _slot[_last].event.sync();
+  }
+
+  /// True if any snapshot has not been written to its file (non-blocking)
+  inline bool busy() {
+    UCL_Lock l(_lock);
+    return _pending>0;
+  }
+
+  /// Block until all snapshots have been written
+  /** \return UCL_SUCCESS or the error from a failed write **/
+  inline int wait() {
+    _lock.lock();
+    while (_pending>0)
+      _cond.wait(_lock);
+    _lock.unlock();
+    return _check_error();
+  }
+
+  /// Number of snapshots written to files
+  inline size_t written() {
+    UCL_Lock l(_lock);
+    return _written;
+  }
+
+  /// Wait for pending writes, stop the writer, remove all containers and
+  /// free all memory
+  inline void clear() {
+    _release();
+    for (size_t i=0; i<_entries.size(); i++)
+      delete _entries[i];
+    _entries.clear();
+  }
+
+ private:
+  struct _Slot {
+    UCL_H_Vec<char> buffer;
+    UCL_Event event;
+    std::string filename, header;
+    size_t bytes;
+  };
+
+  std::vector<_UCL_CkptEntry *> _entries;
+  UCL_Device *_dev;
+  command_queue _cq;
+  _Slot _slot[2];
+  UCL_Thread _thread;
+  UCL_Mutex _lock;
+  UCL_Cond _cond;
+  // First slot waiting to be written and number of slots waiting
+  int _head, _pending;
+  bool _stop;
+  int _error;
+  std::string _error_file;
+  size_t _written;
+  int _last;
+
+  UCL_Checkpoint(const UCL_Checkpoint &);
+  UCL_Checkpoint & operator=(const UCL_Checkpoint &);
+
+  // Wait for pending writes, stop the writer and free the buffers (the
+  // containers are kept)
+  inline void _release() {
+    if (_thread.running()) {
+      wait();
+      _lock.lock();
+      _stop=true;
+      _cond.broadcast();
+      _lock.unlock();
+      _thread.join();
+    }
+    for (int s=0; s<2; s++) {
+      _slot[s].buffer.clear();
+      _slot[s].event.clear();
+    }
+    _dev=NULL;
+    _head=_pending=0;
+    _written=0;
+    _last=-1;
+    _error=UCL_SUCCESS;
+  }
+
+  // Build the file header and the data offset of each container
+  inline std::string _header(std::vector<size_t> &offsets, size_t &bytes) {
+    std::ostringstream t;
+    t << "entries " << _entries.size() << "\n";
+    bytes=0;
+    for (size_t i=0; i<_entries.size(); i++) {
+      size_t rows, cols;
+      _entries[i]->shape(rows,cols);
+      offsets.push_back(bytes);
+      t << _entries[i]->name << " " << _entries[i]->descr << " " << rows
+        << " " << cols << " " << bytes << "\n";
+      bytes+=(rows*cols*_entries[i]->element_size+63)/64*64;
+    }
+    std::string text=t.str();
+    const size_t pre=16;
+    text.append((pre+text.size()+63)/64*64-pre-text.size(),' ');
+
+    std::string h("UCL_CKPT",8);
+    const unsigned version=1, len=text.size();
+    for (int i=0; i<4; i++)
+      h+=static_cast<char>((version>>(8*i)) & 0xff);
+    for (int i=0; i<4; i++)
+      h+=static_cast<char>((len>>(8*i)) & 0xff);
+    return h+text;
+  }
+
+  // Write one slot once its copies have finished (writer thread)
+  inline int _write(_Slot &slot) {
+    slot.event.sync();
+    FILE *out=fopen(slot.filename.c_str(),"wb");
+    if (out==NULL)
+      return UCL_FILE_NOT_FOUND;
+    bool ok=(fwrite(slot.header.data(),1,slot.header.size(),out)==
+             slot.header.size());
+    if (slot.bytes>0)
+      ok=ok && (fwrite(slot.buffer.begin(),1,slot.bytes,out)==slot.bytes);
+    if (fclose(out)!=0)
+      ok=false;
+    return ok ? UCL_SUCCESS : UCL_ERROR;
+  }
+
+  static void * _writer(void *arg) {
+    UCL_Checkpoint &c=*static_cast<UCL_Checkpoint *>(arg);
+    c._lock.lock();
+    while (true) {
+      while (c._pending==0 && !c._stop)
+        c._cond.wait(c._lock);
+      if (c._pending==0)
+        break;
+      _Slot &slot=c._slot[c._head];
+      c._lock.unlock();
+      const int err=c._write(slot);
+      c._lock.lock();
+      if (err!=UCL_SUCCESS) {
+        c._error=err;
+        c._error_file=slot.filename;
+      } else
+        c._written++;
+      c._head=(c._head+1)%2;
+      c._pending--;
+      c._cond.broadcast();
+    }
+    c._lock.unlock();
+    return NULL;
+  }
+
+  // Report and reset the error from a failed write
+  inline int _check_error() {
+    UCL_Lock l(_lock);
+    const int err=_error;
+    if (err!=UCL_SUCCESS) {
+      #ifndef UCL_NO_EXIT
+      std::cerr << "UCL Error: Could not write checkpoint file "
+                << _error_file << std::endl;
+      UCL_GERYON_EXIT;
+      #endif
+      _error=UCL_SUCCESS;
+    }
+    return err;
+  }
+};
+
+#endif
@@ -27,12 +27,32 @@
    for the matrix and vector types in nvc_memory.
 
    For host/host and host/device transfers, typecasting is performed
-   automatically as necessary.
+   automatically as necessary. Containers with the same data type (including
+   structs and vector types) are copied in bulk; otherwise each element is
+   assigned with a cast. Large host/host copies and casts are split across
+   the threads of ucl_copy_pool() (see ucl_host_copy.h).
 
    The routines are written so that all branches can be removed by the
    compiler during template instantiation.
 
-   The routines currently assume row-major ordering for all types.
+   Vectors are treated as row-major. Column-major matrices (UCL_H_ColMat
+   and UCL_D_ColMat) can be copied to or from row-major containers; rows
+   and cols always refer to the logical shape and the data is reordered:
+     - host to host copies are reordered (and cast) on the host in tiles
+     - host/device copies move the device data in its own order with one
+       2D copy through a host buffer, which is reordered (and cast) on the
+       host
+     - device to device copies between orderings need a kernel and are a
+       compile-time error; use UCL_Transpose with the storage() of the
+       column-major matrix (see ucl_transpose.h)
+   Copies with a number of elements rather than rows and cols use the
+   storage order of each container.
+
+   Ranges of elements marked in a UCL_DirtyRanges are copied with one
+   transfer per range (or per set of consecutive rows for matrices).
+
+   Uploads can be skipped when the host data has not changed since the
+   last upload by passing a UCL_UploadHash (see ucl_hash.h).
 
    For asynchronous copy in the default command queue, async is boolean true;
    For asynchronous copy in a specified command queue, async is command queue
@@ -130,6 +150,52 @@ inline void _check_ucl_copy_perm(mat1 &dst, mat2 &src) {
 // - HOST-HOST COPY ROUTINES
 // --------------------------------------------------------------------------
 
+// Data can be copied without a cast. Types are compared directly since
+// all types that are not registered have a DATA_TYPE of 0
+template <class mat1, class mat2> struct _ucl_same_data {
+  enum { ans=ucl_same_type<typename mat1::data_type,
+                           typename mat2::data_type>::ans };
+};
+
+// Cast n elements on the host
+template <class dtype, class stype> struct _ucl_host_cast {
+  static inline void cast(dtype *dst, const stype *src, const size_t n) {
+    for (size_t i=0; i<n; i++)
+      dst[i]=static_cast<dtype>(src[i]);
+  }
+};
+
+// Half precision conversions use F16C when available
+template <> struct _ucl_host_cast<ucl_half,float> {
+  static inline void cast(ucl_half *dst, const float *src, const size_t n)
+    { ucl_float_to_half(dst,src,n); }
+};
+template <> struct _ucl_host_cast<float,ucl_half> {
+  static inline void cast(float *dst, const ucl_half *src, const size_t n)
+    { ucl_half_to_float(dst,src,n); }
+};
+
+// Cast rows of cols elements between host containers
+/** \param dst_stride Elements between the start of each row in dst
+  * \param src_stride Elements between the start of each row in src **/
+template <class mat1, class mat2>
+inline void _ucl_host_cast_rows(mat1 &dst, const size_t dst_stride,
+                                const mat2 &src, const size_t src_stride,
+                                const size_t rows, const size_t cols) {
+  if (rows==0 || cols==0)
+    return;
+  typedef typename mat1::data_type t1;
+  typedef typename mat2::data_type t2;
+  if (_ucl_parallel_cast<_ucl_host_cast<t1,t2> >(&dst[0],dst_stride,&src[0],
+                                                  src_stride,rows,cols))
+    return;
+  if (dst_stride==cols && src_stride==cols)
+    _ucl_host_cast<t1,t2>::cast(&dst[0],&src[0],rows*cols);
+  else
+    for (size_t i=0; i<rows; i++)
+      _ucl_host_cast<t1,t2>::cast(&dst[i*dst_stride],&src[i*src_stride],cols);
+}
+
 // Have to use specialization because some types don't have operator[]
 template <int host_t1, int host_t2> struct _host_host_copy;
 
@@ -139,9 +205,9 @@ template <> struct _host_host_copy<1,1> {
   static inline void hhc(mat1 &dst, const mat2 &src, const size_t numel) {
     #ifdef UCL_DEBUG
     assert(mat1::PADDED==0 && mat2::PADDED==0);
-    assert(mat1::ROW_MAJOR==1 && mat2::ROW_MAJOR==1);
+    assert(mat1::ROW_MAJOR==mat2::ROW_MAJOR || mat1::VECTOR || mat2::VECTOR);
     #endif
-    if ((int)mat1::DATA_TYPE==(int)mat2::DATA_TYPE && mat1::DATA_TYPE!=0) {
+    if (_ucl_same_data<mat1,mat2>::ans) {
       #ifdef _OCL_MAT
       if (dst.begin()==src.begin()) {
         #ifdef UCL_DBG_MEM_TRACE
@@ -150,13 +216,15 @@ template <> struct _host_host_copy<1,1> {
         return;
       }
       #endif
-      memcpy(dst.begin(),src.begin(),numel*sizeof(typename mat1::data_type));
+      const size_t bytes=numel*sizeof(typename mat1::data_type);
+      if (!_ucl_parallel_copy((void *)dst.begin(),bytes,src.begin(),bytes,
+                              bytes,1))
+        memcpy((void *)dst.begin(),src.begin(),bytes);
       #ifdef UCL_DBG_MEM_TRACE
       std::cerr << "UCL_COPY 7NS\n";
       #endif
-    } else
-      for (size_t i=0; i<numel; i++)
-        dst[i]=static_cast<typename mat1::data_type>(src[i]);
+    } else if (numel>0)
+      _ucl_host_cast_rows(dst,numel,src,numel,1,numel);
   }
   template <class mat1, class mat2>
   static inline void hhc(mat1 &dst, const mat2 &src, const size_t rows,
@@ -173,7 +241,7 @@ template <> struct _host_host_copy<1,1> {
       src_row_size=cols;
     else
       src_row_size=src.row_size();
-    if ((int)mat1::DATA_TYPE==(int)mat2::DATA_TYPE && mat1::DATA_TYPE!=0) {
+    if (_ucl_same_data<mat1,mat2>::ans) {
       #ifdef _OCL_MAT
       if (dst.begin()==src.begin()) {
         #ifdef UCL_DBG_MEM_TRACE
@@ -186,19 +254,15 @@ template <> struct _host_host_copy<1,1> {
       #ifdef UCL_DBG_MEM_TRACE
       std::cerr << "UCL_COPY 8NS\n";
       #endif
-      for (size_t i=0; i<rows; i++)
-        memcpy(dst.begin()+i*dst_row_size,src.begin()+i*src_row_size,
-               cols*sizeof(typename mat1::data_type));
-    } else
-      for (size_t j=0; j<rows; j++) {
-        size_t dst_i=j*dst_row_size;
-        size_t d_end=dst_i+cols;
-        size_t src_i=j*src_row_size;
-        for (; dst_i<d_end; dst_i++) {
-          dst[dst_i]=static_cast<typename mat1::data_type>(src[src_i]);
-          src_i++;
-        }
-      }
+      const size_t bytes=sizeof(typename mat1::data_type);
+      if (!_ucl_parallel_copy((void *)dst.begin(),dst_row_size*bytes,
+                              src.begin(),src_row_size*bytes,cols*bytes,rows))
+        for (size_t i=0; i<rows; i++)
+          memcpy((void *)(dst.begin()+i*dst_row_size),
+                 src.begin()+i*src_row_size,
+                 cols*sizeof(typename mat1::data_type));
+    } else if (cols>0)
+      _ucl_host_cast_rows(dst,dst_row_size,src,src_row_size,rows,cols);
   }
 };
 
@@ -228,16 +292,14 @@ template <int host_type2> struct _ucl_cast_copy<1,host_type2> {
   static inline void cc(mat1 &dst, const mat2 &src, const size_t numel,
                         mat3 &cast_buffer) {
     ucl_mv_cpy(cast_buffer,src,numel*sizeof(typename mat2::data_type));
-    for (size_t i=0; i<numel; i++)
-      dst[i]=static_cast<typename mat1::data_type>(cast_buffer[i]);
+    _ucl_host_cast_rows(dst,numel,cast_buffer,numel,1,numel);
   }
   template <class mat1, class mat2, class mat3>
   static inline void cc(mat1 &dst, const mat2 &src, const size_t numel,
                         mat3 &cast_buffer,command_queue &cq) {
     ucl_mv_cpy(cast_buffer,src,numel*sizeof(typename mat2::data_type),cq);
     cast_buffer.sync();
-    for (size_t i=0; i<numel; i++)
-      dst[i]=static_cast<typename mat1::data_type>(cast_buffer[i]);
+    _ucl_host_cast_rows(dst,numel,cast_buffer,numel,1,numel);
   }
   template <class mat1, class mat2, class mat3>
   static inline void cc(mat1 &dst, const mat2 &src, const size_t rows,
@@ -252,8 +314,7 @@ template <int host_type2> struct _ucl_cast_copy<1,host_type2> {
     if (mat1::VECTOR) {
       ucl_mv_cpy(cast_buffer,cols*sizeof(typename mat2::data_type),src,
                  src.row_bytes(),cols*sizeof(typename mat2::data_type),rows);
-      for (size_t i=0; i<rows*cols; i++)
-        dst[i]=static_cast<typename mat1::data_type>(cast_buffer[i]);
+      _ucl_host_cast_rows(dst,cols,cast_buffer,cols,rows,cols);
     } else {
       if (mat2::VECTOR)
         ucl_mv_cpy(cast_buffer,cols*sizeof(typename mat2::data_type),src,
@@ -263,15 +324,7 @@ template <int host_type2> struct _ucl_cast_copy<1,host_type2> {
         ucl_mv_cpy(cast_buffer,cols*sizeof(typename mat2::data_type),src,
                    src.row_bytes(),cols*sizeof(typename mat2::data_type),
                    rows);
-      size_t dst_i=0, buff_i=0, doff=dst.cols()-cols;
-      for (size_t i=0; i<rows; i++) {
-        for (size_t j=0; j<cols; j++) {
-          dst[dst_i]=static_cast<typename mat1::data_type>(cast_buffer[buff_i]);
-          buff_i++;
-          dst_i++;
-        }
-        dst_i+=doff;
-      }
+      _ucl_host_cast_rows(dst,dst.cols(),cast_buffer,cols,rows,cols);
     }
   }
   template <class mat1, class mat2, class mat3>
@@ -289,8 +342,7 @@ template <int host_type2> struct _ucl_cast_copy<1,host_type2> {
       ucl_mv_cpy(cast_buffer,cols*sizeof(typename mat2::data_type),src,
                  src.row_bytes(),cols*sizeof(typename mat2::data_type),rows,cq);
       cast_buffer.sync();
-      for (size_t i=0; i<rows*cols; i++)
-        dst[i]=static_cast<typename mat1::data_type>(cast_buffer[i]);
+      _ucl_host_cast_rows(dst,cols,cast_buffer,cols,rows,cols);
     } else {
       if (mat2::VECTOR)
         ucl_mv_cpy(cast_buffer,cols*sizeof(typename mat2::data_type),src,
@@ -301,15 +353,7 @@ template <int host_type2> struct _ucl_cast_copy<1,host_type2> {
                    src.row_bytes(),cols*sizeof(typename mat2::data_type),
                    rows,cq);
       cast_buffer.sync();
-      size_t dst_i=0, buff_i=0, doff=dst.cols()-cols;
-      for (size_t i=0; i<rows; i++) {
-        for (size_t j=0; j<cols; j++) {
-          dst[dst_i]=static_cast<typename mat1::data_type>(cast_buffer[buff_i]);
-          buff_i++;
-          dst_i++;
-        }
-        dst_i+=doff;
-      }
+      _ucl_host_cast_rows(dst,dst.cols(),cast_buffer,cols,rows,cols);
     }
   }
 };
@@ -319,15 +363,13 @@ template <int host_type1> struct _ucl_cast_copy<host_type1,1> {
   template <class mat1, class mat2, class mat3>
   static inline void cc(mat1 &dst, const mat2 &src, const size_t numel,
                         mat3 &cast_buffer) {
-    for (size_t i=0; i<numel; i++)
-      cast_buffer[i]=static_cast<typename mat3::data_type>(src[i]);
+    _ucl_host_cast_rows(cast_buffer,numel,src,numel,1,numel);
     ucl_mv_cpy(dst,cast_buffer,numel*sizeof(typename mat1::data_type));
   }
   template <class mat1, class mat2, class mat3>
   static inline void cc(mat1 &dst, const mat2 &src, const size_t numel,
                         mat3 &cast_buffer, command_queue &cq) {
-    for (size_t i=0; i<numel; i++)
-      cast_buffer[i]=static_cast<typename mat3::data_type>(src[i]);
+    _ucl_host_cast_rows(cast_buffer,numel,src,numel,1,numel);
     ucl_mv_cpy(dst,cast_buffer,numel*sizeof(typename mat1::data_type),cq);
   }
   template <class mat1, class mat2, class mat3>
@@ -345,54 +387,29 @@ template <int host_type1> struct _ucl_cast_copy<host_type1,1> {
     #endif
     if (mat2::VECTOR) {
       if (mat3::VECTOR==0) {
-        size_t ci=0, si=0, co=cast_buffer.cols()-cols, so=src.cols()-cols;
-        for (size_t i=0; i<rows; i++) {
-          for (size_t j=0; j<cols; j++) {
-            cast_buffer[ci]=static_cast<typename mat3::data_type>(src[si]);
-            ci++;
-            si++;
-          }
-          ci+=co;
-          si+=so;
-        }
+        _ucl_host_cast_rows(cast_buffer,cast_buffer.cols(),src,cols,rows,
+                            cols);
         ucl_mv_cpy(dst,dst.row_bytes(),cast_buffer,cast_buffer.row_bytes(),
                    cols*sizeof(typename mat1::data_type),rows);
       } else {
-        for (size_t i=0; i<rows*cols; i++)
-          cast_buffer[i]=static_cast<typename mat3::data_type>(src[i]);
+        _ucl_host_cast_rows(cast_buffer,cols,src,cols,rows,cols);
         ucl_mv_cpy(dst,dst.row_bytes(),cast_buffer,
                    cols*sizeof(typename mat1::data_type),
                    cols*sizeof(typename mat1::data_type),rows);
       }
     } else if (mat1::VECTOR) {
-      size_t src_i=0, buf_i=0, soff=src.cols()-cols;
-      for (size_t i=0; i<rows; i++) {
-        for (size_t j=0; j<cols; j++) {
-          cast_buffer[buf_i]=static_cast<typename mat3::data_type>(src[src_i]);
-          buf_i++;
-          src_i++;
-        }
-        src_i+=soff;
-      }
+      _ucl_host_cast_rows(cast_buffer,cols,src,src.cols(),rows,cols);
       ucl_mv_cpy(dst,cast_buffer,cols*sizeof(typename mat1::data_type)*rows);
     } else {
-      size_t src_i=0, buf_i=0, so=src.cols()-cols, co, spitch;
+      size_t cstride, spitch;
       if (mat3::VECTOR==0) {
-        co=cast_buffer.cols()-cols;
+        cstride=cast_buffer.cols();
         spitch=cast_buffer.row_bytes();
       } else {
-        co=0;
+        cstride=cols;
         spitch=cols*sizeof(typename mat1::data_type);
       }
-      for (size_t i=0; i<rows; i++) {
-        for (size_t j=0; j<cols; j++) {
-          cast_buffer[buf_i]=static_cast<typename mat3::data_type>(src[src_i]);
-          buf_i++;
-          src_i++;
-        }
-        src_i+=so;
-        buf_i+=co;
-      }
+      _ucl_host_cast_rows(cast_buffer,cstride,src,src.cols(),rows,cols);
       ucl_mv_cpy(dst,dst.row_bytes(),cast_buffer,spitch,
                  cols*sizeof(typename mat1::data_type),rows);
     }
@@ -413,54 +430,29 @@ template <int host_type1> struct _ucl_cast_copy<host_type1,1> {
     #endif
     if (mat2::VECTOR) {
       if (mat3::VECTOR==0) {
-        size_t ci=0, si=0, co=cast_buffer.cols()-cols, so=src.cols()-cols;
-        for (size_t i=0; i<rows; i++) {
-          for (size_t j=0; j<cols; j++) {
-            cast_buffer[ci]=static_cast<typename mat3::data_type>(src[si]);
-            ci++;
-            si++;
-          }
-          ci+=co;
-          si+=so;
-        }
+        _ucl_host_cast_rows(cast_buffer,cast_buffer.cols(),src,cols,rows,
+                            cols);
         ucl_mv_cpy(dst,dst.row_bytes(),cast_buffer,cast_buffer.row_bytes(),
                    cols*sizeof(typename mat1::data_type),rows);
       } else {
-        for (size_t i=0; i<rows*cols; i++)
-          cast_buffer[i]=static_cast<typename mat3::data_type>(src[i]);
+        _ucl_host_cast_rows(cast_buffer,cols,src,cols,rows,cols);
         ucl_mv_cpy(dst,dst.row_bytes(),
                    cast_buffer,cols*sizeof(typename mat1::data_type),
                    cols*sizeof(typename mat1::data_type),rows,cq);
       }
     } else if (mat1::VECTOR) {
-      size_t src_i=0, buf_i=0, soff=src.cols()-cols;
-      for (size_t i=0; i<rows; i++) {
-        for (size_t j=0; j<cols; j++) {
-          cast_buffer[buf_i]=static_cast<typename mat3::data_type>(src[src_i]);
-          buf_i++;
-          src_i++;
-        }
-        src_i+=soff;
-      }
+      _ucl_host_cast_rows(cast_buffer,cols,src,src.cols(),rows,cols);
       ucl_mv_cpy(dst,cast_buffer,cols*sizeof(typename mat1::data_type)*rows,cq);
     } else {
-      size_t src_i=0, buf_i=0, so=src.cols()-cols, co, spitch;
+      size_t cstride, spitch;
       if (mat3::VECTOR==0) {
-        co=cast_buffer.cols()-cols;
+        cstride=cast_buffer.cols();
         spitch=cast_buffer.row_bytes();
       } else {
-        co=0;
+        cstride=cols;
         spitch=cols*sizeof(typename mat1::data_type);
       }
-      for (size_t i=0; i<rows; i++) {
-        for (size_t j=0; j<cols; j++) {
-          cast_buffer[buf_i]=static_cast<typename mat3::data_type>(src[src_i]);
-          buf_i++;
-          src_i++;
-        }
-        src_i+=so;
-        buf_i+=co;
-      }
+      _ucl_host_cast_rows(cast_buffer,cstride,src,src.cols(),rows,cols);
       ucl_mv_cpy(dst,dst.row_bytes(),cast_buffer,spitch,
                  cols*sizeof(typename mat1::data_type),rows,cq);
     }
@@ -517,6 +509,121 @@ template <> struct _ucl_cast_copy<0,0> {
   }
 };
 
+// --------------------------------------------------------------------------
+// - COLUMN-MAJOR AND MIXED ORDER COPY ROUTINES
+// --------------------------------------------------------------------------
+
+// Element (i,j) of the logical rows x cols shape is at i*rs()+j*cs()
+template <int row_major> struct _ucl_order_stride;
+template <> struct _ucl_order_stride<1> {
+  template <class mat_type>
+  static inline size_t rs(const mat_type &mat, const size_t cols)
+    { return mat_type::VECTOR ? cols : mat.row_size(); }
+  template <class mat_type>
+  static inline size_t cs(const mat_type &) { return 1; }
+};
+template <> struct _ucl_order_stride<0> {
+  template <class mat_type>
+  static inline size_t rs(const mat_type &, const size_t)
+    { return 1; }
+  template <class mat_type>
+  static inline size_t cs(const mat_type &mat) { return mat.col_size(); }
+};
+
+// Host matrix type with a given ordering for staging casts
+template <int row_major, class numtyp> struct _ucl_order_host
+  { typedef UCL_H_Mat<numtyp> mat_type; };
+template <class numtyp> struct _ucl_order_host<0,numtyp>
+  { typedef UCL_H_ColMat<numtyp> mat_type; };
+
+// Copies between row-major and column-major containers. There is no
+// definition for two device containers, so those copies fail to compile
+// (use UCL_Transpose with the storage() of the column-major matrix).
+template <int host_t1, int host_t2> struct _ucl_mixed_copy;
+
+// Both on host: reorder (and cast) in tiles
+template <> struct _ucl_mixed_copy<1,1> {
+  template <class mat1, class mat2>
+  static inline void mc(mat1 &dst, const mat2 &src, const size_t rows,
+                        const size_t cols, command_queue &) {
+    const size_t drs=_ucl_order_stride<mat1::ROW_MAJOR>::rs(dst,cols);
+    const size_t dcs=_ucl_order_stride<mat1::ROW_MAJOR>::cs(dst);
+    const size_t srs=_ucl_order_stride<mat2::ROW_MAJOR>::rs(src,cols);
+    const size_t scs=_ucl_order_stride<mat2::ROW_MAJOR>::cs(src);
+    const size_t tile=32;
+    for (size_t i0=0; i0<rows; i0+=tile) {
+      const size_t iend=(i0+tile<rows) ? i0+tile : rows;
+      for (size_t j0=0; j0<cols; j0+=tile) {
+        const size_t jend=(j0+tile<cols) ? j0+tile : cols;
+        for (size_t i=i0; i<iend; i++)
+          for (size_t j=j0; j<jend; j++)
+            dst[i*drs+j*dcs]=
+              static_cast<typename mat1::data_type>(src[i*srs+j*scs]);
+      }
+    }
+  }
+};
+
+// Destination on host: copy the device data in its own order to a host
+// buffer and reorder (and cast) there
+template <> struct _ucl_mixed_copy<1,0> {
+  template <class mat1, class mat2>
+  static inline void mc(mat1 &dst, const mat2 &src, const size_t rows,
+                        const size_t cols, command_queue &cq) {
+    typename _ucl_order_host<mat2::ROW_MAJOR,
+                             typename mat2::data_type>::mat_type buffer;
+    if (buffer.alloc(rows,cols,dst,UCL_READ_ONLY)!=UCL_SUCCESS)
+      return;
+    ucl_copy(buffer,src,rows,cols,cq);
+    ucl_sync(cq);
+    _ucl_mixed_copy<1,1>::mc(dst,buffer,rows,cols,cq);
+  }
+};
+
+// Source on host: reorder (and cast) into a host buffer with the order of
+// the device data and copy it
+template <> struct _ucl_mixed_copy<0,1> {
+  template <class mat1, class mat2>
+  static inline void mc(mat1 &dst, const mat2 &src, const size_t rows,
+                        const size_t cols, command_queue &cq) {
+    typename _ucl_order_host<mat1::ROW_MAJOR,
+                             typename mat1::data_type>::mat_type buffer;
+    if (buffer.alloc(rows,cols,dst,UCL_WRITE_ONLY)!=UCL_SUCCESS)
+      return;
+    _ucl_mixed_copy<1,1>::mc(buffer,src,rows,cols,cq);
+    ucl_copy(dst,buffer,rows,cols,cq);
+    // The staging buffer is freed on return
+    ucl_sync(cq);
+  }
+};
+
+// Dispatch on the ordering of the two containers
+template <int row_major1, int row_major2> struct _ucl_order_copy {
+  template <class mat1, class mat2>
+  static inline void oc(mat1 &dst, const mat2 &src, const size_t rows,
+                        const size_t cols, command_queue &cq) {
+    _ucl_mixed_copy<mat1::MEM_TYPE,mat2::MEM_TYPE>::mc(dst,src,rows,cols,cq);
+  }
+};
+
+// Both column-major: copy the transposed storage
+template <> struct _ucl_order_copy<0,0> {
+  template <class mat1, class mat2>
+  static inline void oc(mat1 &dst, const mat2 &src, const size_t rows,
+                        const size_t cols, command_queue &cq) {
+    ucl_copy(dst.storage(),src.storage(),cols,rows,cq);
+  }
+};
+
+// Both row-major: should never be here
+template <> struct _ucl_order_copy<1,1> {
+  template <class mat1, class mat2>
+  static inline void oc(mat1 &, const mat2 &, const size_t, const size_t,
+                        command_queue &) {
+    assert(0==1);
+  }
+};
+
 // --------------------------------------------------------------------------
 // - 1D COPY - SPECIFIED NUMBER OF BYTES
 // --------------------------------------------------------------------------
@@ -533,9 +640,9 @@ inline void ucl_cast_copy(mat1 &dst, const mat2 &src, const size_t numel,
   #ifdef UCL_DEBUG
   assert(dst.numel()>=numel && src.numel()>=numel);
   assert(cast_buffer.numel()>=numel);
-  assert(mat1::ROW_MAJOR==1 && mat2::ROW_MAJOR==1);
+  assert(mat1::ROW_MAJOR==mat2::ROW_MAJOR || mat1::VECTOR || mat2::VECTOR);
   #endif
-  if ((int)mat1::DATA_TYPE==(int)mat2::DATA_TYPE)
+  if (_ucl_same_data<mat1,mat2>::ans)
     ucl_copy(dst,src,numel,cq);
   else {
     #ifdef UCL_DEBUG
@@ -559,10 +666,10 @@ inline void ucl_cast_copy(mat1 &dst, const mat2 &src, const size_t numel,
   #ifdef UCL_DEBUG
   assert(dst.numel()>=numel && src.numel()>=numel);
   assert(cast_buffer.numel()>=numel);
-  assert(mat1::ROW_MAJOR==1 && mat2::ROW_MAJOR==1);
+  assert(mat1::ROW_MAJOR==mat2::ROW_MAJOR || mat1::VECTOR || mat2::VECTOR);
   _check_ucl_copy_perm(dst,src);
   #endif
-  if ((int)mat1::DATA_TYPE==(int)mat2::DATA_TYPE)
+  if (_ucl_same_data<mat1,mat2>::ans)
     ucl_copy(dst,src,numel,async);
   else if (async)
     _ucl_cast_copy<mat1::MEM_TYPE,mat2::MEM_TYPE>::cc(dst,src,numel,
@@ -587,13 +694,12 @@ inline void ucl_copy(mat1 &dst, const mat2 &src, const size_t numel,
                      command_queue &cq) {
   #ifdef UCL_DEBUG
   assert(dst.row_size()*dst.rows()>=numel && src.row_size()*src.rows()>=numel);
-  assert(mat1::ROW_MAJOR==1 && mat2::ROW_MAJOR==1);
-  assert(mat1::ROW_MAJOR==1 && mat2::ROW_MAJOR==1);
+  assert(mat1::ROW_MAJOR==mat2::ROW_MAJOR || mat1::VECTOR || mat2::VECTOR);
   _check_ucl_copy_perm(dst,src);
   #endif
   if (mat1::MEM_TYPE==1 && mat2::MEM_TYPE==1)
     _host_host_copy<mat1::MEM_TYPE,mat2::MEM_TYPE>::hhc(dst,src,numel);
-  else if ((int)mat1::DATA_TYPE!=(int)mat2::DATA_TYPE &&
+  else if (!_ucl_same_data<mat1,mat2>::ans &&
       (mat1::MEM_TYPE==1 || mat2::MEM_TYPE==1)) {
     if (mat1::MEM_TYPE==1) {
       UCL_H_Vec<typename mat2::data_type> cast_buffer;
@@ -627,14 +733,14 @@ inline void ucl_copy(mat1 &dst, const mat2 &src, const size_t numel,
                      const bool async) {
   #ifdef UCL_DEBUG
   assert(dst.row_size()*dst.rows()>=numel && src.row_size()*src.rows()>=numel);
-  assert(mat1::ROW_MAJOR==1 && mat2::ROW_MAJOR==1);
+  assert(mat1::ROW_MAJOR==mat2::ROW_MAJOR || mat1::VECTOR || mat2::VECTOR);
   _check_ucl_copy_perm(dst,src);
   #endif
   if (mat1::MEM_TYPE==1 && mat2::MEM_TYPE==1)
     _host_host_copy<mat1::MEM_TYPE,mat2::MEM_TYPE>::hhc(dst,src,numel);
   else if (async)
     ucl_copy(dst,src,numel,dst.cq());
-  else if ((int)mat1::DATA_TYPE!=(int)mat2::DATA_TYPE &&
+  else if (!_ucl_same_data<mat1,mat2>::ans &&
            (mat1::MEM_TYPE==1 || mat2::MEM_TYPE==1)) {
     if (mat1::MEM_TYPE==1) {
       UCL_H_Vec<typename mat2::data_type> cast_buffer;
@@ -670,7 +776,8 @@ template <class mat1, class mat2, class mat3>
 inline void ucl_cast_copy(mat1 &dst, const mat2 &src, const size_t rows,
                           const size_t cols, mat3 &cast_buffer,
                           const bool async) {
-  if ((int)mat1::DATA_TYPE==(int)mat2::DATA_TYPE)
+  if (_ucl_same_data<mat1,mat2>::ans ||
+      mat1::ROW_MAJOR==0 || mat2::ROW_MAJOR==0)
     ucl_copy(dst,src,rows,cols,async);
   else if (async)
     ucl_copy(dst,src,rows,cols,dst.cq());
@@ -697,7 +804,8 @@ template <class mat1, class mat2, class mat3>
 inline void ucl_cast_copy(mat1 &dst, const mat2 &src, const size_t rows,
                           const size_t cols, mat3 &cast_buffer,
                           command_queue &cq) {
-  if ((int)mat1::DATA_TYPE==(int)mat2::DATA_TYPE)
+  if (_ucl_same_data<mat1,mat2>::ans ||
+      mat1::ROW_MAJOR==0 || mat2::ROW_MAJOR==0)
     ucl_copy(dst,src,rows,cols,cq);
   else {
     #ifdef UCL_DEBUG
@@ -728,9 +836,12 @@ inline void ucl_copy(mat1 &dst, const mat2 &src, const size_t rows,
   #ifdef UCL_DEBUG
   _check_ucl_copy_perm(dst,src);
   #endif
-  if (mat1::MEM_TYPE==1 && mat2::MEM_TYPE==1)
+  if (mat1::ROW_MAJOR==0 || mat2::ROW_MAJOR==0)
+    _ucl_order_copy<mat1::ROW_MAJOR,mat2::ROW_MAJOR>::oc(dst,src,rows,cols,
+                                                         cq);
+  else if (mat1::MEM_TYPE==1 && mat2::MEM_TYPE==1)
     _host_host_copy<mat1::MEM_TYPE,mat2::MEM_TYPE>::hhc(dst,src,rows,cols);
-  else if ((int)mat1::DATA_TYPE!=(int)mat2::DATA_TYPE &&
+  else if (!_ucl_same_data<mat1,mat2>::ans &&
            (mat1::MEM_TYPE==1 || mat2::MEM_TYPE==1)) {
     if (mat1::MEM_TYPE==1) {
       UCL_H_Vec<typename mat2::data_type> cast_buffer;
@@ -794,9 +905,13 @@ inline void ucl_copy(mat1 &dst, const mat2 &src, const size_t rows,
   #endif
   if (async)
     ucl_copy(dst,src,rows,cols,dst.cq());
-  else if (mat1::MEM_TYPE==1 && mat2::MEM_TYPE==1)
+  else if (mat1::ROW_MAJOR==0 || mat2::ROW_MAJOR==0) {
+    _ucl_order_copy<mat1::ROW_MAJOR,mat2::ROW_MAJOR>::oc(dst,src,rows,cols,
+                                                         dst.cq());
+    dst.sync();
+  } else if (mat1::MEM_TYPE==1 && mat2::MEM_TYPE==1)
     _host_host_copy<mat1::MEM_TYPE,mat2::MEM_TYPE>::hhc(dst,src,rows,cols);
-  else if ((int)mat1::DATA_TYPE!=(int)mat2::DATA_TYPE &&
+  else if (!_ucl_same_data<mat1,mat2>::ans &&
            (mat1::MEM_TYPE==1 || mat2::MEM_TYPE==1)) {
     if (mat1::MEM_TYPE==1) {
       UCL_H_Vec<typename mat2::data_type> cast_buffer;
@@ -852,7 +967,7 @@ inline void ucl_copy(mat1 &dst, const mat2 &src, const size_t rows,
 template <class mat1, class mat2, class mat3>
 inline void ucl_cast_copy(mat1 &dst, const mat2 &src,
                           mat3 &cast_buffer, const bool async) {
-  if ((int)mat1::DATA_TYPE==(int)mat2::DATA_TYPE)
+  if (_ucl_same_data<mat1,mat2>::ans)
     ucl_copy(dst,src,async);
   else if (mat2::PADDED==1 || (mat1::PADDED==1 && mat2::VECTOR==0) )
     ucl_cast_copy(dst,src,src.rows(),src.cols(),cast_buffer,async);
@@ -872,14 +987,14 @@ inline void ucl_cast_copy(mat1 &dst, const mat2 &src,
 template <class mat1, class mat2, class mat3>
 inline void ucl_cast_copy(mat1 &dst, const mat2 &src,
                           mat3 &cast_buffer, command_queue &cq) {
-  if ((int)mat1::DATA_TYPE==(int)mat2::DATA_TYPE)
+  if (_ucl_same_data<mat1,mat2>::ans)
     ucl_copy(dst,src,cq);
   else if (mat2::PADDED==1 || (mat1::PADDED==1 && mat2::VECTOR==0) )
-    ucl_copy(dst,src,src.rows(),src.cols(),cast_buffer,cq);
+    ucl_cast_copy(dst,src,src.rows(),src.cols(),cast_buffer,cq);
   else if (mat1::PADDED==1)
-    ucl_copy(dst,src,dst.rows(),dst.cols(),cast_buffer,cq);
+    ucl_cast_copy(dst,src,dst.rows(),dst.cols(),cast_buffer,cq);
   else
-    ucl_copy(dst,src,src.numel(),cast_buffer,cq);
+    ucl_cast_copy(dst,src,src.numel(),cast_buffer,cq);
 }
 
 /// Asynchronous copy of matrix/vector (memory already allocated)
@@ -895,9 +1010,14 @@ inline void ucl_cast_copy(mat1 &dst, const mat2 &src,
   * - Currently does not handle textures **/
 template <class mat1, class mat2>
 inline void ucl_copy(mat1 &dst, const mat2 &src, command_queue &cq) {
-  if (dst.row_bytes()==src.row_bytes() &&
+  if (mat1::ROW_MAJOR==0 || mat2::ROW_MAJOR==0) {
+    if (mat2::VECTOR)
+      ucl_copy(dst,src,dst.rows(),dst.cols(),cq);
+    else
+      ucl_copy(dst,src,src.rows(),src.cols(),cq);
+  } else if (dst.row_bytes()==src.row_bytes() &&
       src.kind()!=UCL_VIEW && dst.kind()!=UCL_VIEW &&
-      (int)mat1::DATA_TYPE==(int)mat2::DATA_TYPE)
+      _ucl_same_data<mat1,mat2>::ans)
     ucl_copy(dst,src,src.row_size()*src.rows(),cq);
   else if (mat2::PADDED==1 || (mat1::PADDED==1 && mat2::VECTOR==0) )
     ucl_copy(dst,src,src.rows(),src.cols(),cq);
@@ -924,9 +1044,14 @@ template <class mat1, class mat2>
 inline void ucl_copy(mat1 &dst, const mat2 &src, const bool async) {
   if (async)
     ucl_copy(dst,src,dst.cq());
-  else if (dst.row_bytes()==src.row_bytes() &&
+  else if (mat1::ROW_MAJOR==0 || mat2::ROW_MAJOR==0) {
+    if (mat2::VECTOR)
+      ucl_copy(dst,src,dst.rows(),dst.cols(),async);
+    else
+      ucl_copy(dst,src,src.rows(),src.cols(),async);
+  } else if (dst.row_bytes()==src.row_bytes() &&
            src.kind()!=UCL_VIEW && dst.kind()!=UCL_VIEW &&
-           (int)mat1::DATA_TYPE==(int)mat2::DATA_TYPE)
+           _ucl_same_data<mat1,mat2>::ans)
     ucl_copy(dst,src,src.row_size()*src.rows(),async);
   else if (mat2::PADDED==1 || (mat1::PADDED==1 && mat2::VECTOR==0) )
     ucl_copy(dst,src,src.rows(),src.cols(),async);
@@ -936,5 +1061,256 @@ inline void ucl_copy(mat1 &dst, const mat2 &src, const bool async) {
     ucl_copy(dst,src,src.numel(),async);
 }
 
-#endif
+// --------------------------------------------------------------------------
+// - 2D COPY - BLOCK AT THE SAME OFFSET IN BOTH CONTAINERS
+// --------------------------------------------------------------------------
+
+// Helper functions for casting blocks
+template <int host_type1> struct _ucl_cast_block;
 
+// Destination is on host
+template <> struct _ucl_cast_block<1> {
+  template <class mat1, class mat2, class mat3>
+  static inline void cc(mat1 &dst, const mat2 &src, const size_t row,
+                        const size_t col, const size_t rows,
+                        const size_t cols, mat3 &cast_buffer,
+                        command_queue &cq) {
+    ucl_copy_block(cast_buffer,src,row,col,rows,cols,cq);
+    ucl_sync(cq);
+    const size_t stride=dst.row_size();
+    for (size_t i=row; i<row+rows; i++)
+      _ucl_host_cast<typename mat1::data_type,typename mat3::data_type>::
+        cast(&dst[i*stride+col],&cast_buffer[i*stride+col],cols);
+  }
+};
+
+// Destination is on device
+template <> struct _ucl_cast_block<0> {
+  template <class mat1, class mat2, class mat3>
+  static inline void cc(mat1 &dst, const mat2 &src, const size_t row,
+                        const size_t col, const size_t rows,
+                        const size_t cols, mat3 &cast_buffer,
+                        command_queue &cq) {
+    const size_t stride=src.row_size();
+    for (size_t i=row; i<row+rows; i++)
+      _ucl_host_cast<typename mat3::data_type,typename mat2::data_type>::
+        cast(&cast_buffer[i*stride+col],&src[i*stride+col],cols);
+    ucl_copy_block(dst,cast_buffer,row,col,rows,cols,cq);
+  }
+};
+
+/// Asynchronous copy of a block at the same position in dst and src
+/** \param row First row of the block (0 for vectors)
+  * \param col First column of the block (first element for vectors)
+  * \param rows Number of rows in the block (1 for vectors)
+  * \param cols Number of columns in the block
+  * - The data types of the two containers must be the same
+  * - One transfer is used with byte offsets for the block, so elements
+  *   before the block are not copied
+  * - Currently does not handle textures **/
+template <class mat1, class mat2>
+inline void ucl_copy_block(mat1 &dst, const mat2 &src, const size_t row,
+                           const size_t col, const size_t rows,
+                           const size_t cols, command_queue &cq) {
+  assert((_ucl_same_data<mat1,mat2>::ans));
+  #ifdef UCL_DEBUG
+  assert(mat1::ROW_MAJOR==1 && mat2::ROW_MAJOR==1);
+  assert(row+rows<=dst.rows() && row+rows<=src.rows());
+  assert(col+cols<=dst.cols() && col+cols<=src.cols());
+  #endif
+  if (rows==0 || cols==0)
+    return;
+  const size_t es=sizeof(typename mat1::data_type);
+  if (rows==1)
+    ucl_mv_cpy(dst,row*dst.row_bytes()+col*es,cols*es,src,
+               row*src.row_bytes()+col*es,cols*es,cols*es,1,cq);
+  else
+    ucl_mv_cpy(dst,row*dst.row_bytes()+col*es,dst.row_bytes(),src,
+               row*src.row_bytes()+col*es,src.row_bytes(),cols*es,rows,cq);
+}
+
+/// Asynchronous copy of a block at the same position with cast
+/** \param cast_buffer Host container with the shape of the host container
+  *                    and the data type of the device container
+  * - If the data types for the two containers are same, no cast performed
+  * - Copies from the device block until the transfer is complete, so that
+  *   the cast can be performed
+  * \sa ucl_copy_block() **/
+template <class mat1, class mat2, class mat3>
+inline void ucl_cast_copy_block(mat1 &dst, const mat2 &src, const size_t row,
+                                const size_t col, const size_t rows,
+                                const size_t cols, mat3 &cast_buffer,
+                                command_queue &cq) {
+  if (_ucl_same_data<mat1,mat2>::ans)
+    ucl_copy_block(dst,src,row,col,rows,cols,cq);
+  else {
+    #ifdef UCL_DEBUG
+    _check_ucl_copy_perm(dst,src);
+    #endif
+    _ucl_cast_block<mat1::MEM_TYPE>::cc(dst,src,row,col,rows,cols,
+                                        cast_buffer,cq);
+  }
+}
+
+// --------------------------------------------------------------------------
+// - COPY OF MARKED RANGES (UCL_DirtyRanges)
+// --------------------------------------------------------------------------
+
+// Convert range r to units of cols elements, skipping units already copied
+/** \param next First unit that has not been copied (updated)
+  * \return false if the range has already been copied **/
+inline bool _ucl_range_units(const UCL_DirtyRanges &ranges, const size_t r,
+                             const size_t cols, size_t &next, size_t &first,
+                             size_t &count) {
+  first=ranges.begin(r)/cols;
+  const size_t last=(ranges.end(r)+cols-1)/cols;
+  if (first<next)
+    first=next;
+  if (first>=last)
+    return false;
+  count=last-first;
+  next=last;
+  return true;
+}
+
+// Helper functions for casting ranges
+template <int host_type1> struct _ucl_cast_ranges;
+
+// Destination is on host
+template <> struct _ucl_cast_ranges<1> {
+  template <class mat1, class mat2, class mat3>
+  static inline void cc(mat1 &dst, const mat2 &src,
+                        const UCL_DirtyRanges &ranges, const size_t cols,
+                        mat3 &cast_buffer, command_queue &cq) {
+    ucl_copy(cast_buffer,src,ranges,cq);
+    ucl_sync(cq);
+    size_t next=0, first, count;
+    for (size_t r=0; r<ranges.size(); r++)
+      if (_ucl_range_units(ranges,r,cols,next,first,count))
+        _ucl_host_cast<typename mat1::data_type,typename mat3::data_type>::
+          cast(&dst[first*cols],&cast_buffer[first*cols],count*cols);
+  }
+};
+
+// Destination is on device
+template <> struct _ucl_cast_ranges<0> {
+  template <class mat1, class mat2, class mat3>
+  static inline void cc(mat1 &dst, const mat2 &src,
+                        const UCL_DirtyRanges &ranges, const size_t cols,
+                        mat3 &cast_buffer, command_queue &cq) {
+    size_t next=0, first, count;
+    for (size_t r=0; r<ranges.size(); r++)
+      if (_ucl_range_units(ranges,r,cols,next,first,count))
+        _ucl_host_cast<typename mat3::data_type,typename mat2::data_type>::
+          cast(&cast_buffer[first*cols],&src[first*cols],count*cols);
+    ucl_copy(dst,cast_buffer,ranges,cq);
+  }
+};
+
+/// Asynchronous copy of the elements marked in ranges (Device/Host transfer)
+/** \param ranges Element ranges; indices are as for operator[] of the host
+  *               container
+  * - The data types of the two containers must be the same
+  * - Each range of a vector is copied with one transfer
+  * - Ranges in matrices are extended to whole rows and each set of
+  *   consecutive rows is copied with one 2D transfer
+  * - Host matrices must not be padded
+  * - Currently does not handle textures **/
+template <class mat1, class mat2>
+inline void ucl_copy(mat1 &dst, const mat2 &src,
+                     const UCL_DirtyRanges &ranges, command_queue &cq) {
+  assert((_ucl_same_data<mat1,mat2>::ans));
+  #ifdef UCL_DEBUG
+  assert(mat1::ROW_MAJOR==1 && mat2::ROW_MAJOR==1);
+  assert(mat1::VECTOR==mat2::VECTOR && dst.cols()==src.cols());
+  assert(ranges.empty() || ranges.end(ranges.size()-1)<=src.numel());
+  #endif
+  const size_t es=sizeof(typename mat1::data_type);
+  size_t next=0, first, count;
+  if (mat1::VECTOR) {
+    for (size_t r=0; r<ranges.size(); r++)
+      if (_ucl_range_units(ranges,r,1,next,first,count))
+        ucl_mv_cpy(dst,first*es,count*es,src,first*es,count*es,count*es,1,
+                   cq);
+  } else {
+    const size_t cols=src.cols();
+    for (size_t r=0; r<ranges.size(); r++)
+      if (_ucl_range_units(ranges,r,cols,next,first,count))
+        ucl_mv_cpy(dst,first*dst.row_bytes(),dst.row_bytes(),src,
+                   first*src.row_bytes(),src.row_bytes(),cols*es,count,cq);
+  }
+}
+
+/// Asynchronous copy of the elements marked in ranges with cast
+/** \param ranges Element ranges; indices are as for operator[] of the host
+  *               container
+  * \param cast_buffer Host container with the shape of the host container
+  *                    and the data type of the device container
+  * - If the data types for the two containers are same, no cast performed
+  * - Copies from the device block until the transfer is complete, so that
+  *   the cast can be performed
+  * - Ranges in matrices are extended to whole rows
+  * - Currently does not handle textures **/
+template <class mat1, class mat2, class mat3>
+inline void ucl_cast_copy(mat1 &dst, const mat2 &src,
+                          const UCL_DirtyRanges &ranges, mat3 &cast_buffer,
+                          command_queue &cq) {
+  if (_ucl_same_data<mat1,mat2>::ans)
+    ucl_copy(dst,src,ranges,cq);
+  else {
+    #ifdef UCL_DEBUG
+    _check_ucl_copy_perm(dst,src);
+    #endif
+    _ucl_cast_ranges<mat1::MEM_TYPE>::cc(dst,src,ranges,
+                                         mat1::VECTOR ? 1 : src.cols(),
+                                         cast_buffer,cq);
+  }
+}
+
+// --------------------------------------------------------------------------
+// - UPLOADS SKIPPED WHEN THE HOST DATA IS UNCHANGED (UCL_UploadHash)
+// --------------------------------------------------------------------------
+
+/// True if the data in host container src matches the last upload in hash
+/** A match is counted by hash and by the memory tracker for dst;
+  * otherwise the hash of src is recorded as the last upload.
+  * - The hash covers all of src (including any padding)
+  * - Use one UCL_UploadHash for each destination buffer **/
+template <class mat1, class mat2>
+inline bool ucl_upload_unchanged(mat1 &dst, const mat2 &src,
+                                 UCL_UploadHash &hash) {
+  assert(mat2::MEM_TYPE==1);
+  const size_t bytes=src.numel()*sizeof(typename mat1::data_type);
+  if (!hash.unchanged(ucl_hash64(src.begin(),src.row_bytes()*src.rows()),
+                      bytes))
+    return false;
+  UCL_MemTracker *tracker=_ucl_mem_tracker(dst);
+  if (tracker!=NULL)
+    tracker->count_skipped_upload(bytes);
+  return true;
+}
+
+/// Asynchronous upload that is skipped if src has not changed
+/** \param hash Hash of the last upload to dst (updated)
+  * - Otherwise the same as ucl_copy(dst,src,cq)
+  * - Call hash.invalidate() if dst is modified on the device **/
+template <class mat1, class mat2>
+inline void ucl_copy(mat1 &dst, const mat2 &src, UCL_UploadHash &hash,
+                     command_queue &cq) {
+  if (!ucl_upload_unchanged(dst,src,hash))
+    ucl_copy(dst,src,cq);
+}
+
+/// Upload that is skipped if src has not changed
+/** \param hash Hash of the last upload to dst (updated)
+  * \param async Perform non-blocking copy on default stream
+  * - Otherwise the same as ucl_copy(dst,src,async)
+  * - Call hash.invalidate() if dst is modified on the device **/
+template <class mat1, class mat2>
+inline void ucl_copy(mat1 &dst, const mat2 &src, UCL_UploadHash &hash,
+                     const bool async) {
+  if (!ucl_upload_unchanged(dst,src,hash))
+    ucl_copy(dst,src,async);
+}
+
+#endif
@@ -0,0 +1,148 @@
+/***************************************************************************
+                                ucl_d_colmat.h
+                             -------------------
+
+  Column-major Matrix Container on Device
+
+ __________________________________________________________________________
+    This file is part of the Geryon Unified Coprocessor Library (UCL)
+ __________________________________________________________________________
+
+ ***************************************************************************/
+
+/* -----------------------------------------------------------------------
+   Copyright (2009) Sandia Corporation.  Under the terms of Contract
+   DE-AC04-94AL85000 with Sandia Corporation, the U.S. Government retains
+   certain rights in this software.  This software is distributed under
+   the Simplified BSD License.
+   ----------------------------------------------------------------------- */
+
+// Only allow this file to be included by CUDA and OpenCL specific headers
+#ifdef _UCL_MAT_ALLOW
+
+/// Column-major matrix on device (columns can be padded for alignment)
+/** A rows x cols column-major matrix is stored as a row-major cols x rows
+  * UCL_D_Mat, returned by storage(), so the pitch applies to columns.
+  * UCL_D_ColMat(row,col) is given by array[col*col_size()+row].
+  * - rows() and cols() use the column-major shape
+  * - Other members inherited from the storage (row_size(), row_bytes(),
+  *   view_offset(), ...) refer to the transposed storage
+  * - Kernels receive the storage; coalesced access uses adjacent rows in
+  *   the same column
+  * - ucl_copy() to or from a row-major host container reorders the data
+  *   on the host. Copies to or from a row-major device container use
+  *   UCL_Transpose with the storage (ucl_copy() does not compile for
+  *   them). **/
+template <class numtyp>
+class UCL_D_ColMat : public UCL_D_Mat<numtyp> {
+ public:
+  // Traits for copying data
+  // MEM_TYPE is 0 for device, 1 for host, and 2 for image
+  enum traits {
+    DATA_TYPE = _UCL_DATA_ID<numtyp>::id,
+    MEM_TYPE = 0,
+    PADDED = 1,
+    ROW_MAJOR = 0,
+    VECTOR = 0
+  };
+  typedef numtyp data_type;
+  typedef UCL_D_Mat<numtyp> storage_type;
+
+  UCL_D_ColMat() {}
+
+  /// Construct with specified rows and cols
+  /** \sa alloc() **/
+  UCL_D_ColMat(const size_t rows, const size_t cols, UCL_Device &device,
+               const enum UCL_MEMOPT kind=UCL_READ_WRITE)
+    { alloc(rows,cols,device,kind); }
+
+  /// Column major matrix on device
+  /** \param cq Default command queue for operations copied from another mat
+    * \sa UCL_D_Mat::alloc()
+    * \return UCL_SUCCESS if the memory allocation is successful **/
+  template <class mat_type>
+  inline int alloc(const size_t rows, const size_t cols, mat_type &cq,
+                   const enum UCL_MEMOPT kind=UCL_READ_WRITE)
+    { return storage_type::alloc(cols,rows,cq,kind); }
+
+  /// Column major matrix on device
+  /** \param device Used to get the default command queue for operations
+    * \sa UCL_D_Mat::alloc()
+    * \return UCL_SUCCESS if the memory allocation is successful **/
+  inline int alloc(const size_t rows, const size_t cols, UCL_Device &device,
+                   const enum UCL_MEMOPT kind=UCL_READ_WRITE)
+    { return storage_type::alloc(cols,rows,device,kind); }
+
+  /// Do not allocate memory, instead use an existing allocation from Geryon
+  /** This function must be passed a Geryon vector or matrix container.
+    * No memory is freed when the object is destructed.
+    * - The view does not prevent the memory from being freed by the
+    *   allocating container when using CUDA APIs
+    * \param stride Number of _elements_ between the start of each column **/
+  template <class ucl_type>
+  inline void view(ucl_type &input, const size_t rows, const size_t cols,
+                   const size_t stride)
+    { storage_type::view(input,cols,rows,stride); }
+
+  /// Do not allocate memory, instead use an existing allocation from Geryon
+  /** This function must be passed a Geryon vector or matrix container.
+    * No memory is freed when the object is destructed.
+    * - The view does not prevent the memory from being freed by the
+    *   allocating container when using CUDA APIs **/
+  template <class ucl_type>
+  inline void view(ucl_type &input, const size_t rows, const size_t cols)
+    { view(input,rows,cols,input.row_size()); }
+
+  /// Do not allocate memory, instead use an existing allocation from Geryon
+  /** This function must be passed a Geryon vector or matrix container.
+    * No memory is freed when the object is destructed.
+    * - The view does not prevent the memory from being freed by the
+    *   allocating container when using CUDA APIs **/
+  template <class ucl_type>
+  inline void view(ucl_type &input)
+    { view(input,input.rows(),input.cols()); }
+
+  /// Do not allocate memory, instead use an existing allocation
+  /** - No memory is freed when the object is destructed.
+    * - The view does not prevent the memory from being freed by the
+    *   allocating container when using CUDA APIs
+    * \param stride Number of _elements_ between the start of each column **/
+  template <class ptr_type>
+  inline void view(ptr_type input, const size_t rows, const size_t cols,
+                   const size_t stride, UCL_Device &dev)
+    { storage_type::view(input,cols,rows,stride,dev); }
+
+  /// Do not allocate memory, instead use an existing allocation
+  /** - No memory is freed when the object is destructed.
+    * - The view does not prevent the memory from being freed by the
+    *   allocating container when using CUDA APIs **/
+  template <class ptr_type>
+  inline void view(ptr_type input, const size_t rows, const size_t cols,
+                   UCL_Device &dev) { view(input,rows,cols,rows,dev); }
+
+  /// Resize the allocation to contain rows x cols elements
+  /** \note Cannot be used on views **/
+  inline int resize(const int rows, const int cols)
+    { return storage_type::resize(cols,rows); }
+
+  /// Resize (only if bigger) the allocation to contain rows x cols elements
+  /** \note Cannot be used on views **/
+  inline int resize_ib(const int rows, const int cols)
+    { return storage_type::resize_ib(cols,rows); }
+
+  /// Get the number of rows
+  inline size_t rows() const { return storage_type::cols(); }
+  /// Get the number of columns
+  inline size_t cols() const { return storage_type::rows(); }
+  /// Get the size of a column (including any padding) in elements
+  inline size_t col_size() const { return storage_type::row_size(); }
+  /// Get the size of a column (including any padding) in bytes
+  inline size_t col_bytes() const { return storage_type::row_bytes(); }
+
+  /// Row-major cols x rows storage for the matrix
+  inline storage_type & storage() { return *this; }
+  /// Row-major cols x rows storage for the matrix
+  inline const storage_type & storage() const { return *this; }
+};
+
+#endif
@@ -0,0 +1,130 @@
+/***************************************************************************
+                                 ucl_dirty.h
+                             -------------------
+
+  Coalesced element ranges for partial host/device updates
+
+ __________________________________________________________________________
+    This file is part of the Geryon Unified Coprocessor Library (UCL)
+ __________________________________________________________________________
+
+ ***************************************************************************/
+
+/* -----------------------------------------------------------------------
+   Copyright (2010) Sandia Corporation.  Under the terms of Contract
+   DE-AC04-94AL85000 with Sandia Corporation, the U.S. Government retains
+   certain rights in this software.  This software is distributed under
+   the Simplified BSD License.
+   ----------------------------------------------------------------------- */
+
+/***************************************************************************
+   UCL_DirtyRanges records which elements of a container were modified as a
+   sorted list of disjoint [begin,end) intervals. Overlapping and adjacent
+   intervals are merged when added, as are intervals separated by no more
+   than gap() elements; sending a few clean elements is usually cheaper
+   than starting another transfer. When there are more than max_ranges()
+   intervals, the two closest ones are merged, so the number of transfers
+   is bounded.
+
+   UCL_Vector and UCL_Matrix keep one list for each direction when dirty
+   tracking is on (see track_dirty()):
+
+     atoms.track_dirty(true);
+     atoms[i]=x; atoms.mark_dirty(i,1);
+     atoms.update_device();             // only the marked ranges are sent
+ ***************************************************************************/
+
+// Only allow this file to be included by CUDA and OpenCL specific headers
+#ifdef _UCL_MAT_ALLOW
+
+/// Sorted set of disjoint element ranges
+class UCL_DirtyRanges {
+ public:
+  UCL_DirtyRanges() : _gap(0), _max_ranges(64) {}
+
+  /// Mark the n elements starting at i
+  inline void add(const size_t i, const size_t n) {
+    if (n==0)
+      return;
+    size_t lo=i, hi=i+n;
+
+    // First range that could touch [lo,hi)
+    size_t first=0, last=_ranges.size();
+    while (first<last) {
+      const size_t mid=(first+last)/2;
+      if (_ranges[mid].second+_gap<lo)
+        first=mid+1;
+      else
+        last=mid;
+    }
+    last=first;
+    while (last<_ranges.size() && _ranges[last].first<=hi+_gap) {
+      if (_ranges[last].first<lo)
+        lo=_ranges[last].first;
+      if (_ranges[last].second>hi)
+        hi=_ranges[last].second;
+      last++;
+    }
+    if (first==last)
+      _ranges.insert(_ranges.begin()+first,std::make_pair(lo,hi));
+    else {
+      _ranges[first]=std::make_pair(lo,hi);
+      _ranges.erase(_ranges.begin()+first+1,_ranges.begin()+last);
+    }
+
+    while (_ranges.size()>_max_ranges)
+      _merge_closest();
+  }
+
+  /// Remove all ranges
+  inline void clear() { _ranges.clear(); }
+
+  /// True if no elements are marked
+  inline bool empty() const { return _ranges.empty(); }
+  /// Number of ranges
+  inline size_t size() const { return _ranges.size(); }
+  /// First element in range r
+  inline size_t begin(const size_t r) const { return _ranges[r].first; }
+  /// One past the last element in range r
+  inline size_t end(const size_t r) const { return _ranges[r].second; }
+
+  /// Number of elements in all ranges
+  inline size_t elements() const {
+    size_t n=0;
+    for (size_t r=0; r<_ranges.size(); r++)
+      n+=_ranges[r].second-_ranges[r].first;
+    return n;
+  }
+
+  /// Ranges separated by at most this many elements are merged
+  inline size_t gap() const { return _gap; }
+  /// Set the number of elements between ranges that are merged
+  /** Only applies to ranges added afterwards **/
+  inline void gap(const size_t g) { _gap=g; }
+
+  /// Maximum number of ranges kept
+  inline size_t max_ranges() const { return _max_ranges; }
+  /// Set the maximum number of ranges kept (at least 1)
+  inline void max_ranges(const size_t n) {
+    _max_ranges=(n>0) ? n : 1;
+    while (_ranges.size()>_max_ranges)
+      _merge_closest();
+  }
+
+ private:
+  std::vector<std::pair<size_t,size_t> > _ranges;
+  size_t _gap, _max_ranges;
+
+  // Merge the two neighboring ranges with the fewest elements between them
+  inline void _merge_closest() {
+    size_t best=0;
+    for (size_t r=1; r+1<_ranges.size(); r++)
+      if (_ranges[r+1].first-_ranges[r].second<
+          _ranges[best+1].first-_ranges[best].second)
+        best=r;
+    _ranges[best].second=_ranges[best+1].second;
+    _ranges.erase(_ranges.begin()+best+1);
+  }
+};
+
+#endif
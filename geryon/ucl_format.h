@@ -0,0 +1,138 @@
+/***************************************************************************
+                                 ucl_format.h
+                             -------------------
+
+  Conversion of numbers to text without iostreams
+
+ __________________________________________________________________________
+    This file is part of the Geryon Unified Coprocessor Library (UCL)
+ __________________________________________________________________________
+
+ ***************************************************************************/
+
+/* -----------------------------------------------------------------------
+   Copyright (2010) Sandia Corporation.  Under the terms of Contract
+   DE-AC04-94AL85000 with Sandia Corporation, the U.S. Government retains
+   certain rights in this software.  This software is distributed under
+   the Simplified BSD License.
+   ----------------------------------------------------------------------- */
+
+/***************************************************************************
+   _ucl_format<numtyp>::f(p,x,precision) writes x to the character buffer
+   p and returns the number of characters written. The text is the same as
+   operator<< with the default stream flags and the given precision. At
+   most UCL_FORMAT_MAX characters are written; no terminator is added.
+
+   Integers are converted directly. Floating point numbers use
+   std::to_chars when the standard library provides it (C++17) and
+   snprintf otherwise. Other types are formatted with an ostringstream.
+   These are used by ucl_dump() (ucl_print.h).
+ ***************************************************************************/
+
+#ifndef UCL_FORMAT_H
+#define UCL_FORMAT_H
+
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <sstream>
+#include "ucl_half.h"
+
+#if __cplusplus >= 201703L
+#include <charconv>
+#endif
+
+#if defined(__cpp_lib_to_chars) && __cpp_lib_to_chars >= 201611L
+#define _UCL_TO_CHARS
+#endif
+
+/// Maximum number of characters written for one number
+#define UCL_FORMAT_MAX 64
+
+template <class numtyp> struct _ucl_format {
+  static inline size_t f(char *p, const numtyp &x, const int precision) {
+    std::ostringstream s;
+    s.precision(precision);
+    s << x;
+    const std::string t=s.str();
+    const size_t n=(t.size()<UCL_FORMAT_MAX) ? t.size() : UCL_FORMAT_MAX;
+    memcpy(p,t.data(),n);
+    return n;
+  }
+};
+
+// Unsigned integers, written from the last digit
+template <class inttyp>
+inline size_t _ucl_format_uint(char *p, inttyp x) {
+  char t[24];
+  int i=24;
+  do {
+    t[--i]=static_cast<char>('0'+x%10);
+    x/=10;
+  } while (x!=0);
+  memcpy(p,t+i,24-i);
+  return 24-i;
+}
+
+template <class inttyp, class uinttyp>
+inline size_t _ucl_format_int(char *p, const inttyp x) {
+  if (x<0) {
+    *p='-';
+    return 1+_ucl_format_uint(p+1,static_cast<uinttyp>(0)-
+                                  static_cast<uinttyp>(x));
+  }
+  return _ucl_format_uint(p,static_cast<uinttyp>(x));
+}
+
+#define _UCL_FORMAT_INT(type,utype)                                          \
+  template <> struct _ucl_format<type> {                                      \
+    static inline size_t f(char *p, const type x, const int)                  \
+      { return _ucl_format_int<type,utype>(p,x); }                            \
+  };                                                                          \
+  template <> struct _ucl_format<utype> {                                     \
+    static inline size_t f(char *p, const utype x, const int)                 \
+      { return _ucl_format_uint(p,x); }                                       \
+  };
+
+_UCL_FORMAT_INT(short,unsigned short)
+_UCL_FORMAT_INT(int,unsigned)
+_UCL_FORMAT_INT(long,unsigned long)
+
+#ifdef _UCL_TO_CHARS
+
+#define _UCL_FORMAT_FLOAT(type)                                              \
+  template <> struct _ucl_format<type> {                                      \
+    static inline size_t f(char *p, const type x, const int precision) {      \
+      std::to_chars_result r=std::to_chars(p,p+UCL_FORMAT_MAX,x,              \
+                                           std::chars_format::general,        \
+                                           precision);                        \
+      return r.ptr-p;                                                         \
+    }                                                                         \
+  };
+
+#else
+
+#define _UCL_FORMAT_FLOAT(type)                                              \
+  template <> struct _ucl_format<type> {                                      \
+    static inline size_t f(char *p, const type x, const int precision) {      \
+      char t[UCL_FORMAT_MAX+1];                                               \
+      int n=snprintf(t,UCL_FORMAT_MAX+1,"%.*g",precision,                     \
+                     static_cast<double>(x));                                 \
+      if (n>UCL_FORMAT_MAX)                                                   \
+        n=UCL_FORMAT_MAX;                                                     \
+      memcpy(p,t,n);                                                          \
+      return n;                                                               \
+    }                                                                         \
+  };
+
+#endif
+
+_UCL_FORMAT_FLOAT(float)
+_UCL_FORMAT_FLOAT(double)
+
+template <> struct _ucl_format<ucl_half> {
+  static inline size_t f(char *p, const ucl_half x, const int precision)
+    { return _ucl_format<float>::f(p,static_cast<float>(x),precision); }
+};
+
+#endif
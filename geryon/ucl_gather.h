@@ -0,0 +1,364 @@
+/***************************************************************************
+                                 ucl_gather.h
+                             -------------------
+
+  Gather, scatter and stream compaction of device vectors and matrix rows
+
+ __________________________________________________________________________
+    This file is part of the Geryon Unified Coprocessor Library (UCL)
+ __________________________________________________________________________
+
+ ***************************************************************************/
+
+/* -----------------------------------------------------------------------
+   Copyright (2010) Sandia Corporation.  Under the terms of Contract
+   DE-AC04-94AL85000 with Sandia Corporation, the U.S. Government retains
+   certain rights in this software.  This software is distributed under
+   the Simplified BSD License.
+   ----------------------------------------------------------------------- */
+
+/***************************************************************************
+   UCL_Gather moves elements of UCL_D_Vec data or rows of UCL_D_Mat data
+   by an index list or a flag vector on the device:
+
+     gather:   dst[i]=src[index[i]]
+     scatter:  dst[index[i]]=src[i]
+     compact:  dst[j]=src[i] for each i with flags[i]!=0, keeping the order
+
+   For matrices, whole rows are moved. Rows can also be gathered from a
+   matrix into a packed UCL_D_Vec (row i starts at element i*cols(), with
+   no pitch padding) and scattered back, e.g. to pack rows for a ghost
+   exchange before a single copy to the host:
+
+     UCL_Gather<double> pack(dev);
+     pack.gather(buf,x,send_list,cq,nsend);     // buf is a UCL_D_Vec
+     ucl_copy(host_buf,buf,nsend*x.cols(),cq);
+     ...
+     pack.scatter(x,buf,recv_list,cq,nrecv);
+
+   Index lists and flags are UCL_D_Vec<int>; flags must be 0 or 1. All
+   kernels are queued on the command queue given, so calls are asynchronous
+   with respect to the host.
+ ***************************************************************************/
+
+// Only allow this file to be included by nvd_prims.h and ocl_prims.h
+#ifdef UCL_PRIMS_ALLOW
+
+/// Kernel source for gather, scatter and compaction
+/** Rows have width elements and are pitch elements apart **/
+inline const char * _ucl_gather_source() {
+  return
+    "__kernel void ucl_gather(const __global NUMTYP *src, const int src_off,\n"
+    "                         const int src_pitch, __global NUMTYP *dst,\n"
+    "                         const int dst_off, const int dst_pitch,\n"
+    "                         const __global int *index, const int idx_off,\n"
+    "                         const int nrows, const int width,\n"
+    "                         const int scatter) {\n"
+    "  const int total=nrows*width;\n"
+    "  for (int i=GLOBAL_ID_X; i<total; i+=GRID_SIZE_X*BLOCK_SIZE) {\n"
+    "    const int r=i/width;\n"
+    "    const int c=i-r*width;\n"
+    "    const int m=index[idx_off+r];\n"
+    "    if (scatter)\n"
+    "      dst[dst_off+m*dst_pitch+c]=src[src_off+r*src_pitch+c];\n"
+    "    else\n"
+    "      dst[dst_off+r*dst_pitch+c]=src[src_off+m*src_pitch+c];\n"
+    "  }\n"
+    "}\n"
+    "\n"
+    "__kernel void ucl_compact(const __global NUMTYP *src, const int src_off,\n"
+    "                          const int src_pitch, __global NUMTYP *dst,\n"
+    "                          const int dst_off, const int dst_pitch,\n"
+    "                          const __global int *flags,\n"
+    "                          const int flag_off,\n"
+    "                          const __global int *pos,\n"
+    "                          const int nrows, const int width) {\n"
+    "  const int total=nrows*width;\n"
+    "  for (int i=GLOBAL_ID_X; i<total; i+=GRID_SIZE_X*BLOCK_SIZE) {\n"
+    "    const int r=i/width;\n"
+    "    if (flags[flag_off+r]) {\n"
+    "      const int c=i-r*width;\n"
+    "      dst[dst_off+pos[r]*dst_pitch+c]=src[src_off+r*src_pitch+c];\n"
+    "    }\n"
+    "  }\n"
+    "}\n";
+}
+
+/// Gather, scatter and compaction of device vectors and matrix rows
+/** Kernels are compiled on first use and cached with the device. Storage
+  * for compaction offsets is kept between calls. **/
+template <class numtyp>
+class UCL_Gather {
+ public:
+  /// Set up gather and scatter on a device
+  /** \param block_size Work-group size (rounded down to a power of 2;
+    *                   0 for a default based on the device)
+    * \param max_groups Maximum number of work-groups (0 for a default
+    *                   based on the device) **/
+  UCL_Gather(UCL_Device &dev, const int block_size=0,
+             const int max_groups=0)
+    : _dev(&dev), _kernels(NULL), _scan(dev) {
+    _block_size=(block_size>0) ? _ucl_pow2_floor(block_size) :
+                                 _ucl_prim_block_size(dev);
+    _max_groups=(max_groups>0) ? max_groups : dev.cus()*8;
+    if (_max_groups<1)
+      _max_groups=1;
+  }
+
+  /// Work-group size used for the kernels
+  inline int block_size() const { return _block_size; }
+
+  /// dst[i]=src[index[i]] for the first n indices
+  /** \param n Number of indices (0 for all of index)
+    * \note Asynchronous with respect to the host **/
+  inline int gather(UCL_D_Vec<numtyp> &dst, const UCL_D_Vec<numtyp> &src,
+                    const UCL_D_Vec<int> &index, command_queue &cq,
+                    const size_t n=0) {
+    const int nrows=_count(index,n);
+    assert(static_cast<size_t>(nrows)<=dst.cols());
+    return _move(dst,1,src,1,index,nrows,1,0,cq);
+  }
+
+  /// Row i of dst is set to row index[i] of src for the first n indices
+  /** \param n Number of indices (0 for all of index)
+    * \note Asynchronous with respect to the host **/
+  inline int gather(UCL_D_Mat<numtyp> &dst, const UCL_D_Mat<numtyp> &src,
+                    const UCL_D_Vec<int> &index, command_queue &cq,
+                    const size_t n=0) {
+    const int nrows=_count(index,n);
+    assert(static_cast<size_t>(nrows)<=dst.rows() && dst.cols()>=src.cols());
+    return _move(dst,_pitch(dst),src,_pitch(src),index,nrows,src.cols(),0,cq);
+  }
+
+  /// Row index[i] of src is packed into dst at element i*src.cols()
+  /** \param n Number of indices (0 for all of index)
+    * \note Asynchronous with respect to the host **/
+  inline int gather(UCL_D_Vec<numtyp> &dst, const UCL_D_Mat<numtyp> &src,
+                    const UCL_D_Vec<int> &index, command_queue &cq,
+                    const size_t n=0) {
+    const int nrows=_count(index,n);
+    const int width=static_cast<int>(src.cols());
+    assert(static_cast<size_t>(nrows)*src.cols()<=dst.cols());
+    return _move(dst,width,src,_pitch(src),index,nrows,width,0,cq);
+  }
+
+  /// dst[index[i]]=src[i] for the first n indices
+  /** \param n Number of indices (0 for all of index)
+    * \note Indices should be unique
+    * \note Asynchronous with respect to the host **/
+  inline int scatter(UCL_D_Vec<numtyp> &dst, const UCL_D_Vec<numtyp> &src,
+                     const UCL_D_Vec<int> &index, command_queue &cq,
+                     const size_t n=0) {
+    const int nrows=_count(index,n);
+    assert(static_cast<size_t>(nrows)<=src.cols());
+    return _move(dst,1,src,1,index,nrows,1,1,cq);
+  }
+
+  /// Row index[i] of dst is set to row i of src for the first n indices
+  /** \param n Number of indices (0 for all of index)
+    * \note Indices should be unique
+    * \note Asynchronous with respect to the host **/
+  inline int scatter(UCL_D_Mat<numtyp> &dst, const UCL_D_Mat<numtyp> &src,
+                     const UCL_D_Vec<int> &index, command_queue &cq,
+                     const size_t n=0) {
+    const int nrows=_count(index,n);
+    assert(static_cast<size_t>(nrows)<=src.rows() && dst.cols()>=src.cols());
+    return _move(dst,_pitch(dst),src,_pitch(src),index,nrows,src.cols(),1,cq);
+  }
+
+  /// Row index[i] of dst is set from packed src at element i*dst.cols()
+  /** \param n Number of indices (0 for all of index)
+    * \note Indices should be unique
+    * \note Asynchronous with respect to the host **/
+  inline int scatter(UCL_D_Mat<numtyp> &dst, const UCL_D_Vec<numtyp> &src,
+                     const UCL_D_Vec<int> &index, command_queue &cq,
+                     const size_t n=0) {
+    const int nrows=_count(index,n);
+    const int width=static_cast<int>(dst.cols());
+    assert(static_cast<size_t>(nrows)*dst.cols()<=src.cols());
+    return _move(dst,_pitch(dst),src,width,index,nrows,width,1,cq);
+  }
+
+  /// Copy the elements of src with flags set to the start of dst
+  /** \param n Number of elements of src and flags (0 for all of src)
+    * \param count If not NULL, the number of elements copied is stored in
+    *              (*count)[count_pos]
+    * \note dst must not overlap src
+    * \note Asynchronous with respect to the host **/
+  inline int compact(UCL_D_Vec<numtyp> &dst, const UCL_D_Vec<numtyp> &src,
+                     const UCL_D_Vec<int> &flags, command_queue &cq,
+                     const size_t n=0, UCL_D_Vec<int> *count=NULL,
+                     const size_t count_pos=0) {
+    const int nrows=static_cast<int>((n==0) ? src.cols() : n);
+    assert(static_cast<size_t>(nrows)<=dst.cols() &&
+           static_cast<size_t>(nrows)<=flags.cols());
+    return _compact(dst,1,src,1,flags,nrows,1,count,count_pos,cq);
+  }
+
+  /// Copy the rows of src with flags set to the first rows of dst
+  /** \param n Number of rows of src and flags (0 for all rows of src)
+    * \param count If not NULL, the number of rows copied is stored in
+    *              (*count)[count_pos]
+    * \note dst must not overlap src
+    * \note Asynchronous with respect to the host **/
+  inline int compact(UCL_D_Mat<numtyp> &dst, const UCL_D_Mat<numtyp> &src,
+                     const UCL_D_Vec<int> &flags, command_queue &cq,
+                     const size_t n=0, UCL_D_Vec<int> *count=NULL,
+                     const size_t count_pos=0) {
+    const int nrows=static_cast<int>((n==0) ? src.rows() : n);
+    assert(static_cast<size_t>(nrows)<=dst.rows() &&
+           static_cast<size_t>(nrows)<=flags.cols() &&
+           dst.cols()>=src.cols());
+    return _compact(dst,_pitch(dst),src,_pitch(src),flags,nrows,src.cols(),
+                    count,count_pos,cq);
+  }
+
+  /// Free temporary storage
+  inline void clear() {
+    _pos.clear();
+    _scan.clear();
+  }
+
+ private:
+  UCL_Device *_dev;
+  int _block_size, _max_groups;
+  UCL_PrimKernels *_kernels;
+  UCL_Scan<int> _scan;
+  UCL_D_Vec<int> _pos;
+
+  inline int _pitch(const UCL_D_Mat<numtyp> &mat) const
+    { return static_cast<int>(mat.row_bytes()/sizeof(numtyp)); }
+
+  inline int _count(const UCL_D_Vec<int> &index, const size_t n) const {
+    assert(n<=index.cols());
+    return static_cast<int>((n==0) ? index.cols() : n);
+  }
+
+  inline int _groups(const int total) const {
+    int ngroups=(total+_block_size-1)/_block_size;
+    return (ngroups>_max_groups) ? _max_groups : ngroups;
+  }
+
+  inline UCL_PrimKernels * _get_kernels() {
+    if (_kernels==NULL) {
+      std::ostringstream key, src;
+      key << "ucl_gather_" << _UCL_DATA_ID<numtyp>::name() << "_"
+          << _block_size;
+      src << _ucl_prim_defs<numtyp>(_block_size) << _ucl_gather_source();
+      const char *names[2]={"ucl_gather","ucl_compact"};
+      _kernels=_ucl_prim_kernels(*_dev,key.str(),src.str(),names,2);
+    }
+    return _kernels;
+  }
+
+  template <class dst_type, class src_type>
+  inline int _move(dst_type &dst, int dst_pitch, const src_type &src,
+                   int src_pitch, const UCL_D_Vec<int> &index, int nrows,
+                   int width, int scatter, command_queue &cq) {
+    UCL_PrimKernels *k=_get_kernels();
+    if (k==NULL)
+      return UCL_COMPILE_ERROR;
+    if (nrows==0 || width==0)
+      return UCL_SUCCESS;
+    int src_off=src.offset(), dst_off=dst.offset(), idx_off=index.offset();
+    UCL_Kernel &kg=(*k)[0];
+    kg.set_size(_groups(nrows*width),_block_size,cq);
+    kg.clear_args();
+    kg.add_arg(&src);
+    kg.add_arg(&src_off);
+    kg.add_arg(&src_pitch);
+    kg.add_arg(&dst);
+    kg.add_arg(&dst_off);
+    kg.add_arg(&dst_pitch);
+    kg.add_arg(&index);
+    kg.add_arg(&idx_off);
+    kg.add_arg(&nrows);
+    kg.add_arg(&width);
+    kg.add_arg(&scatter);
+    kg.run();
+    return UCL_SUCCESS;
+  }
+
+  template <class mat_type>
+  inline int _compact(mat_type &dst, int dst_pitch, const mat_type &src,
+                      int src_pitch, const UCL_D_Vec<int> &flags, int nrows,
+                      int width, UCL_D_Vec<int> *count,
+                      const size_t count_pos, command_queue &cq) {
+    UCL_PrimKernels *k=_get_kernels();
+    if (k==NULL)
+      return UCL_COMPILE_ERROR;
+    // Nothing is selected from an empty source (a scan length of 0 would
+    // mean all of flags)
+    if (nrows==0) {
+      if (count!=NULL) {
+        UCL_D_Vec<int> c;
+        c.view_offset(count_pos,*count,1);
+        c.zero(cq);
+      }
+      return UCL_SUCCESS;
+    }
+    if (_pos.cols()<static_cast<size_t>(nrows))
+      if (_pos.alloc(nrows,*_dev)!=UCL_SUCCESS)
+        return UCL_MEMORY_ERROR;
+
+    // Destination of each selected row from a scan of the flags
+    int err=_scan.exclusive(_pos,flags,cq,nrows,count,count_pos);
+    if (err!=UCL_SUCCESS || width==0)
+      return err;
+
+    int src_off=src.offset(), dst_off=dst.offset(), flag_off=flags.offset();
+    UCL_Kernel &kc=(*k)[1];
+    kc.set_size(_groups(nrows*width),_block_size,cq);
+    kc.clear_args();
+    kc.add_arg(&src);
+    kc.add_arg(&src_off);
+    kc.add_arg(&src_pitch);
+    kc.add_arg(&dst);
+    kc.add_arg(&dst_off);
+    kc.add_arg(&dst_pitch);
+    kc.add_arg(&flags);
+    kc.add_arg(&flag_off);
+    kc.add_arg(&_pos);
+    kc.add_arg(&nrows);
+    kc.add_arg(&width);
+    kc.run();
+    return UCL_SUCCESS;
+  }
+};
+
+/// dst[i]=src[index[i]] for vectors, or row gather from a matrix
+/** Queued on the default command queue for dev **/
+template <class dst_type, class src_type>
+inline int ucl_gather(dst_type &dst, const src_type &src,
+                      const UCL_D_Vec<int> &index, UCL_Device &dev) {
+  UCL_Gather<typename dst_type::data_type> g(dev);
+  return g.gather(dst,src,index,dev.cq());
+}
+
+/// dst[index[i]]=src[i] for vectors, or row scatter to a matrix
+/** Queued on the default command queue for dev **/
+template <class dst_type, class src_type>
+inline int ucl_scatter(dst_type &dst, const src_type &src,
+                       const UCL_D_Vec<int> &index, UCL_Device &dev) {
+  UCL_Gather<typename dst_type::data_type> g(dev);
+  return g.scatter(dst,src,index,dev.cq());
+}
+
+/// Copy elements (or matrix rows) of src with flags set to dst
+/** \return The number of elements (or rows) copied (blocks until
+  *         complete) **/
+template <class mat_type>
+inline int ucl_compact(mat_type &dst, const mat_type &src,
+                       const UCL_D_Vec<int> &flags, UCL_Device &dev) {
+  UCL_Gather<typename mat_type::data_type> g(dev);
+  UCL_D_Vec<int> dcount;
+  UCL_H_Vec<int> hcount;
+  if (dcount.alloc(1,dev)!=UCL_SUCCESS || hcount.alloc(1,dev)!=UCL_SUCCESS)
+    return 0;
+  hcount[0]=0;
+  if (g.compact(dst,src,flags,dev.cq(),0,&dcount)==UCL_SUCCESS)
+    ucl_copy(hcount,dcount,1,false);
+  return hcount[0];
+}
+
+#endif
@@ -0,0 +1,386 @@
+/***************************************************************************
+                                  ucl_gemm.h
+                             -------------------
+
+  Tiled matrix-matrix and matrix-vector products on pitched device matrices
+
+ __________________________________________________________________________
+    This file is part of the Geryon Unified Coprocessor Library (UCL)
+ __________________________________________________________________________
+
+ ***************************************************************************/
+
+/* -----------------------------------------------------------------------
+   Copyright (2010) Sandia Corporation.  Under the terms of Contract
+   DE-AC04-94AL85000 with Sandia Corporation, the U.S. Government retains
+   certain rights in this software.  This software is distributed under
+   the Simplified BSD License.
+   ----------------------------------------------------------------------- */
+
+/***************************************************************************
+   UCL_Gemm computes
+
+     C=alpha*op(A)*op(B)+beta*C     (gemm)
+     y=alpha*op(A)*x+beta*y         (gemv)
+
+   for row-major UCL_D_Mat storage, using the row pitch of each matrix
+   directly so that padded allocations need no repacking. op(A) is A or
+   its transpose.
+
+   GEMM works on TILE x TILE blocks of C. A work-group loads a TILE x TILE
+   block of op(A) and op(B) into local memory (padded by one column to
+   avoid bank conflicts) and each work-item accumulates WPT elements of a
+   column of the C block in registers. The tile size and work per thread
+   are chosen from the work-group size and local memory of the device
+   unless given; CPU devices get smaller work-groups.
+
+   GEMV without transpose uses a group of work-items for each row so that
+   loads of A are contiguous; with transpose, each work-item computes one
+   element of y while the work-group shares x through local memory.
+
+   Intended for float and double.
+ ***************************************************************************/
+
+// Only allow this file to be included by nvd_prims.h and ocl_prims.h
+#ifdef UCL_PRIMS_ALLOW
+
+/// Kernel source for GEMM (TILE, WPT and BLOCK_SIZE are defined first)
+inline const char * _ucl_gemm_source() {
+  return
+    "#define RTS (TILE/WPT)\n"
+    "\n"
+    "__kernel void ucl_gemm(const int m, const int n, const int k,\n"
+    "                       const NUMTYP alpha,\n"
+    "                       const __global NUMTYP *a, const int a_off,\n"
+    "                       const int lda, const int ta,\n"
+    "                       const __global NUMTYP *b, const int b_off,\n"
+    "                       const int ldb, const int tb,\n"
+    "                       const NUMTYP beta, __global NUMTYP *c,\n"
+    "                       const int c_off, const int ldc) {\n"
+    "  __local NUMTYP as[TILE][TILE+1];\n"
+    "  __local NUMTYP bs[TILE][TILE+1];\n"
+    "  const int tid=THREAD_ID_X;\n"
+    "  const int tx=tid%TILE;\n"
+    "  const int ty=tid/TILE;\n"
+    "  const int nbx=(n+TILE-1)/TILE;\n"
+    "  const int row0=(BLOCK_ID_X/nbx)*TILE;\n"
+    "  const int col0=(BLOCK_ID_X%nbx)*TILE;\n"
+    "  NUMTYP acc[WPT];\n"
+    "  for (int r=0; r<WPT; r++)\n"
+    "    acc[r]=(NUMTYP)0;\n"
+    "\n"
+    "  for (int k0=0; k0<k; k0+=TILE) {\n"
+    "    // Loads are contiguous in tx for either orientation\n"
+    "    for (int r=0; r<WPT; r++) {\n"
+    "      const int lr=ty+r*RTS;\n"
+    "      if (ta) {\n"
+    "        const int gi=row0+tx, gk=k0+lr;\n"
+    "        as[tx][lr]=(gi<m && gk<k) ? a[a_off+gk*lda+gi] : (NUMTYP)0;\n"
+    "      } else {\n"
+    "        const int gi=row0+lr, gk=k0+tx;\n"
+    "        as[lr][tx]=(gi<m && gk<k) ? a[a_off+gi*lda+gk] : (NUMTYP)0;\n"
+    "      }\n"
+    "      if (tb) {\n"
+    "        const int gj=col0+lr, gk=k0+tx;\n"
+    "        bs[tx][lr]=(gj<n && gk<k) ? b[b_off+gj*ldb+gk] : (NUMTYP)0;\n"
+    "      } else {\n"
+    "        const int gj=col0+tx, gk=k0+lr;\n"
+    "        bs[lr][tx]=(gj<n && gk<k) ? b[b_off+gk*ldb+gj] : (NUMTYP)0;\n"
+    "      }\n"
+    "    }\n"
+    "    __syncthreads();\n"
+    "    for (int kk=0; kk<TILE; kk++) {\n"
+    "      const NUMTYP bv=bs[kk][tx];\n"
+    "      for (int r=0; r<WPT; r++)\n"
+    "        acc[r]+=as[ty+r*RTS][kk]*bv;\n"
+    "    }\n"
+    "    __syncthreads();\n"
+    "  }\n"
+    "\n"
+    "  const int col=col0+tx;\n"
+    "  for (int r=0; r<WPT; r++) {\n"
+    "    const int row=row0+ty+r*RTS;\n"
+    "    if (row<m && col<n) {\n"
+    "      const int ci=c_off+row*ldc+col;\n"
+    "      if (beta==(NUMTYP)0)\n"
+    "        c[ci]=alpha*acc[r];\n"
+    "      else\n"
+    "        c[ci]=alpha*acc[r]+beta*c[ci];\n"
+    "    }\n"
+    "  }\n"
+    "}\n";
+}
+
+/// Kernel source for GEMV (BLOCK_SIZE is defined first)
+inline const char * _ucl_gemv_source() {
+  return
+    "__kernel void ucl_gemv_n(const int m, const int n, const NUMTYP alpha,\n"
+    "                         const __global NUMTYP *a, const int a_off,\n"
+    "                         const int lda,\n"
+    "                         const __global NUMTYP *x, const int x_off,\n"
+    "                         const int incx, const NUMTYP beta,\n"
+    "                         __global NUMTYP *y, const int y_off,\n"
+    "                         const int incy, const int tpr) {\n"
+    "  __local NUMTYP sh[BLOCK_SIZE];\n"
+    "  const int tid=THREAD_ID_X;\n"
+    "  const int lane=tid%tpr;\n"
+    "  const int row=BLOCK_ID_X*(BLOCK_SIZE/tpr)+tid/tpr;\n"
+    "  NUMTYP s=(NUMTYP)0;\n"
+    "  if (row<m)\n"
+    "    for (int j=lane; j<n; j+=tpr)\n"
+    "      s+=a[a_off+row*lda+j]*x[x_off+j*incx];\n"
+    "  sh[tid]=s;\n"
+    "  __syncthreads();\n"
+    "  for (int o=tpr/2; o>0; o>>=1) {\n"
+    "    if (lane<o)\n"
+    "      sh[tid]+=sh[tid+o];\n"
+    "    __syncthreads();\n"
+    "  }\n"
+    "  if (lane==0 && row<m) {\n"
+    "    const int yi=y_off+row*incy;\n"
+    "    if (beta==(NUMTYP)0)\n"
+    "      y[yi]=alpha*sh[tid];\n"
+    "    else\n"
+    "      y[yi]=alpha*sh[tid]+beta*y[yi];\n"
+    "  }\n"
+    "}\n"
+    "\n"
+    "__kernel void ucl_gemv_t(const int m, const int n, const NUMTYP alpha,\n"
+    "                         const __global NUMTYP *a, const int a_off,\n"
+    "                         const int lda,\n"
+    "                         const __global NUMTYP *x, const int x_off,\n"
+    "                         const int incx, const NUMTYP beta,\n"
+    "                         __global NUMTYP *y, const int y_off,\n"
+    "                         const int incy) {\n"
+    "  __local NUMTYP xs[BLOCK_SIZE];\n"
+    "  const int tid=THREAD_ID_X;\n"
+    "  const int col=BLOCK_ID_X*BLOCK_SIZE+tid;\n"
+    "  NUMTYP s=(NUMTYP)0;\n"
+    "  for (int i0=0; i0<m; i0+=BLOCK_SIZE) {\n"
+    "    xs[tid]=(i0+tid<m) ? x[x_off+(i0+tid)*incx] : (NUMTYP)0;\n"
+    "    __syncthreads();\n"
+    "    if (col<n) {\n"
+    "      const int iend=(m-i0<BLOCK_SIZE) ? m-i0 : BLOCK_SIZE;\n"
+    "      for (int ii=0; ii<iend; ii++)\n"
+    "        s+=a[a_off+(i0+ii)*lda+col]*xs[ii];\n"
+    "    }\n"
+    "    __syncthreads();\n"
+    "  }\n"
+    "  if (col<n) {\n"
+    "    const int yi=y_off+col*incy;\n"
+    "    if (beta==(NUMTYP)0)\n"
+    "      y[yi]=alpha*s;\n"
+    "    else\n"
+    "      y[yi]=alpha*s+beta*y[yi];\n"
+    "  }\n"
+    "}\n";
+}
+
+/// Choose the GEMM tile size and work per thread for a device
+/** The work-group (tile*tile/wpt work-items) must fit the default
+  * primitive work-group size and the two tiles must use no more than half
+  * of the local memory so that more than one work-group can be resident.
+  * \param bytes Size of the element type **/
+inline void _ucl_gemm_tile(UCL_Device &dev, const size_t bytes, int &tile,
+                           int &wpt) {
+  const int bs=_ucl_prim_block_size(dev);
+  const size_t local=dev.local_bytes();
+  for (tile=32; tile>4; tile/=2) {
+    wpt=tile*tile/bs;
+    if (wpt<1)
+      wpt=1;
+    if (wpt<=8 && 2*tile*(tile+1)*bytes<=local/2)
+      return;
+  }
+  tile=4;
+  wpt=1;
+}
+
+/// Tiled GEMM and GEMV for pitched device matrices
+/** Kernels are compiled on first use and cached with the device **/
+template <class numtyp>
+class UCL_Gemm {
+ public:
+  /// Set up GEMM and GEMV on a device
+  /** \param tile GEMM tile size (power of 2 from 4 to 64; 0 to choose
+    *             from the device properties)
+    * \param work_per_thread Elements of C computed by each work-item
+    *                        (power of 2 no larger than tile; 0 to choose
+    *                        from the device properties)
+    * \param block_size Work-group size for GEMV (0 for a default based on
+    *                   the device)
+    * \note An explicit tile is reduced if the tiles do not fit in local
+    *       memory, and work_per_thread is increased if the work-group
+    *       would be larger than the device allows; see tile() and
+    *       work_per_thread() for the values used **/
+  UCL_Gemm(UCL_Device &dev, const int tile=0, const int work_per_thread=0,
+           const int block_size=0) : _dev(&dev) {
+    _ucl_gemm_tile(dev,sizeof(numtyp),_tile,_wpt);
+    if (tile>0) {
+      _tile=_ucl_pow2_floor(tile);
+      if (_tile<4)
+        _tile=4;
+      else if (_tile>64)
+        _tile=64;
+      _wpt=_tile*_tile/_ucl_prim_block_size(dev);
+    }
+    if (work_per_thread>0)
+      _wpt=_ucl_pow2_floor(work_per_thread);
+
+    // Clamp explicit values so that the two tiles fit in local memory and
+    // the work-group fits the device
+    while (_tile>4 && 2*_tile*(_tile+1)*sizeof(numtyp)>dev.local_bytes())
+      _tile/=2;
+    if (_wpt<1)
+      _wpt=1;
+    else if (_wpt>_tile)
+      _wpt=_tile;
+    while (_wpt<_tile &&
+           static_cast<size_t>(_tile*_tile/_wpt)>dev.group_size())
+      _wpt*=2;
+    _block_size=(block_size>0) ? _ucl_pow2_floor(block_size) :
+                                 _ucl_prim_block_size(dev);
+    _kernels[0]=NULL;
+    _kernels[1]=NULL;
+  }
+
+  /// GEMM tile size
+  inline int tile() const { return _tile; }
+  /// Elements of C computed by each work-item in GEMM
+  inline int work_per_thread() const { return _wpt; }
+  /// GEMM work-group size
+  inline int gemm_block_size() const { return _tile*_tile/_wpt; }
+  /// GEMV work-group size
+  inline int block_size() const { return _block_size; }
+
+  /// C=alpha*op(A)*op(B)+beta*C
+  /** \param trans_a Use the transpose of A
+    * \param trans_b Use the transpose of B
+    * \note C is not read when beta is 0
+    * \note C must not overlap A or B
+    * \note Asynchronous with respect to the host **/
+  inline int gemm(UCL_D_Mat<numtyp> &c, const UCL_D_Mat<numtyp> &a,
+                  const UCL_D_Mat<numtyp> &b, command_queue &cq,
+                  const numtyp alpha=static_cast<numtyp>(1),
+                  const numtyp beta=static_cast<numtyp>(0),
+                  const bool trans_a=false, const bool trans_b=false) {
+    int m=static_cast<int>(trans_a ? a.cols() : a.rows());
+    int k=static_cast<int>(trans_a ? a.rows() : a.cols());
+    int n=static_cast<int>(trans_b ? b.rows() : b.cols());
+    assert(static_cast<size_t>(k)==(trans_b ? b.cols() : b.rows()));
+    assert(c.rows()==static_cast<size_t>(m) &&
+           c.cols()==static_cast<size_t>(n));
+    UCL_PrimKernels *kern=_get_kernels(0);
+    if (kern==NULL)
+      return UCL_COMPILE_ERROR;
+    if (m==0 || n==0)
+      return UCL_SUCCESS;
+
+    int a_off=a.offset(), b_off=b.offset(), c_off=c.offset();
+    int lda=_pitch(a), ldb=_pitch(b), ldc=_pitch(c);
+    int ta=trans_a ? 1 : 0, tb=trans_b ? 1 : 0;
+    numtyp al=alpha, be=beta;
+    const int ngroups=((m+_tile-1)/_tile)*((n+_tile-1)/_tile);
+    UCL_Kernel &kg=(*kern)[0];
+    kg.set_size(ngroups,gemm_block_size(),cq);
+    kg.clear_args();
+    kg.add_arg(&m);
+    kg.add_arg(&n);
+    kg.add_arg(&k);
+    kg.add_arg(&al);
+    kg.add_arg(&a);
+    kg.add_arg(&a_off);
+    kg.add_arg(&lda);
+    kg.add_arg(&ta);
+    kg.add_arg(&b);
+    kg.add_arg(&b_off);
+    kg.add_arg(&ldb);
+    kg.add_arg(&tb);
+    kg.add_arg(&be);
+    kg.add_arg(&c);
+    kg.add_arg(&c_off);
+    kg.add_arg(&ldc);
+    kg.run();
+    return UCL_SUCCESS;
+  }
+
+  /// y=alpha*op(A)*x+beta*y
+  /** x and y can be UCL_D_Vec data or rows and columns of matrices
+    * (see UCL_Strided)
+    * \param trans Use the transpose of A
+    * \note y is not read when beta is 0
+    * \note Asynchronous with respect to the host **/
+  inline int gemv(UCL_Strided<numtyp> y, const UCL_D_Mat<numtyp> &a,
+                  UCL_Strided<numtyp> x, command_queue &cq,
+                  const numtyp alpha=static_cast<numtyp>(1),
+                  const numtyp beta=static_cast<numtyp>(0),
+                  const bool trans=false) {
+    int m=a.rows(), n=a.cols();
+    assert(x.numel()==(trans ? m : n) && y.numel()==(trans ? n : m));
+    UCL_PrimKernels *kern=_get_kernels(1);
+    if (kern==NULL)
+      return UCL_COMPILE_ERROR;
+    if (y.numel()==0)
+      return UCL_SUCCESS;
+
+    int a_off=a.offset(), lda=_pitch(a);
+    numtyp al=alpha, be=beta;
+    UCL_Kernel &kv=(*kern)[trans ? 1 : 0];
+    kv.clear_args();
+    kv.add_arg(&m);
+    kv.add_arg(&n);
+    kv.add_arg(&al);
+    kv.add_arg(&a);
+    kv.add_arg(&a_off);
+    kv.add_arg(&lda);
+    x.add_args(kv);
+    kv.add_arg(&be);
+    y.add_args(kv);
+    if (trans) {
+      kv.set_size((n+_block_size-1)/_block_size,_block_size,cq);
+      kv.run();
+    } else {
+      // Work-items for each row (up to 32 so rows are read contiguously)
+      int tpr=1;
+      while (tpr<32 && tpr<n && tpr<_block_size)
+        tpr*=2;
+      const int rpg=_block_size/tpr;
+      kv.add_arg(&tpr);
+      kv.set_size((m+rpg-1)/rpg,_block_size,cq);
+      kv.run();
+    }
+    return UCL_SUCCESS;
+  }
+
+ private:
+  UCL_Device *_dev;
+  int _tile, _wpt, _block_size;
+  UCL_PrimKernels *_kernels[2];
+
+  inline int _pitch(const UCL_D_Mat<numtyp> &mat) const
+    { return static_cast<int>(mat.row_bytes()/sizeof(numtyp)); }
+
+  inline UCL_PrimKernels * _get_kernels(const int gemv) {
+    if (_kernels[gemv]==NULL) {
+      std::ostringstream key, src;
+      if (gemv) {
+        key << "ucl_gemv_" << _UCL_DATA_ID<numtyp>::name() << "_"
+            << _block_size;
+        src << _ucl_prim_defs<numtyp>(_block_size) << _ucl_gemv_source();
+        const char *names[2]={"ucl_gemv_n","ucl_gemv_t"};
+        _kernels[1]=_ucl_prim_kernels(*_dev,key.str(),src.str(),names,2);
+      } else {
+        key << "ucl_gemm_" << _UCL_DATA_ID<numtyp>::name() << "_" << _tile
+            << "_" << _wpt;
+        src << _ucl_prim_defs<numtyp>(gemm_block_size())
+            << "#define TILE " << _tile << "\n"
+            << "#define WPT " << _wpt << "\n" << _ucl_gemm_source();
+        const char *names[1]={"ucl_gemm"};
+        _kernels[0]=_ucl_prim_kernels(*_dev,key.str(),src.str(),names,1);
+      }
+    }
+    return _kernels[gemv];
+  }
+};
+
+#endif
@@ -0,0 +1,136 @@
+/***************************************************************************
+                                ucl_h_colmat.h
+                             -------------------
+
+  Column-major Matrix Container on Host
+
+ __________________________________________________________________________
+    This file is part of the Geryon Unified Coprocessor Library (UCL)
+ __________________________________________________________________________
+
+ ***************************************************************************/
+
+/* -----------------------------------------------------------------------
+   Copyright (2009) Sandia Corporation.  Under the terms of Contract
+   DE-AC04-94AL85000 with Sandia Corporation, the U.S. Government retains
+   certain rights in this software.  This software is distributed under
+   the Simplified BSD License.
+   ----------------------------------------------------------------------- */
+
+// Only allow this file to be included by CUDA and OpenCL specific headers
+#ifdef _UCL_MAT_ALLOW
+
+/// Column-major matrix on host with options for pinning (page locked)
+/** A rows x cols column-major matrix is stored as a row-major cols x rows
+  * UCL_H_Mat, returned by storage(). UCL_H_ColMat(row,col) is given by
+  * array[col*col_size()+row].
+  * - rows(), cols() and operator() use the column-major shape
+  * - Other members inherited from the storage (row_size(), row_bytes(),
+  *   view_offset(), ...) refer to the transposed storage
+  * - ucl_copy() between row-major and column-major containers reorders
+  *   the data on the host **/
+template <class numtyp>
+class UCL_H_ColMat : public UCL_H_Mat<numtyp> {
+ public:
+   // Traits for copying data
+   // MEM_TYPE is 0 for device, 1 for host, and 2 for image
+   enum traits {
+     DATA_TYPE = _UCL_DATA_ID<numtyp>::id,
+     MEM_TYPE = 1,
+     PADDED = 0,
+     ROW_MAJOR = 0,
+     VECTOR = 0
+   };
+   typedef numtyp data_type;
+   typedef UCL_H_Mat<numtyp> storage_type;
+
+  UCL_H_ColMat() {}
+
+  /// Construct with specied number of rows and columns
+  /** \sa alloc() **/
+  UCL_H_ColMat(const size_t rows, const size_t cols, UCL_Device &device,
+               const enum UCL_MEMOPT kind=UCL_READ_WRITE)
+    { alloc(rows,cols,device,kind); }
+
+  /// Set up host matrix with specied # of rows/cols and reserve memory
+  /** \param cq Default command queue for operations copied from another mat
+    * \sa UCL_H_Mat::alloc()
+    * \return UCL_SUCCESS if the memory allocation is successful **/
+  template <class mat_type>
+  inline int alloc(const size_t rows, const size_t cols, mat_type &cq,
+                   const enum UCL_MEMOPT kind=UCL_READ_WRITE,
+                   const enum UCL_MEMOPT kind2=UCL_NOT_SPECIFIED)
+    { return storage_type::alloc(cols,rows,cq,kind,kind2); }
+
+  /// Set up host matrix with specied # of rows/cols and reserve memory
+  /** \param device Used to get the default command queue for operations
+    * \sa UCL_H_Mat::alloc()
+    * \return UCL_SUCCESS if the memory allocation is successful **/
+  inline int alloc(const size_t rows, const size_t cols, UCL_Device &device,
+                   const enum UCL_MEMOPT kind=UCL_READ_WRITE,
+                   const enum UCL_MEMOPT kind2=UCL_NOT_SPECIFIED)
+    { return storage_type::alloc(cols,rows,device,kind,kind2); }
+
+  /// Do not allocate memory, instead use an existing allocation from Geryon
+  /** This function must be passed a Geryon vector or matrix container.
+    * No memory is freed when the object is destructed.
+    * - The view does not prevent the memory from being freed by the
+    *   allocating container when using CUDA APIs
+    * - Viewing a device container on the host is not supported **/
+  template <class ucl_type>
+  inline void view(ucl_type &input, const size_t rows, const size_t cols)
+    { storage_type::view(input,cols,rows,rows); }
+
+  /// Do not allocate memory, instead use an existing allocation from Geryon
+  /** This function must be passed a Geryon vector or matrix container.
+    * No memory is freed when the object is destructed.
+    * - The view does not prevent the memory from being freed by the
+    *   allocating container when using CUDA APIs
+    * - Viewing a device container on the host is not supported **/
+  template <class ucl_type>
+  inline void view(ucl_type &input)
+    { view(input,input.rows(),input.cols()); }
+
+  /// Do not allocate memory, instead use an existing allocation
+  /** - No memory is freed when the object is destructed.
+    * - The view does not prevent the memory from being freed by the
+    *   allocating container when using CUDA APIs
+    * - Viewing a device pointer on the host is not supported **/
+  template <class ptr_type>
+  inline void view(ptr_type *input, const size_t rows, const size_t cols,
+                   UCL_Device &dev)
+    { storage_type::view(input,cols,rows,rows,dev); }
+
+  /// Resize the allocation to rows x cols elements
+  /** \note Cannot be used on views **/
+  inline int resize(const int rows, const int cols)
+    { return storage_type::resize(cols,rows); }
+
+  /// Resize (only if bigger) the allocation to contain rows x cols elements
+  /** \note Cannot be used on views **/
+  inline int resize_ib(const int rows, const int cols)
+    { return storage_type::resize_ib(cols,rows); }
+
+  /// Get the number of rows
+  inline size_t rows() const { return storage_type::cols(); }
+  /// Get the number of columns
+  inline size_t cols() const { return storage_type::rows(); }
+  /// Get the size of a column (including any padding) in elements
+  inline size_t col_size() const { return storage_type::row_size(); }
+  /// Get the size of a column (including any padding) in bytes
+  inline size_t col_bytes() const { return storage_type::row_bytes(); }
+
+  /// 2D access
+  inline numtyp & operator()(const int row, const int col)
+    { return this->begin()[col*col_size()+row]; }
+  /// 2D access
+  inline const numtyp & operator()(const int row, const int col) const
+    { return this->begin()[col*col_size()+row]; }
+
+  /// Row-major cols x rows storage for the matrix
+  inline storage_type & storage() { return *this; }
+  /// Row-major cols x rows storage for the matrix
+  inline const storage_type & storage() const { return *this; }
+};
+
+#endif
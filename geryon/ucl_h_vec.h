@@ -39,7 +39,7 @@ class UCL_H_Vec : public UCL_BaseMat {
    };
    typedef numtyp data_type;
 
-  UCL_H_Vec() : _cols(0) {
+  UCL_H_Vec() : _cols(0), _host_mapped(0) {
     #ifdef _OCL_MAT
     _carray=(cl_mem)(0);
     #endif
@@ -50,7 +50,7 @@ class UCL_H_Vec : public UCL_BaseMat {
   /** \sa alloc() **/
   UCL_H_Vec(const size_t n, UCL_Device &device,
             const enum UCL_MEMOPT kind=UCL_READ_WRITE)
-    { _cols=0; _kind=UCL_VIEW; alloc(n,device,kind); }
+    { _cols=0; _host_mapped=0; _kind=UCL_VIEW; alloc(n,device,kind); }
 
   /// Set up host vector with 'cols' columns and reserve memory
   /** The kind parameter controls memory pinning as follows:
@@ -82,6 +82,9 @@ class UCL_H_Vec : public UCL_BaseMat {
 
     _cols=cols;
     _kind=kind;
+    // Demoted to pageable memory by the pinned limit of the tracker
+    if (_mem_record.kind==UCL_MEM_PAGEABLE_HOST)
+      _kind=UCL_NOT_PINNED;
     _end=_array+cols;
     return err;
   }
@@ -115,6 +118,9 @@ class UCL_H_Vec : public UCL_BaseMat {
 
     _cols=cols;
     _kind=kind;
+    // Demoted to pageable memory by the pinned limit of the tracker
+    if (_mem_record.kind==UCL_MEM_PAGEABLE_HOST)
+      _kind=UCL_NOT_PINNED;
     _end=_array+cols;
     return err;
   }
@@ -332,10 +338,15 @@ class UCL_H_Vec : public UCL_BaseMat {
       _row_bytes=0;
       UCL_GERYON_EXIT;
       #endif
+      // The old allocation was released; leave the container cleared
       _row_bytes=0;
+      _kind=UCL_VIEW;
+      _cols=0;
       return err;
     }
 
+    if (_mem_record.kind==UCL_MEM_PAGEABLE_HOST)
+      _kind=UCL_NOT_PINNED;
     _cols=cols;
     _end=_array+cols;
     return err;
@@ -388,6 +399,18 @@ class UCL_H_Vec : public UCL_BaseMat {
   /// Returns pointer to memory pointer for allocation on host
   inline numtyp ** host_ptr() { return &_array; }
 
+  /// Placement policy for host memory allocated by alloc() and resize()
+  /** The default, UCL_HOST_DEFAULT, uses the policy of the device passed
+    * to alloc() (the driver allocates memory when allocating with another
+    * container). A device policy that is used is copied to the container.
+    * \sa UCL_HostPolicy **/
+  inline UCL_HostPolicy & host_policy() { return _host_policy; }
+  /// Set the placement policy for the next alloc() or resize()
+  inline void host_policy(const UCL_HostPolicy &p) { _host_policy=p; }
+  /// Returns reference to the bytes mapped with a placement policy
+  /** 0 if the memory was allocated by the driver **/
+  inline size_t & host_mapped() { return _host_mapped; }
+
   /// Return the offset (in elements) from begin() pointer where data starts
   /** \note Always 0 for host matrices and CUDA APIs **/
   inline size_t offset() const { return 0; }
@@ -406,6 +429,9 @@ class UCL_H_Vec : public UCL_BaseMat {
   numtyp *_array, *_end;
   size_t _row_bytes, _cols;
 
+  UCL_HostPolicy _host_policy;
+  size_t _host_mapped;
+
   #ifdef _OCL_MAT
   device_ptr _carray;
   #endif
@@ -0,0 +1,150 @@
+/***************************************************************************
+                                 ucl_half.h
+                             -------------------
+
+  Half precision storage type with conversion on the host
+
+ __________________________________________________________________________
+    This file is part of the Geryon Unified Coprocessor Library (UCL)
+ __________________________________________________________________________
+
+ ***************************************************************************/
+
+/* -----------------------------------------------------------------------
+   Copyright (2010) Sandia Corporation.  Under the terms of Contract
+   DE-AC04-94AL85000 with Sandia Corporation, the U.S. Government retains
+   certain rights in this software.  This software is distributed under
+   the Simplified BSD License.
+   ----------------------------------------------------------------------- */
+
+/***************************************************************************
+   ucl_half holds the bits of an IEEE 754 binary16 value. It is a storage
+   type only: it converts to and from float, so that containers can hold
+   16-bit data that is computed with in single or double precision:
+
+     UCL_Vector<float,ucl_half> table(n,dev);
+     ... fill table.host ...
+     table.update_device();             // converted on the host
+
+   The conversion rounds to nearest even and handles subnormals, infinity
+   and NaN. Arrays are converted 8 values at a time when compiled with
+   F16C support (e.g. -mf16c or -march=native on x86).
+
+   In kernels the type is named half. Values are read and written with
+   vload_half(i,p) and vstore_half(v,i,p), which are built in for OpenCL
+   and defined for CUDA by geryon.h and the device primitives.
+   UCL_HalfConvert converts device containers when the data is already on
+   the device.
+ ***************************************************************************/
+
+#ifndef UCL_HALF_H
+#define UCL_HALF_H
+
+#include <cstring>
+#include "ucl_types.h"
+
+#ifdef __F16C__
+#include <immintrin.h>
+#endif
+
+/// Convert a float to the bits of a half (round to nearest even)
+inline unsigned short ucl_float_to_half(const float f) {
+  unsigned int x;
+  memcpy(&x,&f,sizeof(x));
+  const unsigned int sign=(x>>16) & 0x8000u;
+  const unsigned int e=(x>>23) & 0xffu;
+  unsigned int m=x & 0x7fffffu;
+  if (e==0xffu)
+    return static_cast<unsigned short>(sign | 0x7c00u |
+                                       (m ? 0x200u | (m>>13) : 0u));
+  const int he=static_cast<int>(e)-112;
+  if (he>=0x1f)
+    return static_cast<unsigned short>(sign | 0x7c00u);
+  unsigned int h;
+  if (he<=0) {
+    // Subnormal half; rounding up can carry into the smallest normal
+    if (he<-10)
+      return static_cast<unsigned short>(sign);
+    m|=0x800000u;
+    const unsigned int shift=static_cast<unsigned int>(14-he);
+    const unsigned int rem=m & ((1u<<shift)-1u);
+    const unsigned int halfway=1u<<(shift-1u);
+    h=m>>shift;
+    if (rem>halfway || (rem==halfway && (h & 1u)))
+      h++;
+    return static_cast<unsigned short>(sign | h);
+  }
+  // Rounding up can carry into the exponent (and to infinity)
+  const unsigned int rem=m & 0x1fffu;
+  h=(static_cast<unsigned int>(he)<<10) | (m>>13);
+  if (rem>0x1000u || (rem==0x1000u && (h & 1u)))
+    h++;
+  return static_cast<unsigned short>(sign | h);
+}
+
+/// Convert the bits of a half to a float
+inline float ucl_half_to_float(const unsigned short h) {
+  const unsigned int sign=(static_cast<unsigned int>(h) & 0x8000u)<<16;
+  unsigned int e=(h>>10) & 0x1fu;
+  unsigned int m=h & 0x3ffu;
+  unsigned int x;
+  if (e==0x1fu)
+    x=sign | 0x7f800000u | (m ? 0x400000u | (m<<13) : 0u);
+  else if (e!=0)
+    x=sign | ((e+112u)<<23) | (m<<13);
+  else if (m==0)
+    x=sign;
+  else {
+    e=113;
+    while ((m & 0x400u)==0) {
+      m<<=1;
+      e--;
+    }
+    x=sign | (e<<23) | ((m & 0x3ffu)<<13);
+  }
+  float f;
+  memcpy(&f,&x,sizeof(f));
+  return f;
+}
+
+/// Half precision storage (IEEE 754 binary16)
+struct ucl_half {
+  unsigned short bits;
+
+  ucl_half() {}
+  /// Round a float to half precision
+  ucl_half(const float f) : bits(ucl_float_to_half(f)) {}
+  /// Value as a float (exact)
+  operator float() const { return ucl_half_to_float(bits); }
+};
+
+_UCL_REGISTER_DATA_ID(ucl_half,20,"half",12)
+
+/// Convert n floats to half precision
+inline void ucl_float_to_half(ucl_half *dst, const float *src,
+                              const size_t n) {
+  size_t i=0;
+  #ifdef __F16C__
+  for ( ; i+8<=n; i+=8)
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(dst+i),
+                     _mm256_cvtps_ph(_mm256_loadu_ps(src+i),
+                                     _MM_FROUND_TO_NEAREST_INT));
+  #endif
+  for ( ; i<n; i++)
+    dst[i].bits=ucl_float_to_half(src[i]);
+}
+
+/// Convert n half precision values to floats
+inline void ucl_half_to_float(float *dst, const ucl_half *src,
+                              const size_t n) {
+  size_t i=0;
+  #ifdef __F16C__
+  for ( ; i+8<=n; i+=8)
+    _mm256_storeu_ps(dst+i,_mm256_cvtph_ps(_mm_loadu_si128(
+      reinterpret_cast<const __m128i *>(src+i))));
+  #endif
+  for ( ; i<n; i++)
+    dst[i]=ucl_half_to_float(src[i].bits);
+}
+
+#endif
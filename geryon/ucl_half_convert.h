@@ -0,0 +1,206 @@
+/***************************************************************************
+                             ucl_half_convert.h
+                             -------------------
+
+  Conversion between half precision and float or double on the device
+
+ __________________________________________________________________________
+    This file is part of the Geryon Unified Coprocessor Library (UCL)
+ __________________________________________________________________________
+
+ ***************************************************************************/
+
+/* -----------------------------------------------------------------------
+   Copyright (2010) Sandia Corporation.  Under the terms of Contract
+   DE-AC04-94AL85000 with Sandia Corporation, the U.S. Government retains
+   certain rights in this software.  This software is distributed under
+   the Simplified BSD License.
+   ----------------------------------------------------------------------- */
+
+/***************************************************************************
+   UCL_HalfConvert converts UCL_D_Vec or UCL_D_Mat data between ucl_half
+   storage and float or double with vstore_half and vload_half. This is
+   used when the values are produced or consumed on the device; data that
+   starts on the host should be converted on the host (see ucl_half.h) so
+   that only 16-bit values are transferred:
+
+     UCL_HalfConvert<float> hc(dev);
+     hc.to_half(table16,table32,cq);    // table16[i]=(half)table32[i]
+
+   Matrices are addressed with their own pitch and offset. All kernels are
+   queued on the command queue given, so calls are asynchronous with
+   respect to the host.
+ ***************************************************************************/
+
+// Only allow this file to be included by nvd_prims.h and ocl_prims.h
+#ifdef UCL_PRIMS_ALLOW
+
+/// Kernel source for half precision conversion
+/** Rows have cols elements and are pitch elements apart **/
+inline const char * _ucl_half_convert_source() {
+  return
+    "__kernel void ucl_to_half(const __global NUMTYP *in, const int in_off,\n"
+    "                          const int in_pitch, __global half *out,\n"
+    "                          const int out_off, const int out_pitch,\n"
+    "                          const int rows, const int cols) {\n"
+    "  const int total=rows*cols;\n"
+    "  for (int i=GLOBAL_ID_X; i<total; i+=GRID_SIZE_X*BLOCK_SIZE) {\n"
+    "    const int r=i/cols;\n"
+    "    const int c=i-r*cols;\n"
+    "    vstore_half(in[in_off+r*in_pitch+c],out_off+r*out_pitch+c,out);\n"
+    "  }\n"
+    "}\n"
+    "\n"
+    "__kernel void ucl_from_half(const __global half *in, const int in_off,\n"
+    "                            const int in_pitch, __global NUMTYP *out,\n"
+    "                            const int out_off, const int out_pitch,\n"
+    "                            const int rows, const int cols) {\n"
+    "  const int total=rows*cols;\n"
+    "  for (int i=GLOBAL_ID_X; i<total; i+=GRID_SIZE_X*BLOCK_SIZE) {\n"
+    "    const int r=i/cols;\n"
+    "    const int c=i-r*cols;\n"
+    "    out[out_off+r*out_pitch+c]=\n"
+    "      (NUMTYP)vload_half(in_off+r*in_pitch+c,in);\n"
+    "  }\n"
+    "}\n";
+}
+
+/// Conversion between ucl_half and numtyp (float or double) on the device
+/** Kernels are compiled on first use and cached with the device **/
+template <class numtyp>
+class UCL_HalfConvert {
+ public:
+  /// Set up conversion on a device
+  /** \param block_size Work-group size (rounded down to a power of 2;
+    *                   0 for a default based on the device)
+    * \param max_groups Maximum number of work-groups (0 for a default
+    *                   based on the device) **/
+  UCL_HalfConvert(UCL_Device &dev, const int block_size=0,
+                  const int max_groups=0)
+    : _dev(&dev), _kernels(NULL) {
+    _block_size=(block_size>0) ? _ucl_pow2_floor(block_size) :
+                                 _ucl_prim_block_size(dev);
+    _max_groups=(max_groups>0) ? max_groups : dev.cus()*8;
+    if (_max_groups<1)
+      _max_groups=1;
+  }
+
+  /// Work-group size used for the kernels
+  inline int block_size() const { return _block_size; }
+
+  /// dst[i]=src[i] rounded to half precision for the first n elements
+  /** \param n Number of elements (0 for all of src)
+    * \note Asynchronous with respect to the host **/
+  inline int to_half(UCL_D_Vec<ucl_half> &dst, const UCL_D_Vec<numtyp> &src,
+                     command_queue &cq, const size_t n=0) {
+    const int count=static_cast<int>((n==0) ? src.cols() : n);
+    assert(static_cast<size_t>(count)<=src.cols() &&
+           static_cast<size_t>(count)<=dst.cols());
+    return _convert(0,src,0,dst,0,1,count,cq);
+  }
+
+  /// dst=src rounded to half precision
+  /** \note dst must have at least as many rows and columns as src
+    * \note Asynchronous with respect to the host **/
+  inline int to_half(UCL_D_Mat<ucl_half> &dst, const UCL_D_Mat<numtyp> &src,
+                     command_queue &cq) {
+    assert(dst.rows()>=src.rows() && dst.cols()>=src.cols());
+    return _convert(0,src,_pitch(src),dst,_pitch(dst),src.rows(),src.cols(),
+                    cq);
+  }
+
+  /// dst[i]=src[i] for the first n elements
+  /** \param n Number of elements (0 for all of src)
+    * \note Asynchronous with respect to the host **/
+  inline int from_half(UCL_D_Vec<numtyp> &dst,
+                       const UCL_D_Vec<ucl_half> &src, command_queue &cq,
+                       const size_t n=0) {
+    const int count=static_cast<int>((n==0) ? src.cols() : n);
+    assert(static_cast<size_t>(count)<=src.cols() &&
+           static_cast<size_t>(count)<=dst.cols());
+    return _convert(1,src,0,dst,0,1,count,cq);
+  }
+
+  /// dst=src
+  /** \note dst must have at least as many rows and columns as src
+    * \note Asynchronous with respect to the host **/
+  inline int from_half(UCL_D_Mat<numtyp> &dst,
+                       const UCL_D_Mat<ucl_half> &src, command_queue &cq) {
+    assert(dst.rows()>=src.rows() && dst.cols()>=src.cols());
+    return _convert(1,src,_pitch(src),dst,_pitch(dst),src.rows(),src.cols(),
+                    cq);
+  }
+
+ private:
+  UCL_Device *_dev;
+  int _block_size, _max_groups;
+  UCL_PrimKernels *_kernels;
+
+  template <class mat_type>
+  inline int _pitch(const mat_type &mat) const {
+    return static_cast<int>(mat.row_bytes()/
+                            sizeof(typename mat_type::data_type));
+  }
+
+  inline UCL_PrimKernels * _get_kernels() {
+    if (_kernels==NULL) {
+      std::ostringstream key, src;
+      key << "ucl_half_convert_" << _UCL_DATA_ID<numtyp>::name() << "_"
+          << _block_size;
+      src << _ucl_prim_defs<numtyp>(_block_size)
+          << _ucl_half_convert_source();
+      const char *names[2]={"ucl_to_half","ucl_from_half"};
+      _kernels=_ucl_prim_kernels(*_dev,key.str(),src.str(),names,2);
+    }
+    return _kernels;
+  }
+
+  template <class in_type, class out_type>
+  inline int _convert(const int dir, const in_type &in, int in_pitch,
+                      out_type &out, int out_pitch, const size_t rows,
+                      const size_t cols, command_queue &cq) {
+    UCL_PrimKernels *k=_get_kernels();
+    if (k==NULL)
+      return UCL_COMPILE_ERROR;
+    int nrows=static_cast<int>(rows), ncols=static_cast<int>(cols);
+    if (nrows==0 || ncols==0)
+      return UCL_SUCCESS;
+    int in_off=in.offset(), out_off=out.offset();
+    int ngroups=(nrows*ncols+_block_size-1)/_block_size;
+    if (ngroups>_max_groups)
+      ngroups=_max_groups;
+    UCL_Kernel &kc=(*k)[dir];
+    kc.set_size(ngroups,_block_size,cq);
+    kc.clear_args();
+    kc.add_arg(&in);
+    kc.add_arg(&in_off);
+    kc.add_arg(&in_pitch);
+    kc.add_arg(&out);
+    kc.add_arg(&out_off);
+    kc.add_arg(&out_pitch);
+    kc.add_arg(&nrows);
+    kc.add_arg(&ncols);
+    kc.run();
+    return UCL_SUCCESS;
+  }
+};
+
+/// dst=src rounded to half precision (vectors or matrices)
+/** Queued on the default command queue for dev **/
+template <class mat_type, class half_type>
+inline int ucl_to_half(half_type &dst, const mat_type &src,
+                       UCL_Device &dev) {
+  UCL_HalfConvert<typename mat_type::data_type> hc(dev);
+  return hc.to_half(dst,src,dev.cq());
+}
+
+/// dst=src from half precision (vectors or matrices)
+/** Queued on the default command queue for dev **/
+template <class mat_type, class half_type>
+inline int ucl_from_half(mat_type &dst, const half_type &src,
+                         UCL_Device &dev) {
+  UCL_HalfConvert<typename mat_type::data_type> hc(dev);
+  return hc.from_half(dst,src,dev.cq());
+}
+
+#endif
@@ -0,0 +1,159 @@
+/***************************************************************************
+                                 ucl_hash.h
+                             -------------------
+
+  Content hashing for skipping uploads of unchanged host data
+
+ __________________________________________________________________________
+    This file is part of the Geryon Unified Coprocessor Library (UCL)
+ __________________________________________________________________________
+
+ ***************************************************************************/
+
+/* -----------------------------------------------------------------------
+   Copyright (2010) Sandia Corporation.  Under the terms of Contract
+   DE-AC04-94AL85000 with Sandia Corporation, the U.S. Government retains
+   certain rights in this software.  This software is distributed under
+   the Simplified BSD License.
+   ----------------------------------------------------------------------- */
+
+/***************************************************************************
+   ucl_hash64 is the 64-bit xxHash (XXH64) of a block of memory. It keeps
+   four independent accumulators, so it hashes at close to memory bandwidth
+   and is much cheaper than a transfer of the same data over PCIe.
+
+   A UCL_UploadHash remembers the hash of the data last copied to one
+   device buffer. ucl_copy() with a UCL_UploadHash, and UCL_Vector or
+   UCL_Matrix with skip_unchanged(true), hash the host data before each
+   upload and skip the transfer when the data has not changed:
+
+     UCL_UploadHash coeff_hash;
+     ...
+     ucl_copy(d_coeff,h_coeff,coeff_hash,cq);   // each step
+
+   The hash only describes what was sent from the host. If a kernel writes
+   to the device buffer, call invalidate() so that the next upload is not
+   skipped. Skipped uploads are counted by the UCL_UploadHash and by the
+   UCL_MemTracker of the device.
+ ***************************************************************************/
+
+#ifndef UCL_HASH_H
+#define UCL_HASH_H
+
+#include <cstring>
+#include <stdint.h>
+
+#define _UCL_XXH_P1 11400714785074694791ULL
+#define _UCL_XXH_P2 14029467366897019727ULL
+#define _UCL_XXH_P3 1609587929392839161ULL
+#define _UCL_XXH_P4 9650029242287828579ULL
+#define _UCL_XXH_P5 2870177450012600261ULL
+
+inline uint64_t _ucl_xxh_rotl(const uint64_t x, const int r)
+  { return (x<<r) | (x>>(64-r)); }
+
+inline uint64_t _ucl_xxh_read64(const unsigned char *p)
+  { uint64_t v; memcpy(&v,p,sizeof(v)); return v; }
+
+inline uint64_t _ucl_xxh_read32(const unsigned char *p)
+  { uint32_t v; memcpy(&v,p,sizeof(v)); return v; }
+
+inline uint64_t _ucl_xxh_round(uint64_t acc, const uint64_t input) {
+  acc+=input*_UCL_XXH_P2;
+  acc=_ucl_xxh_rotl(acc,31);
+  return acc*_UCL_XXH_P1;
+}
+
+inline uint64_t _ucl_xxh_merge(uint64_t acc, const uint64_t val) {
+  acc^=_ucl_xxh_round(0,val);
+  return acc*_UCL_XXH_P1+_UCL_XXH_P4;
+}
+
+/// 64-bit xxHash (XXH64) of bytes starting at data
+inline uint64_t ucl_hash64(const void *data, const size_t bytes,
+                           const uint64_t seed=0) {
+  const unsigned char *p=static_cast<const unsigned char *>(data);
+  const unsigned char *end=p+bytes;
+  uint64_t h;
+  if (bytes>=32) {
+    const unsigned char *limit=end-32;
+    uint64_t v1=seed+_UCL_XXH_P1+_UCL_XXH_P2;
+    uint64_t v2=seed+_UCL_XXH_P2;
+    uint64_t v3=seed;
+    uint64_t v4=seed-_UCL_XXH_P1;
+    do {
+      v1=_ucl_xxh_round(v1,_ucl_xxh_read64(p));
+      v2=_ucl_xxh_round(v2,_ucl_xxh_read64(p+8));
+      v3=_ucl_xxh_round(v3,_ucl_xxh_read64(p+16));
+      v4=_ucl_xxh_round(v4,_ucl_xxh_read64(p+24));
+      p+=32;
+    } while (p<=limit);
+    h=_ucl_xxh_rotl(v1,1)+_ucl_xxh_rotl(v2,7)+_ucl_xxh_rotl(v3,12)+
+      _ucl_xxh_rotl(v4,18);
+    h=_ucl_xxh_merge(h,v1);
+    h=_ucl_xxh_merge(h,v2);
+    h=_ucl_xxh_merge(h,v3);
+    h=_ucl_xxh_merge(h,v4);
+  } else
+    h=seed+_UCL_XXH_P5;
+  h+=static_cast<uint64_t>(bytes);
+
+  for ( ; p+8<=end; p+=8) {
+    h^=_ucl_xxh_round(0,_ucl_xxh_read64(p));
+    h=_ucl_xxh_rotl(h,27)*_UCL_XXH_P1+_UCL_XXH_P4;
+  }
+  if (p+4<=end) {
+    h^=_ucl_xxh_read32(p)*_UCL_XXH_P1;
+    h=_ucl_xxh_rotl(h,23)*_UCL_XXH_P2+_UCL_XXH_P3;
+    p+=4;
+  }
+  for ( ; p<end; p++) {
+    h^=(*p)*_UCL_XXH_P5;
+    h=_ucl_xxh_rotl(h,11)*_UCL_XXH_P1;
+  }
+
+  h^=h>>33;
+  h*=_UCL_XXH_P2;
+  h^=h>>29;
+  h*=_UCL_XXH_P3;
+  h^=h>>32;
+  return h;
+}
+
+/// Hash of the data last uploaded to one device buffer
+class UCL_UploadHash {
+ public:
+  UCL_UploadHash() : _valid(false), _hash(0), _bytes(0), _skipped(0),
+                     _bytes_avoided(0) {}
+
+  /// Forget the last upload so that the next one is not skipped
+  inline void invalidate() { _valid=false; }
+
+  /// True if bytes with hash h were the last upload (counted as skipped)
+  /** Otherwise h is recorded as the last upload **/
+  inline bool unchanged(const uint64_t h, const size_t bytes) {
+    if (_valid && h==_hash && bytes==_bytes) {
+      _skipped++;
+      _bytes_avoided+=bytes;
+      return true;
+    }
+    _valid=true;
+    _hash=h;
+    _bytes=bytes;
+    return false;
+  }
+
+  /// Number of uploads skipped
+  inline size_t skipped() const { return _skipped; }
+  /// Bytes not transferred because uploads were skipped
+  inline size_t bytes_avoided() const { return _bytes_avoided; }
+  /// Zero the counters
+  inline void reset_counters() { _skipped=_bytes_avoided=0; }
+
+ private:
+  bool _valid;
+  uint64_t _hash;
+  size_t _bytes, _skipped, _bytes_avoided;
+};
+
+#endif
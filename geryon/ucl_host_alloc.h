@@ -0,0 +1,319 @@
+/***************************************************************************
+                               ucl_host_alloc.h
+                             -------------------
+
+  NUMA placement and hugepages for host allocations
+
+ __________________________________________________________________________
+    This file is part of the Geryon Unified Coprocessor Library (UCL)
+ __________________________________________________________________________
+
+ ***************************************************************************/
+
+/* -----------------------------------------------------------------------
+   Copyright (2010) Sandia Corporation.  Under the terms of Contract
+   DE-AC04-94AL85000 with Sandia Corporation, the U.S. Government retains
+   certain rights in this software.  This software is distributed under
+   the Simplified BSD License.
+   ----------------------------------------------------------------------- */
+
+/***************************************************************************
+   By default, pinned host memory for UCL_H_Vec and UCL_H_Mat is allocated
+   by the driver, which decides where the pages are placed. A
+   UCL_HostPolicy makes Geryon map the memory itself and then pin it
+   (CL_MEM_USE_HOST_PTR for OpenCL, cuMemHostRegister for CUDA):
+
+     UCL_HostPolicy p;
+     p.placement=UCL_HOST_BIND;          // all pages on NUMA node 1
+     p.node=1;
+     p.pages=UCL_PAGES_THP;              // 2 MB aligned, transparent hugepages
+     dev.host_policy()=p;                // default for host allocations
+     x.host.host_policy(p);              // or for one container
+
+   Placements:
+     UCL_HOST_BIND        - pages on one node (MPOL_BIND)
+     UCL_HOST_INTERLEAVE  - pages round-robin across allowed nodes
+     UCL_HOST_FIRST_TOUCH - pages zeroed in parallel by 'threads' host
+                            threads bound evenly to the allowed nodes, so
+                            each node gets a contiguous share of the pages
+     UCL_HOST_ANY         - pages placed by the kernel (for hugepages only)
+
+   Pages:
+     UCL_PAGES_THP        - 2 MB aligned with madvise(MADV_HUGEPAGE)
+     UCL_PAGES_HUGE       - explicit hugepages (MAP_HUGETLB); falls back to
+                            UCL_PAGES_THP if none are reserved
+
+   With CUDA, memory mapped for a policy is page-locked with
+   cuMemHostRegister, which cannot make it write-combined; UCL_WRITE_ONLY
+   containers with a policy use ordinary cached pinned memory.
+
+   NUMA placement uses the mbind system call directly, so libnuma is not
+   required. It is ignored where the kernel has no NUMA support. Memory is
+   always aligned to at least a page, which satisfies the OpenCL base
+   address alignment for zero-copy CL_MEM_USE_HOST_PTR buffers.
+ ***************************************************************************/
+
+#ifndef UCL_HOST_ALLOC_H
+#define UCL_HOST_ALLOC_H
+
+#include <cstdio>
+#include <cstring>
+#include <vector>
+#include <unistd.h>
+#include <sys/mman.h>
+#include "ucl_thread.h"
+
+#ifdef __linux__
+#include <sched.h>
+#include <sys/syscall.h>
+#endif
+
+/// Placement of pages for host allocations
+enum UCL_HOST_PLACEMENT {
+  UCL_HOST_DEFAULT,     ///< Use the policy of the device (containers only)
+  UCL_HOST_DRIVER,      ///< Allocated by the driver
+  UCL_HOST_ANY,         ///< Allocated by Geryon, pages placed by the kernel
+  UCL_HOST_BIND,        ///< All pages on one NUMA node
+  UCL_HOST_INTERLEAVE,  ///< Pages interleaved across the allowed nodes
+  UCL_HOST_FIRST_TOUCH  ///< Pages touched in parallel by host threads
+};
+
+/// Page size for host allocations
+enum UCL_HOST_PAGES {
+  UCL_PAGES_DEFAULT,    ///< Base pages
+  UCL_PAGES_THP,        ///< 2 MB aligned and advised for transparent hugepages
+  UCL_PAGES_HUGE        ///< Explicit hugepages, THP if none are available
+};
+
+/// Size of hugepages used for alignment
+#define UCL_HUGEPAGE_BYTES 2097152
+
+/// Placement policy for host allocations
+struct UCL_HostPolicy {
+  UCL_HostPolicy() : placement(UCL_HOST_DEFAULT), pages(UCL_PAGES_DEFAULT),
+                     node(0), threads(0) {}
+  UCL_HostPolicy(const enum UCL_HOST_PLACEMENT p,
+                 const enum UCL_HOST_PAGES pg=UCL_PAGES_DEFAULT,
+                 const int n=0) :
+    placement(p), pages(pg), node(n), threads(0) {}
+
+  enum UCL_HOST_PLACEMENT placement;
+  enum UCL_HOST_PAGES pages;
+  /// Node for UCL_HOST_BIND
+  int node;
+  /// Threads for UCL_HOST_FIRST_TOUCH (0 for one per online processor)
+  int threads;
+
+  /// True if the memory is allocated by the driver
+  inline bool driver() const {
+    return (placement==UCL_HOST_DEFAULT || placement==UCL_HOST_DRIVER) &&
+           pages==UCL_PAGES_DEFAULT;
+  }
+};
+
+#define _UCL_NUMA_MASK_WORDS 16
+#define _UCL_MPOL_BIND 2
+#define _UCL_MPOL_INTERLEAVE 3
+#define _UCL_MPOL_F_MEMS_ALLOWED 4
+
+// Get the nodes this process may allocate on; false if there is no NUMA
+// support
+inline bool _ucl_numa_allowed(unsigned long *mask) {
+  memset(mask,0,sizeof(unsigned long)*_UCL_NUMA_MASK_WORDS);
+  #if defined(__linux__) && defined(SYS_get_mempolicy)
+  int mode;
+  return syscall(SYS_get_mempolicy,&mode,mask,
+                 _UCL_NUMA_MASK_WORDS*8*sizeof(unsigned long),0,
+                 _UCL_MPOL_F_MEMS_ALLOWED)==0;
+  #else
+  return false;
+  #endif
+}
+
+// List the nodes this process may allocate on (node 0 without NUMA)
+inline void _ucl_numa_node_list(std::vector<int> &nodes) {
+  nodes.clear();
+  unsigned long mask[_UCL_NUMA_MASK_WORDS];
+  if (_ucl_numa_allowed(mask)) {
+    const int bits=8*sizeof(unsigned long);
+    for (int i=0; i<_UCL_NUMA_MASK_WORDS*bits; i++)
+      if (mask[i/bits] & (1UL<<(i%bits)))
+        nodes.push_back(i);
+  }
+  if (nodes.empty())
+    nodes.push_back(0);
+}
+
+/// Number of NUMA nodes this process may allocate on (1 without NUMA)
+inline int ucl_numa_nodes() {
+  std::vector<int> nodes;
+  _ucl_numa_node_list(nodes);
+  return static_cast<int>(nodes.size());
+}
+
+// Bind the calling thread to the processors of a NUMA node (no-op if the
+// node's processors cannot be read)
+inline void _ucl_bind_node(const int node) {
+  #if defined(__linux__) && defined(CPU_SET)
+  char name[64];
+  snprintf(name,64,"/sys/devices/system/node/node%d/cpulist",node);
+  FILE *in=fopen(name,"r");
+  if (in==NULL)
+    return;
+  cpu_set_t set;
+  CPU_ZERO(&set);
+  int first, last;
+  while (fscanf(in,"%d",&first)==1) {
+    last=first;
+    int c=fgetc(in);
+    if (c=='-') {
+      if (fscanf(in,"%d",&last)!=1)
+        break;
+      c=fgetc(in);
+    }
+    for (int i=first; i<=last && i<CPU_SETSIZE; i++)
+      CPU_SET(i,&set);
+    if (c!=',')
+      break;
+  }
+  fclose(in);
+  if (CPU_COUNT(&set)>0)
+    pthread_setaffinity_np(pthread_self(),sizeof(set),&set);
+  #endif
+}
+
+// Apply the NUMA placement of a policy to a mapping; false on failure
+inline bool _ucl_numa_place(void *ptr, const size_t bytes,
+                            const UCL_HostPolicy &p) {
+  if (p.placement!=UCL_HOST_BIND && p.placement!=UCL_HOST_INTERLEAVE)
+    return true;
+  #if defined(__linux__) && defined(SYS_mbind)
+  unsigned long mask[_UCL_NUMA_MASK_WORDS];
+  if (!_ucl_numa_allowed(mask))
+    return true;
+  int mode=_UCL_MPOL_INTERLEAVE;
+  if (p.placement==UCL_HOST_BIND) {
+    const int bits=8*sizeof(unsigned long);
+    if (p.node<0 || p.node>=_UCL_NUMA_MASK_WORDS*bits ||
+        (mask[p.node/bits] & (1UL<<(p.node%bits)))==0)
+      return false;
+    memset(mask,0,sizeof(mask));
+    mask[p.node/bits]=1UL<<(p.node%bits);
+    mode=_UCL_MPOL_BIND;
+  }
+  return syscall(SYS_mbind,ptr,bytes,mode,mask,
+                 _UCL_NUMA_MASK_WORDS*8*sizeof(unsigned long)+1,0)==0;
+  #else
+  return true;
+  #endif
+}
+
+// Slice of an allocation zeroed by one thread on a node (-1 for no
+// binding)
+struct _ucl_touch_part {
+  char *ptr;
+  size_t bytes;
+  int node;
+};
+
+inline void * _ucl_touch(void *arg) {
+  _ucl_touch_part &p=*static_cast<_ucl_touch_part *>(arg);
+  if (p.node>=0)
+    _ucl_bind_node(p.node);
+  memset(p.ptr,0,p.bytes);
+  return NULL;
+}
+
+// Zero an allocation with several threads, splitting at page boundaries.
+// With more than one allowed node, the threads are spread evenly over the
+// nodes and bound to their processors, so each node gets a contiguous
+// share of the pages.
+inline void _ucl_first_touch(void *ptr, const size_t bytes, int threads,
+                             const size_t page) {
+  if (threads<=0)
+    threads=static_cast<int>(sysconf(_SC_NPROCESSORS_ONLN));
+  const size_t pages=bytes/page;
+  if (threads>static_cast<int>(pages))
+    threads=static_cast<int>(pages);
+  if (threads<=1) {
+    memset(ptr,0,bytes);
+    return;
+  }
+  std::vector<int> nodes;
+  _ucl_numa_node_list(nodes);
+  const int nnodes=static_cast<int>(nodes.size());
+  std::vector<_ucl_touch_part> part(threads);
+  UCL_Thread *thread=new UCL_Thread[threads];
+  size_t start=0;
+  for (int i=0; i<threads; i++) {
+    const size_t n=(pages/threads+(static_cast<size_t>(i)<pages%threads))*
+                   page;
+    part[i].ptr=static_cast<char *>(ptr)+start;
+    part[i].bytes=n;
+    part[i].node=(nnodes>1) ? nodes[i*nnodes/threads] : -1;
+    start+=n;
+    if (!thread[i].start(_ucl_touch,&part[i])) {
+      // Zero the slice here without binding the calling thread
+      part[i].node=-1;
+      _ucl_touch(&part[i]);
+    }
+  }
+  for (int i=0; i<threads; i++)
+    thread[i].join();
+  delete [] thread;
+}
+
+/// Map n bytes of host memory following a policy
+/** \param mapped Set to the number of bytes mapped, n rounded up to a
+  *        multiple of the page size (needed by ucl_host_unmap)
+  * \return NULL if the memory could not be mapped or placed **/
+inline void * ucl_host_map(const size_t n, const UCL_HostPolicy &p,
+                           size_t &mapped) {
+  const size_t base=static_cast<size_t>(sysconf(_SC_PAGESIZE));
+  const size_t page=(p.pages==UCL_PAGES_DEFAULT) ? base : UCL_HUGEPAGE_BYTES;
+  mapped=(n>0) ? (n+page-1)/page*page : page;
+
+  void *ptr=MAP_FAILED;
+  #ifdef MAP_HUGETLB
+  if (p.pages==UCL_PAGES_HUGE)
+    ptr=mmap(NULL,mapped,PROT_READ | PROT_WRITE,
+             MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB,-1,0);
+  #endif
+  if (ptr==MAP_FAILED) {
+    // Map an extra page so that the start can be aligned to page
+    const size_t extra=(page>base) ? page : 0;
+    char *raw=static_cast<char *>(mmap(NULL,mapped+extra,
+                                       PROT_READ | PROT_WRITE,
+                                       MAP_PRIVATE | MAP_ANONYMOUS,-1,0));
+    if (raw==MAP_FAILED)
+      return NULL;
+    char *start=raw;
+    if (extra>0) {
+      start=raw+(page-reinterpret_cast<size_t>(raw)%page)%page;
+      if (start>raw)
+        munmap(raw,start-raw);
+      if (raw+mapped+extra>start+mapped)
+        munmap(start+mapped,raw+mapped+extra-start-mapped);
+      #ifdef MADV_HUGEPAGE
+      madvise(start,mapped,MADV_HUGEPAGE);
+      #endif
+    }
+    ptr=start;
+  }
+
+  if (!_ucl_numa_place(ptr,mapped,p)) {
+    munmap(ptr,mapped);
+    return NULL;
+  }
+  if (p.placement==UCL_HOST_FIRST_TOUCH)
+    _ucl_first_touch(ptr,mapped,p.threads,page);
+  return ptr;
+}
+
+/// Unmap memory from ucl_host_map
+inline void ucl_host_unmap(void *ptr, const size_t mapped) {
+  if (ptr!=NULL && mapped>0)
+    munmap(ptr,mapped);
+}
+
+#endif
@@ -0,0 +1,481 @@
+/***************************************************************************
+                                ucl_host_copy.h
+                             -------------------
+
+  Parallel host to host copies and casts for large containers
+
+ __________________________________________________________________________
+    This file is part of the Geryon Unified Coprocessor Library (UCL)
+ __________________________________________________________________________
+
+ ***************************************************************************/
+
+/* -----------------------------------------------------------------------
+   Copyright (2010) Sandia Corporation.  Under the terms of Contract
+   DE-AC04-94AL85000 with Sandia Corporation, the U.S. Government retains
+   certain rights in this software.  This software is distributed under
+   the Simplified BSD License.
+   ----------------------------------------------------------------------- */
+
+/***************************************************************************
+   Host to host copies and casts in ucl_copy() are split across a
+   persistent pool of host threads when the destination is at least
+   parallel_bytes() (UCL_PARALLEL_COPY_BYTES by default):
+
+     ucl_copy_pool().threads(32);            // 0 for one per processor
+     ucl_copy_pool().parallel_bytes(64<<20); // only copies of 64 MB or more
+     ucl_copy(big_host,other_host,false);
+
+   The threads are started by the first parallel copy and kept until the
+   program exits or threads() is changed. The calling thread also takes
+   part in the copy.
+
+   With more than one NUMA node, the pool threads are spread over the nodes
+   and bound to their processors. The copy is split into chunks at page
+   boundaries of the destination (long rows of a pitched copy are split
+   into column ranges), and each chunk is given first to a thread on the
+   node that holds its destination pages. Pages that are not mapped yet
+   are not faulted in to find their node.
+
+   Destinations larger than stream_bytes() (the size of the last-level
+   cache by default) are written with non-temporal stores where available
+   (SSE2), so the copy does not evict the cache or read the destination
+   first. Casts are done in small blocks in the cache and then streamed.
+
+   Only one parallel copy runs at a time; a copy from another host thread
+   while the pool is in use is done by that thread alone. The settings are
+   not thread-safe.
+ ***************************************************************************/
+
+#ifndef UCL_HOST_COPY_H
+#define UCL_HOST_COPY_H
+
+#include <cstring>
+#include <vector>
+#include <unistd.h>
+#include "ucl_thread.h"
+#include "ucl_host_alloc.h"
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+/// Default destination bytes for a host copy to use the copy pool
+#ifndef UCL_PARALLEL_COPY_BYTES
+#define UCL_PARALLEL_COPY_BYTES 16777216
+#endif
+
+/// Smallest number of bytes copied by one thread at a time
+#define UCL_COPY_MIN_CHUNK 1048576
+
+/// Last-level cache size used when it cannot be queried
+#define UCL_DEFAULT_LLC_BYTES 33554432
+
+/// Copy bytes with non-temporal stores (memcpy without SSE2)
+/** Use for destinations that will not be read again soon **/
+inline void ucl_stream_copy(void *dst, const void *src, size_t bytes) {
+  #ifdef __SSE2__
+  char *d=static_cast<char *>(dst);
+  const char *s=static_cast<const char *>(src);
+  const size_t head=(16-reinterpret_cast<size_t>(d)%16)%16;
+  if (bytes<head+64) {
+    memcpy(d,s,bytes);
+    return;
+  }
+  memcpy(d,s,head);
+  d+=head;
+  s+=head;
+  bytes-=head;
+  for ( ; bytes>=64; bytes-=64, d+=64, s+=64) {
+    const __m128i a=_mm_loadu_si128(reinterpret_cast<const __m128i *>(s));
+    const __m128i b=_mm_loadu_si128(reinterpret_cast<const __m128i *>(s+16));
+    const __m128i c=_mm_loadu_si128(reinterpret_cast<const __m128i *>(s+32));
+    const __m128i e=_mm_loadu_si128(reinterpret_cast<const __m128i *>(s+48));
+    _mm_stream_si128(reinterpret_cast<__m128i *>(d),a);
+    _mm_stream_si128(reinterpret_cast<__m128i *>(d+16),b);
+    _mm_stream_si128(reinterpret_cast<__m128i *>(d+32),c);
+    _mm_stream_si128(reinterpret_cast<__m128i *>(d+48),e);
+  }
+  memcpy(d,s,bytes);
+  _mm_sfence();
+  #else
+  memcpy(dst,src,bytes);
+  #endif
+}
+
+/// Size of the last-level cache in bytes
+inline size_t ucl_llc_bytes() {
+  long b=0;
+  #ifdef _SC_LEVEL3_CACHE_SIZE
+  b=sysconf(_SC_LEVEL3_CACHE_SIZE);
+  #endif
+  #ifdef _SC_LEVEL2_CACHE_SIZE
+  if (b<=0)
+    b=sysconf(_SC_LEVEL2_CACHE_SIZE);
+  #endif
+  return (b>0) ? static_cast<size_t>(b) : UCL_DEFAULT_LLC_BYTES;
+}
+
+// NUMA node holding the page at ptr (-1 if unknown or not yet mapped)
+// move_pages() with no target nodes only reports the node of each page;
+// unlike get_mempolicy(), it does not fault in a page that is not mapped
+inline int _ucl_page_node(const void *ptr) {
+  #if defined(__linux__) && defined(SYS_move_pages)
+  const void *page[1]={ptr};
+  int status=-1;
+  if (syscall(SYS_move_pages,0,1UL,page,NULL,&status,0)==0 && status>=0)
+    return status;
+  #endif
+  return -1;
+}
+
+// NUMA node of the processor running the calling thread (-1 if unknown)
+inline int _ucl_current_node() {
+  #if defined(__linux__) && defined(SYS_getcpu)
+  unsigned cpu, node;
+  if (syscall(SYS_getcpu,&cpu,&node,NULL)==0)
+    return static_cast<int>(node);
+  #endif
+  return -1;
+}
+
+/// Persistent pool of host threads for large host copies
+/** Use ucl_copy_pool() to get the pool used by ucl_copy() **/
+class UCL_CopyPool {
+ public:
+  UCL_CopyPool() : _threads(0), _parallel_bytes(UCL_PARALLEL_COPY_BYTES),
+                   _stream_bytes(ucl_llc_bytes()), _workers(NULL),
+                   _num_workers(0), _stop(false), _generation(0),
+                   _fn(NULL), _arg(NULL), _remaining(0) {
+    _ucl_numa_node_list(_nodes);
+  }
+  ~UCL_CopyPool() { clear(); }
+
+  /// Set the number of threads used for a copy, including the caller
+  /** 0 uses one per online processor; 1 turns off parallel copies **/
+  inline void threads(const int n) {
+    clear();
+    _threads=(n>0) ? n : 0;
+  }
+
+  /// Number of threads used for a copy, including the caller
+  inline int threads() const {
+    if (_threads>0)
+      return _threads;
+    const long n=sysconf(_SC_NPROCESSORS_ONLN);
+    return (n>0) ? static_cast<int>(n) : 1;
+  }
+
+  /// Copies with at least this many destination bytes use the pool
+  inline void parallel_bytes(const size_t bytes) { _parallel_bytes=bytes; }
+
+  /// Copies with at least this many destination bytes use the pool
+  inline size_t parallel_bytes() const { return _parallel_bytes; }
+
+  /// Copies with more destination bytes use non-temporal stores
+  inline void stream_bytes(const size_t bytes) { _stream_bytes=bytes; }
+
+  /// Copies with more destination bytes use non-temporal stores
+  inline size_t stream_bytes() const { return _stream_bytes; }
+
+  /// Number of NUMA nodes the threads are spread over
+  inline int nodes() const { return static_cast<int>(_nodes.size()); }
+
+  /// Index (0 to nodes()-1) of the node holding the page at ptr
+  inline int node_index(const void *ptr) const {
+    if (_nodes.size()<2)
+      return 0;
+    return _index(_ucl_page_node(ptr));
+  }
+
+  /// Run fn(arg,i) for each chunk i with the pool
+  /** \param node Node index for each chunk; chunks are taken first by
+    *        threads on that node
+    * \return false (without running anything) if the pool is in use by
+    *         another thread **/
+  inline bool run(void (*fn)(void *, const size_t), void *arg,
+                  const std::vector<int> &node) {
+    if (!_run_lock.try_lock())
+      return false;
+    _start();
+    _lock.lock();
+    _fn=fn;
+    _arg=arg;
+    _queue.assign(_nodes.size(),std::vector<size_t>());
+    _next.assign(_nodes.size(),0);
+    for (size_t i=0; i<node.size(); i++)
+      _queue[node[i]].push_back(i);
+    _remaining=node.size();
+    _generation++;
+    _work.broadcast();
+    _drain(_nodes.size()<2 ? 0 : _index(_ucl_current_node()));
+    while (_remaining>0)
+      _done.wait(_lock);
+    _fn=NULL;
+    _arg=NULL;
+    _lock.unlock();
+    _run_lock.unlock();
+    return true;
+  }
+
+  /// Stop and join the pool threads (restarted by the next copy)
+  inline void clear() {
+    if (_workers==NULL)
+      return;
+    _lock.lock();
+    _stop=true;
+    _work.broadcast();
+    _lock.unlock();
+    for (int i=0; i<_num_workers; i++)
+      _workers[i].thread.join();
+    delete [] _workers;
+    _workers=NULL;
+    _num_workers=0;
+    _stop=false;
+  }
+
+ private:
+  struct _Worker {
+    UCL_CopyPool *pool;
+    int node;
+    UCL_Thread thread;
+  };
+
+  int _threads;
+  size_t _parallel_bytes, _stream_bytes;
+  std::vector<int> _nodes;
+  _Worker *_workers;
+  int _num_workers;
+  UCL_Mutex _run_lock, _lock;
+  UCL_Cond _work, _done;
+  bool _stop;
+  unsigned long _generation;
+  void (*_fn)(void *, const size_t);
+  void *_arg;
+  // Chunks waiting for each node and the next one to take
+  std::vector<std::vector<size_t> > _queue;
+  std::vector<size_t> _next;
+  size_t _remaining;
+
+  UCL_CopyPool(const UCL_CopyPool &);
+  UCL_CopyPool & operator=(const UCL_CopyPool &);
+
+  // Index of an OS node number (0 if unknown)
+  inline int _index(const int node) const {
+    for (size_t i=0; i<_nodes.size(); i++)
+      if (_nodes[i]==node)
+        return static_cast<int>(i);
+    return 0;
+  }
+
+  // Start the threads if they are not running
+  inline void _start() {
+    if (_workers!=NULL)
+      return;
+    _num_workers=threads()-1;
+    _workers=new _Worker[(_num_workers>0) ? _num_workers : 1];
+    for (int i=0; i<_num_workers; i++) {
+      _workers[i].pool=this;
+      _workers[i].node=i%static_cast<int>(_nodes.size());
+      if (!_workers[i].thread.start(_worker,&_workers[i])) {
+        _num_workers=i;
+        break;
+      }
+    }
+  }
+
+  // Take a chunk, first from node's queue and then from the others
+  inline bool _take(const int node, size_t &chunk) {
+    for (size_t i=0; i<_queue.size(); i++) {
+      const size_t q=(node+i)%_queue.size();
+      if (_next[q]<_queue[q].size()) {
+        chunk=_queue[q][_next[q]++];
+        return true;
+      }
+    }
+    return false;
+  }
+
+  // Run chunks until none are left (called with _lock held)
+  inline void _drain(const int node) {
+    size_t chunk;
+    while (_take(node,chunk)) {
+      _lock.unlock();
+      _fn(_arg,chunk);
+      _lock.lock();
+      if (--_remaining==0)
+        _done.broadcast();
+    }
+  }
+
+  static void * _worker(void *arg) {
+    _Worker &w=*static_cast<_Worker *>(arg);
+    UCL_CopyPool &p=*w.pool;
+    if (p._nodes.size()>1)
+      _ucl_bind_node(p._nodes[w.node]);
+    unsigned long seen=0;
+    p._lock.lock();
+    while (true) {
+      while (p._generation==seen && !p._stop)
+        p._work.wait(p._lock);
+      if (p._stop)
+        break;
+      seen=p._generation;
+      if (p._fn!=NULL)
+        p._drain(w.node);
+    }
+    p._lock.unlock();
+    return NULL;
+  }
+};
+
+/// Pool of host threads used by ucl_copy() for large host copies
+inline UCL_CopyPool & ucl_copy_pool() {
+  static UCL_CopyPool pool;
+  return pool;
+}
+
+// Byte copy for _ucl_parallel_cast
+struct _ucl_byte_copy {
+  static inline void cast(char *dst, const char *src, const size_t n)
+    { memcpy(dst,src,n); }
+};
+
+// Cast n elements with op, streaming the results if requested
+template <class op, class t1, class t2> struct _ucl_copy_kernel {
+  static inline void run(t1 *dst, const t2 *src, const size_t n,
+                         const bool stream) {
+    if (!stream) {
+      op::cast(dst,src,n);
+      return;
+    }
+    // Cast blocks into the cache and stream them out
+    const size_t block=(16384/sizeof(t1)>0) ? 16384/sizeof(t1) : 1;
+    t1 buffer[(16384/sizeof(t1)>0) ? 16384/sizeof(t1) : 1];
+    for (size_t i=0; i<n; i+=block) {
+      const size_t m=(n-i<block) ? n-i : block;
+      op::cast(buffer,src+i,m);
+      ucl_stream_copy(dst+i,buffer,m*sizeof(t1));
+    }
+  }
+};
+
+template <> struct _ucl_copy_kernel<_ucl_byte_copy,char,char> {
+  static inline void run(char *dst, const char *src, const size_t n,
+                         const bool stream) {
+    if (stream)
+      ucl_stream_copy(dst,src,n);
+    else
+      memcpy(dst,src,n);
+  }
+};
+
+// Chunks of a copy run by the pool
+template <class op, class t1, class t2> struct _ucl_copy_job {
+  t1 *dst;
+  const t2 *src;
+  size_t dst_stride, src_stride;
+  bool stream;
+  // Rows [r0,r1) and columns [c0,c1) of each chunk
+  struct part { size_t r0, r1, c0, c1; };
+  std::vector<part> parts;
+
+  inline void add(const size_t r0, const size_t r1, const size_t c0,
+                  const size_t c1) {
+    part p={r0,r1,c0,c1};
+    parts.push_back(p);
+  }
+
+  // Split n elements of row r into chunks of about per elements that start
+  // on page boundaries of dst
+  inline void split_row(const size_t r, const size_t n, const size_t per) {
+    const t1 *d=dst+r*dst_stride;
+    const bool align=(4096%sizeof(t1)==0 &&
+                      reinterpret_cast<size_t>(d)%sizeof(t1)==0);
+    size_t b=0;
+    for (size_t e=per; b<n; e+=per) {
+      size_t s=(e<n) ? e : n;
+      if (align && s<n)
+        s-=(reinterpret_cast<size_t>(d+s)%4096)/sizeof(t1);
+      if (s>b) {
+        add(r,r+1,b,s);
+        b=s;
+      }
+    }
+  }
+
+  // Elements in each of k chunks of n, but at least UCL_COPY_MIN_CHUNK bytes
+  static inline size_t per_chunk(const size_t n, const size_t k) {
+    const size_t per=n/k;
+    if (per*sizeof(t1)<UCL_COPY_MIN_CHUNK)
+      return UCL_COPY_MIN_CHUNK/sizeof(t1)+1;
+    return per;
+  }
+
+  static void chunk(void *arg, const size_t c) {
+    _ucl_copy_job &j=*static_cast<_ucl_copy_job *>(arg);
+    const part &p=j.parts[c];
+    for (size_t r=p.r0; r<p.r1; r++)
+      _ucl_copy_kernel<op,t1,t2>::run(j.dst+r*j.dst_stride+p.c0,
+                                      j.src+r*j.src_stride+p.c0,
+                                      p.c1-p.c0,j.stream);
+  }
+};
+
+/// Cast rows of cols elements with op::cast(dst,src,n) using the pool
+/** \param dst_stride Elements between the start of each row in dst
+  * \param src_stride Elements between the start of each row in src
+  * \return false if nothing was copied because the copy is smaller than
+  *         parallel_bytes() or the pool is in use **/
+template <class op, class t1, class t2>
+inline bool _ucl_parallel_cast(t1 *dst, const size_t dst_stride,
+                               const t2 *src, const size_t src_stride,
+                               const size_t rows, const size_t cols) {
+  UCL_CopyPool &pool=ucl_copy_pool();
+  const size_t bytes=rows*cols*sizeof(t1);
+  if (rows==0 || cols==0 || bytes<pool.parallel_bytes() || pool.threads()<2)
+    return false;
+
+  typedef _ucl_copy_job<op,t1,t2> job_type;
+  job_type job;
+  job.dst=dst;
+  job.src=src;
+  job.dst_stride=dst_stride;
+  job.src_stride=src_stride;
+  job.stream=(bytes>pool.stream_bytes());
+  const size_t nparts=4*static_cast<size_t>(pool.threads());
+
+  if (rows==1 || (dst_stride==cols && src_stride==cols)) {
+    // Contiguous; copy as one row
+    job.split_row(0,rows*cols,job_type::per_chunk(rows*cols,nparts));
+  } else if (rows>=nparts) {
+    size_t per=rows/nparts;
+    if (per*cols*sizeof(t1)<UCL_COPY_MIN_CHUNK)
+      per=UCL_COPY_MIN_CHUNK/(cols*sizeof(t1))+1;
+    for (size_t r=0; r<rows; r+=per)
+      job.add(r,(r+per<rows) ? r+per : rows,0,cols);
+  } else {
+    // A few long rows; split each row into column ranges
+    const size_t per=job_type::per_chunk(cols,(nparts+rows-1)/rows);
+    for (size_t r=0; r<rows; r++)
+      job.split_row(r,cols,per);
+  }
+
+  std::vector<int> node(job.parts.size());
+  for (size_t c=0; c<job.parts.size(); c++)
+    node[c]=pool.node_index(dst+job.parts[c].r0*dst_stride+job.parts[c].c0);
+  return pool.run(&job_type::chunk,&job,node);
+}
+
+/// Copy rows of width bytes using the pool
+/** \return false if nothing was copied because the copy is smaller than
+  *         parallel_bytes() or the pool is in use **/
+inline bool _ucl_parallel_copy(void *dst, const size_t dpitch,
+                               const void *src, const size_t spitch,
+                               const size_t width, const size_t rows) {
+  return _ucl_parallel_cast<_ucl_byte_copy>(static_cast<char *>(dst),dpitch,
+                                            static_cast<const char *>(src),
+                                            spitch,rows,width);
+}
+
+#endif
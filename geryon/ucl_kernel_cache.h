@@ -0,0 +1,77 @@
+/***************************************************************************
+                             ucl_kernel_cache.h
+                             -------------------
+
+  Per-device cache for kernels generated and compiled at run time
+
+ __________________________________________________________________________
+    This file is part of the Geryon Unified Coprocessor Library (UCL)
+ __________________________________________________________________________
+
+ ***************************************************************************/
+
+/* -----------------------------------------------------------------------
+   Copyright (2010) Sandia Corporation.  Under the terms of Contract
+   DE-AC04-94AL85000 with Sandia Corporation, the U.S. Government retains
+   certain rights in this software.  This software is distributed under
+   the Simplified BSD License.
+   ----------------------------------------------------------------------- */
+
+/***************************************************************************
+   Each UCL_Device owns a UCL_KernelCache. The device primitives (reductions,
+   scans, sorts, ...) generate kernel source for a data type and parameter
+   set, compile it on first use, and store the program here under a string
+   key so that later calls with the same key reuse the compiled kernels.
+   Entries are deleted before the device context is released.
+ ***************************************************************************/
+
+#ifndef UCL_KERNEL_CACHE_H
+#define UCL_KERNEL_CACHE_H
+
+#include <map>
+#include <string>
+
+/// Base class for data stored in a UCL_KernelCache
+class UCL_KernelCacheEntry {
+ public:
+  virtual ~UCL_KernelCacheEntry() {}
+};
+
+/// Compiled kernels stored by key
+class UCL_KernelCache {
+ public:
+  UCL_KernelCache() {}
+  ~UCL_KernelCache() { clear(); }
+
+  /// Return the entry for key (NULL if not found)
+  inline UCL_KernelCacheEntry * find(const std::string &key) const {
+    std::map<std::string,UCL_KernelCacheEntry *>::const_iterator i;
+    i=_entries.find(key);
+    return (i==_entries.end()) ? NULL : i->second;
+  }
+
+  /// Store an entry for key (the cache takes ownership)
+  inline void insert(const std::string &key, UCL_KernelCacheEntry *entry) {
+    UCL_KernelCacheEntry *&e=_entries[key];
+    delete e;
+    e=entry;
+  }
+
+  /// Number of cached entries
+  inline size_t size() const { return _entries.size(); }
+
+  /// Delete all cached entries
+  inline void clear() {
+    std::map<std::string,UCL_KernelCacheEntry *>::iterator i;
+    for (i=_entries.begin(); i!=_entries.end(); ++i)
+      delete i->second;
+    _entries.clear();
+  }
+
+ private:
+  std::map<std::string,UCL_KernelCacheEntry *> _entries;
+  UCL_KernelCache(const UCL_KernelCache &);
+  UCL_KernelCache & operator=(const UCL_KernelCache &);
+};
+
+#endif
@@ -0,0 +1,108 @@
+/***************************************************************************
+                                ucl_managed.h
+                             -------------------
+
+  Eviction of device containers to host memory for oversubscription
+
+ __________________________________________________________________________
+    This file is part of the Geryon Unified Coprocessor Library (UCL)
+ __________________________________________________________________________
+
+ ***************************************************************************/
+
+/* -----------------------------------------------------------------------
+   Copyright (2010) Sandia Corporation.  Under the terms of Contract
+   DE-AC04-94AL85000 with Sandia Corporation, the U.S. Government retains
+   certain rights in this software.  This software is distributed under
+   the Simplified BSD License.
+   ----------------------------------------------------------------------- */
+
+// Only allow this file to be included by nvd_mat.h and ocl_mat.h
+#ifdef UCL_MANAGED_ALLOW
+
+/// Managed mode entry for a UCL_D_Vec or UCL_D_Mat
+/** The allocation is copied to a pinned host buffer on eviction and the
+  * device memory is released. Page-in reallocates device memory with the
+  * same size, so the pitch of matrices is unchanged.
+  * \sa UCL_MemTracker **/
+template <class mat_type>
+class UCL_ManagedMem : public UCL_ManagedBase {
+ public:
+  UCL_ManagedMem(mat_type &mat, UCL_Device &dev) :
+    UCL_ManagedBase(dev.mem_tracker()), _mat(mat), _tag(0) {}
+
+  size_t device_bytes() const {
+    if (_evicted || _mat.kind()==UCL_VIEW)
+      return 0;
+    return _mat.row_bytes()*_mat.rows();
+  }
+
+  size_t page_out() {
+    const size_t bytes=device_bytes();
+    if (bytes==0)
+      return 0;
+    if (_host.alloc(bytes,_mat,UCL_READ_WRITE)!=UCL_SUCCESS)
+      return 0;
+    ucl_sync(_mat.cq());
+    ucl_mv_cpy(_host,_mat,bytes);
+    _tag=_mat.mem_record().tag;
+    _device_free(_mat);
+    _evicted=true;
+    _tracker.count_eviction(bytes);
+    return bytes;
+  }
+
+  int page_in() {
+    if (_evicted) {
+      const size_t bytes=_host.row_bytes();
+      int err=_device_alloc(_mat,_host,bytes,_mat.kind());
+      if (err!=UCL_SUCCESS) {
+        #ifndef UCL_NO_EXIT
+        std::cerr << "UCL Error: Could not page in " << bytes
+                  << " bytes on device.\n";
+        UCL_GERYON_EXIT;
+        #endif
+        return err;
+      }
+      _evicted=false;
+      _ucl_track_free(_mat);
+      _ucl_track_alloc(_mat,&_tracker,bytes,UCL_MEM_DEVICE,_tag);
+      ucl_mv_cpy(_mat,_host,bytes);
+      _host.clear();
+      _tracker.count_page_in(bytes);
+    }
+    _tracker.touch(this);
+    return UCL_SUCCESS;
+  }
+
+  void discard() {
+    _host.clear();
+    _evicted=false;
+  }
+
+ private:
+  mat_type &_mat;
+  UCL_H_Vec<char> _host;
+  int _tag;
+};
+
+/// Register a device container for eviction in managed mode
+/** The container can be evicted to host memory when a device allocation
+  * made with dev fails while dev.mem_tracker().managed() is true. The
+  * registration is kept when the container is cleared or reallocated.
+  * \note Views of managed containers are not updated on eviction **/
+template <class mat_type>
+inline void ucl_manage(mat_type &mat, UCL_Device &dev) {
+  assert(mat_type::MEM_TYPE==0);
+  if (mat.managed()==NULL)
+    mat.managed(new UCL_ManagedMem<mat_type>(mat,dev));
+}
+
+/// Page in the container and remove it from managed mode
+template <class mat_type>
+inline void ucl_unmanage(mat_type &mat) {
+  mat.touch();
+  mat.managed(NULL);
+}
+
+#endif
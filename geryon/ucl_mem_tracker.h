@@ -0,0 +1,516 @@
+/***************************************************************************
+                              ucl_mem_tracker.h
+                             -------------------
+
+  Memory accounting for host and device allocations made through Geryon
+
+ __________________________________________________________________________
+    This file is part of the Geryon Unified Coprocessor Library (UCL)
+ __________________________________________________________________________
+
+ ***************************************************************************/
+
+/* -----------------------------------------------------------------------
+   Copyright (2010) Sandia Corporation.  Under the terms of Contract
+   DE-AC04-94AL85000 with Sandia Corporation, the U.S. Government retains
+   certain rights in this software.  This software is distributed under
+   the Simplified BSD License.
+   ----------------------------------------------------------------------- */
+
+/***************************************************************************
+   Each UCL_Device owns a UCL_MemTracker. Every allocation, resize and free
+   performed by the API specific memory routines (_host_alloc, _host_view,
+   _device_alloc, ...) updates the tracker of the device that the memory
+   was allocated with, so that current and high-water-mark usage can be
+   queried at any time:
+
+     dev.mem_tracker().tag("neighbor");   // tag subsequent allocations
+     nbor.alloc(n,dev);
+     dev.mem_tracker().clear_tag();
+     ...
+     dev.mem_tracker().dump(std::cout);
+     size_t peak=dev.mem_tracker().peak(UCL_MEM_DEVICE);
+
+   Usage is kept by kind of allocation (UCL_MEM_KIND) and by user tag.
+   Containers that view memory owned by another Geryon container are not
+   counted; host memory wrapped for the device with _host_view is counted
+   as UCL_MEM_VIEW.
+
+   The tracker is not thread-safe; allocations for a device should be made
+   from one thread at a time.
+
+   The tracker also implements an opt-in managed mode for oversubscribing
+   device memory. Device containers registered with ucl_manage() can be
+   evicted to pinned host memory in least-recently-used order when a device
+   allocation fails (or would exceed managed_limit()). Evicted containers
+   are paged back in on the next kernel argument bind, copy, or explicit
+   call to touch():
+
+     dev.mem_tracker().managed(true);
+     ucl_manage(big_table,dev);
+     ...
+     k.add_arg(&big_table);              // pages in big_table if evicted
+     std::cout << dev.mem_tracker().evictions() << std::endl;
+
+   Eviction frees the device buffer, so views of managed containers and
+   kernel arguments bound before an eviction are not updated. All
+   containers bound for one kernel launch must fit in device memory.
+
+   A limit can also be set on pinned host memory. Pinned host allocations
+   that would exceed pinned_limit() are made in pageable memory instead, as
+   if UCL_NOT_PINNED had been requested; the container's kind() reports the
+   demotion. OpenCL host memory mapped with a placement policy is counted
+   but never demoted:
+
+     dev.mem_tracker().pinned_limit(4ul<<30);   // 4 GB of pinned memory
+ ***************************************************************************/
+
+#ifndef UCL_MEM_TRACKER_H
+#define UCL_MEM_TRACKER_H
+
+#include <string>
+#include <vector>
+#include <iostream>
+#include <iomanip>
+#include <sstream>
+
+/// Kinds of memory counted by UCL_MemTracker
+enum UCL_MEM_KIND {
+  UCL_MEM_DEVICE,         ///< Device memory
+  UCL_MEM_PINNED_HOST,    ///< Pinned/page-locked host memory
+  UCL_MEM_PAGEABLE_HOST,  ///< Pageable host memory
+  UCL_MEM_VIEW,           ///< Host memory wrapped for access by the device
+  UCL_MEM_NUM_KINDS
+};
+
+class UCL_MemTracker;
+
+/// Accounting record kept by each container for its allocation
+struct UCL_MemRecord {
+  UCL_MemRecord() : tracker(NULL), bytes(0), kind(UCL_MEM_DEVICE), tag(0) {}
+  UCL_MemTracker *tracker;
+  size_t bytes;
+  int kind;
+  int tag;
+};
+
+/// Interface for a device container that can be evicted in managed mode
+/** \sa ucl_manage() **/
+class UCL_ManagedBase {
+ public:
+  /// Register with the tracker for the device
+  inline UCL_ManagedBase(UCL_MemTracker &tracker);
+  /// Unregister with the tracker
+  inline virtual ~UCL_ManagedBase();
+
+  /// Bytes of device memory that would be released by page_out()
+  virtual size_t device_bytes() const = 0;
+  /// Copy the allocation to host memory and release the device memory
+  /** \return Bytes of device memory released (0 if not evicted) **/
+  virtual size_t page_out() = 0;
+  /// Reallocate device memory and copy back the allocation if evicted
+  /** Also marks the allocation as most recently used
+    * \return UCL_SUCCESS or UCL_MEMORY_ERROR **/
+  virtual int page_in() = 0;
+  /// Drop the host copy of an evicted allocation that is being freed
+  virtual void discard() = 0;
+
+  /// True if the allocation currently resides in host memory
+  inline bool evicted() const { return _evicted; }
+  /// Exclude the allocation from eviction (e.g. while it is being resized)
+  inline void hold(const bool h) { _held=h; }
+
+ protected:
+  UCL_MemTracker &_tracker;
+  bool _evicted;
+
+ private:
+  friend class UCL_MemTracker;
+  unsigned long _last_use;
+  bool _held;
+};
+
+/// Current and peak memory usage by allocation kind and user tag
+class UCL_MemTracker {
+ public:
+  UCL_MemTracker() : _tag(0), _total("total"), _managed_on(false),
+    _managed_limit(0), _clock(0), _evictions(0), _bytes_evicted(0),
+    _page_ins(0), _bytes_paged_in(0), _skipped_uploads(0),
+    _bytes_avoided(0), _pinned_limit(0), _demotions(0), _bytes_demoted(0)
+    { _tags.push_back(_Usage("untagged")); }
+
+  /// Apply a tag to all subsequent allocations
+  /** Tags are created on first use **/
+  inline void tag(const std::string &name) { _tag=tag_id(name); }
+
+  /// Return the tag applied to new allocations
+  inline const std::string & tag() const { return _tags[_tag].name; }
+
+  /// Stop tagging new allocations
+  inline void clear_tag() { _tag=0; }
+
+  /// Current bytes allocated of a given kind
+  inline size_t current(const enum UCL_MEM_KIND kind) const
+    { return _total.current[kind]; }
+
+  /// Peak bytes allocated of a given kind
+  inline size_t peak(const enum UCL_MEM_KIND kind) const
+    { return _total.peak[kind]; }
+
+  /// Number of live allocations of a given kind
+  inline size_t count(const enum UCL_MEM_KIND kind) const
+    { return _total.count[kind]; }
+
+  /// Current bytes allocated of a given kind with a given tag
+  inline size_t current(const enum UCL_MEM_KIND kind,
+                        const std::string &name) const {
+    int t=find_tag(name);
+    return (t<0) ? 0 : _tags[t].current[kind];
+  }
+
+  /// Peak bytes allocated of a given kind with a given tag
+  inline size_t peak(const enum UCL_MEM_KIND kind,
+                     const std::string &name) const {
+    int t=find_tag(name);
+    return (t<0) ? 0 : _tags[t].peak[kind];
+  }
+
+  /// Current bytes of host memory (pinned and pageable)
+  inline size_t host_bytes() const
+    { return current(UCL_MEM_PINNED_HOST)+current(UCL_MEM_PAGEABLE_HOST); }
+
+  /// Current bytes of device memory
+  inline size_t device_bytes() const { return current(UCL_MEM_DEVICE); }
+
+  /// Set the peak usage for all kinds and tags to the current usage
+  inline void reset_peak() {
+    _total.reset_peak();
+    for (size_t i=0; i<_tags.size(); i++)
+      _tags[i].reset_peak();
+  }
+
+  /// Print current and peak usage by kind and tag
+  inline void dump(std::ostream &out) const {
+    out << "Geryon memory usage (MB, current/peak)\n"
+        << std::setw(20) << std::left << "tag" << std::right;
+    for (int k=0; k<UCL_MEM_NUM_KINDS; k++)
+      out << std::setw(24) << kind_name(k);
+    out << std::endl;
+    for (size_t i=0; i<_tags.size(); i++)
+      if (_tags[i].used())
+        print_usage(out,_tags[i]);
+    print_usage(out,_total);
+    if (_managed_on || _evictions>0)
+      out << "Managed: " << _managed.size() << " containers, "
+          << _evictions << " evictions (" << std::fixed
+          << std::setprecision(2) << _bytes_evicted/1048576.0 << " MB), "
+          << _page_ins << " page-ins (" << _bytes_paged_in/1048576.0
+          << " MB)" << std::endl;
+    if (_skipped_uploads>0)
+      out << "Unchanged uploads skipped: " << _skipped_uploads << " ("
+          << std::fixed << std::setprecision(2) << _bytes_avoided/1048576.0
+          << " MB)" << std::endl;
+    if (_demotions>0)
+      out << "Pinned allocations made pageable: " << _demotions << " ("
+          << std::fixed << std::setprecision(2) << _bytes_demoted/1048576.0
+          << " MB)" << std::endl;
+  }
+
+  /// Turn on or off eviction of managed containers for device allocations
+  inline void managed(const bool on) { _managed_on=on; }
+
+  /// True if eviction of managed containers is on
+  inline bool managed() const { return _managed_on; }
+
+  /// Limit on device bytes allocated in managed mode (0 for no limit)
+  /** When set, managed containers are evicted before an allocation that
+    * would exceed the limit rather than waiting for the allocation to
+    * fail. This is useful for APIs that defer allocation of memory. **/
+  inline void managed_limit(const size_t bytes) { _managed_limit=bytes; }
+
+  /// Limit on device bytes allocated in managed mode (0 for no limit)
+  inline size_t managed_limit() const { return _managed_limit; }
+
+  /// Number of times a managed container was evicted to host
+  inline size_t evictions() const { return _evictions; }
+
+  /// Total bytes copied to host by evictions
+  inline size_t bytes_evicted() const { return _bytes_evicted; }
+
+  /// Number of times a managed container was paged back in
+  inline size_t page_ins() const { return _page_ins; }
+
+  /// Total bytes copied to the device by page-ins
+  inline size_t bytes_paged_in() const { return _bytes_paged_in; }
+
+  /// Zero the eviction and page-in counters
+  inline void reset_managed_counters()
+    { _evictions=_bytes_evicted=_page_ins=_bytes_paged_in=0; }
+
+  /// Number of uploads skipped because the host data was unchanged
+  /** \sa UCL_UploadHash **/
+  inline size_t skipped_uploads() const { return _skipped_uploads; }
+
+  /// Total bytes not transferred because uploads were skipped
+  inline size_t bytes_avoided() const { return _bytes_avoided; }
+
+  /// Zero the counters for skipped uploads
+  inline void reset_upload_counters()
+    { _skipped_uploads=_bytes_avoided=0; }
+
+  /// Limit on pinned host bytes (0 for no limit)
+  /** Pinned host allocations (and resizes) that would exceed the limit are
+    * made in pageable memory instead. **/
+  inline void pinned_limit(const size_t bytes) { _pinned_limit=bytes; }
+
+  /// Limit on pinned host bytes (0 for no limit)
+  inline size_t pinned_limit() const { return _pinned_limit; }
+
+  /// Number of pinned host allocations made pageable by pinned_limit()
+  inline size_t demotions() const { return _demotions; }
+
+  /// Total bytes allocated in pageable memory because of pinned_limit()
+  inline size_t bytes_demoted() const { return _bytes_demoted; }
+
+  /// Zero the counters for demoted allocations
+  inline void reset_pinned_counters()
+    { _demotions=_bytes_demoted=0; }
+
+  /// Evict least-recently-used managed containers to free bytes
+  /** \return true if any device memory was released **/
+  inline bool evict(const size_t bytes) {
+    size_t freed=0;
+    while (freed<bytes) {
+      UCL_ManagedBase *lru=NULL;
+      for (size_t i=0; i<_managed.size(); i++) {
+        UCL_ManagedBase *m=_managed[i];
+        if (!m->evicted() && !m->_held && m->device_bytes()>0 &&
+            (lru==NULL || m->_last_use<lru->_last_use))
+          lru=m;
+      }
+      if (lru==NULL)
+        break;
+      size_t b=lru->page_out();
+      if (b==0)
+        break;
+      freed+=b;
+    }
+    return freed>0;
+  }
+
+  /// Evict managed containers so that an allocation fits managed_limit()
+  inline void reserve(const size_t bytes) {
+    if (_managed_limit>0 && device_bytes()+bytes>_managed_limit)
+      evict(device_bytes()+bytes-_managed_limit);
+  }
+
+  /// Register a managed container (used by UCL_ManagedBase)
+  inline void register_managed(UCL_ManagedBase *m) {
+    _managed.push_back(m);
+    touch(m);
+  }
+
+  /// Unregister a managed container (used by UCL_ManagedBase)
+  inline void unregister_managed(UCL_ManagedBase *m) {
+    for (size_t i=0; i<_managed.size(); i++)
+      if (_managed[i]==m) {
+        _managed.erase(_managed.begin()+i);
+        return;
+      }
+  }
+
+  /// Mark a managed container as most recently used
+  inline void touch(UCL_ManagedBase *m) { m->_last_use=++_clock; }
+
+  /// Count an eviction (used by managed containers)
+  inline void count_eviction(const size_t bytes)
+    { _evictions++; _bytes_evicted+=bytes; }
+
+  /// Count a page-in (used by managed containers)
+  inline void count_page_in(const size_t bytes)
+    { _page_ins++; _bytes_paged_in+=bytes; }
+
+  /// Count an upload skipped by ucl_copy (used by the copy routines)
+  inline void count_skipped_upload(const size_t bytes)
+    { _skipped_uploads++; _bytes_avoided+=bytes; }
+
+  /// Count a pinned allocation made pageable (used by the memory routines)
+  inline void count_demotion(const size_t bytes)
+    { _demotions++; _bytes_demoted+=bytes; }
+
+  /// Name of an allocation kind
+  static inline const char * kind_name(const int kind) {
+    switch (kind) {
+      case UCL_MEM_DEVICE:        return "device";
+      case UCL_MEM_PINNED_HOST:   return "pinned_host";
+      case UCL_MEM_PAGEABLE_HOST: return "pageable_host";
+      case UCL_MEM_VIEW:          return "view";
+    }
+    return "unknown";
+  }
+
+  /// Tag id for new allocations (used by the memory routines)
+  inline int tag_id() const { return _tag; }
+
+  /// Count an allocation (used by the memory routines)
+  inline void add(const int kind, const int tag, const size_t bytes) {
+    _total.add(kind,bytes);
+    _tags[tag].add(kind,bytes);
+  }
+
+  /// Count a free (used by the memory routines)
+  inline void remove(const int kind, const int tag, const size_t bytes) {
+    _total.remove(kind,bytes);
+    _tags[tag].remove(kind,bytes);
+  }
+
+ private:
+  struct _Usage {
+    _Usage(const std::string &n) : name(n) {
+      for (int k=0; k<UCL_MEM_NUM_KINDS; k++)
+        current[k]=peak[k]=count[k]=0;
+    }
+    inline void add(const int kind, const size_t bytes) {
+      current[kind]+=bytes;
+      count[kind]++;
+      if (current[kind]>peak[kind])
+        peak[kind]=current[kind];
+    }
+    inline void remove(const int kind, const size_t bytes) {
+      current[kind]-=bytes;
+      count[kind]--;
+    }
+    inline void reset_peak() {
+      for (int k=0; k<UCL_MEM_NUM_KINDS; k++)
+        peak[k]=current[k];
+    }
+    inline bool used() const {
+      for (int k=0; k<UCL_MEM_NUM_KINDS; k++)
+        if (peak[k]>0) return true;
+      return false;
+    }
+    std::string name;
+    size_t current[UCL_MEM_NUM_KINDS];
+    size_t peak[UCL_MEM_NUM_KINDS];
+    size_t count[UCL_MEM_NUM_KINDS];
+  };
+
+  int _tag;
+  std::vector<_Usage> _tags;
+  _Usage _total;
+
+  bool _managed_on;
+  size_t _managed_limit;
+  std::vector<UCL_ManagedBase *> _managed;
+  unsigned long _clock;
+  size_t _evictions, _bytes_evicted, _page_ins, _bytes_paged_in;
+  size_t _skipped_uploads, _bytes_avoided;
+  size_t _pinned_limit, _demotions, _bytes_demoted;
+
+  inline int find_tag(const std::string &name) const {
+    for (size_t i=0; i<_tags.size(); i++)
+      if (_tags[i].name==name)
+        return static_cast<int>(i);
+    return -1;
+  }
+
+  inline int tag_id(const std::string &name) {
+    int t=find_tag(name);
+    if (t<0) {
+      _tags.push_back(_Usage(name));
+      t=static_cast<int>(_tags.size())-1;
+    }
+    return t;
+  }
+
+  inline void print_usage(std::ostream &out, const _Usage &u) const {
+    out << std::setw(20) << std::left << u.name << std::right;
+    for (int k=0; k<UCL_MEM_NUM_KINDS; k++) {
+      std::ostringstream s;
+      s << std::fixed << std::setprecision(2) << u.current[k]/1048576.0
+        << '/' << u.peak[k]/1048576.0;
+      out << std::setw(24) << s.str();
+    }
+    out << std::endl;
+  }
+};
+
+inline UCL_ManagedBase::UCL_ManagedBase(UCL_MemTracker &tracker) :
+  _tracker(tracker), _evicted(false), _last_use(0), _held(false)
+  { _tracker.register_managed(this); }
+
+inline UCL_ManagedBase::~UCL_ManagedBase()
+  { _tracker.unregister_managed(this); }
+
+// --------------------------------------------------------------------------
+// - HELPERS USED BY THE API SPECIFIC MEMORY ROUTINES
+// --------------------------------------------------------------------------
+
+/// Record an allocation of bytes for mat with tracker (NULL to not count)
+/** \param tag Tag for the allocation (-1 uses the current tracker tag) **/
+template <class mat_type>
+inline void _ucl_track_alloc(mat_type &mat, UCL_MemTracker *tracker,
+                             const size_t bytes, const int kind,
+                             const int tag=-1) {
+  UCL_MemRecord &r=mat.mem_record();
+  if (tracker==NULL)
+    return;
+  r.tracker=tracker;
+  r.bytes=bytes;
+  r.kind=kind;
+  r.tag=(tag<0) ? tracker->tag_id() : tag;
+  tracker->add(r.kind,r.tag,r.bytes);
+}
+
+/// Remove the allocation for mat from its tracker (if any)
+template <class mat_type>
+inline void _ucl_track_free(mat_type &mat) {
+  UCL_MemRecord &r=mat.mem_record();
+  if (r.tracker!=NULL)
+    r.tracker->remove(r.kind,r.tag,r.bytes);
+  r=UCL_MemRecord();
+}
+
+/// Evict managed containers so that a device allocation fits the limit
+inline void _ucl_managed_reserve(UCL_MemTracker *tracker, const size_t n) {
+  if (tracker!=NULL && tracker->managed())
+    tracker->reserve(n);
+}
+
+/// Evict managed containers after a failed device allocation
+/** \return true if memory was released and the allocation should be retried **/
+inline bool _ucl_managed_retry(UCL_MemTracker *tracker, const size_t n) {
+  return tracker!=NULL && tracker->managed() && tracker->evict(n);
+}
+
+/// True if a pinned host allocation of n bytes would exceed the limit
+/** A true result is counted as a demotion to pageable memory **/
+inline bool _ucl_pinned_demote(UCL_MemTracker *tracker, const size_t n) {
+  if (tracker==NULL || tracker->pinned_limit()==0 ||
+      tracker->current(UCL_MEM_PINNED_HOST)+n<=tracker->pinned_limit())
+    return false;
+  tracker->count_demotion(n);
+  return true;
+}
+
+/// Exclude mat from eviction while its device memory is replaced
+/** The old allocation is released before the new one is made, so mat
+  * must not be paged out by a reserve or retry in between **/
+template <class mat_type>
+inline void _ucl_managed_hold(mat_type &mat, const bool h) {
+  if (mat.managed()!=NULL)
+    mat.managed()->hold(h);
+}
+
+/// Drop the host copy if mat is evicted (nothing to free on the device)
+/** \return true if mat was evicted **/
+template <class mat_type>
+inline bool _ucl_managed_free(mat_type &mat) {
+  UCL_ManagedBase *m=mat.managed();
+  if (m==NULL || !m->evicted())
+    return false;
+  m->discard();
+  return true;
+}
+
+#endif
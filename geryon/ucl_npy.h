@@ -0,0 +1,334 @@
+/***************************************************************************
+                                  ucl_npy.h
+                             -------------------
+
+  Reading and writing of NumPy .npy files
+
+ __________________________________________________________________________
+    This file is part of the Geryon Unified Coprocessor Library (UCL)
+ __________________________________________________________________________
+
+ ***************************************************************************/
+
+/* -----------------------------------------------------------------------
+   Copyright (2010) Sandia Corporation.  Under the terms of Contract
+   DE-AC04-94AL85000 with Sandia Corporation, the U.S. Government retains
+   certain rights in this software.  This software is distributed under
+   the Simplified BSD License.
+   ----------------------------------------------------------------------- */
+
+/***************************************************************************
+   UCL_NpyFile memory-maps a .npy file (format version 1, 2 or 3) and
+   parses the header. The mapping is private, so the data can be modified
+   in memory without changing the file. Pages are read from disk on first
+   access.
+
+   Devices that share memory with the host can only use a
+   CL_MEM_USE_HOST_PTR buffer without a copy if the data is on a page
+   boundary. ucl_npy_save() pads the header so that the data starts
+   UCL_NPY_ALIGN bytes into the file. Other files (NumPy aligns the data to
+   64 bytes) stay mapped; align() copies the data to aligned memory when it
+   is needed, which ucl_npy_view() does only for such devices.
+
+   Containers are loaded and saved with the routines in ucl_npy_io.h:
+
+     ucl_npy_save("x.npy",x);            // x is a host container or s-object
+     ucl_npy_load("x.npy",x,dev);        // allocates x and copies
+
+     UCL_NpyFile f;
+     f.open("x.npy");
+     ucl_npy_view(f,hx,dev);             // hx is a view of the mapped file
+
+   Only little-endian data with a dtype matching the container (e.g. '<f4'
+   for float, '<f2' for ucl_half) is supported. Files are 1-D or 2-D
+   C-ordered arrays; a 1-D file is treated as a single row.
+ ***************************************************************************/
+
+#ifndef UCL_NPY_H
+#define UCL_NPY_H
+
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+#include <new>
+#include <sstream>
+#include <iostream>
+#include "ucl_types.h"
+#include "ucl_half.h"
+
+/// Alignment in bytes of the data in files written by ucl_npy_save()
+#define UCL_NPY_ALIGN 4096
+
+#ifdef _WIN32
+#include <fstream>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+/// Kind character used in .npy dtype strings
+template <class numtyp> struct _ucl_npy_kind;
+
+#define _UCL_NPY_KIND(type,kind)                                             \
+  template <> struct _ucl_npy_kind<type> {                                    \
+    static inline char k() { return kind; }                                   \
+  };
+
+_UCL_NPY_KIND(float,'f')
+_UCL_NPY_KIND(double,'f')
+_UCL_NPY_KIND(ucl_half,'f')
+_UCL_NPY_KIND(char,'i')
+_UCL_NPY_KIND(signed char,'i')
+_UCL_NPY_KIND(unsigned char,'u')
+_UCL_NPY_KIND(short,'i')
+_UCL_NPY_KIND(unsigned short,'u')
+_UCL_NPY_KIND(int,'i')
+_UCL_NPY_KIND(unsigned,'u')
+_UCL_NPY_KIND(long,'i')
+_UCL_NPY_KIND(unsigned long,'u')
+
+/// dtype string for numtyp in a .npy header (e.g. '<f4')
+template <class numtyp>
+inline std::string ucl_npy_descr() {
+  std::ostringstream s;
+  s << (sizeof(numtyp)==1 ? '|' : '<') << _ucl_npy_kind<numtyp>::k()
+    << sizeof(numtyp);
+  return s.str();
+}
+
+/// Header for a C-ordered array with rows and cols (rows=0 for 1-D)
+/** The header is padded so that the data starts on a UCL_NPY_ALIGN byte
+  * boundary **/
+inline std::string ucl_npy_header(const std::string &descr, const size_t rows,
+                                  const size_t cols) {
+  std::ostringstream d;
+  d << "{'descr': '" << descr << "', 'fortran_order': False, 'shape': (";
+  if (rows==0)
+    d << cols << ",), }";
+  else
+    d << rows << ", " << cols << "), }";
+  std::string dict=d.str();
+  size_t pre=10;
+  if (dict.size()+pre+1>65535)
+    pre=12;
+  const size_t total=(pre+dict.size()+UCL_NPY_ALIGN)/UCL_NPY_ALIGN*
+                     UCL_NPY_ALIGN;
+  dict.append(total-pre-dict.size()-1,' ');
+  dict+='\n';
+
+  std::string h("\x93NUMPY",6);
+  const size_t len=dict.size();
+  h+=static_cast<char>(pre==10 ? 1 : 2);
+  h+='\0';
+  h+=static_cast<char>(len & 0xff);
+  h+=static_cast<char>((len>>8) & 0xff);
+  if (pre==12) {
+    h+=static_cast<char>((len>>16) & 0xff);
+    h+=static_cast<char>((len>>24) & 0xff);
+  }
+  return h+dict;
+}
+
+/// Memory map of a .npy file
+class UCL_NpyFile {
+ public:
+  UCL_NpyFile() : _map(NULL), _map_bytes(0), _data(NULL), _copy(NULL),
+                  _bytes(0), _rows(0), _cols(0), _ndim(0), _fortran(false) {}
+  ~UCL_NpyFile() { close(); }
+
+  /// Map a file and parse its header
+  /** \return UCL_SUCCESS, UCL_FILE_NOT_FOUND or UCL_ERROR for a file
+    *         that is not a supported .npy file **/
+  inline int open(const std::string &filename) {
+    close();
+    size_t file_bytes;
+    #ifdef _WIN32
+    std::ifstream in(filename.c_str(),std::ios::binary);
+    if (!in)
+      return _error("Could not open",filename,UCL_FILE_NOT_FOUND);
+    in.seekg(0,std::ios::end);
+    file_bytes=static_cast<size_t>(in.tellg());
+    in.seekg(0,std::ios::beg);
+    _map=new char[file_bytes+1];
+    in.read(static_cast<char *>(_map),file_bytes);
+    #else
+    int fd=::open(filename.c_str(),O_RDONLY);
+    if (fd<0)
+      return _error("Could not open",filename,UCL_FILE_NOT_FOUND);
+    struct stat st;
+    if (fstat(fd,&st)!=0 || st.st_size<10) {
+      ::close(fd);
+      return _error("Not a .npy file:",filename,UCL_ERROR);
+    }
+    file_bytes=static_cast<size_t>(st.st_size);
+    _map=mmap(NULL,file_bytes,PROT_READ | PROT_WRITE,MAP_PRIVATE,fd,0);
+    ::close(fd);
+    if (_map==MAP_FAILED) {
+      _map=NULL;
+      return _error("Could not map",filename,UCL_ERROR);
+    }
+    #endif
+    _map_bytes=file_bytes;
+    if (!_parse()) {
+      close();
+      return _error("Unsupported .npy file:",filename,UCL_ERROR);
+    }
+    return UCL_SUCCESS;
+  }
+
+  /// Unmap the file (views of the data become invalid)
+  inline void close() {
+    if (_map!=NULL) {
+      #ifdef _WIN32
+      delete [] static_cast<char *>(_map);
+      #else
+      munmap(_map,_map_bytes);
+      #endif
+    }
+    delete [] _copy;
+    _copy=NULL;
+    _map=NULL;
+    _data=NULL;
+    _map_bytes=_bytes=_rows=_cols=0;
+    _ndim=0;
+    _descr.clear();
+  }
+
+  /// True if a file is mapped
+  inline bool is_open() const { return _map!=NULL; }
+  /// dtype string from the header
+  inline const std::string & descr() const { return _descr; }
+  /// True if the dtype matches numtyp
+  template <class numtyp>
+  inline bool is_type() const { return _descr==ucl_npy_descr<numtyp>(); }
+  /// Number of dimensions
+  inline int ndim() const { return _ndim; }
+  /// Number of rows (1 for 1-D arrays)
+  inline size_t rows() const { return _rows; }
+  /// Number of columns
+  inline size_t cols() const { return _cols; }
+  /// Number of elements
+  inline size_t numel() const { return _rows*_cols; }
+  /// Pointer to the data (mapped, or the copy made by align())
+  inline void * data() { return _data; }
+  /// Bytes of data
+  inline size_t bytes() const { return _bytes; }
+
+  /// True if data() is on a UCL_NPY_ALIGN byte boundary
+  inline bool aligned() const
+    { return reinterpret_cast<size_t>(_data)%UCL_NPY_ALIGN==0; }
+
+  /// Copy the data to memory on a UCL_NPY_ALIGN byte boundary if needed
+  /** data() returns the copy afterward. The file stays mapped, so views of
+    * the earlier data() remain valid until close().
+    * eturn false if the copy could not be allocated **/
+  inline bool align() {
+    if (_data==NULL || aligned())
+      return true;
+    char *c=new (std::nothrow) char[_bytes+UCL_NPY_ALIGN];
+    if (c==NULL)
+      return false;
+    const size_t a=reinterpret_cast<size_t>(c)%UCL_NPY_ALIGN;
+    char *d=c+(a==0 ? 0 : UCL_NPY_ALIGN-a);
+    memcpy(d,_data,_bytes);
+    _copy=c;
+    _data=d;
+    return true;
+  }
+
+ private:
+  void *_map;
+  size_t _map_bytes;
+  void *_data;
+  char *_copy;
+  size_t _bytes, _rows, _cols;
+  int _ndim;
+  bool _fortran;
+  std::string _descr;
+
+  UCL_NpyFile(const UCL_NpyFile &);
+  UCL_NpyFile & operator=(const UCL_NpyFile &);
+
+  inline int _error(const char *msg, const std::string &filename,
+                    const int err) {
+    #ifndef UCL_NO_EXIT
+    std::cerr << "UCL Error: " << msg << " " << filename << std::endl;
+    UCL_GERYON_EXIT;
+    #endif
+    return err;
+  }
+
+  inline bool _parse() {
+    const unsigned char *p=static_cast<const unsigned char *>(_map);
+    if (_map_bytes<10 || memcmp(p,"\x93NUMPY",6)!=0)
+      return false;
+    size_t len, pre;
+    if (p[6]==1) {
+      len=p[8] | (static_cast<size_t>(p[9])<<8);
+      pre=10;
+    } else if (p[6]==2 || p[6]==3) {
+      if (_map_bytes<12)
+        return false;
+      len=p[8] | (static_cast<size_t>(p[9])<<8) |
+          (static_cast<size_t>(p[10])<<16) | (static_cast<size_t>(p[11])<<24);
+      pre=12;
+    } else
+      return false;
+    if (pre+len>_map_bytes)
+      return false;
+    const std::string h(reinterpret_cast<const char *>(p)+pre,len);
+
+    size_t k=h.find("'descr'");
+    if (k==std::string::npos)
+      return false;
+    size_t q1=h.find('\'',k+7);
+    size_t q2=(q1==std::string::npos) ? q1 : h.find('\'',q1+1);
+    if (q2==std::string::npos)
+      return false;
+    _descr=h.substr(q1+1,q2-q1-1);
+
+    k=h.find("'fortran_order'");
+    if (k==std::string::npos)
+      return false;
+    k=h.find_first_not_of(": ",k+15);
+    _fortran=(k!=std::string::npos && h.compare(k,4,"True")==0);
+
+    k=h.find("'shape'");
+    size_t s1=(k==std::string::npos) ? k : h.find('(',k);
+    size_t s2=(s1==std::string::npos) ? s1 : h.find(')',s1);
+    if (s2==std::string::npos)
+      return false;
+    std::vector<size_t> shape;
+    std::istringstream in(h.substr(s1+1,s2-s1-1));
+    std::string tok;
+    while (std::getline(in,tok,',')) {
+      if (tok.find_first_of("0123456789")==std::string::npos)
+        continue;
+      std::istringstream v(tok);
+      size_t d;
+      v >> d;
+      shape.push_back(d);
+    }
+    _ndim=static_cast<int>(shape.size());
+    if (_ndim>2 || (_ndim==2 && _fortran && shape[0]>1 && shape[1]>1))
+      return false;
+    _rows=(_ndim==2) ? shape[0] : 1;
+    _cols=(_ndim==0) ? 1 : shape[_ndim-1];
+
+    if (_descr.size()<3 || _descr[0]=='>')
+      return false;
+    size_t es=0;
+    std::istringstream e(_descr.substr(2));
+    e >> es;
+    _bytes=_rows*_cols*es;
+    if (es==0 || pre+len+_bytes>_map_bytes)
+      return false;
+    _data=static_cast<char *>(_map)+pre+len;
+    return true;
+  }
+};
+
+#endif
@@ -0,0 +1,309 @@
+/***************************************************************************
+                                ucl_npy_io.h
+                             -------------------
+
+  Loading and saving of host containers and s-objects as .npy files
+
+ __________________________________________________________________________
+    This file is part of the Geryon Unified Coprocessor Library (UCL)
+ __________________________________________________________________________
+
+ ***************************************************************************/
+
+/* -----------------------------------------------------------------------
+   Copyright (2010) Sandia Corporation.  Under the terms of Contract
+   DE-AC04-94AL85000 with Sandia Corporation, the U.S. Government retains
+   certain rights in this software.  This software is distributed under
+   the Simplified BSD License.
+   ----------------------------------------------------------------------- */
+
+/***************************************************************************
+   ucl_npy_save() writes the host data of a UCL_H_Vec, UCL_H_Mat,
+   UCL_Vector or UCL_Matrix straight from the (pinned) host allocation; no
+   staging copy is made. Vectors are saved as 1-D arrays and matrices as
+   2-D arrays. For s-objects, call update_host() first if the device data
+   is newer.
+
+   ucl_npy_load() allocates the container with the shape in the file and
+   copies the data from the mapped file. S-objects are then copied to the
+   device (with a cast if the device type differs).
+
+   ucl_npy_view() does not allocate or copy on the host: the host container
+   becomes a view of the mapped file. With OpenCL, the view is wrapped in a
+   CL_MEM_USE_HOST_PTR buffer. For a device that shares memory with the
+   host, data that is not page-aligned is first copied once with
+   UCL_NpyFile::align() so that the buffer is zero-copy. For a UCL_Vector
+   or UCL_Matrix with the same host and device type, the device container
+   also views the host data when the accelerator shares memory with the
+   host; otherwise the device memory is allocated and the data copied once.
+   The UCL_NpyFile must stay open while the views are in use.
+ ***************************************************************************/
+
+// Only allow this file to be included by nvd_mat.h and ocl_mat.h
+#ifdef UCL_NPY_ALLOW
+
+// Shape of a container holding the data in a .npy file
+template <int vec> struct _ucl_npy_shape;
+template <> struct _ucl_npy_shape<1> {
+  template <class mat_type>
+  static inline size_t rows(const mat_type &) { return 0; }
+  template <class mat_type>
+  static inline int alloc(mat_type &mat, const UCL_NpyFile &f,
+                          UCL_Device &dev)
+    { return mat.alloc(f.numel(),dev); }
+  template <class mat_type, class ptr_type>
+  static inline void view(mat_type &mat, ptr_type *ptr, const UCL_NpyFile &f,
+                          UCL_Device &dev)
+    { mat.view(ptr,f.numel(),dev); }
+};
+
+template <> struct _ucl_npy_shape<0> {
+  template <class mat_type>
+  static inline size_t rows(const mat_type &mat) { return mat.rows(); }
+  template <class mat_type>
+  static inline int alloc(mat_type &mat, const UCL_NpyFile &f,
+                          UCL_Device &dev)
+    { return mat.alloc(f.rows(),f.cols(),dev); }
+  template <class mat_type, class ptr_type>
+  static inline void view(mat_type &mat, ptr_type *ptr, const UCL_NpyFile &f,
+                          UCL_Device &dev)
+    { mat.view(ptr,f.rows(),f.cols(),dev); }
+};
+
+// With OpenCL, align the data for a device that shares memory with the
+// host so that the CL_MEM_USE_HOST_PTR buffer of a view is zero-copy
+#ifdef _OCL_MAT
+inline int _ucl_npy_share(UCL_NpyFile &f, UCL_Device &dev) {
+  if (dev.shared_memory() && !f.align())
+    return UCL_MEMORY_ERROR;
+  return UCL_SUCCESS;
+}
+#else
+inline int _ucl_npy_share(UCL_NpyFile &, UCL_Device &)
+  { return UCL_SUCCESS; }
+#endif
+
+// Print an error for a failed save or load
+inline int _ucl_npy_error(const char *msg, const std::string &filename,
+                          const int err) {
+  #ifndef UCL_NO_EXIT
+  std::cerr << "UCL Error: " << msg << " " << filename << std::endl;
+  UCL_GERYON_EXIT;
+  #endif
+  return err;
+}
+
+// Open a .npy file and check that the dtype matches numtyp
+template <class numtyp>
+inline int _ucl_npy_open(UCL_NpyFile &f, const std::string &filename) {
+  int err=f.open(filename);
+  if (err!=UCL_SUCCESS)
+    return err;
+  if (!f.is_type<numtyp>()) {
+    std::string msg="dtype "+f.descr()+" does not match "+
+                    ucl_npy_descr<numtyp>()+" in";
+    f.close();
+    return _ucl_npy_error(msg.c_str(),filename,UCL_ERROR);
+  }
+  return UCL_SUCCESS;
+}
+
+// Write a host container
+template <class mat_type>
+inline int _ucl_npy_save(const std::string &filename, const mat_type &mat) {
+  typedef typename mat_type::data_type numtyp;
+  const size_t cols=mat.cols();
+  const size_t rows=_ucl_npy_shape<mat_type::VECTOR>::rows(mat);
+  const std::string h=ucl_npy_header(ucl_npy_descr<numtyp>(),rows,cols);
+
+  FILE *out=fopen(filename.c_str(),"wb");
+  if (out==NULL)
+    return _ucl_npy_error("Could not open",filename,UCL_FILE_NOT_FOUND);
+  bool ok=(fwrite(h.data(),1,h.size(),out)==h.size());
+
+  const size_t n=(rows==0) ? 1 : rows;
+  const size_t bytes=cols*sizeof(numtyp);
+  const char *p=reinterpret_cast<const char *>(mat.begin());
+  if (bytes==mat.row_bytes())
+    ok=ok && (fwrite(p,1,bytes*n,out)==bytes*n);
+  else
+    for (size_t i=0; i<n && ok; i++, p+=mat.row_bytes())
+      ok=(fwrite(p,1,bytes,out)==bytes);
+  if (fclose(out)!=0)
+    ok=false;
+  if (!ok)
+    return _ucl_npy_error("Could not write",filename,UCL_ERROR);
+  return UCL_SUCCESS;
+}
+
+// Allocate a container and copy the data from a .npy file to its host data
+template <class mat_type, class host_type>
+inline int _ucl_npy_load(const std::string &filename, mat_type &mat,
+                         host_type &host, UCL_Device &dev) {
+  typedef typename mat_type::data_type numtyp;
+  UCL_NpyFile f;
+  int err=_ucl_npy_open<numtyp>(f,filename);
+  if (err!=UCL_SUCCESS)
+    return err;
+  err=_ucl_npy_shape<mat_type::VECTOR>::alloc(mat,f,dev);
+  if (err!=UCL_SUCCESS)
+    return err;
+  memcpy((void *)host.begin(),f.data(),f.bytes());
+  return UCL_SUCCESS;
+}
+
+// ---------------------------------------------------------------------------
+// - SAVE
+// ---------------------------------------------------------------------------
+
+/// Save a host vector as a 1-D .npy file
+/** \return UCL_SUCCESS, UCL_FILE_NOT_FOUND if the file could not be
+  *         created or UCL_ERROR on a write error **/
+template <class numtyp>
+inline int ucl_npy_save(const std::string &filename,
+                        const UCL_H_Vec<numtyp> &mat)
+  { return _ucl_npy_save(filename,mat); }
+
+/// Save a host matrix as a 2-D .npy file
+/** \return UCL_SUCCESS, UCL_FILE_NOT_FOUND if the file could not be
+  *         created or UCL_ERROR on a write error **/
+template <class numtyp>
+inline int ucl_npy_save(const std::string &filename,
+                        const UCL_H_Mat<numtyp> &mat)
+  { return _ucl_npy_save(filename,mat); }
+
+/// Save the host data of a vector s-object as a 1-D .npy file
+template <class hosttype, class devtype>
+inline int ucl_npy_save(const std::string &filename,
+                        const UCL_Vector<hosttype,devtype> &mat)
+  { return _ucl_npy_save(filename,mat.host); }
+
+/// Save the host data of a matrix s-object as a 2-D .npy file
+template <class hosttype, class devtype>
+inline int ucl_npy_save(const std::string &filename,
+                        const UCL_Matrix<hosttype,devtype> &mat)
+  { return _ucl_npy_save(filename,mat.host); }
+
+// ---------------------------------------------------------------------------
+// - LOAD
+// ---------------------------------------------------------------------------
+
+/// Allocate a host vector with the size of a .npy file and copy the data
+/** A 2-D file is loaded in row-major order
+  * \return UCL_SUCCESS, UCL_FILE_NOT_FOUND, UCL_ERROR for an unsupported
+  *         file or dtype, or the error from the allocation **/
+template <class numtyp>
+inline int ucl_npy_load(const std::string &filename, UCL_H_Vec<numtyp> &mat,
+                        UCL_Device &dev)
+  { return _ucl_npy_load(filename,mat,mat,dev); }
+
+/// Allocate a host matrix with the shape of a .npy file and copy the data
+/** A 1-D file is loaded as a single row
+  * \return UCL_SUCCESS, UCL_FILE_NOT_FOUND, UCL_ERROR for an unsupported
+  *         file or dtype, or the error from the allocation **/
+template <class numtyp>
+inline int ucl_npy_load(const std::string &filename, UCL_H_Mat<numtyp> &mat,
+                        UCL_Device &dev)
+  { return _ucl_npy_load(filename,mat,mat,dev); }
+
+/// Allocate a vector s-object from a .npy file and copy to the device
+/** The dtype of the file must match the host type **/
+template <class hosttype, class devtype>
+inline int ucl_npy_load(const std::string &filename,
+                        UCL_Vector<hosttype,devtype> &mat, UCL_Device &dev) {
+  int err=_ucl_npy_load(filename,mat,mat.host,dev);
+  if (err==UCL_SUCCESS)
+    mat.update_device(false);
+  return err;
+}
+
+/// Allocate a matrix s-object from a .npy file and copy to the device
+/** The dtype of the file must match the host type **/
+template <class hosttype, class devtype>
+inline int ucl_npy_load(const std::string &filename,
+                        UCL_Matrix<hosttype,devtype> &mat, UCL_Device &dev) {
+  int err=_ucl_npy_load(filename,mat,mat.host,dev);
+  if (err==UCL_SUCCESS)
+    mat.update_device(false);
+  return err;
+}
+
+// ---------------------------------------------------------------------------
+// - ZERO-COPY VIEWS
+// ---------------------------------------------------------------------------
+
+/// Make a host vector a view of the data in an open .npy file
+/** \return UCL_SUCCESS, UCL_ERROR if the dtype does not match, or
+  *         UCL_MEMORY_ERROR if aligned data could not be allocated **/
+template <class numtyp>
+inline int ucl_npy_view(UCL_NpyFile &f, UCL_H_Vec<numtyp> &mat,
+                        UCL_Device &dev) {
+  if (!f.is_open() || !f.is_type<numtyp>())
+    return UCL_ERROR;
+  if (_ucl_npy_share(f,dev)!=UCL_SUCCESS)
+    return UCL_MEMORY_ERROR;
+  _ucl_npy_shape<1>::view(mat,static_cast<numtyp *>(f.data()),f,dev);
+  return UCL_SUCCESS;
+}
+
+/// Make a host matrix a view of the data in an open .npy file
+/** \return UCL_SUCCESS, UCL_ERROR if the dtype does not match, or
+  *         UCL_MEMORY_ERROR if aligned data could not be allocated **/
+template <class numtyp>
+inline int ucl_npy_view(UCL_NpyFile &f, UCL_H_Mat<numtyp> &mat,
+                        UCL_Device &dev) {
+  if (!f.is_open() || !f.is_type<numtyp>())
+    return UCL_ERROR;
+  if (_ucl_npy_share(f,dev)!=UCL_SUCCESS)
+    return UCL_MEMORY_ERROR;
+  _ucl_npy_shape<0>::view(mat,static_cast<numtyp *>(f.data()),f,dev);
+  return UCL_SUCCESS;
+}
+
+// View the file from the host container of an s-object and give the
+// device container the same data
+template <class mat_type>
+inline int _ucl_npy_view(UCL_NpyFile &f, mat_type &mat, UCL_Device &dev) {
+  typedef typename mat_type::data_type numtyp;
+  if (!f.is_open() || !f.is_type<numtyp>())
+    return UCL_ERROR;
+  if (_ucl_npy_share(f,dev)!=UCL_SUCCESS)
+    return UCL_MEMORY_ERROR;
+  mat.clear();
+  _ucl_npy_shape<mat_type::VECTOR>::view(mat.host,
+                                         static_cast<numtyp *>(f.data()),
+                                         f,dev);
+  if (dev.shared_memory()) {
+    mat.device.view(mat.host);
+    return UCL_SUCCESS;
+  }
+  int err=_ucl_npy_shape<mat_type::VECTOR>::alloc(mat.device,f,dev);
+  if (err!=UCL_SUCCESS)
+    return err;
+  ucl_copy(mat.device,mat.host,false);
+  return UCL_SUCCESS;
+}
+
+/// Make a vector s-object use the data in an open .npy file
+/** The host vector is a view of the file data. The device vector is a
+  * view of the same memory if the accelerator shares memory with the host
+  * and a copy otherwise.
+  * \return UCL_SUCCESS, UCL_ERROR if the dtype does not match, or the
+  *         error from an allocation **/
+template <class numtyp>
+inline int ucl_npy_view(UCL_NpyFile &f, UCL_Vector<numtyp,numtyp> &mat,
+                        UCL_Device &dev)
+  { return _ucl_npy_view(f,mat,dev); }
+
+/// Make a matrix s-object use the data in an open .npy file
+/** The host matrix is a view of the file data. The device matrix is a
+  * view of the same memory if the accelerator shares memory with the host
+  * and a copy otherwise.
+  * \return UCL_SUCCESS, UCL_ERROR if the dtype does not match, or the
+  *         error from an allocation **/
+template <class numtyp>
+inline int ucl_npy_view(UCL_NpyFile &f, UCL_Matrix<numtyp,numtyp> &mat,
+                        UCL_Device &dev)
+  { return _ucl_npy_view(f,mat,dev); }
+
+#endif
@@ -0,0 +1,149 @@
+/***************************************************************************
+                                 ucl_prims.h
+                             -------------------
+
+  Common routines for device primitives built from generated kernels
+
+ __________________________________________________________________________
+    This file is part of the Geryon Unified Coprocessor Library (UCL)
+ __________________________________________________________________________
+
+ ***************************************************************************/
+
+/* -----------------------------------------------------------------------
+   Copyright (2010) Sandia Corporation.  Under the terms of Contract
+   DE-AC04-94AL85000 with Sandia Corporation, the U.S. Government retains
+   certain rights in this software.  This software is distributed under
+   the Simplified BSD License.
+   ----------------------------------------------------------------------- */
+
+/***************************************************************************
+   Device primitives generate kernel source for the data type and
+   work-group size requested, prefix it with the API specific definitions
+   from _ucl_prims_prelude(), compile it with _ucl_prims_compile() and keep
+   the result in the kernel cache of the UCL_Device. Kernel source is
+   written with the following portable names:
+
+     __kernel, __global, __local, __syncthreads(), THREAD_ID_X, BLOCK_ID_X,
+     BLOCK_SIZE_X, GRID_SIZE_X, GLOBAL_ID_X, ucl_inline,
+     ucl_as_uint (bits of a float), ucl_as_ulong (bits of a double),
+     ucl_local_inc (atomic increment of a __local int)
+
+   along with NUMTYP (the element type), NUMTYP4 (the 4-vector of NUMTYP)
+   and BLOCK_SIZE (the work-group size, a power of 2).
+ ***************************************************************************/
+
+// Only allow this file to be included by nvd_prims.h and ocl_prims.h
+#ifdef UCL_PRIMS_ALLOW
+
+/// Name of the 4-vector type for an element type in kernel source
+template <class numtyp> struct _UCL_VEC4_NAME;
+template <> struct _UCL_VEC4_NAME<double>
+  { static inline const char * name() { return "double4"; } };
+template <> struct _UCL_VEC4_NAME<float>
+  { static inline const char * name() { return "float4"; } };
+template <> struct _UCL_VEC4_NAME<unsigned>
+  { static inline const char * name() { return "uint4"; } };
+template <> struct _UCL_VEC4_NAME<int>
+  { static inline const char * name() { return "int4"; } };
+template <> struct _UCL_VEC4_NAME<char>
+  { static inline const char * name() { return "char4"; } };
+template <> struct _UCL_VEC4_NAME<unsigned char>
+  { static inline const char * name() { return "uchar4"; } };
+template <> struct _UCL_VEC4_NAME<short>
+  { static inline const char * name() { return "short4"; } };
+template <> struct _UCL_VEC4_NAME<unsigned short>
+  { static inline const char * name() { return "ushort4"; } };
+template <> struct _UCL_VEC4_NAME<long>
+  { static inline const char * name() { return "long4"; } };
+template <> struct _UCL_VEC4_NAME<unsigned long>
+  { static inline const char * name() { return "ulong4"; } };
+template <class numtyp> struct _UCL_VEC4_NAME
+  { static inline const char * name() { return "error_type4"; } };
+
+/// Largest value of a type (identity for minimum)
+template <class numtyp>
+inline numtyp _ucl_prim_max() { return std::numeric_limits<numtyp>::max(); }
+
+/// Lowest value of a type (identity for maximum)
+template <class numtyp>
+inline numtyp _ucl_prim_lowest() {
+  if (std::numeric_limits<numtyp>::is_integer)
+    return std::numeric_limits<numtyp>::min();
+  return -std::numeric_limits<numtyp>::max();
+}
+
+/// Largest power of 2 that is not greater than n (and at least 1)
+inline int _ucl_pow2_floor(const size_t n) {
+  int p=1;
+  while (static_cast<size_t>(p)*2<=n)
+    p*=2;
+  return p;
+}
+
+/// Default work-group size for the primitives on a device
+/** \param max_size Upper limit for the primitive **/
+inline int _ucl_prim_block_size(UCL_Device &dev, const int max_size=256) {
+  size_t bs=dev.group_size();
+  if (dev.device_type()==UCL_CPU && bs>64)
+    bs=64;
+  if (bs>static_cast<size_t>(max_size))
+    bs=max_size;
+  return _ucl_pow2_floor(bs);
+}
+
+/// Definitions for NUMTYP, NUMTYP4 and BLOCK_SIZE in generated source
+template <class numtyp>
+inline std::string _ucl_prim_defs(const int block_size) {
+  std::ostringstream s;
+  s << "#define NUMTYP " << _UCL_DATA_ID<numtyp>::name() << "\n"
+    << "#define NUMTYP4 " << _UCL_VEC4_NAME<numtyp>::name() << "\n"
+    << "#define BLOCK_SIZE " << block_size << "\n";
+  return s.str();
+}
+
+/// Program and kernels for a primitive stored in the kernel cache
+class UCL_PrimKernels : public UCL_KernelCacheEntry {
+ public:
+  UCL_PrimKernels(UCL_Device &dev) : program(dev) {}
+  ~UCL_PrimKernels() {
+    for (size_t i=0; i<kernels.size(); i++)
+      delete kernels[i];
+  }
+
+  /// Return kernel i (in the order of the names used to build)
+  inline UCL_Kernel & operator[](const int i) { return *kernels[i]; }
+
+  UCL_Program program;
+  std::vector<UCL_Kernel *> kernels;
+};
+
+/// Return the kernels for key, compiling src on first use
+/** \param names Names of the nfun kernel functions in src
+  * \return NULL if the source could not be compiled **/
+inline UCL_PrimKernels * _ucl_prim_kernels(UCL_Device &dev,
+                                           const std::string &key,
+                                           const std::string &src,
+                                           const char **names,
+                                           const int nfun) {
+  UCL_KernelCacheEntry *e=dev.kernel_cache().find(key);
+  if (e!=NULL)
+    return static_cast<UCL_PrimKernels *>(e);
+
+  UCL_PrimKernels *p=new UCL_PrimKernels(dev);
+  if (_ucl_prims_compile(dev,p->program,src,NULL)!=UCL_SUCCESS) {
+    delete p;
+    return NULL;
+  }
+  for (int i=0; i<nfun; i++) {
+    p->kernels.push_back(new UCL_Kernel);
+    if (p->kernels.back()->set_function(p->program,names[i])!=UCL_SUCCESS) {
+      delete p;
+      return NULL;
+    }
+  }
+  dev.kernel_cache().insert(key,p);
+  return p;
+}
+
+#endif
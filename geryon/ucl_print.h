@@ -42,6 +42,16 @@ template <> struct _ucl_print<1> {
   static inline void p(mat_type &mat, const size_t rows, const size_t cols,
                        std::ostream &out, const std::string delim,
                        const std::string row_delim) {
+    if (mat_type::ROW_MAJOR==0) {
+      for (size_t j=0; j<rows; j++) {
+        for (size_t i=0; i<cols-1; i++)
+          out << mat(j,i) << delim;
+        out << mat(j,cols-1);
+        if (j!=rows-1)
+          out << row_delim;
+      }
+      return;
+    }
     int offset=0;
     int row_size=cols;
     if (mat_type::VECTOR==0)
@@ -169,10 +179,25 @@ inline void ucl_print(mat_type &mat) {
   ucl_print(mat,std::cout);
 }
 
+// True if out only uses formatting that ucl_dump() reproduces (precision)
+inline bool _ucl_dump_format(const std::ostream &out) {
+  const std::ios_base::fmtflags f=std::ios_base::floatfield |
+    std::ios_base::basefield | std::ios_base::showpos |
+    std::ios_base::showpoint | std::ios_base::showbase |
+    std::ios_base::uppercase;
+  return (out.flags() & f)==std::ios_base::dec && out.width()==0;
+}
+
 /// Outputs mat delimited by a space
+/** Row-major device containers are written in chunks with ucl_dump()
+  * unless out has flags (fixed, scientific, width, showpos, ...) that
+  * ucl_dump() does not follow **/
 template <class mat_type>
 inline void ucl_print(mat_type &mat, std::ostream &out) {
-  if (mat_type::VECTOR==1)
+  if (mat_type::MEM_TYPE==0 && mat_type::ROW_MAJOR==1 &&
+      _ucl_dump_format(out))
+    ucl_dump(mat,out);
+  else if (mat_type::VECTOR==1)
     ucl_print(mat,mat.cols(),out," ");
   else
     ucl_print(mat,mat.rows(),mat.cols(),out," ","\n");
@@ -250,6 +275,260 @@ inline void ucl_print(const mat_type &mat, std::ostream &out, UCL_Device &dev) {
     ucl_print(mat,mat.rows(),mat.cols(),out," ","\n",dev);
 }
 
+// -------------------------------------------------------------------------
+// - Streaming dump of whole containers
+// -------------------------------------------------------------------------
+
+/// Default bytes of host buffer used by ucl_dump for each chunk
+#ifndef UCL_DUMP_CHUNK
+#define UCL_DUMP_CHUNK 4194304
+#endif
+
+// Formats packed elements as text. Element g (counted from the start of
+// the container) is preceded by row_delim if it starts a row of cols
+// elements and by delim otherwise.
+template <class numtyp>
+struct _ucl_dump_text {
+  _ucl_dump_text(std::ostream &o, const std::string &d, const std::string &rd,
+                 const size_t c, const int t) :
+    out(o), delim(d), row_delim(rd), cols(c), threads(t),
+    precision(static_cast<int>(o.precision())) {}
+
+  std::ostream &out;
+  std::string delim, row_delim, buf;
+  size_t cols;
+  int threads, precision;
+
+  inline void format(const numtyp *x, const size_t first, const size_t n,
+                     std::string &s, const bool flush) {
+    char t[UCL_FORMAT_MAX];
+    for (size_t i=0; i<n; i++) {
+      const size_t g=first+i;
+      if (g>0) {
+        if (g%cols==0)
+          s+=row_delim;
+        else
+          s+=delim;
+      }
+      s.append(t,_ucl_format<numtyp>::f(t,x[i],precision));
+      if (flush && s.size()>=UCL_DUMP_CHUNK) {
+        out.write(s.data(),s.size());
+        s.clear();
+      }
+    }
+  }
+
+  // Part of a chunk formatted by a pool thread; kept between chunks so
+  // the strings keep their capacity
+  struct _part {
+    const numtyp *x;
+    size_t first, n;
+    std::string s;
+  };
+  std::vector<_part> part;
+
+  static void _run(void *arg, const size_t i) {
+    _ucl_dump_text &w=*static_cast<_ucl_dump_text *>(arg);
+    _part &p=w.part[i];
+    w.format(p.x,p.first,p.n,p.s,false);
+  }
+
+  inline void operator()(const numtyp *x, const size_t first, const size_t n) {
+    if (threads<2 || n<static_cast<size_t>(threads)*1024) {
+      format(x,first,n,buf,true);
+      return;
+    }
+    out.write(buf.data(),buf.size());
+    buf.clear();
+    part.resize(threads);
+    const size_t per=(n+threads-1)/threads;
+    for (int i=0; i<threads; i++) {
+      part[i].first=per*i;
+      part[i].n=(per*i<n) ? std::min(per,n-per*i) : 0;
+      part[i].x=x+part[i].first;
+      part[i].first+=first;
+    }
+    // Format on the copy pool (with the calling thread taking part), or
+    // here if the pool is in use by another thread
+    std::vector<int> node(threads,0);
+    if (!ucl_copy_pool().run(_run,this,node))
+      for (int i=0; i<threads; i++)
+        _run(this,i);
+    for (int i=0; i<threads; i++) {
+      out.write(part[i].s.data(),part[i].s.size());
+      part[i].s.clear();
+    }
+  }
+
+  inline void finish() {
+    out.write(buf.data(),buf.size());
+    buf.clear();
+  }
+};
+
+// Writes packed elements unformatted
+template <class numtyp>
+struct _ucl_dump_binary {
+  _ucl_dump_binary(std::ostream &o) : out(o) {}
+  std::ostream &out;
+  inline void operator()(const numtyp *x, const size_t, const size_t n)
+    { out.write(reinterpret_cast<const char *>(x),n*sizeof(numtyp)); }
+  inline void finish() {}
+};
+
+// Split a container into units (elements of vectors, rows of matrices) and
+// get the number of units in a chunk of at most chunk_bytes
+template <class mat_type>
+inline size_t _ucl_dump_units(mat_type &mat, const size_t chunk_bytes,
+                              size_t &unit_elems, size_t &units) {
+  unit_elems=(mat_type::VECTOR==1) ? 1 : mat.cols();
+  units=(mat_type::VECTOR==1) ? mat.cols() : mat.rows();
+  size_t per=chunk_bytes/(unit_elems*sizeof(typename mat_type::data_type));
+  if (per==0)
+    per=1;
+  return (per>units) ? units : per;
+}
+
+// Passes the elements of mat to w in chunks of at most chunk_bytes
+template <int mem> struct _ucl_dump;
+template <> struct _ucl_dump<1> {
+  template <class mat_type, class writer>
+  static inline int run(mat_type &mat, const size_t chunk_bytes,
+                        writer &w) {
+    typedef typename mat_type::data_type numtyp;
+    size_t unit_elems, units;
+    size_t per=_ucl_dump_units(mat,chunk_bytes,unit_elems,units);
+    if (units==0 || unit_elems==0)
+      return UCL_SUCCESS;
+    size_t pitch=sizeof(numtyp);
+    if (mat_type::VECTOR==0) {
+      pitch=mat.row_bytes();
+      if (pitch!=unit_elems*sizeof(numtyp))
+        per=1;
+    }
+    const char *p=reinterpret_cast<const char *>(mat.begin());
+    for (size_t u=0; u<units; u+=per)
+      w(reinterpret_cast<const numtyp *>(p+u*pitch),u*unit_elems,
+        std::min(per,units-u)*unit_elems);
+    w.finish();
+    return UCL_SUCCESS;
+  }
+};
+
+// Device data is copied to two pinned buffers in turn, so that the copy of
+// the next chunk overlaps with writing the current one. If the second
+// buffer cannot be allocated, one buffer is used without overlap.
+template <int mem> struct _ucl_dump {
+  template <class mat_type, class writer>
+  static inline int run(mat_type &mat, const size_t chunk_bytes,
+                        writer &w) {
+    typedef typename mat_type::data_type numtyp;
+    size_t unit_elems, units;
+    const size_t per=_ucl_dump_units(mat,chunk_bytes,unit_elems,units);
+    if (units==0 || unit_elems==0)
+      return UCL_SUCCESS;
+
+    UCL_H_Vec<numtyp> buf[2];
+    UCL_Event event[2];
+    if (buf[0].alloc(per*unit_elems,mat)!=UCL_SUCCESS)
+      return UCL_MEMORY_ERROR;
+    size_t nbuf=1;
+    if (per<units && buf[1].alloc(per*unit_elems,mat)==UCL_SUCCESS)
+      nbuf=2;
+
+    _read(mat,buf[0],event[0],0,per);
+    for (size_t u=0, k=0; u<units; u+=per, k++) {
+      const size_t next=u+per, b=k%nbuf;
+      if (nbuf==2 && next<units)
+        _read(mat,buf[1-b],event[1-b],next,std::min(per,units-next));
+      event[b].sync();
+      w(buf[b].begin(),u*unit_elems,std::min(per,units-u)*unit_elems);
+      if (nbuf==1 && next<units)
+        _read(mat,buf[0],event[0],next,std::min(per,units-next));
+    }
+    w.finish();
+    return UCL_SUCCESS;
+  }
+
+  template <class mat_type, class buf_type>
+  static inline void _read(mat_type &mat, buf_type &buf, UCL_Event &event,
+                           const size_t u, const size_t n) {
+    typedef typename mat_type::data_type numtyp;
+    if (mat_type::VECTOR==1)
+      ucl_mv_cpy(buf,0,n*sizeof(numtyp),mat,u*sizeof(numtyp),
+                 n*sizeof(numtyp),n*sizeof(numtyp),1,mat.cq());
+    else {
+      const size_t width=mat.cols()*sizeof(numtyp);
+      ucl_mv_cpy(buf,0,width,mat,u*mat.row_bytes(),mat.row_bytes(),width,n,
+                 mat.cq());
+    }
+    event.record(mat.cq());
+  }
+};
+
+/// Write all elements of a row-major container as text in chunks
+/** Elements are delimited by delim and rows of matrices by row_delim, as
+  * in ucl_print(). Device data is read back through two pinned buffers of
+  * chunk_bytes; the copy of the next chunk overlaps with formatting of the
+  * current one, so no full-size host copy is made. Numbers are formatted
+  * without iostreams using only the precision of out (see ucl_format.h);
+  * other stream flags such as fixed or width are not followed.
+  * \param threads Number of parts each chunk is split into for formatting
+  *                on the copy pool (see ucl_host_copy.h)
+  * \return UCL_SUCCESS or UCL_MEMORY_ERROR if a chunk buffer could not be
+  *         allocated **/
+template <class mat_type>
+inline int ucl_dump(mat_type &mat, std::ostream &out,
+                    const std::string delim=" ",
+                    const std::string row_delim="\n", const int threads=1,
+                    const size_t chunk_bytes=UCL_DUMP_CHUNK) {
+  assert(mat_type::ROW_MAJOR==1);
+  _ucl_dump_text<typename mat_type::data_type> w(out,delim,row_delim,
+                                                 mat.cols(),threads);
+  return _ucl_dump<mat_type::MEM_TYPE>::run(mat,chunk_bytes,w);
+}
+
+/// Write the host data of a vector s-object as text in chunks
+template <class t1, class t2>
+inline int ucl_dump(UCL_Vector<t1,t2> &mat, std::ostream &out,
+                    const std::string delim=" ",
+                    const std::string row_delim="\n", const int threads=1,
+                    const size_t chunk_bytes=UCL_DUMP_CHUNK)
+  { return ucl_dump(mat.host,out,delim,row_delim,threads,chunk_bytes); }
+
+/// Write the host data of a matrix s-object as text in chunks
+template <class t1, class t2>
+inline int ucl_dump(UCL_Matrix<t1,t2> &mat, std::ostream &out,
+                    const std::string delim=" ",
+                    const std::string row_delim="\n", const int threads=1,
+                    const size_t chunk_bytes=UCL_DUMP_CHUNK)
+  { return ucl_dump(mat.host,out,delim,row_delim,threads,chunk_bytes); }
+
+/// Write all elements of a row-major container as raw binary in chunks
+/** The packed elements are written in row-major order without padding.
+  * Device data is read back as for ucl_dump().
+  * \return UCL_SUCCESS or UCL_MEMORY_ERROR if a chunk buffer could not be
+  *         allocated **/
+template <class mat_type>
+inline int ucl_dump_binary(mat_type &mat, std::ostream &out,
+                           const size_t chunk_bytes=UCL_DUMP_CHUNK) {
+  assert(mat_type::ROW_MAJOR==1);
+  _ucl_dump_binary<typename mat_type::data_type> w(out);
+  return _ucl_dump<mat_type::MEM_TYPE>::run(mat,chunk_bytes,w);
+}
+
+/// Write the host data of a vector s-object as raw binary in chunks
+template <class t1, class t2>
+inline int ucl_dump_binary(UCL_Vector<t1,t2> &mat, std::ostream &out,
+                           const size_t chunk_bytes=UCL_DUMP_CHUNK)
+  { return ucl_dump_binary(mat.host,out,chunk_bytes); }
+
+/// Write the host data of a matrix s-object as raw binary in chunks
+template <class t1, class t2>
+inline int ucl_dump_binary(UCL_Matrix<t1,t2> &mat, std::ostream &out,
+                           const size_t chunk_bytes=UCL_DUMP_CHUNK)
+  { return ucl_dump_binary(mat.host,out,chunk_bytes); }
+
 // -------------------------------------------------------------------------
 // - Operator << Overloading
 // -------------------------------------------------------------------------
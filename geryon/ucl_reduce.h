@@ -0,0 +1,618 @@
+/***************************************************************************
+                                 ucl_reduce.h
+                             -------------------
+
+  Parallel reductions (sum/min/max/minmax/argmin/argmax) on device data
+
+ __________________________________________________________________________
+    This file is part of the Geryon Unified Coprocessor Library (UCL)
+ __________________________________________________________________________
+
+ ***************************************************************************/
+
+/* -----------------------------------------------------------------------
+   Copyright (2010) Sandia Corporation.  Under the terms of Contract
+   DE-AC04-94AL85000 with Sandia Corporation, the U.S. Government retains
+   certain rights in this software.  This software is distributed under
+   the Simplified BSD License.
+   ----------------------------------------------------------------------- */
+
+/***************************************************************************
+   UCL_Reduce performs reductions over UCL_D_Vec and UCL_D_Mat data with
+   work-group tree reductions. Long inputs are reduced in multiple passes
+   through temporary storage that is kept by the object between calls.
+   The first pass uses 4-vector loads when the buffer is aligned to four
+   elements; elements before the first and after the last full vector in
+   each row are loaded one at a time, so any length, offset or pitch is
+   vectorized.
+
+   Results can be left on the device (no synchronization; the result can
+   be used by the next kernel in the queue) or returned to the host:
+
+     UCL_Reduce<double> red(dev);
+     red.reduce(energy_sum,energy,UCL_REDUCE_SUM,dev.cq());  // stays on dev
+     double emax=red.max(energy);                            // host result
+
+   For UCL_REDUCE_MINMAX, results are stored as (min,max) pairs. For
+   UCL_REDUCE_ARGMIN and UCL_REDUCE_ARGMAX, the index of the first extreme
+   element is stored in a UCL_D_Vec<int> along with the value. Row and
+   column reductions of matrices store one result per row or column;
+   indices are column or row numbers, respectively. Indices from
+   reductions over a whole matrix are row*cols+col. Empty inputs store the
+   identity of the operation (0 for sums, the largest or lowest value for
+   minimums and maximums) and an index of -1.
+
+   A UCL_Reduce object should only be used with one queue at a time.
+ ***************************************************************************/
+
+// Only allow this file to be included by nvd_prims.h and ocl_prims.h
+#ifdef UCL_PRIMS_ALLOW
+
+/// Reduction operations for UCL_Reduce
+enum UCL_REDUCE_OP {
+  UCL_REDUCE_SUM,     ///< Sum of elements
+  UCL_REDUCE_MIN,     ///< Minimum element
+  UCL_REDUCE_MAX,     ///< Maximum element
+  UCL_REDUCE_MINMAX,  ///< Minimum and maximum element (stored as a pair)
+  UCL_REDUCE_ARGMIN,  ///< Minimum element and its index
+  UCL_REDUCE_ARGMAX   ///< Maximum element and its index
+};
+
+/// Kernel source for reductions (RED_OP and the type are defined first)
+inline const char * _ucl_reduce_source() {
+  return
+    "#if (RED_OP==3)\n"
+    "#define TWO_VAL\n"
+    "#elif (RED_OP>3)\n"
+    "#define HAS_IDX\n"
+    "#endif\n"
+    "#if (RED_OP==0)\n"
+    "#define FOLD(a,b) { a=(a)+(b); }\n"
+    "#elif (RED_OP==1)\n"
+    "#define FOLD(a,b) { if ((b)<(a)) a=(b); }\n"
+    "#else\n"
+    "#define FOLD(a,b) { if ((a)<(b)) a=(b); }\n"
+    "#endif\n"
+    "#if (RED_OP==4)\n"
+    "#define BETTER(v,i,bv,bi) ((v)<(bv) || ((v)==(bv) && (i)<(bi)))\n"
+    "#else\n"
+    "#define BETTER(v,i,bv,bi) ((bv)<(v) || ((v)==(bv) && (i)<(bi)))\n"
+    "#endif\n"
+    "#if defined(HAS_IDX)\n"
+    "#define ELEM(x,i) { NUMTYP _x=(x); int _i=(i);                        \\\n"
+    "  if (BETTER(_x,_i,a0,ai)) { a0=_x; ai=_i; } }\n"
+    "#elif defined(TWO_VAL)\n"
+    "#define ELEM(x,i) { NUMTYP _x=(x); if (_x<a0) a0=_x; if (a1<_x) a1=_x; }\n"
+    "#else\n"
+    "#define ELEM(x,i) FOLD(a0,(x))\n"
+    "#endif\n"
+    "\n"
+    "#define STORE(out,out_off,out_idx,idx_off,g)                           \\\n"
+    "  { out[out_off+g]=a0; }\n"
+    "#if defined(TWO_VAL)\n"
+    "#undef STORE\n"
+    "#define STORE(out,out_off,out_idx,idx_off,g)                           \\\n"
+    "  { out[out_off+2*(g)]=a0; out[out_off+2*(g)+1]=a1; }\n"
+    "#elif defined(HAS_IDX)\n"
+    "#undef STORE\n"
+    "#define STORE(out,out_off,out_idx,idx_off,g)                           \\\n"
+    "  { out[out_off+g]=a0; out_idx[idx_off+g]=ai; }\n"
+    "#endif\n"
+    "\n"
+    "__kernel void ucl_reduce(const __global NUMTYP *in, const int in_off,\n"
+    "                         const __global int *in_idx, const int cols,\n"
+    "                         const int pitch, const int gpr,\n"
+    "                         const int idx_stride, const int partial,\n"
+    "                         const int vec, const NUMTYP id0,\n"
+    "                         const NUMTYP id1, __global NUMTYP *out,\n"
+    "                         const int out_off, __global int *out_idx,\n"
+    "                         const int idx_off) {\n"
+    "  __local NUMTYP s0[BLOCK_SIZE];\n"
+    "  #ifdef TWO_VAL\n"
+    "  __local NUMTYP s1[BLOCK_SIZE];\n"
+    "  #endif\n"
+    "  #ifdef HAS_IDX\n"
+    "  __local int si[BLOCK_SIZE];\n"
+    "  #endif\n"
+    "  const int tid=THREAD_ID_X;\n"
+    "  const int g=BLOCK_ID_X;\n"
+    "  const int row=g/gpr;\n"
+    "  const int start=(g-row*gpr)*BLOCK_SIZE+tid;\n"
+    "  const int stride=gpr*BLOCK_SIZE;\n"
+    "  NUMTYP a0=id0;\n"
+    "  NUMTYP a1=id1;\n"
+    "  int ai=0x7fffffff;\n"
+    "\n"
+    "  if (partial) {\n"
+    "    for (int k=start; k<cols; k+=stride) {\n"
+    "      const int e=row*pitch+k;\n"
+    "      #if defined(TWO_VAL)\n"
+    "      NUMTYP lo=in[in_off+2*e];\n"
+    "      NUMTYP hi=in[in_off+2*e+1];\n"
+    "      if (lo<a0) a0=lo;\n"
+    "      if (a1<hi) a1=hi;\n"
+    "      #elif defined(HAS_IDX)\n"
+    "      ELEM(in[in_off+e],in_idx[e]);\n"
+    "      #else\n"
+    "      ELEM(in[in_off+e],0);\n"
+    "      #endif\n"
+    "    }\n"
+    "  } else {\n"
+    "    const __global NUMTYP *p=in+in_off+row*pitch;\n"
+    "    const int ibase=row*idx_stride;\n"
+    "    int k0=0;\n"
+    "    if (vec) {\n"
+    "      int head=(4-((in_off+row*pitch)&3))&3;\n"
+    "      if (head>cols) head=cols;\n"
+    "      for (int k=start; k<head; k+=stride)\n"
+    "        ELEM(p[k],ibase+k);\n"
+    "      const int nv=(cols-head)/4;\n"
+    "      const __global NUMTYP4 *p4=(const __global NUMTYP4 *)(p+head);\n"
+    "      for (int k=start; k<nv; k+=stride) {\n"
+    "        const NUMTYP4 v=p4[k];\n"
+    "        const int i=ibase+head+4*k;\n"
+    "        ELEM(v.x,i); ELEM(v.y,i+1); ELEM(v.z,i+2); ELEM(v.w,i+3);\n"
+    "      }\n"
+    "      k0=head+nv*4;\n"
+    "    }\n"
+    "    for (int k=k0+start; k<cols; k+=stride)\n"
+    "      ELEM(p[k],ibase+k);\n"
+    "  }\n"
+    "\n"
+    "  s0[tid]=a0;\n"
+    "  #ifdef TWO_VAL\n"
+    "  s1[tid]=a1;\n"
+    "  #endif\n"
+    "  #ifdef HAS_IDX\n"
+    "  si[tid]=ai;\n"
+    "  #endif\n"
+    "  __syncthreads();\n"
+    "  for (int s=BLOCK_SIZE/2; s>0; s>>=1) {\n"
+    "    if (tid<s) {\n"
+    "      #if defined(TWO_VAL)\n"
+    "      if (s0[tid+s]<s0[tid]) s0[tid]=s0[tid+s];\n"
+    "      if (s1[tid]<s1[tid+s]) s1[tid]=s1[tid+s];\n"
+    "      #elif defined(HAS_IDX)\n"
+    "      if (BETTER(s0[tid+s],si[tid+s],s0[tid],si[tid])) {\n"
+    "        s0[tid]=s0[tid+s];\n"
+    "        si[tid]=si[tid+s];\n"
+    "      }\n"
+    "      #else\n"
+    "      FOLD(s0[tid],s0[tid+s]);\n"
+    "      #endif\n"
+    "    }\n"
+    "    __syncthreads();\n"
+    "  }\n"
+    "  if (tid==0) {\n"
+    "    a0=s0[0];\n"
+    "    #ifdef TWO_VAL\n"
+    "    a1=s1[0];\n"
+    "    #endif\n"
+    "    #ifdef HAS_IDX\n"
+    "    ai=(cols==0) ? -1 : si[0];\n"
+    "    #endif\n"
+    "    STORE(out,out_off,out_idx,idx_off,g);\n"
+    "  }\n"
+    "}\n"
+    "\n"
+    "__kernel void ucl_reduce_cols(const __global NUMTYP *in,\n"
+    "                              const int in_off, const int rows,\n"
+    "                              const int cols, const int pitch,\n"
+    "                              const NUMTYP id0, const NUMTYP id1,\n"
+    "                              __global NUMTYP *out, const int out_off,\n"
+    "                              __global int *out_idx,\n"
+    "                              const int idx_off) {\n"
+    "  const int c=BLOCK_ID_X*BLOCK_SIZE+THREAD_ID_X;\n"
+    "  if (c<cols) {\n"
+    "    NUMTYP a0=id0;\n"
+    "    NUMTYP a1=id1;\n"
+    "    int ai=0x7fffffff;\n"
+    "    for (int r=0; r<rows; r++)\n"
+    "      ELEM(in[in_off+r*pitch+c],r);\n"
+    "    #ifdef HAS_IDX\n"
+    "    if (rows==0) ai=-1;\n"
+    "    #endif\n"
+    "    STORE(out,out_off,out_idx,idx_off,c);\n"
+    "  }\n"
+    "}\n";
+}
+
+/// Reductions over device vectors and matrices
+/** Kernels are compiled on first use for each operation and cached with
+  * the device. Temporary storage is kept between calls. **/
+template <class numtyp>
+class UCL_Reduce {
+ public:
+  /// Set up reductions on a device
+  /** \param block_size Work-group size (rounded down to a power of 2;
+    *                   0 for a default based on the device)
+    * \param max_groups Maximum work-groups used for the first pass
+    *                   (0 for a default based on the device) **/
+  UCL_Reduce(UCL_Device &dev, const int block_size=0,
+             const int max_groups=0) : _dev(&dev) {
+    _block_size=(block_size>0) ? _ucl_pow2_floor(block_size) :
+                                 _ucl_prim_block_size(dev);
+    _max_groups=(max_groups>0) ? max_groups : dev.cus()*8;
+    if (_max_groups<1)
+      _max_groups=1;
+    for (int i=0; i<6; i++)
+      _kernels[i]=NULL;
+  }
+
+  /// Work-group size used for reductions
+  inline int block_size() const { return _block_size; }
+
+  /// Reduce all elements of src into result[pos] on the device
+  /** For UCL_REDUCE_MINMAX, result[pos] and result[pos+1] are set
+    * \note Asynchronous with respect to the host **/
+  inline int reduce(UCL_D_Vec<numtyp> &result, const UCL_D_Vec<numtyp> &src,
+                    const enum UCL_REDUCE_OP op, command_queue &cq,
+                    const size_t pos=0) {
+    return _reduce(src,src.offset(),1,src.cols(),src.cols(),true,op,result,
+                   pos,_idx[0],0,cq);
+  }
+
+  /// Reduce all elements of src into value[pos] and index[pos] on the device
+  /** For use with UCL_REDUCE_ARGMIN and UCL_REDUCE_ARGMAX
+    * \note Asynchronous with respect to the host **/
+  inline int reduce(UCL_D_Vec<numtyp> &value, UCL_D_Vec<int> &index,
+                    const UCL_D_Vec<numtyp> &src, const enum UCL_REDUCE_OP op,
+                    command_queue &cq, const size_t pos=0) {
+    return _reduce(src,src.offset(),1,src.cols(),src.cols(),true,op,value,
+                   pos,index,pos,cq);
+  }
+
+  /// Reduce all elements of a matrix into result[pos] on the device
+  /** Padding in the matrix pitch is not included
+    * \note Asynchronous with respect to the host **/
+  inline int reduce(UCL_D_Vec<numtyp> &result, const UCL_D_Mat<numtyp> &src,
+                    const enum UCL_REDUCE_OP op, command_queue &cq,
+                    const size_t pos=0) {
+    return _reduce(src,src.offset(),src.rows(),src.cols(),_pitch(src),true,
+                   op,result,pos,_idx[0],0,cq);
+  }
+
+  /// Reduce all elements of a matrix into value[pos] and index[pos]
+  /** For use with UCL_REDUCE_ARGMIN and UCL_REDUCE_ARGMAX
+    * \note Asynchronous with respect to the host **/
+  inline int reduce(UCL_D_Vec<numtyp> &value, UCL_D_Vec<int> &index,
+                    const UCL_D_Mat<numtyp> &src, const enum UCL_REDUCE_OP op,
+                    command_queue &cq, const size_t pos=0) {
+    return _reduce(src,src.offset(),src.rows(),src.cols(),_pitch(src),true,
+                   op,value,pos,index,pos,cq);
+  }
+
+  /// Reduce each row of a matrix into result (one result per row)
+  /** \note Asynchronous with respect to the host **/
+  inline int reduce_rows(UCL_D_Vec<numtyp> &result,
+                         const UCL_D_Mat<numtyp> &src,
+                         const enum UCL_REDUCE_OP op, command_queue &cq) {
+    return _reduce(src,src.offset(),src.rows(),src.cols(),_pitch(src),false,
+                   op,result,0,_idx[0],0,cq);
+  }
+
+  /// Reduce each row of a matrix into value and the column index into index
+  /** \note Asynchronous with respect to the host **/
+  inline int reduce_rows(UCL_D_Vec<numtyp> &value, UCL_D_Vec<int> &index,
+                         const UCL_D_Mat<numtyp> &src,
+                         const enum UCL_REDUCE_OP op, command_queue &cq) {
+    return _reduce(src,src.offset(),src.rows(),src.cols(),_pitch(src),false,
+                   op,value,0,index,0,cq);
+  }
+
+  /// Reduce each column of a matrix into result (one result per column)
+  /** \note Asynchronous with respect to the host **/
+  inline int reduce_cols(UCL_D_Vec<numtyp> &result,
+                         const UCL_D_Mat<numtyp> &src,
+                         const enum UCL_REDUCE_OP op, command_queue &cq) {
+    if (_reserve_idx(1)!=UCL_SUCCESS)
+      return UCL_MEMORY_ERROR;
+    return _reduce_cols(src,op,result,_idx[0],cq);
+  }
+
+  /// Reduce each column of a matrix into value and the row index into index
+  /** \note Asynchronous with respect to the host **/
+  inline int reduce_cols(UCL_D_Vec<numtyp> &value, UCL_D_Vec<int> &index,
+                         const UCL_D_Mat<numtyp> &src,
+                         const enum UCL_REDUCE_OP op, command_queue &cq)
+    { return _reduce_cols(src,op,value,index,cq); }
+
+  /// Return the sum of the elements in src (blocks until complete)
+  template <class mat_type>
+  inline numtyp sum(const mat_type &src)
+    { _host_result(src,UCL_REDUCE_SUM); return _hval[0]; }
+
+  /// Return the minimum element in src (blocks until complete)
+  template <class mat_type>
+  inline numtyp min(const mat_type &src)
+    { _host_result(src,UCL_REDUCE_MIN); return _hval[0]; }
+
+  /// Return the maximum element in src (blocks until complete)
+  template <class mat_type>
+  inline numtyp max(const mat_type &src)
+    { _host_result(src,UCL_REDUCE_MAX); return _hval[0]; }
+
+  /// Get the minimum and maximum element in src (blocks until complete)
+  template <class mat_type>
+  inline void minmax(const mat_type &src, numtyp &min_val, numtyp &max_val) {
+    _host_result(src,UCL_REDUCE_MINMAX);
+    min_val=_hval[0];
+    max_val=_hval[1];
+  }
+
+  /// Return the index of the first minimum element (blocks until complete)
+  /** \param value If not NULL, set to the minimum value **/
+  template <class mat_type>
+  inline int argmin(const mat_type &src, numtyp *value=NULL)
+    { return _host_arg(src,UCL_REDUCE_ARGMIN,value); }
+
+  /// Return the index of the first maximum element (blocks until complete)
+  /** \param value If not NULL, set to the maximum value **/
+  template <class mat_type>
+  inline int argmax(const mat_type &src, numtyp *value=NULL)
+    { return _host_arg(src,UCL_REDUCE_ARGMAX,value); }
+
+  /// Free temporary storage
+  inline void clear() {
+    for (int i=0; i<2; i++) {
+      _part[i].clear();
+      _idx[i].clear();
+    }
+    _dval.clear();
+    _didx.clear();
+    _hval.clear();
+    _hidx.clear();
+  }
+
+ private:
+  UCL_Device *_dev;
+  int _block_size, _max_groups;
+  UCL_PrimKernels *_kernels[6];
+  UCL_D_Vec<numtyp> _part[2], _dval;
+  UCL_D_Vec<int> _idx[2], _didx;
+  UCL_H_Vec<numtyp> _hval;
+  UCL_H_Vec<int> _hidx;
+
+  // Row pitch of a matrix in elements
+  inline int _pitch(const UCL_D_Mat<numtyp> &mat) const
+    { return static_cast<int>(mat.row_bytes()/sizeof(numtyp)); }
+
+  // Identity values for the first and second accumulator
+  inline numtyp _id0(const enum UCL_REDUCE_OP op) const {
+    if (op==UCL_REDUCE_SUM) return numtyp(0);
+    if (op==UCL_REDUCE_MAX || op==UCL_REDUCE_ARGMAX)
+      return _ucl_prim_lowest<numtyp>();
+    return _ucl_prim_max<numtyp>();
+  }
+  inline numtyp _id1(const enum UCL_REDUCE_OP) const
+    { return _ucl_prim_lowest<numtyp>(); }
+
+  // Compiled kernels for an operation (NULL on error)
+  inline UCL_PrimKernels * _get_kernels(const enum UCL_REDUCE_OP op) {
+    if (_kernels[op]==NULL) {
+      std::ostringstream key, src;
+      key << "ucl_reduce_" << _UCL_DATA_ID<numtyp>::name() << "_"
+          << _block_size << "_" << op;
+      src << _ucl_prim_defs<numtyp>(_block_size) << "#define RED_OP " << op
+          << "\n" << _ucl_reduce_source();
+      const char *names[2]={"ucl_reduce","ucl_reduce_cols"};
+      _kernels[op]=_ucl_prim_kernels(*_dev,key.str(),src.str(),names,2);
+    }
+    return _kernels[op];
+  }
+
+  inline int _reserve(UCL_D_Vec<numtyp> &v, const size_t n) {
+    if (v.cols()>=n)
+      return UCL_SUCCESS;
+    return v.alloc(n,*_dev);
+  }
+
+  inline int _reserve_idx(const size_t n) {
+    for (int i=0; i<2; i++)
+      if (_idx[i].cols()<n)
+        if (_idx[i].alloc(n,*_dev)!=UCL_SUCCESS)
+          return UCL_MEMORY_ERROR;
+    return UCL_SUCCESS;
+  }
+
+  // Work-groups for each row in the first pass
+  inline int _groups_per_row(const int rows, const int cols) const {
+    const int per_group=_block_size*4;
+    int gpr=(cols+per_group-1)/per_group;
+    int max_gpr=_max_groups/rows;
+    if (max_gpr<1) max_gpr=1;
+    if (gpr>max_gpr) gpr=max_gpr;
+    if (gpr<1) gpr=1;
+    return gpr;
+  }
+
+  template <class mat_type>
+  inline int _reduce(const mat_type &src, const int src_off, const int rows,
+                     const int cols, const int pitch, const bool whole,
+                     const enum UCL_REDUCE_OP op, UCL_D_Vec<numtyp> &result,
+                     const size_t pos, UCL_D_Vec<int> &index,
+                     const size_t ipos, command_queue &cq) {
+    UCL_PrimKernels *k=_get_kernels(op);
+    if (k==NULL)
+      return UCL_COMPILE_ERROR;
+
+    // Empty input: a single pass over no elements stores the identity (and
+    // an index of -1) in each result
+    const bool empty=(rows==0 || cols==0);
+    if (empty && rows==0 && !whole)
+      return UCL_SUCCESS;
+    int nrows=(empty && whole) ? 1 : rows, ncols=empty ? 0 : cols;
+
+    const int width=(op==UCL_REDUCE_MINMAX) ? 2 : 1;
+    int gpr=_groups_per_row(nrows,ncols);
+    const int max_part=nrows*gpr;
+    if (_reserve_idx(max_part)!=UCL_SUCCESS)
+      return UCL_MEMORY_ERROR;
+    if (max_part>1 || !whole || empty)
+      if (_reserve(_part[0],max_part*width)!=UCL_SUCCESS ||
+          _reserve(_part[1],max_part*width)!=UCL_SUCCESS)
+        return UCL_MEMORY_ERROR;
+
+    // Each row peels elements up to a 4-element boundary and the rest
+    // after the last full vector, so only the buffer must be aligned
+    int vec=_ucl_prims_aligned(src,4*sizeof(numtyp)) ? 1 : 0;
+    int npitch=pitch;
+    int idx_stride=whole ? cols : 0;
+    int partial=0;
+    int in_off=src_off;
+    numtyp id0=_id0(op), id1=_id1(op);
+
+    for (int pass=0; ; pass++) {
+      const int groups=nrows*gpr;
+      const bool last=whole ? (groups==1) : (gpr==1);
+      UCL_D_Vec<numtyp> &out=last ? result : _part[pass%2];
+      UCL_D_Vec<int> &oidx=last ? index : _idx[pass%2];
+      int out_off=last ? static_cast<int>(result.offset()+pos) : 0;
+      int idx_off=last ? static_cast<int>(index.offset()+ipos) : 0;
+
+      UCL_Kernel &kr=(*k)[0];
+      kr.set_size(groups,_block_size,cq);
+      kr.clear_args();
+      if (pass==0 && !empty)
+        kr.add_arg(&src);
+      else
+        kr.add_arg(&_part[(pass+1)%2]);
+      kr.add_arg(&in_off);
+      kr.add_arg(&_idx[(pass+1)%2]);
+      kr.add_arg(&ncols);
+      kr.add_arg(&npitch);
+      kr.add_arg(&gpr);
+      kr.add_arg(&idx_stride);
+      kr.add_arg(&partial);
+      kr.add_arg(&vec);
+      kr.add_arg(&id0);
+      kr.add_arg(&id1);
+      kr.add_arg(&out);
+      kr.add_arg(&out_off);
+      kr.add_arg(&oidx);
+      kr.add_arg(&idx_off);
+      kr.run();
+      if (last)
+        break;
+
+      if (whole) {
+        ncols=groups;
+        nrows=1;
+      } else
+        ncols=gpr;
+      npitch=ncols;
+      in_off=0;
+      partial=1;
+      vec=0;
+      gpr=_groups_per_row(nrows,ncols);
+    }
+    return UCL_SUCCESS;
+  }
+
+  inline int _reduce_cols(const UCL_D_Mat<numtyp> &src,
+                          const enum UCL_REDUCE_OP op,
+                          UCL_D_Vec<numtyp> &result, UCL_D_Vec<int> &index,
+                          command_queue &cq) {
+    UCL_PrimKernels *k=_get_kernels(op);
+    if (k==NULL)
+      return UCL_COMPILE_ERROR;
+    if (src.cols()==0)
+      return UCL_SUCCESS;
+    // With no rows, each column stores the identity (and an index of -1)
+    if (src.rows()==0 && _reserve(_part[0],1)!=UCL_SUCCESS)
+      return UCL_MEMORY_ERROR;
+    int in_off=src.offset(), rows=src.rows(), cols=src.cols();
+    int pitch=_pitch(src);
+    int out_off=result.offset(), idx_off=index.offset();
+    numtyp id0=_id0(op), id1=_id1(op);
+    UCL_Kernel &kr=(*k)[1];
+    kr.set_size((cols+_block_size-1)/_block_size,_block_size,cq);
+    kr.clear_args();
+    if (rows==0)
+      kr.add_arg(&_part[0]);
+    else
+      kr.add_arg(&src);
+    kr.add_arg(&in_off);
+    kr.add_arg(&rows);
+    kr.add_arg(&cols);
+    kr.add_arg(&pitch);
+    kr.add_arg(&id0);
+    kr.add_arg(&id1);
+    kr.add_arg(&result);
+    kr.add_arg(&out_off);
+    kr.add_arg(&index);
+    kr.add_arg(&idx_off);
+    kr.run();
+    return UCL_SUCCESS;
+  }
+
+  // Reduce into _dval and copy the result to _hval
+  template <class mat_type>
+  inline void _host_result(const mat_type &src, const enum UCL_REDUCE_OP op) {
+    if (_dval.cols()<2) {
+      _dval.alloc(2,*_dev);
+      _hval.alloc(2,*_dev);
+    }
+    _hval[0]=_id0(op);
+    _hval[1]=_id1(op);
+    if (src.numel()>0 && reduce(_dval,src,op,_dval.cq())==UCL_SUCCESS)
+      ucl_copy(_hval,_dval,2,false);
+  }
+
+  template <class mat_type>
+  inline int _host_arg(const mat_type &src, const enum UCL_REDUCE_OP op,
+                       numtyp *value) {
+    if (_dval.cols()<2) {
+      _dval.alloc(2,*_dev);
+      _hval.alloc(2,*_dev);
+    }
+    if (_hidx.cols()<1) {
+      _didx.alloc(1,*_dev);
+      _hidx.alloc(1,*_dev);
+    }
+    _hval[0]=_id0(op);
+    _hidx[0]=-1;
+    if (src.numel()>0 &&
+        reduce(_dval,_didx,src,op,_dval.cq())==UCL_SUCCESS) {
+      ucl_copy(_hval,_dval,1,false);
+      ucl_copy(_hidx,_didx,1,false);
+    }
+    if (value!=NULL)
+      *value=_hval[0];
+    return _hidx[0];
+  }
+};
+
+/// Sum of the elements of a device vector or matrix (blocks until complete)
+template <class mat_type>
+inline typename mat_type::data_type ucl_sum(const mat_type &src,
+                                            UCL_Device &dev) {
+  UCL_Reduce<typename mat_type::data_type> red(dev);
+  return red.sum(src);
+}
+
+/// Minimum element of a device vector or matrix (blocks until complete)
+template <class mat_type>
+inline typename mat_type::data_type ucl_min(const mat_type &src,
+                                            UCL_Device &dev) {
+  UCL_Reduce<typename mat_type::data_type> red(dev);
+  return red.min(src);
+}
+
+/// Maximum element of a device vector or matrix (blocks until complete)
+template <class mat_type>
+inline typename mat_type::data_type ucl_max(const mat_type &src,
+                                            UCL_Device &dev) {
+  UCL_Reduce<typename mat_type::data_type> red(dev);
+  return red.max(src);
+}
+
+/// Index of the first minimum element of a device vector or matrix
+/** Blocks until complete **/
+template <class mat_type>
+inline int ucl_argmin(const mat_type &src, UCL_Device &dev) {
+  UCL_Reduce<typename mat_type::data_type> red(dev);
+  return red.argmin(src);
+}
+
+#endif
@@ -164,6 +164,20 @@ template <> struct _ucl_s_obj_help<1> {
     ucl_copy(dst,src,rows,cols,cq);
   }
 
+  template <class t1, class t2, class t3>
+  static inline void copy(t1 &dst, t2 &src, const UCL_DirtyRanges &ranges,
+                          t3 &buffer, command_queue &cq) {
+    ucl_copy(dst,src,ranges,cq);
+  }
+
+  template <class t1, class t2, class t3>
+  static inline void copy_block(t1 &dst, t2 &src, const size_t row,
+                                const size_t col, const size_t rows,
+                                const size_t cols, t3 &buffer,
+                                command_queue &cq) {
+    ucl_copy_block(dst,src,row,col,rows,cols,cq);
+  }
+
   template <class t1, class t2, class t3>
   static inline int dev_resize(t1 &device, t2 &host, t3 &buff,const int cols) {
     if (device.kind()==UCL_VIEW) {
@@ -352,6 +366,20 @@ template <int st> struct _ucl_s_obj_help {
     ucl_cast_copy(dst,src,rows,cols,buffer,cq);
   }
 
+  template <class t1, class t2, class t3>
+  static inline void copy(t1 &dst, t2 &src, const UCL_DirtyRanges &ranges,
+                          t3 &buffer, command_queue &cq) {
+    ucl_cast_copy(dst,src,ranges,buffer,cq);
+  }
+
+  template <class t1, class t2, class t3>
+  static inline void copy_block(t1 &dst, t2 &src, const size_t row,
+                                const size_t col, const size_t rows,
+                                const size_t cols, t3 &buffer,
+                                command_queue &cq) {
+    ucl_cast_copy_block(dst,src,row,col,rows,cols,buffer,cq);
+  }
+
   template <class t1, class t2, class t3>
   static inline int dev_resize(t1 &device, t2 &host, t3 &buff,const int cols) {
     int err=buff.resize(cols);
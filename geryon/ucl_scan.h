@@ -0,0 +1,295 @@
+/***************************************************************************
+                                  ucl_scan.h
+                             -------------------
+
+  Exclusive and inclusive prefix sums (scans) on device vectors
+
+ __________________________________________________________________________
+    This file is part of the Geryon Unified Coprocessor Library (UCL)
+ __________________________________________________________________________
+
+ ***************************************************************************/
+
+/* -----------------------------------------------------------------------
+   Copyright (2010) Sandia Corporation.  Under the terms of Contract
+   DE-AC04-94AL85000 with Sandia Corporation, the U.S. Government retains
+   certain rights in this software.  This software is distributed under
+   the Simplified BSD License.
+   ----------------------------------------------------------------------- */
+
+/***************************************************************************
+   UCL_Scan computes prefix sums of UCL_D_Vec data with a reduce-then-scan
+   algorithm in three kernels:
+
+     1. Each work-group sums a contiguous tile of the input
+     2. One work-group scans the tile sums
+     3. Each work-group scans its tile, starting from its scanned tile sum
+
+   Work is O(n) and the input is read twice. Scans can be done in place.
+   All kernels are queued on the command queue given, so calls are
+   asynchronous with respect to the host; tile sums are kept in storage
+   owned by the object and reused between calls:
+
+     UCL_Scan<int> scan(dev);
+     scan.exclusive(offsets,counts,cq,natoms,&total,0);  // total on device
+
+   Intended for int, unsigned, float and double; any type supported by
+   _UCL_DATA_ID can be used. A UCL_Scan object should only be used with one
+   queue at a time.
+ ***************************************************************************/
+
+// Only allow this file to be included by nvd_prims.h and ocl_prims.h
+#ifdef UCL_PRIMS_ALLOW
+
+/// Kernel source for scans (the type and BLOCK_SIZE are defined first)
+inline const char * _ucl_scan_source() {
+  return
+    "#define LOCAL_SCAN(sh,tid)                                             \\\n"
+    "  for (int o=1; o<BLOCK_SIZE; o<<=1) {                               \\\n"
+    "    NUMTYP t=(tid>=o) ? sh[tid-o] : (NUMTYP)0;                       \\\n"
+    "    __syncthreads();                                                 \\\n"
+    "    sh[tid]+=t;                                                      \\\n"
+    "    __syncthreads();                                                 \\\n"
+    "  }\n"
+    "\n"
+    "__kernel void ucl_scan_reduce(const __global NUMTYP *in,\n"
+    "                              const int in_off, const int n,\n"
+    "                              const int tile,\n"
+    "                              __global NUMTYP *partial) {\n"
+    "  __local NUMTYP sh[BLOCK_SIZE];\n"
+    "  const int tid=THREAD_ID_X;\n"
+    "  const int start=BLOCK_ID_X*tile;\n"
+    "  int end=start+tile;\n"
+    "  if (end>n) end=n;\n"
+    "  NUMTYP s=(NUMTYP)0;\n"
+    "  for (int i=start+tid; i<end; i+=BLOCK_SIZE)\n"
+    "    s+=in[in_off+i];\n"
+    "  sh[tid]=s;\n"
+    "  __syncthreads();\n"
+    "  for (int o=BLOCK_SIZE/2; o>0; o>>=1) {\n"
+    "    if (tid<o)\n"
+    "      sh[tid]+=sh[tid+o];\n"
+    "    __syncthreads();\n"
+    "  }\n"
+    "  if (tid==0)\n"
+    "    partial[BLOCK_ID_X]=sh[0];\n"
+    "}\n"
+    "\n"
+    "__kernel void ucl_scan_partials(__global NUMTYP *partial,\n"
+    "                                const int ngroups,\n"
+    "                                __global NUMTYP *total,\n"
+    "                                const int total_off,\n"
+    "                                const int want_total) {\n"
+    "  __local NUMTYP sh[BLOCK_SIZE];\n"
+    "  const int tid=THREAD_ID_X;\n"
+    "  NUMTYP carry=(NUMTYP)0;\n"
+    "  for (int base=0; base<ngroups; base+=BLOCK_SIZE) {\n"
+    "    const int i=base+tid;\n"
+    "    sh[tid]=(i<ngroups) ? partial[i] : (NUMTYP)0;\n"
+    "    __syncthreads();\n"
+    "    LOCAL_SCAN(sh,tid);\n"
+    "    if (i<ngroups)\n"
+    "      partial[i]=carry+((tid>0) ? sh[tid-1] : (NUMTYP)0);\n"
+    "    carry+=sh[BLOCK_SIZE-1];\n"
+    "    __syncthreads();\n"
+    "  }\n"
+    "  if (tid==0 && want_total)\n"
+    "    total[total_off]=carry;\n"
+    "}\n"
+    "\n"
+    "__kernel void ucl_scan_down(const __global NUMTYP *in, const int in_off,\n"
+    "                            __global NUMTYP *out, const int out_off,\n"
+    "                            const int n, const int tile,\n"
+    "                            const __global NUMTYP *partial,\n"
+    "                            const int inclusive, const int vec) {\n"
+    "  __local NUMTYP sh[BLOCK_SIZE];\n"
+    "  const int tid=THREAD_ID_X;\n"
+    "  const int start=BLOCK_ID_X*tile;\n"
+    "  int end=start+tile;\n"
+    "  if (end>n) end=n;\n"
+    "  NUMTYP carry=partial[BLOCK_ID_X];\n"
+    "  for (int base=start; base<end; base+=4*BLOCK_SIZE) {\n"
+    "    const int i=base+4*tid;\n"
+    "    NUMTYP v0, v1, v2, v3;\n"
+    "    if (vec && i+3<end) {\n"
+    "      const NUMTYP4 v=*((const __global NUMTYP4 *)(in+in_off+i));\n"
+    "      v0=v.x; v1=v.y; v2=v.z; v3=v.w;\n"
+    "    } else {\n"
+    "      v0=(i<end) ? in[in_off+i] : (NUMTYP)0;\n"
+    "      v1=(i+1<end) ? in[in_off+i+1] : (NUMTYP)0;\n"
+    "      v2=(i+2<end) ? in[in_off+i+2] : (NUMTYP)0;\n"
+    "      v3=(i+3<end) ? in[in_off+i+3] : (NUMTYP)0;\n"
+    "    }\n"
+    "    const NUMTYP p0=v0;\n"
+    "    const NUMTYP p1=p0+v1;\n"
+    "    const NUMTYP p2=p1+v2;\n"
+    "    const NUMTYP p3=p2+v3;\n"
+    "    sh[tid]=p3;\n"
+    "    __syncthreads();\n"
+    "    LOCAL_SCAN(sh,tid);\n"
+    "    const NUMTYP b=carry+((tid>0) ? sh[tid-1] : (NUMTYP)0);\n"
+    "    carry+=sh[BLOCK_SIZE-1];\n"
+    "    if (inclusive) {\n"
+    "      if (i<end) out[out_off+i]=b+p0;\n"
+    "      if (i+1<end) out[out_off+i+1]=b+p1;\n"
+    "      if (i+2<end) out[out_off+i+2]=b+p2;\n"
+    "      if (i+3<end) out[out_off+i+3]=b+p3;\n"
+    "    } else {\n"
+    "      if (i<end) out[out_off+i]=b;\n"
+    "      if (i+1<end) out[out_off+i+1]=b+p0;\n"
+    "      if (i+2<end) out[out_off+i+2]=b+p1;\n"
+    "      if (i+3<end) out[out_off+i+3]=b+p2;\n"
+    "    }\n"
+    "    __syncthreads();\n"
+    "  }\n"
+    "}\n";
+}
+
+/// Prefix sums of device vectors
+/** Kernels are compiled on first use and cached with the device. Storage
+  * for tile sums is kept between calls. **/
+template <class numtyp>
+class UCL_Scan {
+ public:
+  /// Set up scans on a device
+  /** \param block_size Work-group size (rounded down to a power of 2;
+    *                   0 for a default based on the device)
+    * \param max_groups Maximum number of tiles (0 for a default based on
+    *                   the device) **/
+  UCL_Scan(UCL_Device &dev, const int block_size=0, const int max_groups=0)
+    : _dev(&dev), _kernels(NULL) {
+    _block_size=(block_size>0) ? _ucl_pow2_floor(block_size) :
+                                 _ucl_prim_block_size(dev);
+    _max_groups=(max_groups>0) ? max_groups : dev.cus()*4;
+    if (_max_groups<1)
+      _max_groups=1;
+  }
+
+  /// Work-group size used for scans
+  inline int block_size() const { return _block_size; }
+
+  /// dst[i]=src[0]+...+src[i-1] for the first n elements (dst[0]=0)
+  /** \param n Number of elements (0 for all of src)
+    * \param total If not NULL, the sum of all n elements is stored in
+    *              (*total)[total_pos]
+    * \note dst can be the same as src
+    * \note Asynchronous with respect to the host **/
+  inline int exclusive(UCL_D_Vec<numtyp> &dst, const UCL_D_Vec<numtyp> &src,
+                       command_queue &cq, const size_t n=0,
+                       UCL_D_Vec<numtyp> *total=NULL,
+                       const size_t total_pos=0)
+    { return _scan(dst,src,cq,n,total,total_pos,0); }
+
+  /// dst[i]=src[0]+...+src[i] for the first n elements
+  /** \param n Number of elements (0 for all of src)
+    * \param total If not NULL, the sum of all n elements is stored in
+    *              (*total)[total_pos]
+    * \note dst can be the same as src
+    * \note Asynchronous with respect to the host **/
+  inline int inclusive(UCL_D_Vec<numtyp> &dst, const UCL_D_Vec<numtyp> &src,
+                       command_queue &cq, const size_t n=0,
+                       UCL_D_Vec<numtyp> *total=NULL,
+                       const size_t total_pos=0)
+    { return _scan(dst,src,cq,n,total,total_pos,1); }
+
+  /// Free temporary storage
+  inline void clear() { _partial.clear(); }
+
+ private:
+  UCL_Device *_dev;
+  int _block_size, _max_groups;
+  UCL_PrimKernels *_kernels;
+  UCL_D_Vec<numtyp> _partial;
+
+  inline UCL_PrimKernels * _get_kernels() {
+    if (_kernels==NULL) {
+      std::ostringstream key, src;
+      key << "ucl_scan_" << _UCL_DATA_ID<numtyp>::name() << "_"
+          << _block_size;
+      src << _ucl_prim_defs<numtyp>(_block_size) << _ucl_scan_source();
+      const char *names[3]={"ucl_scan_reduce","ucl_scan_partials",
+                            "ucl_scan_down"};
+      _kernels=_ucl_prim_kernels(*_dev,key.str(),src.str(),names,3);
+    }
+    return _kernels;
+  }
+
+  inline int _scan(UCL_D_Vec<numtyp> &dst, const UCL_D_Vec<numtyp> &src,
+                   command_queue &cq, const size_t n_in,
+                   UCL_D_Vec<numtyp> *total, const size_t total_pos,
+                   int inclusive) {
+    UCL_PrimKernels *k=_get_kernels();
+    if (k==NULL)
+      return UCL_COMPILE_ERROR;
+    int n=static_cast<int>((n_in==0) ? src.cols() : n_in);
+    assert(static_cast<size_t>(n)<=src.cols() &&
+           static_cast<size_t>(n)<=dst.cols());
+
+    // Split the input into tiles that are a multiple of 4 work-groups
+    const int chunk=4*_block_size;
+    int ngroups=(n+chunk-1)/chunk;
+    if (ngroups>_max_groups)
+      ngroups=_max_groups;
+    int tile=0;
+    if (ngroups>0) {
+      tile=(n+ngroups-1)/ngroups;
+      tile=((tile+chunk-1)/chunk)*chunk;
+      ngroups=(n+tile-1)/tile;
+    }
+    if (_partial.cols()<static_cast<size_t>(ngroups) || _partial.cols()==0)
+      if (_partial.alloc(ngroups>0 ? ngroups : 1,*_dev)!=UCL_SUCCESS)
+        return UCL_MEMORY_ERROR;
+
+    int in_off=src.offset(), out_off=dst.offset();
+    int want_total=(total!=NULL) ? 1 : 0;
+    int total_off=(total!=NULL) ? static_cast<int>(total->offset()+
+                                                   total_pos) : 0;
+    int vec=(in_off%4==0 && _ucl_prims_aligned(src,4*sizeof(numtyp))) ? 1 : 0;
+    if (ngroups==0 && !want_total)
+      return UCL_SUCCESS;
+
+    if (ngroups>0) {
+      UCL_Kernel &kr=(*k)[0];
+      kr.set_size(ngroups,_block_size,cq);
+      kr.clear_args();
+      kr.add_arg(&src);
+      kr.add_arg(&in_off);
+      kr.add_arg(&n);
+      kr.add_arg(&tile);
+      kr.add_arg(&_partial);
+      kr.run();
+    }
+
+    UCL_Kernel &kp=(*k)[1];
+    kp.set_size(1,_block_size,cq);
+    kp.clear_args();
+    kp.add_arg(&_partial);
+    kp.add_arg(&ngroups);
+    if (total!=NULL)
+      kp.add_arg(total);
+    else
+      kp.add_arg(&_partial);
+    kp.add_arg(&total_off);
+    kp.add_arg(&want_total);
+    kp.run();
+
+    if (ngroups>0) {
+      UCL_Kernel &kd=(*k)[2];
+      kd.set_size(ngroups,_block_size,cq);
+      kd.clear_args();
+      kd.add_arg(&src);
+      kd.add_arg(&in_off);
+      kd.add_arg(&dst);
+      kd.add_arg(&out_off);
+      kd.add_arg(&n);
+      kd.add_arg(&tile);
+      kd.add_arg(&_partial);
+      kd.add_arg(&inclusive);
+      kd.add_arg(&vec);
+      kd.run();
+    }
+    return UCL_SUCCESS;
+  }
+};
+
+#endif
@@ -0,0 +1,326 @@
+/***************************************************************************
+                                  ucl_soa.h
+                             -------------------
+
+  Structure-of-arrays host/device container with AoS conversion
+
+ __________________________________________________________________________
+    This file is part of the Geryon Unified Coprocessor Library (UCL)
+ __________________________________________________________________________
+
+ ***************************************************************************/
+
+/* -----------------------------------------------------------------------
+   Copyright (2010) Sandia Corporation.  Under the terms of Contract
+   DE-AC04-94AL85000 with Sandia Corporation, the U.S. Government retains
+   certain rights in this software.  This software is distributed under
+   the Simplified BSD License.
+   ----------------------------------------------------------------------- */
+
+/***************************************************************************
+   UCL_SoA stores N component streams of a shared length n on the host and
+   on the device. Stream c is row c of an N x n matrix, so component c of
+   element i is at host(c,i) and neighboring work-items reading the same
+   component access neighboring memory on the device. Device streams are
+   padded to a common pitch.
+
+   Data in array-of-structures order (component c of element i at
+   aos[i*N+c]) is converted with one call:
+
+     UCL_SoA<double,3> x(natoms,dev);
+     x.upload(pos,natoms,cq);        // pos is double[natoms][3]
+
+   With UCL_SOA_ON_DEVICE, the AoS data is copied to the device as is and
+   reordered with UCL_Transpose. With UCL_SOA_ON_HOST, the host streams
+   are filled in blocks with the number of components known at compile time
+   and copied to the device with one pitched copy. download() does the
+   reverse and blocks until the data is on the host.
+
+   add_args() binds all streams to a kernel at once as the device buffer,
+   the offset of the first element and the pitch (all in elements):
+
+     __kernel void k(__global double *x, const int x_off,
+                     const int x_pitch, ...)
+       ... x[x_off+c*x_pitch+i] ...
+ ***************************************************************************/
+
+// Only allow this file to be included by nvd_prims.h and ocl_prims.h
+#ifdef UCL_PRIMS_ALLOW
+
+/// Where UCL_SoA reorders array-of-structures data
+enum UCL_SOA_CONVERT {UCL_SOA_ON_DEVICE, UCL_SOA_ON_HOST};
+
+/// Elements reordered per block on the host
+#define UCL_SOA_HOST_BLOCK 256
+
+/// Structure-of-arrays container with N component streams
+/** \sa ucl_soa.h for the layout and kernel arguments **/
+template <class numtyp, int N>
+class UCL_SoA {
+ public:
+  enum { COMPONENTS = N };
+  typedef numtyp data_type;
+
+  /// Host streams (N x n, stream c is row c)
+  UCL_H_Mat<numtyp> host;
+
+  /// Device streams (N x n, padded pitch)
+  UCL_D_Mat<numtyp> device;
+
+  UCL_SoA() : _dev(NULL), _tr(NULL), _stage_busy(false) { }
+  ~UCL_SoA() { clear(); }
+
+  /// Construct with n elements in each stream
+  /** \sa alloc() **/
+  UCL_SoA(const size_t n, UCL_Device &acc,
+          const enum UCL_MEMOPT kind1=UCL_READ_WRITE,
+          const enum UCL_MEMOPT kind2=UCL_READ_WRITE)
+      : _dev(NULL), _tr(NULL), _stage_busy(false)
+    { alloc(n,acc,kind1,kind2); }
+
+  /// Set up N streams of n elements on the host and the device
+  /** The kind1 parameter controls memory access from the host and kind2
+    * controls memory optimizations from the device (see UCL_Matrix)
+    * \return UCL_SUCCESS if the memory allocation is successful **/
+  inline int alloc(const size_t n, UCL_Device &acc,
+                   const enum UCL_MEMOPT kind1=UCL_READ_WRITE,
+                   const enum UCL_MEMOPT kind2=UCL_READ_WRITE) {
+    clear();
+    _dev=&acc;
+    int err=host.alloc(N,n,acc,kind1);
+    if (err!=UCL_SUCCESS)
+      return err;
+    err=device.alloc(N,n,acc,kind2);
+    _set_args();
+    return err;
+  }
+
+  /// Free memory and set size to 0
+  inline void clear() {
+    if (_stage_busy)
+      ucl_sync(_stage_cq);
+    _stage_busy=false;
+    host.clear();
+    device.clear();
+    _aos_view.clear();
+    _aos_d.clear();
+    _aos_h.clear();
+    if (_tr!=NULL)
+      delete _tr;
+    _tr=NULL;
+  }
+
+  /// Resize each stream to n elements
+  /** Contents are not preserved **/
+  inline int resize(const int n) {
+    int err=host.resize(N,n);
+    if (err!=UCL_SUCCESS)
+      return err;
+    err=device.resize(N,n);
+    _set_args();
+    return err;
+  }
+
+  /// Resize (only if bigger) each stream to n elements
+  inline int resize_ib(const int n)
+    { if (static_cast<size_t>(n)>size()) return resize(n);
+      else return UCL_SUCCESS; }
+
+  /// Get the number of components
+  inline int components() const { return N; }
+  /// Get the number of elements in each stream
+  inline size_t size() const { return host.cols(); }
+  /// Get the number of elements in all streams
+  inline size_t numel() const { return host.numel(); }
+  /// Get the distance between device streams in elements
+  inline size_t pitch() const { return device.row_size(); }
+  /// Get the memory usage (bytes) on the host (including staging buffers)
+  inline size_t host_mem_usage()
+    { return host.row_bytes()*host.rows()+_aos_h.row_bytes(); }
+  /// Get the memory usage (bytes) on the device (including staging buffers)
+  inline size_t device_mem_usage()
+    { return device.row_bytes()*device.rows()+_aos_d.row_bytes(); }
+
+  /// Component c of element i on the host
+  inline numtyp & operator()(const int c, const int i) { return host(c,i); }
+  /// Component c of element i on the host
+  inline const numtyp & operator()(const int c, const int i) const
+    { return host(c,i); }
+  /// Host stream for component c
+  inline numtyp * stream(const int c)
+    { return host.begin()+c*host.row_size(); }
+  /// Host stream for component c
+  inline const numtyp * stream(const int c) const
+    { return host.begin()+c*host.row_size(); }
+
+  /// Return the default command queue/stream associated with this data
+  inline command_queue & cq() { return host.cq(); }
+  /// Block until command_queue associated with the streams is complete
+  inline void sync() { host.sync(); }
+
+  /// Update the device streams asynchronously
+  inline void update_device() { ucl_copy(device,host,true); }
+  /// Update the device streams (true for asynchronous copy)
+  inline void update_device(const bool async)
+    { ucl_copy(device,host,async); }
+  /// Update the device streams (using command queue)
+  inline void update_device(command_queue &cq) { ucl_copy(device,host,cq); }
+  /// Update the first n elements of each device stream (using command queue)
+  inline void update_device(const int n, command_queue &cq)
+    { ucl_copy(device,host,N,n,cq); }
+
+  /// Update the host streams asynchronously
+  inline void update_host() { ucl_copy(host,device,true); }
+  /// Update the host streams (true for asynchronous copy)
+  inline void update_host(const bool async) { ucl_copy(host,device,async); }
+  /// Update the host streams (using command queue)
+  inline void update_host(command_queue &cq) { ucl_copy(host,device,cq); }
+  /// Update the first n elements of each host stream (using command queue)
+  inline void update_host(const int n, command_queue &cq)
+    { ucl_copy(host,device,N,n,cq); }
+
+  /// Fill the device streams from n elements in array-of-structures order
+  /** Component c of element i is read from aos[i*N+c]. aos can be reused
+    * on return. UCL_SOA_ON_HOST also fills the host streams; with
+    * UCL_SOA_ON_DEVICE the host streams are not changed.
+    * \note Asynchronous with respect to the host for the device copy **/
+  inline int upload(const numtyp *aos, const size_t n, command_queue &cq,
+                    const enum UCL_SOA_CONVERT where=UCL_SOA_ON_DEVICE) {
+    assert(n<=size());
+    if (n==0)
+      return UCL_SUCCESS;
+    if (where==UCL_SOA_ON_HOST) {
+      _to_soa(aos,n);
+      ucl_copy(device,host,N,n,cq);
+      return UCL_SUCCESS;
+    }
+
+    int err=_stage(n);
+    if (err!=UCL_SUCCESS)
+      return err;
+    memcpy(_aos_h.begin(),aos,n*N*sizeof(numtyp));
+    ucl_copy(_aos_d,_aos_h,n*N,cq);
+    _stage_cq=cq;
+    _stage_busy=true;
+    return _tr->transpose(device,_aos_view,cq,n,N);
+  }
+
+  /// Fill the device streams from n elements using the default queue
+  inline int upload(const numtyp *aos, const size_t n,
+                    const enum UCL_SOA_CONVERT where=UCL_SOA_ON_DEVICE)
+    { return upload(aos,n,cq(),where); }
+
+  /// Write the first n elements of the device streams in AoS order
+  /** Component c of element i is written to aos[i*N+c]. UCL_SOA_ON_HOST
+    * also updates the host streams.
+    * \note Blocks until the data is on the host **/
+  inline int download(numtyp *aos, const size_t n, command_queue &cq,
+                      const enum UCL_SOA_CONVERT where=UCL_SOA_ON_DEVICE) {
+    assert(n<=size());
+    if (n==0)
+      return UCL_SUCCESS;
+    if (where==UCL_SOA_ON_HOST) {
+      ucl_copy(host,device,N,n,cq);
+      ucl_sync(cq);
+      _to_aos(aos,n);
+      return UCL_SUCCESS;
+    }
+
+    int err=_stage(n);
+    if (err!=UCL_SUCCESS)
+      return err;
+    err=_tr->transpose(_aos_view,device,cq,N,n);
+    if (err!=UCL_SUCCESS)
+      return err;
+    ucl_copy(_aos_h,_aos_d,n*N,cq);
+    ucl_sync(cq);
+    _stage_busy=false;
+    memcpy(aos,_aos_h.begin(),n*N*sizeof(numtyp));
+    return UCL_SUCCESS;
+  }
+
+  /// Write the first n elements in AoS order using the default queue
+  inline int download(numtyp *aos, const size_t n,
+                      const enum UCL_SOA_CONVERT where=UCL_SOA_ON_DEVICE)
+    { return download(aos,n,cq(),where); }
+
+  /// Add the device buffer, offset and pitch as kernel arguments
+  inline void add_args(UCL_Kernel &k) {
+    k.add_arg(&device);
+    k.add_arg(&_off);
+    k.add_arg(&_pitch);
+  }
+
+ private:
+  UCL_Device *_dev;
+  UCL_Transpose<numtyp> *_tr;
+  int _off, _pitch;
+
+  // Staging for conversion on the device; the host buffer is not reused
+  // until the copy queued on _stage_cq by the last upload is complete
+  UCL_H_Vec<numtyp> _aos_h;
+  UCL_D_Vec<numtyp> _aos_d;
+  UCL_D_Mat<numtyp> _aos_view;
+  command_queue _stage_cq;
+  bool _stage_busy;
+
+  UCL_SoA(const UCL_SoA &);
+  UCL_SoA & operator=(const UCL_SoA &);
+
+  inline void _set_args() {
+    _off=static_cast<int>(device.offset());
+    _pitch=static_cast<int>(device.row_size());
+  }
+
+  // Size the staging buffers for n elements and view them as n x N
+  inline int _stage(const size_t n) {
+    if (_stage_busy) {
+      ucl_sync(_stage_cq);
+      _stage_busy=false;
+    }
+    if (_tr==NULL)
+      _tr=new UCL_Transpose<numtyp>(*_dev);
+    const size_t total=n*N;
+    if (_aos_h.cols()<total) {
+      _aos_view.clear();
+      _aos_d.clear();
+      _aos_h.clear();
+      int err=_aos_h.alloc(total,*_dev);
+      if (err!=UCL_SUCCESS)
+        return err;
+      err=_aos_d.alloc(total,*_dev);
+      if (err!=UCL_SUCCESS)
+        return err;
+    }
+    _aos_view.view(_aos_d,n,N,N);
+    return UCL_SUCCESS;
+  }
+
+  // Blocks of elements are reordered so that the reads of a block stay in
+  // cache while each stream is written contiguously
+  inline void _to_soa(const numtyp *aos, const size_t n) {
+    for (size_t i0=0; i0<n; i0+=UCL_SOA_HOST_BLOCK) {
+      const size_t i1=(n-i0<UCL_SOA_HOST_BLOCK) ? n : i0+UCL_SOA_HOST_BLOCK;
+      for (int c=0; c<N; c++) {
+        numtyp *out=stream(c);
+        const numtyp *in=aos+c;
+        for (size_t i=i0; i<i1; i++)
+          out[i]=in[i*N];
+      }
+    }
+  }
+
+  inline void _to_aos(numtyp *aos, const size_t n) const {
+    for (size_t i0=0; i0<n; i0+=UCL_SOA_HOST_BLOCK) {
+      const size_t i1=(n-i0<UCL_SOA_HOST_BLOCK) ? n : i0+UCL_SOA_HOST_BLOCK;
+      for (int c=0; c<N; c++) {
+        const numtyp *in=stream(c);
+        numtyp *out=aos+c;
+        for (size_t i=i0; i<i1; i++)
+          out[i*N]=in[i];
+      }
+    }
+  }
+};
+
+#endif
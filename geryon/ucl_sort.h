@@ -0,0 +1,463 @@
+/***************************************************************************
+                                  ucl_sort.h
+                             -------------------
+
+  Radix sort of keys and key-value pairs in device vectors
+
+ __________________________________________________________________________
+    This file is part of the Geryon Unified Coprocessor Library (UCL)
+ __________________________________________________________________________
+
+ ***************************************************************************/
+
+/* -----------------------------------------------------------------------
+   Copyright (2010) Sandia Corporation.  Under the terms of Contract
+   DE-AC04-94AL85000 with Sandia Corporation, the U.S. Government retains
+   certain rights in this software.  This software is distributed under
+   the Simplified BSD License.
+   ----------------------------------------------------------------------- */
+
+/***************************************************************************
+   UCL_RadixSort sorts UCL_D_Vec keys (optionally carrying a value for each
+   key) with a least significant digit radix sort. Each pass over
+   bits_per_pass bits of the key runs:
+
+     1. A count of the digits in a contiguous tile for each work-group
+        (atomic increments of a histogram in local memory)
+     2. An exclusive scan of the counts (digit major, tile minor)
+     3. A stable scatter of each tile using the scanned counts
+
+   In the scatter, BLOCK_SIZE keys at a time are ordered by digit in local
+   memory with 1-bit splits so that keys with the same digit are written
+   to contiguous locations. Tiles are large, so there is only one tile for
+   each core by default on CPU devices.
+
+   Sorting the cell index of each atom along with a permutation index:
+
+     UCL_RadixSort<unsigned,int> sorter(dev);
+     sorter.sort_pairs(cell,perm,cq,natoms,cell_bits);
+
+   Keys can be unsigned, int, float, unsigned long, long or double. Signed
+   and floating point keys are sorted in ascending numerical order. Values
+   can be any type supported by _UCL_DATA_ID. Temporary storage is owned
+   by the object and reused between calls. All kernels are queued on the
+   command queue given, so calls are asynchronous with respect to the host.
+ ***************************************************************************/
+
+// Only allow this file to be included by nvd_prims.h and ocl_prims.h
+#ifdef UCL_PRIMS_ALLOW
+
+/// Definitions used to extract digits from keys in kernel source
+/** ordered() is an expression giving an unsigned integer from a key k
+  * with the same ordering as the keys **/
+template <class keytyp> struct _UCL_RADIX_KEY;
+template <> struct _UCL_RADIX_KEY<unsigned> {
+  static inline int bits() { return 32; }
+  static inline const char * utype() { return "unsigned"; }
+  static inline const char * ordered() { return "(k)"; }
+};
+template <> struct _UCL_RADIX_KEY<int> {
+  static inline int bits() { return 32; }
+  static inline const char * utype() { return "unsigned"; }
+  static inline const char * ordered()
+    { return "((unsigned)(k)^0x80000000u)"; }
+};
+template <> struct _UCL_RADIX_KEY<float> {
+  static inline int bits() { return 32; }
+  static inline const char * utype() { return "unsigned"; }
+  static inline const char * ordered() {
+    return "(ucl_as_uint(k)^((ucl_as_uint(k)>>31) ? 0xffffffffu : "
+           "0x80000000u))";
+  }
+};
+template <> struct _UCL_RADIX_KEY<unsigned long> {
+  static inline int bits() { return 64; }
+  static inline const char * utype() { return "unsigned long"; }
+  static inline const char * ordered() { return "(k)"; }
+};
+template <> struct _UCL_RADIX_KEY<long> {
+  static inline int bits() { return 64; }
+  static inline const char * utype() { return "unsigned long"; }
+  static inline const char * ordered()
+    { return "((unsigned long)(k)^((unsigned long)1<<63))"; }
+};
+template <> struct _UCL_RADIX_KEY<double> {
+  static inline int bits() { return 64; }
+  static inline const char * utype() { return "unsigned long"; }
+  static inline const char * ordered() {
+    return "(ucl_as_ulong(k)^((ucl_as_ulong(k)>>63) ? ~(unsigned long)0 : "
+           "((unsigned long)1<<63)))";
+  }
+};
+
+/// Kernel source for radix sort passes
+/** KEYTYP, KEYUTYP, ORDERED(k), VALTYP, RADIX_BITS and BLOCK_SIZE are
+  * defined first; HAS_VALUES is defined when values are sorted.
+  * ucl_radix_count writes the digit counts for each tile to hist.
+  * ucl_radix_pass moves the keys using the scanned counts in hist. **/
+inline const char * _ucl_radix_sort_source() {
+  return
+    "#define RADIX (1<<RADIX_BITS)\n"
+    "#define DIGIT(k) (int)((ORDERED(k)>>shift)&(KEYUTYP)(RADIX-1))\n"
+    "\n"
+    "__kernel void ucl_radix_count(const __global KEYTYP *kin,\n"
+    "                              const int kin_off, const int n,\n"
+    "                              const int tile, const int shift,\n"
+    "                              __global int *hist) {\n"
+    "  __local int count[RADIX];\n"
+    "  const int tid=THREAD_ID_X;\n"
+    "  const int g=BLOCK_ID_X;\n"
+    "  const int start=g*tile;\n"
+    "  int end=start+tile;\n"
+    "  if (end>n) end=n;\n"
+    "  for (int r=tid; r<RADIX; r+=BLOCK_SIZE)\n"
+    "    count[r]=0;\n"
+    "  __syncthreads();\n"
+    "  for (int i=start+tid; i<end; i+=BLOCK_SIZE) {\n"
+    "    const KEYTYP k=kin[kin_off+i];\n"
+    "    ucl_local_inc(&count[DIGIT(k)]);\n"
+    "  }\n"
+    "  __syncthreads();\n"
+    "  for (int r=tid; r<RADIX; r+=BLOCK_SIZE)\n"
+    "    hist[r*GRID_SIZE_X+g]=count[r];\n"
+    "}\n"
+    "\n"
+    "__kernel void ucl_radix_pass(const __global KEYTYP *kin,\n"
+    "                             const int kin_off,\n"
+    "                             const __global VALTYP *vin,\n"
+    "                             const int vin_off,\n"
+    "                             __global KEYTYP *kout, const int kout_off,\n"
+    "                             __global VALTYP *vout, const int vout_off,\n"
+    "                             const int n, const int tile,\n"
+    "                             const int shift,\n"
+    "                             const __global int *hist) {\n"
+    "  __local KEYTYP sk[BLOCK_SIZE];\n"
+    "  #ifdef HAS_VALUES\n"
+    "  __local VALTYP sv[BLOCK_SIZE];\n"
+    "  #endif\n"
+    "  __local int sd[BLOCK_SIZE];\n"
+    "  __local int ss[BLOCK_SIZE];\n"
+    "  __local int first[RADIX];\n"
+    "  __local int last[RADIX];\n"
+    "  __local int run[RADIX];\n"
+    "  const int tid=THREAD_ID_X;\n"
+    "  const int g=BLOCK_ID_X;\n"
+    "  const int ngroups=GRID_SIZE_X;\n"
+    "  const int start=g*tile;\n"
+    "  int end=start+tile;\n"
+    "  if (end>n) end=n;\n"
+    "  for (int r=tid; r<RADIX; r+=BLOCK_SIZE)\n"
+    "    run[r]=hist[r*ngroups+g];\n"
+    "\n"
+    "  for (int base=start; base<end; base+=BLOCK_SIZE) {\n"
+    "    const int i=base+tid;\n"
+    "    const int nvalid=(end-base<BLOCK_SIZE) ? end-base : BLOCK_SIZE;\n"
+    "    KEYTYP k=(KEYTYP)0;\n"
+    "    VALTYP v=(VALTYP)0;\n"
+    "    // Keys past the end get the largest digit and stay at the end\n"
+    "    int d=RADIX-1;\n"
+    "    if (i<end) {\n"
+    "      k=kin[kin_off+i];\n"
+    "      d=DIGIT(k);\n"
+    "      #ifdef HAS_VALUES\n"
+    "      v=vin[vin_off+i];\n"
+    "      #endif\n"
+    "    }\n"
+    "\n"
+    "    // Stable local sort by digit with 1-bit splits\n"
+    "    for (int b=0; b<RADIX_BITS; b++) {\n"
+    "      const int f=(d>>b)&1;\n"
+    "      ss[tid]=1-f;\n"
+    "      __syncthreads();\n"
+    "      for (int o=1; o<BLOCK_SIZE; o<<=1) {\n"
+    "        const int t=(tid>=o) ? ss[tid-o] : 0;\n"
+    "        __syncthreads();\n"
+    "        ss[tid]+=t;\n"
+    "        __syncthreads();\n"
+    "      }\n"
+    "      const int zeros=ss[tid]-(1-f);\n"
+    "      const int pos=f ? ss[BLOCK_SIZE-1]+tid-zeros : zeros;\n"
+    "      sk[pos]=k;\n"
+    "      sd[pos]=d;\n"
+    "      #ifdef HAS_VALUES\n"
+    "      sv[pos]=v;\n"
+    "      #endif\n"
+    "      __syncthreads();\n"
+    "      k=sk[tid];\n"
+    "      d=sd[tid];\n"
+    "      #ifdef HAS_VALUES\n"
+    "      v=sv[tid];\n"
+    "      #endif\n"
+    "    }\n"
+    "\n"
+    "    // Range of each digit in the locally sorted keys\n"
+    "    for (int r=tid; r<RADIX; r+=BLOCK_SIZE) {\n"
+    "      first[r]=0;\n"
+    "      last[r]=0;\n"
+    "    }\n"
+    "    __syncthreads();\n"
+    "    if (tid<nvalid) {\n"
+    "      if (tid==0 || sd[tid-1]!=d) first[d]=tid;\n"
+    "      if (tid==nvalid-1 || sd[tid+1]!=d) last[d]=tid+1;\n"
+    "    }\n"
+    "    __syncthreads();\n"
+    "    if (tid<nvalid) {\n"
+    "      const int dest=run[d]+tid-first[d];\n"
+    "      kout[kout_off+dest]=k;\n"
+    "      #ifdef HAS_VALUES\n"
+    "      vout[vout_off+dest]=v;\n"
+    "      #endif\n"
+    "    }\n"
+    "    __syncthreads();\n"
+    "    for (int r=tid; r<RADIX; r+=BLOCK_SIZE)\n"
+    "      run[r]+=last[r]-first[r];\n"
+    "    __syncthreads();\n"
+    "  }\n"
+    "}\n";
+}
+
+/// Radix sort of device vectors
+/** Kernels are compiled on first use and cached with the device. Storage
+  * for digit counts and the intermediate passes is kept between calls.
+  * \note valtyp is only used by sort_pairs() **/
+template <class keytyp, class valtyp=int>
+class UCL_RadixSort {
+ public:
+  /// Set up sorts on a device
+  /** \param bits_per_pass Number of key bits sorted in each pass (1-8)
+    * \param block_size Work-group size (rounded down to a power of 2;
+    *                   0 for a default based on the device)
+    * \param max_groups Maximum number of tiles (0 for a default based on
+    *                   the device) **/
+  UCL_RadixSort(UCL_Device &dev, const int bits_per_pass=4,
+                const int block_size=0, const int max_groups=0)
+    : _dev(&dev), _scan(dev) {
+    _bits=bits_per_pass;
+    if (_bits<1)
+      _bits=1;
+    else if (_bits>8)
+      _bits=8;
+    _block_size=(block_size>0) ? _ucl_pow2_floor(block_size) :
+                                 _ucl_prim_block_size(dev);
+    if (max_groups>0)
+      _max_groups=max_groups;
+    else if (dev.device_type()==UCL_CPU)
+      _max_groups=dev.cus();
+    else
+      _max_groups=dev.cus()*4;
+    if (_max_groups<1)
+      _max_groups=1;
+    _kernels[0]=NULL;
+    _kernels[1]=NULL;
+  }
+
+  /// Number of key bits sorted in each pass
+  inline int bits_per_pass() const { return _bits; }
+  /// Work-group size used for sorts
+  inline int block_size() const { return _block_size; }
+
+  /// Sort the first n keys in place
+  /** \param n Number of keys (0 for all of keys)
+    * \param end_bit Only the low end_bit bits of the keys are sorted
+    *                (0 for all bits). Use when keys are known to be small.
+    * \note Asynchronous with respect to the host **/
+  inline int sort(UCL_D_Vec<keytyp> &keys, command_queue &cq,
+                  const size_t n=0, const int end_bit=0)
+    { return _sort(keys,NULL,keys,NULL,cq,n,end_bit,true); }
+
+  /// Sort the first n keys in keys_in into keys_out
+  /** \param n Number of keys (0 for all of keys_in)
+    * \param end_bit Only the low end_bit bits of the keys are sorted
+    *                (0 for all bits)
+    * \note keys_in is not modified and must not overlap keys_out
+    * \note Asynchronous with respect to the host **/
+  inline int sort(UCL_D_Vec<keytyp> &keys_out,
+                  const UCL_D_Vec<keytyp> &keys_in, command_queue &cq,
+                  const size_t n=0, const int end_bit=0)
+    { return _sort(keys_out,NULL,keys_in,NULL,cq,n,end_bit,false); }
+
+  /// Sort the first n keys in place, moving values with the keys
+  /** The sort is stable, so values can hold a permutation index
+    * \param n Number of keys (0 for all of keys)
+    * \param end_bit Only the low end_bit bits of the keys are sorted
+    *                (0 for all bits)
+    * \note Asynchronous with respect to the host **/
+  inline int sort_pairs(UCL_D_Vec<keytyp> &keys, UCL_D_Vec<valtyp> &values,
+                        command_queue &cq, const size_t n=0,
+                        const int end_bit=0)
+    { return _sort(keys,&values,keys,&values,cq,n,end_bit,true); }
+
+  /// Sort the first n key-value pairs in keys_in/values_in into keys_out
+  /// and values_out
+  /** \param n Number of keys (0 for all of keys_in)
+    * \param end_bit Only the low end_bit bits of the keys are sorted
+    *                (0 for all bits)
+    * \note The inputs are not modified and must not overlap the outputs
+    * \note Asynchronous with respect to the host **/
+  inline int sort_pairs(UCL_D_Vec<keytyp> &keys_out,
+                        UCL_D_Vec<valtyp> &values_out,
+                        const UCL_D_Vec<keytyp> &keys_in,
+                        const UCL_D_Vec<valtyp> &values_in,
+                        command_queue &cq, const size_t n=0,
+                        const int end_bit=0)
+    { return _sort(keys_out,&values_out,keys_in,&values_in,cq,n,end_bit,
+                   false); }
+
+  /// Free temporary storage
+  inline void clear() {
+    _hist.clear();
+    _tkeys.clear();
+    _tvalues.clear();
+    _scan.clear();
+  }
+
+ private:
+  UCL_Device *_dev;
+  int _bits, _block_size, _max_groups;
+  UCL_PrimKernels *_kernels[2];
+  UCL_Scan<int> _scan;
+  UCL_D_Vec<int> _hist;
+  UCL_D_Vec<keytyp> _tkeys;
+  UCL_D_Vec<valtyp> _tvalues;
+
+  inline UCL_PrimKernels * _get_kernels(const int has_values) {
+    if (_kernels[has_values]==NULL) {
+      std::ostringstream key, src;
+      key << "ucl_radix_sort_" << _UCL_DATA_ID<keytyp>::name() << "_";
+      if (has_values)
+        key << _UCL_DATA_ID<valtyp>::name();
+      else
+        key << "none";
+      key << "_" << _bits << "_" << _block_size;
+      src << "#define KEYTYP " << _UCL_DATA_ID<keytyp>::name() << "\n"
+          << "#define KEYUTYP " << _UCL_RADIX_KEY<keytyp>::utype() << "\n"
+          << "#define ORDERED(k) " << _UCL_RADIX_KEY<keytyp>::ordered()
+          << "\n"
+          << "#define VALTYP "
+          << (has_values ? _UCL_DATA_ID<valtyp>::name() : "int") << "\n"
+          << "#define RADIX_BITS " << _bits << "\n"
+          << "#define BLOCK_SIZE " << _block_size << "\n";
+      if (has_values)
+        src << "#define HAS_VALUES\n";
+      src << _ucl_radix_sort_source();
+      const char *names[2]={"ucl_radix_count","ucl_radix_pass"};
+      _kernels[has_values]=_ucl_prim_kernels(*_dev,key.str(),src.str(),
+                                             names,2);
+    }
+    return _kernels[has_values];
+  }
+
+  inline int _sort(UCL_D_Vec<keytyp> &kout, UCL_D_Vec<valtyp> *vout,
+                   const UCL_D_Vec<keytyp> &kin,
+                   const UCL_D_Vec<valtyp> *vin, command_queue &cq,
+                   const size_t n_in, const int end_bit, const bool in_place) {
+    const int has_values=(vout!=NULL) ? 1 : 0;
+    UCL_PrimKernels *k=_get_kernels(has_values);
+    if (k==NULL)
+      return UCL_COMPILE_ERROR;
+    int n=static_cast<int>((n_in==0) ? kin.cols() : n_in);
+    assert(static_cast<size_t>(n)<=kin.cols() &&
+           static_cast<size_t>(n)<=kout.cols());
+    assert(!has_values || (static_cast<size_t>(n)<=vin->cols() &&
+                           static_cast<size_t>(n)<=vout->cols()));
+
+    int nbits=_UCL_RADIX_KEY<keytyp>::bits();
+    if (end_bit>0 && end_bit<nbits)
+      nbits=end_bit;
+    int passes=(nbits+_bits-1)/_bits;
+    if (n<2)
+      passes=0;
+    if (passes==0) {
+      if (!in_place && n>0) {
+        ucl_copy(kout,kin,n,cq);
+        if (has_values)
+          ucl_copy(*vout,*vin,n,cq);
+      }
+      return UCL_SUCCESS;
+    }
+
+    // Split the input into tiles that are a multiple of the work-group size
+    int ngroups=(n+_block_size-1)/_block_size;
+    if (ngroups>_max_groups)
+      ngroups=_max_groups;
+    int tile=(n+ngroups-1)/ngroups;
+    tile=((tile+_block_size-1)/_block_size)*_block_size;
+    ngroups=(n+tile-1)/tile;
+    const int nhist=ngroups<<_bits;
+    if (_hist.cols()<static_cast<size_t>(nhist))
+      if (_hist.alloc(nhist,*_dev)!=UCL_SUCCESS)
+        return UCL_MEMORY_ERROR;
+    if (_tkeys.cols()<static_cast<size_t>(n))
+      if (_tkeys.alloc(n,*_dev)!=UCL_SUCCESS)
+        return UCL_MEMORY_ERROR;
+    if (has_values && _tvalues.cols()<static_cast<size_t>(n))
+      if (_tvalues.alloc(n,*_dev)!=UCL_SUCCESS)
+        return UCL_MEMORY_ERROR;
+
+    // Alternate between the output and temporary storage so that the last
+    // pass writes the output (in place sorts need a copy for odd passes)
+    const UCL_D_Vec<keytyp> *ksrc=&kin;
+    const UCL_D_Vec<valtyp> *vsrc=vin;
+    UCL_Kernel &kc=(*k)[0], &kp=(*k)[1];
+    for (int p=0; p<passes; p++) {
+      bool to_temp;
+      if (in_place)
+        to_temp=(p%2==0);
+      else
+        to_temp=((passes-1-p)%2==1);
+      UCL_D_Vec<keytyp> *kdst=to_temp ? &_tkeys : &kout;
+      UCL_D_Vec<valtyp> *vdst=to_temp ? &_tvalues : vout;
+
+      int kin_off=ksrc->offset(), kout_off=kdst->offset();
+      int vin_off=has_values ? vsrc->offset() : 0;
+      int vout_off=has_values ? vdst->offset() : 0;
+      int shift=p*_bits;
+
+      kc.set_size(ngroups,_block_size,cq);
+      kc.clear_args();
+      kc.add_arg(ksrc);
+      kc.add_arg(&kin_off);
+      kc.add_arg(&n);
+      kc.add_arg(&tile);
+      kc.add_arg(&shift);
+      kc.add_arg(&_hist);
+      kc.run();
+      int err=_scan.exclusive(_hist,_hist,cq,nhist);
+      if (err!=UCL_SUCCESS)
+        return err;
+
+      kp.set_size(ngroups,_block_size,cq);
+      kp.clear_args();
+      kp.add_arg(ksrc);
+      kp.add_arg(&kin_off);
+      if (has_values)
+        kp.add_arg(vsrc);
+      else
+        kp.add_arg(ksrc);
+      kp.add_arg(&vin_off);
+      kp.add_arg(kdst);
+      kp.add_arg(&kout_off);
+      if (has_values)
+        kp.add_arg(vdst);
+      else
+        kp.add_arg(kdst);
+      kp.add_arg(&vout_off);
+      kp.add_arg(&n);
+      kp.add_arg(&tile);
+      kp.add_arg(&shift);
+      kp.add_arg(&_hist);
+      kp.run();
+      ksrc=kdst;
+      vsrc=vdst;
+    }
+
+    if (in_place && passes%2==1) {
+      ucl_copy(kout,_tkeys,n,cq);
+      if (has_values)
+        ucl_copy(*vout,_tvalues,n,cq);
+    }
+    return UCL_SUCCESS;
+  }
+};
+
+#endif
@@ -0,0 +1,110 @@
+/***************************************************************************
+                                 ucl_thread.h
+                             -------------------
+
+  Threads, mutexes and condition variables for host-side background work
+
+ __________________________________________________________________________
+    This file is part of the Geryon Unified Coprocessor Library (UCL)
+ __________________________________________________________________________
+
+ ***************************************************************************/
+
+/* -----------------------------------------------------------------------
+   Copyright (2010) Sandia Corporation.  Under the terms of Contract
+   DE-AC04-94AL85000 with Sandia Corporation, the U.S. Government retains
+   certain rights in this software.  This software is distributed under
+   the Simplified BSD License.
+   ----------------------------------------------------------------------- */
+
+/***************************************************************************
+   Thin wrappers around POSIX threads. They are used for work that should
+   not hold up the thread issuing device commands, such as writing
+   checkpoint files (UCL_Checkpoint), and for the pool used by large host
+   copies (UCL_CopyPool). Objects are not copyable.
+ ***************************************************************************/
+
+#ifndef UCL_THREAD_H
+#define UCL_THREAD_H
+
+#include <pthread.h>
+
+/// Mutual exclusion lock
+class UCL_Mutex {
+ public:
+  UCL_Mutex() { pthread_mutex_init(&_m,NULL); }
+  ~UCL_Mutex() { pthread_mutex_destroy(&_m); }
+  inline void lock() { pthread_mutex_lock(&_m); }
+  inline void unlock() { pthread_mutex_unlock(&_m); }
+  /// Lock if not locked by another thread (does not block)
+  inline bool try_lock() { return pthread_mutex_trylock(&_m)==0; }
+  inline pthread_mutex_t * handle() { return &_m; }
+
+ private:
+  pthread_mutex_t _m;
+  UCL_Mutex(const UCL_Mutex &);
+  UCL_Mutex & operator=(const UCL_Mutex &);
+};
+
+/// Lock a UCL_Mutex for the lifetime of the object
+class UCL_Lock {
+ public:
+  explicit UCL_Lock(UCL_Mutex &m) : _m(m) { _m.lock(); }
+  ~UCL_Lock() { _m.unlock(); }
+
+ private:
+  UCL_Mutex &_m;
+  UCL_Lock(const UCL_Lock &);
+  UCL_Lock & operator=(const UCL_Lock &);
+};
+
+/// Condition variable used with a UCL_Mutex
+class UCL_Cond {
+ public:
+  UCL_Cond() { pthread_cond_init(&_c,NULL); }
+  ~UCL_Cond() { pthread_cond_destroy(&_c); }
+  /// Release m (which must be locked) and block until signaled
+  inline void wait(UCL_Mutex &m) { pthread_cond_wait(&_c,m.handle()); }
+  /// Wake one waiting thread
+  inline void signal() { pthread_cond_signal(&_c); }
+  /// Wake all waiting threads
+  inline void broadcast() { pthread_cond_broadcast(&_c); }
+
+ private:
+  pthread_cond_t _c;
+  UCL_Cond(const UCL_Cond &);
+  UCL_Cond & operator=(const UCL_Cond &);
+};
+
+/// Host thread running a function until it returns
+class UCL_Thread {
+ public:
+  UCL_Thread() : _running(false) {}
+  ~UCL_Thread() { join(); }
+
+  /// Run fn(arg) in a new thread
+  /** \return false if the thread could not be created **/
+  inline bool start(void *(*fn)(void *), void *arg) {
+    join();
+    _running=(pthread_create(&_t,NULL,fn,arg)==0);
+    return _running;
+  }
+
+  /// Block until the thread returns (no effect if not started)
+  inline void join() {
+    if (_running)
+      pthread_join(_t,NULL);
+    _running=false;
+  }
+
+  /// True if the thread was started and not joined
+  inline bool running() const { return _running; }
+
+ private:
+  pthread_t _t;
+  bool _running;
+  UCL_Thread(const UCL_Thread &);
+  UCL_Thread & operator=(const UCL_Thread &);
+};
+
+#endif
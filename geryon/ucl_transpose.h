@@ -0,0 +1,287 @@
+/***************************************************************************
+                               ucl_transpose.h
+                             -------------------
+
+  Tiled out-of-place and in-place transpose of pitched device matrices
+
+ __________________________________________________________________________
+    This file is part of the Geryon Unified Coprocessor Library (UCL)
+ __________________________________________________________________________
+
+ ***************************************************************************/
+
+/* -----------------------------------------------------------------------
+   Copyright (2010) Sandia Corporation.  Under the terms of Contract
+   DE-AC04-94AL85000 with Sandia Corporation, the U.S. Government retains
+   certain rights in this software.  This software is distributed under
+   the Simplified BSD License.
+   ----------------------------------------------------------------------- */
+
+/***************************************************************************
+   UCL_Transpose writes the transpose of a UCL_D_Mat into another UCL_D_Mat
+   or transposes a square UCL_D_Mat in place. Each matrix is addressed with
+   its own row pitch and offset, so padded allocations and views are
+   handled without repacking. Converting an atom-major n x 3 array into
+   three component-major rows:
+
+     UCL_Transpose<double> tr(dev);
+     tr.transpose(xt,x,cq);
+
+   A work-group reads a TILE x TILE block with contiguous loads into local
+   memory and writes it back with contiguous stores to the transposed
+   position. Each work-item handles TILE/BLOCK_ROWS elements of a tile
+   column. Tiles are padded by one column to avoid bank conflicts. In-place
+   transposes swap the tiles on either side of the diagonal in pairs using
+   two local tiles. Passing the storage() of a UCL_D_ColMat as the output
+   converts a row-major matrix to column-major on the device.
+
+   The tile size is chosen from the work-group size and local memory of
+   the device unless given. All kernels are queued on the command queue
+   given, so calls are asynchronous with respect to the host.
+ ***************************************************************************/
+
+// Only allow this file to be included by nvd_prims.h and ocl_prims.h
+#ifdef UCL_PRIMS_ALLOW
+
+/// Kernel source for transpose (TILE, BLOCK_ROWS and BLOCK_SIZE first)
+inline const char * _ucl_transpose_source() {
+  return
+    "__kernel void ucl_transpose(const __global NUMTYP *in,\n"
+    "                            const int in_off, const int ldi,\n"
+    "                            __global NUMTYP *out, const int out_off,\n"
+    "                            const int ldo, const int rows,\n"
+    "                            const int cols) {\n"
+    "  __local NUMTYP t[TILE][TILE+1];\n"
+    "  const int tx=THREAD_ID_X%TILE;\n"
+    "  const int ty=THREAD_ID_X/TILE;\n"
+    "  const int nbx=(cols+TILE-1)/TILE;\n"
+    "  const int row0=(BLOCK_ID_X/nbx)*TILE;\n"
+    "  const int col0=(BLOCK_ID_X%nbx)*TILE;\n"
+    "  for (int r=ty; r<TILE; r+=BLOCK_ROWS) {\n"
+    "    const int i=row0+r, j=col0+tx;\n"
+    "    if (i<rows && j<cols)\n"
+    "      t[r][tx]=in[in_off+i*ldi+j];\n"
+    "  }\n"
+    "  __syncthreads();\n"
+    "  for (int r=ty; r<TILE; r+=BLOCK_ROWS) {\n"
+    "    const int i=col0+r, j=row0+tx;\n"
+    "    if (i<cols && j<rows)\n"
+    "      out[out_off+i*ldo+j]=t[tx][r];\n"
+    "  }\n"
+    "}\n"
+    "\n"
+    "__kernel void ucl_transpose_square(__global NUMTYP *a, const int off,\n"
+    "                                   const int ld, const int n) {\n"
+    "  __local NUMTYP t1[TILE][TILE+1];\n"
+    "  __local NUMTYP t2[TILE][TILE+1];\n"
+    "  const int tx=THREAD_ID_X%TILE;\n"
+    "  const int ty=THREAD_ID_X/TILE;\n"
+    "  const int nb=(n+TILE-1)/TILE;\n"
+    "  // Work-group b handles tile (bi,bj) of the upper triangle with bj>=bi\n"
+    "  int b=BLOCK_ID_X, bi=0;\n"
+    "  while (b>=nb-bi) {\n"
+    "    b-=nb-bi;\n"
+    "    bi++;\n"
+    "  }\n"
+    "  const int r0=bi*TILE, c0=(bi+b)*TILE;\n"
+    "  const int diag=(b==0);\n"
+    "  for (int r=ty; r<TILE; r+=BLOCK_ROWS) {\n"
+    "    if (r0+r<n && c0+tx<n)\n"
+    "      t1[r][tx]=a[off+(r0+r)*ld+c0+tx];\n"
+    "    if (!diag && c0+r<n && r0+tx<n)\n"
+    "      t2[r][tx]=a[off+(c0+r)*ld+r0+tx];\n"
+    "  }\n"
+    "  __syncthreads();\n"
+    "  for (int r=ty; r<TILE; r+=BLOCK_ROWS) {\n"
+    "    if (c0+r<n && r0+tx<n)\n"
+    "      a[off+(c0+r)*ld+r0+tx]=t1[tx][r];\n"
+    "    if (!diag && r0+r<n && c0+tx<n)\n"
+    "      a[off+(r0+r)*ld+c0+tx]=t2[tx][r];\n"
+    "  }\n"
+    "}\n";
+}
+
+/// Choose the transpose tile size and rows per pass for a device
+/** The work-group (tile*block_rows work-items) must fit the default
+  * primitive work-group size and the two tiles used in place must use no
+  * more than half of the local memory
+  * \param bytes Size of the element type **/
+inline void _ucl_transpose_tile(UCL_Device &dev, const size_t bytes,
+                                int &tile, int &block_rows) {
+  const int bs=_ucl_prim_block_size(dev);
+  const size_t local=dev.local_bytes();
+  tile=(bs<128) ? 16 : 32;
+  while (tile>4 && 2*tile*(tile+1)*bytes>local/2)
+    tile/=2;
+  block_rows=bs/tile;
+  if (block_rows<1)
+    block_rows=1;
+  else if (block_rows>tile)
+    block_rows=tile;
+}
+
+/// Tiled transpose of pitched device matrices
+/** Kernels are compiled on first use and cached with the device **/
+template <class numtyp>
+class UCL_Transpose {
+ public:
+  /// Set up the transpose on a device
+  /** \param tile Tile size (power of 2 from 4 to 64; 0 to choose from the
+    *             device properties)
+    * \param block_rows Rows of a tile handled in one pass of the
+    *                   work-group (power of 2 no larger than tile; 0 to
+    *                   choose from the device properties)
+    * \note An explicit tile is reduced if the tiles do not fit in local
+    *       memory, and block_rows is reduced if the work-group would be
+    *       larger than the device allows; see tile() and block_rows() for
+    *       the values used **/
+  UCL_Transpose(UCL_Device &dev, const int tile=0, const int block_rows=0)
+      : _dev(&dev), _kernels(NULL) {
+    _ucl_transpose_tile(dev,sizeof(numtyp),_tile,_block_rows);
+    if (tile>0) {
+      _tile=_ucl_pow2_floor(tile);
+      if (_tile<4)
+        _tile=4;
+      else if (_tile>64)
+        _tile=64;
+      _block_rows=_ucl_prim_block_size(dev)/_tile;
+    }
+    if (block_rows>0)
+      _block_rows=_ucl_pow2_floor(block_rows);
+
+    // Clamp explicit values so that the two tiles used in place fit in
+    // local memory and the work-group fits the device
+    while (_tile>4 && 2*_tile*(_tile+1)*sizeof(numtyp)>dev.local_bytes())
+      _tile/=2;
+    if (_block_rows>_tile)
+      _block_rows=_tile;
+    while (_block_rows>1 &&
+           static_cast<size_t>(_tile*_block_rows)>dev.group_size())
+      _block_rows/=2;
+    if (_block_rows<1)
+      _block_rows=1;
+  }
+
+  /// Tile size
+  inline int tile() const { return _tile; }
+  /// Rows of a tile handled in one pass of the work-group
+  inline int block_rows() const { return _block_rows; }
+  /// Work-group size
+  inline int block_size() const { return _tile*_block_rows; }
+
+  /// out=transpose(in)
+  /** \param rows Rows of in to transpose (0 for all)
+    * \param cols Columns of in to transpose (0 for all)
+    * \note out must have at least cols rows and rows columns
+    * \note out must not overlap in
+    * \note Asynchronous with respect to the host **/
+  inline int transpose(UCL_D_Mat<numtyp> &out, const UCL_D_Mat<numtyp> &in,
+                       command_queue &cq, const size_t rows=0,
+                       const size_t cols=0) {
+    int m=static_cast<int>(rows==0 ? in.rows() : rows);
+    int n=static_cast<int>(cols==0 ? in.cols() : cols);
+    assert(static_cast<size_t>(m)<=in.rows() &&
+           static_cast<size_t>(n)<=in.cols());
+    assert(out.rows()>=static_cast<size_t>(n) &&
+           out.cols()>=static_cast<size_t>(m));
+    UCL_PrimKernels *kern=_get_kernels();
+    if (kern==NULL)
+      return UCL_COMPILE_ERROR;
+    if (m==0 || n==0)
+      return UCL_SUCCESS;
+
+    int in_off=in.offset(), ldi=_pitch(in);
+    int out_off=out.offset(), ldo=_pitch(out);
+    const int ngroups=((m+_tile-1)/_tile)*((n+_tile-1)/_tile);
+    UCL_Kernel &kt=(*kern)[0];
+    kt.set_size(ngroups,block_size(),cq);
+    kt.clear_args();
+    kt.add_arg(&in);
+    kt.add_arg(&in_off);
+    kt.add_arg(&ldi);
+    kt.add_arg(&out);
+    kt.add_arg(&out_off);
+    kt.add_arg(&ldo);
+    kt.add_arg(&m);
+    kt.add_arg(&n);
+    kt.run();
+    return UCL_SUCCESS;
+  }
+
+  /// Transpose a square matrix in place
+  /** \param n Leading rows and columns to transpose (0 for all)
+    * \note Asynchronous with respect to the host **/
+  inline int transpose(UCL_D_Mat<numtyp> &mat, command_queue &cq,
+                       const size_t n=0) {
+    int nn=static_cast<int>(n==0 ? mat.rows() : n);
+    if (n==0 && mat.rows()!=mat.cols()) {
+      #ifndef UCL_NO_EXIT
+      std::cerr << "UCL Error: In-place transpose of a " << mat.rows()
+                << " x " << mat.cols() << " matrix.\n";
+      UCL_GERYON_EXIT;
+      #endif
+      return UCL_ERROR;
+    }
+    assert(static_cast<size_t>(nn)<=mat.rows() &&
+           static_cast<size_t>(nn)<=mat.cols());
+    UCL_PrimKernels *kern=_get_kernels();
+    if (kern==NULL)
+      return UCL_COMPILE_ERROR;
+    if (nn<2)
+      return UCL_SUCCESS;
+
+    int off=mat.offset(), ld=_pitch(mat);
+    const int nb=(nn+_tile-1)/_tile;
+    UCL_Kernel &ks=(*kern)[1];
+    ks.set_size(nb*(nb+1)/2,block_size(),cq);
+    ks.clear_args();
+    ks.add_arg(&mat);
+    ks.add_arg(&off);
+    ks.add_arg(&ld);
+    ks.add_arg(&nn);
+    ks.run();
+    return UCL_SUCCESS;
+  }
+
+ private:
+  UCL_Device *_dev;
+  int _tile, _block_rows;
+  UCL_PrimKernels *_kernels;
+
+  inline int _pitch(const UCL_D_Mat<numtyp> &mat) const
+    { return static_cast<int>(mat.row_bytes()/sizeof(numtyp)); }
+
+  inline UCL_PrimKernels * _get_kernels() {
+    if (_kernels==NULL) {
+      std::ostringstream key, src;
+      key << "ucl_transpose_" << _UCL_DATA_ID<numtyp>::name() << "_"
+          << _tile << "_" << _block_rows;
+      src << _ucl_prim_defs<numtyp>(block_size())
+          << "#define TILE " << _tile << "\n"
+          << "#define BLOCK_ROWS " << _block_rows << "\n"
+          << _ucl_transpose_source();
+      const char *names[2]={"ucl_transpose","ucl_transpose_square"};
+      _kernels=_ucl_prim_kernels(*_dev,key.str(),src.str(),names,2);
+    }
+    return _kernels;
+  }
+};
+
+/// out=transpose(in)
+/** Queued on the default command queue for dev **/
+template <class numtyp>
+inline int ucl_transpose(UCL_D_Mat<numtyp> &out,
+                         const UCL_D_Mat<numtyp> &in, UCL_Device &dev) {
+  UCL_Transpose<numtyp> tr(dev);
+  return tr.transpose(out,in,dev.cq());
+}
+
+/// Transpose a square matrix in place
+/** Queued on the default command queue for dev **/
+template <class numtyp>
+inline int ucl_transpose(UCL_D_Mat<numtyp> &mat, UCL_Device &dev) {
+  UCL_Transpose<numtyp> tr(dev);
+  return tr.transpose(mat,dev.cq());
+}
+
+#endif
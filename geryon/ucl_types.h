@@ -87,6 +87,39 @@ template <class eltype> struct _UCL_DATA_ID {
   static inline const char * numtyp_flag() { return "-D NUMTYP=error_type"; }
 };
 
+// Ids 12 to UCL_USER_DATA_ID-1 are used for vector types by the backends
+// and for ucl_half
+#define UCL_USER_DATA_ID 64
+
+// Type for each registered id; a second registration of an id fails to
+// compile
+template <int id> struct _UCL_DATA_TYPE;
+
+#define _UCL_REGISTER_DATA_ID(type,tid,kname,min_id)                         \
+  template <> struct _UCL_DATA_ID<type> {                                    \
+    enum { id=(tid) };                                                       \
+    static inline const char * name() { return kname; }                      \
+    static inline const char * numtyp_flag() { return "-D NUMTYP=" kname; }  \
+  };                                                                         \
+  template <> struct _UCL_DATA_TYPE<(tid)> {                                 \
+    typedef type data_type;                                                  \
+    typedef char valid_id[((tid)>=(min_id)) ? 1 : -1];                       \
+  };
+
+/// Register a POD struct or vector type with Geryon
+/** Registered types are copied in bulk by ucl_copy() and can be used with
+  * kernels specialized on NUMTYP. Must be used at global scope before any
+  * container of the type is declared:
+  * \verbatim
+    struct Atom { float x, y, z; int type; };
+    UCL_REGISTER_DATA_TYPE(Atom,UCL_USER_DATA_ID+1,"Atom")
+    \endverbatim
+  * \param tid Unique id (at least UCL_USER_DATA_ID) that is the same
+  *            wherever the type is registered
+  * \param kname Name of the type in kernel code (a string literal) **/
+#define UCL_REGISTER_DATA_TYPE(type,tid,kname)                               \
+  _UCL_REGISTER_DATA_ID(type,tid,kname,UCL_USER_DATA_ID)
+
 // Host memory allocation types
 enum UCL_MEMOPT {
   UCL_WRITE_ONLY,     ///< Allow any optimizations for memory that is write only
@@ -118,57 +151,10 @@ const char * ucl_template_name() { return _UCL_DATA_ID<numtyp>::name(); }
 
 template <class t1, class t2> struct ucl_same_type;
 
-template <> struct ucl_same_type<bool,bool> { enum { ans=1 }; };
-template <> struct ucl_same_type<char,char> { enum { ans=1 }; };
-template <> struct ucl_same_type<unsigned char,unsigned char> { enum { ans=1 }; };
-template <> struct ucl_same_type<int,int> { enum { ans=1 }; };
-template <> struct ucl_same_type<unsigned,unsigned> { enum { ans=1 }; };
-template <> struct ucl_same_type<short,short> { enum { ans=1 }; };
-template <> struct ucl_same_type<unsigned short,unsigned short> { enum { ans=1 }; };
-template <> struct ucl_same_type<long,long> { enum { ans=1 }; };
-template <> struct ucl_same_type<unsigned long,unsigned long> { enum { ans=1 }; };
-template <> struct ucl_same_type<float,float> { enum { ans=1 }; };
-template <> struct ucl_same_type<double,double> { enum { ans=1 }; };
-template <> struct ucl_same_type<long double,long double> { enum { ans=1 }; };
-
-template <> struct ucl_same_type<const bool,bool> { enum { ans=1 }; };
-template <> struct ucl_same_type<const char,char> { enum { ans=1 }; };
-template <> struct ucl_same_type<const unsigned char,unsigned char> { enum { ans=1 }; };
-template <> struct ucl_same_type<const int,int> { enum { ans=1 }; };
-template <> struct ucl_same_type<const unsigned,unsigned> { enum { ans=1 }; };
-template <> struct ucl_same_type<const short,short> { enum { ans=1 }; };
-template <> struct ucl_same_type<const unsigned short,unsigned short> { enum { ans=1 }; };
-template <> struct ucl_same_type<const long,long> { enum { ans=1 }; };
-template <> struct ucl_same_type<const unsigned long,unsigned long> { enum { ans=1 }; };
-template <> struct ucl_same_type<const float,float> { enum { ans=1 }; };
-template <> struct ucl_same_type<const double,double> { enum { ans=1 }; };
-template <> struct ucl_same_type<const long double,long double> { enum { ans=1 }; };
-
-template <> struct ucl_same_type<bool,const bool> { enum { ans=1 }; };
-template <> struct ucl_same_type<char,const char> { enum { ans=1 }; };
-template <> struct ucl_same_type<unsigned char,const unsigned char> { enum { ans=1 }; };
-template <> struct ucl_same_type<int,const int> { enum { ans=1 }; };
-template <> struct ucl_same_type<unsigned,const unsigned> { enum { ans=1 }; };
-template <> struct ucl_same_type<short,const short> { enum { ans=1 }; };
-template <> struct ucl_same_type<unsigned short,const unsigned short> { enum { ans=1 }; };
-template <> struct ucl_same_type<long,const long> { enum { ans=1 }; };
-template <> struct ucl_same_type<unsigned long,const unsigned long> { enum { ans=1 }; };
-template <> struct ucl_same_type<float,const float> { enum { ans=1 }; };
-template <> struct ucl_same_type<double,const double> { enum { ans=1 }; };
-template <> struct ucl_same_type<long double,const long double> { enum { ans=1 }; };
-
-template <> struct ucl_same_type<const bool,const bool> { enum { ans=1 }; };
-template <> struct ucl_same_type<const char,const char> { enum { ans=1 }; };
-template <> struct ucl_same_type<const unsigned char,const unsigned char> { enum { ans=1 }; };
-template <> struct ucl_same_type<const int,const int> { enum { ans=1 }; };
-template <> struct ucl_same_type<const unsigned,const unsigned> { enum { ans=1 }; };
-template <> struct ucl_same_type<const short,const short> { enum { ans=1 }; };
-template <> struct ucl_same_type<const unsigned short,const unsigned short> { enum { ans=1 }; };
-template <> struct ucl_same_type<const long,const long> { enum { ans=1 }; };
-template <> struct ucl_same_type<const unsigned long,const unsigned long> { enum { ans=1 }; };
-template <> struct ucl_same_type<const float,const float> { enum { ans=1 }; };
-template <> struct ucl_same_type<const double,const double> { enum { ans=1 }; };
-template <> struct ucl_same_type<const long double,const long double> { enum { ans=1 }; };
+template <class t> struct ucl_same_type<t,t> { enum { ans=1 }; };
+template <class t> struct ucl_same_type<const t,t> { enum { ans=1 }; };
+template <class t> struct ucl_same_type<t,const t> { enum { ans=1 }; };
+template <class t> struct ucl_same_type<const t,const t> { enum { ans=1 }; };
 
 template <class t1, class t2> struct ucl_same_type { enum { ans=0 }; };
 
@@ -42,7 +42,7 @@ class UCL_Vector {
   /// Device Allocation
   UCL_D_Vec<devtype> device;
 
-  UCL_Vector() { }
+  UCL_Vector() : _track_dirty(false), _skip_unchanged(false) { }
   ~UCL_Vector() { }
 
   /// Construct with n columns
@@ -50,6 +50,7 @@ class UCL_Vector {
   UCL_Vector(const size_t cols, UCL_Device &acc,
              const enum UCL_MEMOPT kind1=UCL_READ_WRITE,
              const enum UCL_MEMOPT kind2=UCL_READ_WRITE)
+    : _track_dirty(false), _skip_unchanged(false)
     { _ucl_s_obj_help< ucl_same_type<hosttype,devtype>::ans >::
         alloc(host,device,_buffer,cols,acc,kind1,kind2); }
 
@@ -72,7 +73,8 @@ class UCL_Vector {
   inline int alloc(const size_t cols, mat_type &cq,
                    const enum UCL_MEMOPT kind1=UCL_READ_WRITE,
                    const enum UCL_MEMOPT kind2=UCL_READ_WRITE)
-    { return _ucl_s_obj_help< ucl_same_type<hosttype,devtype>::ans >::
+    { _reset_tracking();
+      return _ucl_s_obj_help< ucl_same_type<hosttype,devtype>::ans >::
         alloc(host,device,_buffer,cols,cq,kind1,kind2); }
 
   /// Set up host vector with 'cols' columns and reserve memory
@@ -90,16 +92,21 @@ class UCL_Vector {
   inline int alloc(const size_t cols, UCL_Device &acc,
                    const enum UCL_MEMOPT kind1=UCL_READ_WRITE,
                    const enum UCL_MEMOPT kind2=UCL_READ_WRITE)
-    { return _ucl_s_obj_help< ucl_same_type<hosttype,devtype>::ans >::
+    { _reset_tracking();
+      return _ucl_s_obj_help< ucl_same_type<hosttype,devtype>::ans >::
         alloc(host,device,_buffer,cols,acc,kind1,kind2); }
 
   /// Free memory and set size to 0
-  inline void clear()
-    { host.clear(); device.clear(); }
+  inline void clear() {
+    host.clear();
+    device.clear();
+    _reset_tracking();
+  }
 
   /// Resize the allocation to contain cols elements
   inline int resize(const int cols) {
     assert(host.kind()!=UCL_VIEW);
+    _reset_tracking();
     int err=host.resize(cols);
     if (err!=UCL_SUCCESS)
       return err;
@@ -117,12 +124,14 @@ class UCL_Vector {
   inline void zero(const int n) { zero(n,cq()); }
   /// Set each element to zero (asynchronously on device)
   inline void zero(command_queue &cq) {
+    _reset_tracking();
     host.zero();
     if (device.kind()!=UCL_VIEW) device.zero(cq);
     else if (_buffer.numel()>0) _buffer.zero();
   }
   /// Set first n elements to zero (asynchronously on device)
   inline void zero(const int n, command_queue &cq) {
+    _upload_hash.invalidate();
     host.zero(n);
     if (device.kind()!=UCL_VIEW) device.zero(n,cq);
     else if (_buffer.numel()>0) _buffer.zero();
@@ -170,19 +179,77 @@ class UCL_Vector {
   /// Get the size on the host in bytes of 1 element
   inline int element_size() const { return sizeof(hosttype); }
 
+  /// Turn tracking of modified ranges on or off
+  /** When on, update_device() and update_host() without a size only copy
+    * the ranges marked with mark_dirty() and mark_device_dirty() and then
+    * clear them. The host and device data should match when tracking is
+    * turned on. Updates of the first n elements or of a slice copy the
+    * data requested and do not change the marked ranges.
+    * \sa UCL_DirtyRanges **/
+  inline void track_dirty(const bool on)
+    { _track_dirty=on; _reset_tracking(); }
+  /// True if modified ranges are tracked
+  inline bool track_dirty() const { return _track_dirty; }
+  /// Mark n elements starting at index i as modified on the host
+  /** Ignored unless tracking is on **/
+  inline void mark_dirty(const size_t i, const size_t n)
+    { if (_track_dirty) _host_dirty.add(i,n); }
+  /// Mark n elements starting at index i as modified on the device
+  /** Ranges are ignored unless tracking is on. The hash of the last upload
+    * is always invalidated (see skip_unchanged()). **/
+  inline void mark_device_dirty(const size_t i, const size_t n) {
+    _upload_hash.invalidate();
+    if (_track_dirty)
+      _device_dirty.add(i,n);
+  }
+  /// Ranges modified on the host that will be copied by update_device()
+  inline UCL_DirtyRanges & host_dirty() { return _host_dirty; }
+  /// Ranges modified on the device that will be copied by update_host()
+  inline UCL_DirtyRanges & device_dirty() { return _device_dirty; }
+
+  /// Skip update_device() when the host data has not changed
+  /** When on, the host data is hashed by each update_device() of all
+    * elements and the copy is skipped if the data matches the last update.
+    * Call upload_hash().invalidate() or mark_device_dirty() after writing
+    * to the device allocation in a kernel. Updates with dirty tracking or
+    * of part of the data always copy.
+    * \sa UCL_UploadHash **/
+  inline void skip_unchanged(const bool on)
+    { _skip_unchanged=on; _upload_hash.invalidate(); }
+  /// True if unchanged uploads are skipped
+  inline bool skip_unchanged() const { return _skip_unchanged; }
+  /// Hash of the last update_device() with counters for skipped updates
+  inline UCL_UploadHash & upload_hash() { return _upload_hash; }
+
 
   /// Update the allocation on the host asynchronously
-  inline void update_host()
-    { _ucl_s_obj_help< ucl_same_type<hosttype,devtype>::ans >::
-        copy(host,device,_buffer,true); }
+  /** Only marked ranges are copied when dirty tracking is on **/
+  inline void update_host() {
+    if (_track_dirty)
+      _update_host_dirty(cq());
+    else
+      _ucl_s_obj_help< ucl_same_type<hosttype,devtype>::ans >::
+        copy(host,device,_buffer,true);
+  }
   /// Update the allocation on the host (true for asynchronous copy)
-  inline void update_host(const bool async)
-    { _ucl_s_obj_help< ucl_same_type<hosttype,devtype>::ans >::
-        copy(host,device,_buffer,async); }
+  /** Only marked ranges are copied when dirty tracking is on **/
+  inline void update_host(const bool async) {
+    if (_track_dirty) {
+      _update_host_dirty(cq());
+      if (!async) sync();
+    } else
+      _ucl_s_obj_help< ucl_same_type<hosttype,devtype>::ans >::
+        copy(host,device,_buffer,async);
+  }
   /// Update the allocation on the host (using command queue)
-  inline void update_host(command_queue &cq)
-    { _ucl_s_obj_help< ucl_same_type<hosttype,devtype>::ans >::
-        copy(host,device,_buffer,cq); }
+  /** Only marked ranges are copied when dirty tracking is on **/
+  inline void update_host(command_queue &cq) {
+    if (_track_dirty)
+      _update_host_dirty(cq);
+    else
+      _ucl_s_obj_help< ucl_same_type<hosttype,devtype>::ans >::
+        copy(host,device,_buffer,cq);
+  }
   /// Update the first n elements on the host (true for asynchronous copy)
   inline void update_host(const int n, const bool async)
     { _ucl_s_obj_help< ucl_same_type<hosttype,devtype>::ans >::
@@ -199,39 +266,118 @@ class UCL_Vector {
   inline void update_host(const int rows, const int cols, command_queue &cq)
     { _ucl_s_obj_help< ucl_same_type<hosttype,devtype>::ans >::
         copy(host,device,rows,cols,_buffer,cq); }
+  /// Update n elements starting at offset on the host
+  /** \param async true for asynchronous copy on the default queue **/
+  inline void update_host_range(const size_t offset, const size_t n,
+                                const bool async) {
+    _ucl_s_obj_help< ucl_same_type<hosttype,devtype>::ans >::
+      copy_block(host,device,0,offset,1,n,_buffer,cq());
+    if (!async) sync();
+  }
+  /// Update n elements starting at offset on the host (using command queue)
+  inline void update_host_range(const size_t offset, const size_t n,
+                                command_queue &cq)
+    { _ucl_s_obj_help< ucl_same_type<hosttype,devtype>::ans >::
+        copy_block(host,device,0,offset,1,n,_buffer,cq); }
 
 
   /// Update the allocation on the device asynchronously
-  inline void update_device()
-    { _ucl_s_obj_help< ucl_same_type<hosttype,devtype>::ans >::
-        copy(device,host,_buffer,true); }
+  /** Only marked ranges are copied when dirty tracking is on. The copy
+    * is skipped if the data is unchanged with skip_unchanged(). **/
+  inline void update_device() {
+    if (_track_dirty)
+      _update_device_dirty(cq());
+    else if (!_unchanged())
+      _ucl_s_obj_help< ucl_same_type<hosttype,devtype>::ans >::
+        copy(device,host,_buffer,true);
+  }
   /// Update the allocation on the device (true for asynchronous copy)
-  inline void update_device(const bool async)
-    { _ucl_s_obj_help< ucl_same_type<hosttype,devtype>::ans >::
-        copy(device,host,_buffer,async); }
+  /** Only marked ranges are copied when dirty tracking is on. The copy
+    * is skipped if the data is unchanged with skip_unchanged(). **/
+  inline void update_device(const bool async) {
+    if (_track_dirty) {
+      _update_device_dirty(cq());
+      if (!async) sync();
+    } else if (!_unchanged())
+      _ucl_s_obj_help< ucl_same_type<hosttype,devtype>::ans >::
+        copy(device,host,_buffer,async);
+  }
   /// Update the allocation on the device (using command queue)
-  inline void update_device(command_queue &cq)
-    { _ucl_s_obj_help< ucl_same_type<hosttype,devtype>::ans >::
-        copy(device,host,_buffer,cq); }
+  /** Only marked ranges are copied when dirty tracking is on. The copy
+    * is skipped if the data is unchanged with skip_unchanged(). **/
+  inline void update_device(command_queue &cq) {
+    if (_track_dirty)
+      _update_device_dirty(cq);
+    else if (!_unchanged())
+      _ucl_s_obj_help< ucl_same_type<hosttype,devtype>::ans >::
+        copy(device,host,_buffer,cq);
+  }
   /// Update the first n elements on the device (true for asynchronous copy)
   inline void update_device(const int n, const bool async)
-    { _ucl_s_obj_help< ucl_same_type<hosttype,devtype>::ans >::
+    { _upload_hash.invalidate();
+      _ucl_s_obj_help< ucl_same_type<hosttype,devtype>::ans >::
         copy(device,host,n,_buffer,async); }
   /// Update the first n elements on the device (using command queue)
   inline void update_device(const int n, command_queue &cq)
-    { _ucl_s_obj_help< ucl_same_type<hosttype,devtype>::ans >::
+    { _upload_hash.invalidate();
+      _ucl_s_obj_help< ucl_same_type<hosttype,devtype>::ans >::
         copy(device,host,n,_buffer,cq); }
   /// Update slice on the device (true for asynchronous copy)
   inline void update_device(const int rows, const int cols, const bool async)
-    { _ucl_s_obj_help< ucl_same_type<hosttype,devtype>::ans >::
+    { _upload_hash.invalidate();
+      _ucl_s_obj_help< ucl_same_type<hosttype,devtype>::ans >::
         copy(device,host,rows,cols,_buffer,async); }
   /// Update slice on the device (using command queue)
   inline void update_device(const int rows, const int cols, command_queue &cq)
-    { _ucl_s_obj_help< ucl_same_type<hosttype,devtype>::ans >::
+    { _upload_hash.invalidate();
+      _ucl_s_obj_help< ucl_same_type<hosttype,devtype>::ans >::
         copy(device,host,rows,cols,_buffer,cq); }
+  /// Update n elements starting at offset on the device
+  /** \param async true for asynchronous copy on the default queue **/
+  inline void update_device_range(const size_t offset, const size_t n,
+                                  const bool async) {
+    _upload_hash.invalidate();
+    _ucl_s_obj_help< ucl_same_type<hosttype,devtype>::ans >::
+      copy_block(device,host,0,offset,1,n,_buffer,cq());
+    if (!async) sync();
+  }
+  /// Update n elements starting at offset on the device (using command queue)
+  inline void update_device_range(const size_t offset, const size_t n,
+                                  command_queue &cq) {
+    _upload_hash.invalidate();
+    _ucl_s_obj_help< ucl_same_type<hosttype,devtype>::ans >::
+      copy_block(device,host,0,offset,1,n,_buffer,cq);
+  }
 
  private:
+  UCL_DirtyRanges _host_dirty, _device_dirty;
+  bool _track_dirty, _skip_unchanged;
+  UCL_UploadHash _upload_hash;
   UCL_H_Vec<devtype> _buffer;
+
+  inline void _reset_tracking() {
+    _host_dirty.clear();
+    _device_dirty.clear();
+    _upload_hash.invalidate();
+  }
+
+  inline bool _unchanged() {
+    return _skip_unchanged &&
+           ucl_upload_unchanged(device,host,_upload_hash);
+  }
+
+  inline void _update_host_dirty(command_queue &cq) {
+    _ucl_s_obj_help< ucl_same_type<hosttype,devtype>::ans >::
+      copy(host,device,_device_dirty,_buffer,cq);
+    _device_dirty.clear();
+  }
+
+  inline void _update_device_dirty(command_queue &cq) {
+    _upload_hash.invalidate();
+    _ucl_s_obj_help< ucl_same_type<hosttype,devtype>::ans >::
+      copy(device,host,_host_dirty,_buffer,cq);
+    _host_dirty.clear();
+  }
 };
 
 #endif
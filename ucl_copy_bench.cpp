@@ -0,0 +1,470 @@
+/***************************************************************************
+                              ucl_copy_bench.cpp
+                             -------------------
+
+  Transfer bandwidth and latency benchmark for ucl_copy/ucl_cast_copy
+
+ __________________________________________________________________________
+    This file is part of the Geryon Unified Coprocessor Library (UCL)
+ __________________________________________________________________________
+
+ ***************************************************************************/
+
+/* -----------------------------------------------------------------------
+   Copyright (2009) Sandia Corporation.  Under the terms of Contract
+   DE-AC04-94AL85000 with Sandia Corporation, the U.S. Government retains
+   certain rights in this software.  This software is distributed under
+   the Simplified BSD License.
+   ----------------------------------------------------------------------- */
+
+/***************************************************************************
+   Measures effective bandwidth (GB/s) and per-call latency for each of the
+   ucl_copy and ucl_cast_copy paths:
+
+     - host->device, device->host, device->device and host->host
+     - 1D (numel) and pitched 2D (rows,cols) copies
+     - same type and casting (double on host, float on device)
+     - pinned (UCL_READ_WRITE) and pageable (UCL_NOT_PINNED) host memory
+     - blocking and asynchronous copies
+
+   Message sizes are swept by powers of two from -min to -max bytes.
+   Blocking copies are timed individually (min/avg/max per call);
+   asynchronous copies are issued back to back on the default command
+   queue and timed with a single synchronization at the end.
+
+   Usage:
+     ucl_copy_bench [-platform p] [-device d] [-min bytes] [-max bytes]
+                    [-reps n] [-json]
+
+   Results are written to stdout as CSV (default) or JSON. Sizes that
+   cannot be allocated are reported on stderr and skipped.
+ ***************************************************************************/
+
+#define UCL_NO_EXIT
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "geryon/geryon.h"
+
+// --------------------------------------------------------------------------
+// - RESULT STORAGE AND OUTPUT
+// --------------------------------------------------------------------------
+
+struct CopyBenchResult {
+  std::string test, src, dst, host_mem, mode;
+  int dims;
+  size_t bytes, rows, cols;
+  int reps;
+  double tmin, tavg, tmax;       // seconds per copy
+};
+
+class CopyBenchOutput {
+ public:
+  CopyBenchOutput(const bool json) : _json(json) {}
+
+  inline void add(const CopyBenchResult &r) {
+    _results.push_back(r);
+    if (!_json) {
+      if (_results.size()==1)
+        std::cout << "test,src,dst,host_mem,mode,dims,bytes,rows,cols,reps,"
+                  << "min_us,avg_us,max_us,gbps\n";
+      std::cout << r.test << ',' << r.src << ',' << r.dst << ','
+                << r.host_mem << ',' << r.mode << ',' << r.dims << ','
+                << r.bytes << ',' << r.rows << ',' << r.cols << ','
+                << r.reps << ',' << r.tmin*1e6 << ',' << r.tavg*1e6 << ','
+                << r.tmax*1e6 << ',' << gbps(r) << std::endl;
+    }
+  }
+
+  inline void finish(UCL_Device &dev) {
+    if (!_json)
+      return;
+    std::cout << "{\n  \"platform\": \"" << dev.platform_name() << "\",\n"
+              << "  \"device\": \"" << dev.name() << "\",\n"
+              << "  \"results\": [\n";
+    for (size_t i=0; i<_results.size(); i++) {
+      const CopyBenchResult &r=_results[i];
+      std::cout << "    {\"test\": \"" << r.test << "\", \"src\": \""
+                << r.src << "\", \"dst\": \"" << r.dst
+                << "\", \"host_mem\": \"" << r.host_mem << "\", \"mode\": \""
+                << r.mode << "\", \"dims\": " << r.dims << ", \"bytes\": "
+                << r.bytes << ", \"rows\": " << r.rows << ", \"cols\": "
+                << r.cols << ", \"reps\": " << r.reps << ", \"min_us\": "
+                << r.tmin*1e6 << ", \"avg_us\": " << r.tavg*1e6
+                << ", \"max_us\": " << r.tmax*1e6 << ", \"gbps\": "
+                << gbps(r) << "}";
+      if (i+1<_results.size())
+        std::cout << ',';
+      std::cout << '\n';
+    }
+    std::cout << "  ]\n}\n";
+  }
+
+ private:
+  bool _json;
+  std::vector<CopyBenchResult> _results;
+
+  static inline double gbps(const CopyBenchResult &r)
+    { return (r.tmin>0.0) ? r.bytes/r.tmin*1e-9 : 0.0; }
+};
+
+// --------------------------------------------------------------------------
+// - BENCHMARK DRIVER
+// --------------------------------------------------------------------------
+
+class CopyBench {
+ public:
+  CopyBench(UCL_Device &dev, CopyBenchOutput &out, const size_t min_bytes,
+            const size_t max_bytes, const int max_reps) :
+    _dev(dev), _out(out), _min_bytes(min_bytes), _max_bytes(max_bytes),
+    _max_reps(max_reps) {}
+
+  /// Run every copy variant over the size sweep
+  inline void run() {
+    bench_1d(UCL_READ_WRITE);
+    bench_1d(UCL_NOT_PINNED);
+    bench_1d_d2d();
+    bench_2d(UCL_READ_WRITE);
+    bench_2d(UCL_NOT_PINNED);
+    bench_2d_d2d();
+    bench_cast_1d(UCL_READ_WRITE);
+    bench_cast_1d(UCL_NOT_PINNED);
+    bench_cast_2d(UCL_READ_WRITE);
+    bench_cast_2d(UCL_NOT_PINNED);
+    bench_h2h();
+  }
+
+ private:
+  UCL_Device &_dev;
+  CopyBenchOutput &_out;
+  size_t _min_bytes, _max_bytes;
+  int _max_reps;
+
+  typedef std::chrono::high_resolution_clock clock_type;
+
+  static inline const char * mem_name(const enum UCL_MEMOPT kind)
+    { return (kind==UCL_NOT_PINNED) ? "pageable" : "pinned"; }
+
+  /// Number of repetitions for a given message size (at least 3)
+  inline int reps(const size_t bytes) {
+    size_t r=(size_t(1) << 28)/(bytes ? bytes : 1);
+    if (r>(size_t)_max_reps) r=_max_reps;
+    if (r<3) r=3;
+    return r;
+  }
+
+  /// Rows/cols for a pitched copy with n elements (cols not a pitch multiple)
+  static inline void shape_2d(const size_t n, size_t &rows, size_t &cols) {
+    cols=static_cast<size_t>(std::sqrt(static_cast<double>(n)));
+    if (cols==0) cols=1;
+    rows=n/cols;
+  }
+
+  static inline double elapsed(const clock_type::time_point &t0,
+                               const clock_type::time_point &t1)
+    { return std::chrono::duration<double>(t1-t0).count(); }
+
+  inline void skip(const char *test, const size_t bytes) {
+    std::cerr << "Skipping " << test << " at " << bytes
+              << " bytes: allocation failed.\n";
+  }
+
+  /// Time copy_op for one message size and record the result
+  /** Blocking copies are timed individually including the queue sync;
+    * async copies are enqueued back-to-back and synchronized once **/
+  template <class copy_op>
+  inline void time_copy(CopyBenchResult r, command_queue &cq, copy_op op) {
+    r.reps=reps(r.bytes);
+    op();
+    ucl_sync(cq);
+    if (r.mode=="async") {
+      clock_type::time_point t0=clock_type::now();
+      for (int i=0; i<r.reps; i++)
+        op();
+      ucl_sync(cq);
+      clock_type::time_point t1=clock_type::now();
+      r.tmin=r.tavg=r.tmax=elapsed(t0,t1)/r.reps;
+    } else {
+      r.tmin=1e30; r.tmax=0.0; r.tavg=0.0;
+      for (int i=0; i<r.reps; i++) {
+        clock_type::time_point t0=clock_type::now();
+        op();
+        ucl_sync(cq);
+        double t=elapsed(t0,clock_type::now());
+        if (t<r.tmin) r.tmin=t;
+        if (t>r.tmax) r.tmax=t;
+        r.tavg+=t;
+      }
+      r.tavg/=r.reps;
+    }
+    _out.add(r);
+  }
+
+  inline CopyBenchResult make(const char *test, const char *src,
+                              const char *dst, const char *host_mem,
+                              const char *mode, const int dims,
+                              const size_t bytes, const size_t rows,
+                              const size_t cols) {
+    CopyBenchResult r;
+    r.test=test; r.src=src; r.dst=dst; r.host_mem=host_mem; r.mode=mode;
+    r.dims=dims; r.bytes=bytes; r.rows=rows; r.cols=cols; r.reps=0;
+    r.tmin=r.tavg=r.tmax=0.0;
+    return r;
+  }
+
+  // ------------------------------------------------------------------------
+  // - 1D SAME TYPE
+  // ------------------------------------------------------------------------
+
+  inline void bench_1d(const enum UCL_MEMOPT kind) {
+    const char *hm=mem_name(kind);
+    for (size_t bytes=_min_bytes; bytes<=_max_bytes; bytes*=2) {
+      size_t n=bytes/sizeof(float);
+      if (n==0) continue;
+      UCL_H_Vec<float> h;
+      UCL_D_Vec<float> d;
+      if (h.alloc(n,_dev,kind)!=UCL_SUCCESS ||
+          d.alloc(n,_dev,UCL_READ_WRITE)!=UCL_SUCCESS) {
+        skip("copy_1d",bytes);
+        break;
+      }
+      h.zero();
+      time_copy(make("copy_1d","host","device",hm,"blocking",1,bytes,1,n),
+                d.cq(),[&]() { ucl_copy(d,h,n,false); });
+      time_copy(make("copy_1d","host","device",hm,"async",1,bytes,1,n),
+                d.cq(),[&]() { ucl_copy(d,h,n,true); });
+      time_copy(make("copy_1d","device","host",hm,"blocking",1,bytes,1,n),
+                h.cq(),[&]() { ucl_copy(h,d,n,false); });
+      time_copy(make("copy_1d","device","host",hm,"async",1,bytes,1,n),
+                h.cq(),[&]() { ucl_copy(h,d,n,true); });
+    }
+  }
+
+  inline void bench_1d_d2d() {
+    for (size_t bytes=_min_bytes; bytes<=_max_bytes; bytes*=2) {
+      size_t n=bytes/sizeof(float);
+      if (n==0) continue;
+      UCL_D_Vec<float> a, b;
+      if (a.alloc(n,_dev,UCL_READ_WRITE)!=UCL_SUCCESS ||
+          b.alloc(n,_dev,UCL_READ_WRITE)!=UCL_SUCCESS) {
+        skip("copy_1d d2d",bytes);
+        break;
+      }
+      time_copy(make("copy_1d","device","device","none","blocking",1,bytes,
+                     1,n),b.cq(),[&]() { ucl_copy(b,a,n,false); });
+      time_copy(make("copy_1d","device","device","none","async",1,bytes,
+                     1,n),b.cq(),[&]() { ucl_copy(b,a,n,true); });
+    }
+  }
+
+  // ------------------------------------------------------------------------
+  // - PITCHED 2D SAME TYPE
+  // ------------------------------------------------------------------------
+
+  inline void bench_2d(const enum UCL_MEMOPT kind) {
+    const char *hm=mem_name(kind);
+    for (size_t bytes=_min_bytes; bytes<=_max_bytes; bytes*=2) {
+      size_t rows, cols;
+      shape_2d(bytes/sizeof(float),rows,cols);
+      if (rows==0) continue;
+      size_t mb=rows*cols*sizeof(float);
+      UCL_H_Mat<float> h;
+      UCL_D_Mat<float> d;
+      if (h.alloc(rows,cols,_dev,kind)!=UCL_SUCCESS ||
+          d.alloc(rows,cols,_dev,UCL_READ_WRITE)!=UCL_SUCCESS) {
+        skip("copy_2d",bytes);
+        break;
+      }
+      h.zero();
+      time_copy(make("copy_2d","host","device",hm,"blocking",2,mb,rows,cols),
+                d.cq(),[&]() { ucl_copy(d,h,rows,cols,false); });
+      time_copy(make("copy_2d","host","device",hm,"async",2,mb,rows,cols),
+                d.cq(),[&]() { ucl_copy(d,h,rows,cols,true); });
+      time_copy(make("copy_2d","device","host",hm,"blocking",2,mb,rows,cols),
+                h.cq(),[&]() { ucl_copy(h,d,rows,cols,false); });
+      time_copy(make("copy_2d","device","host",hm,"async",2,mb,rows,cols),
+                h.cq(),[&]() { ucl_copy(h,d,rows,cols,true); });
+    }
+  }
+
+  inline void bench_2d_d2d() {
+    for (size_t bytes=_min_bytes; bytes<=_max_bytes; bytes*=2) {
+      size_t rows, cols;
+      shape_2d(bytes/sizeof(float),rows,cols);
+      if (rows==0) continue;
+      size_t mb=rows*cols*sizeof(float);
+      UCL_D_Mat<float> a, b;
+      if (a.alloc(rows,cols,_dev,UCL_READ_WRITE)!=UCL_SUCCESS ||
+          b.alloc(rows,cols,_dev,UCL_READ_WRITE)!=UCL_SUCCESS) {
+        skip("copy_2d d2d",bytes);
+        break;
+      }
+      time_copy(make("copy_2d","device","device","none","blocking",2,mb,
+                     rows,cols),b.cq(),
+                [&]() { ucl_copy(b,a,rows,cols,false); });
+      time_copy(make("copy_2d","device","device","none","async",2,mb,
+                     rows,cols),b.cq(),
+                [&]() { ucl_copy(b,a,rows,cols,true); });
+    }
+  }
+
+  // ------------------------------------------------------------------------
+  // - CASTING COPIES (double on host, float on device)
+  // ------------------------------------------------------------------------
+
+  inline void bench_cast_1d(const enum UCL_MEMOPT kind) {
+    const char *hm=mem_name(kind);
+    for (size_t bytes=_min_bytes; bytes<=_max_bytes; bytes*=2) {
+      size_t n=bytes/sizeof(float);
+      if (n==0) continue;
+      UCL_H_Vec<double> h;
+      UCL_D_Vec<float> d;
+      UCL_H_Vec<float> up_buf, down_buf;
+      if (h.alloc(n,_dev,kind)!=UCL_SUCCESS ||
+          d.alloc(n,_dev,UCL_READ_WRITE)!=UCL_SUCCESS ||
+          up_buf.alloc(n,_dev,UCL_WRITE_ONLY)!=UCL_SUCCESS ||
+          down_buf.alloc(n,_dev,UCL_READ_ONLY)!=UCL_SUCCESS) {
+        skip("cast_1d",bytes);
+        break;
+      }
+      h.zero();
+      time_copy(make("ucl_copy_cast_1d","host","device",hm,"blocking",1,
+                     bytes,1,n),d.cq(),[&]() { ucl_copy(d,h,n,false); });
+      time_copy(make("ucl_copy_cast_1d","device","host",hm,"blocking",1,
+                     bytes,1,n),h.cq(),[&]() { ucl_copy(h,d,n,false); });
+      time_copy(make("cast_copy_1d","host","device",hm,"blocking",1,bytes,
+                     1,n),d.cq(),
+                [&]() { ucl_cast_copy(d,h,n,up_buf,false); });
+      time_copy(make("cast_copy_1d","host","device",hm,"async",1,bytes,1,n),
+                d.cq(),[&]() { ucl_cast_copy(d,h,n,up_buf,true); });
+      time_copy(make("cast_copy_1d","device","host",hm,"blocking",1,bytes,
+                     1,n),h.cq(),
+                [&]() { ucl_cast_copy(h,d,n,down_buf,false); });
+      time_copy(make("cast_copy_1d","device","host",hm,"async",1,bytes,1,n),
+                h.cq(),[&]() { ucl_cast_copy(h,d,n,down_buf,true); });
+    }
+  }
+
+  inline void bench_cast_2d(const enum UCL_MEMOPT kind) {
+    const char *hm=mem_name(kind);
+    for (size_t bytes=_min_bytes; bytes<=_max_bytes; bytes*=2) {
+      size_t rows, cols;
+      shape_2d(bytes/sizeof(float),rows,cols);
+      if (rows==0) continue;
+      size_t mb=rows*cols*sizeof(float);
+      UCL_H_Mat<double> h;
+      UCL_D_Mat<float> d;
+      UCL_H_Vec<float> up_buf, down_buf;
+      if (h.alloc(rows,cols,_dev,kind)!=UCL_SUCCESS ||
+          d.alloc(rows,cols,_dev,UCL_READ_WRITE)!=UCL_SUCCESS ||
+          up_buf.alloc(rows*d.row_size(),_dev,UCL_WRITE_ONLY)!=UCL_SUCCESS ||
+          down_buf.alloc(rows*d.row_size(),_dev,UCL_READ_ONLY)!=UCL_SUCCESS) {
+        skip("cast_2d",bytes);
+        break;
+      }
+      h.zero();
+      time_copy(make("ucl_copy_cast_2d","host","device",hm,"blocking",2,mb,
+                     rows,cols),d.cq(),
+                [&]() { ucl_copy(d,h,rows,cols,false); });
+      time_copy(make("ucl_copy_cast_2d","device","host",hm,"blocking",2,mb,
+                     rows,cols),h.cq(),
+                [&]() { ucl_copy(h,d,rows,cols,false); });
+      time_copy(make("cast_copy_2d","host","device",hm,"blocking",2,mb,
+                     rows,cols),d.cq(),
+                [&]() { ucl_cast_copy(d,h,rows,cols,up_buf,false); });
+      time_copy(make("cast_copy_2d","host","device",hm,"async",2,mb,
+                     rows,cols),d.cq(),
+                [&]() { ucl_cast_copy(d,h,rows,cols,up_buf,true); });
+      time_copy(make("cast_copy_2d","device","host",hm,"blocking",2,mb,
+                     rows,cols),h.cq(),
+                [&]() { ucl_cast_copy(h,d,rows,cols,down_buf,false); });
+      time_copy(make("cast_copy_2d","device","host",hm,"async",2,mb,
+                     rows,cols),h.cq(),
+                [&]() { ucl_cast_copy(h,d,rows,cols,down_buf,true); });
+    }
+  }
+
+  // ------------------------------------------------------------------------
+  // - HOST TO HOST
+  // ------------------------------------------------------------------------
+
+  inline void bench_h2h() {
+    for (size_t bytes=_min_bytes; bytes<=_max_bytes; bytes*=2) {
+      size_t n=bytes/sizeof(float);
+      if (n==0) continue;
+      UCL_H_Vec<float> a, b;
+      UCL_H_Vec<double> c;
+      if (a.alloc(n,_dev,UCL_NOT_PINNED)!=UCL_SUCCESS ||
+          b.alloc(n,_dev,UCL_NOT_PINNED)!=UCL_SUCCESS ||
+          c.alloc(n,_dev,UCL_NOT_PINNED)!=UCL_SUCCESS) {
+        skip("copy_h2h",bytes);
+        break;
+      }
+      a.zero();
+      time_copy(make("copy_1d","host","host","pageable","blocking",1,bytes,
+                     1,n),b.cq(),[&]() { ucl_copy(b,a,n,false); });
+      time_copy(make("ucl_copy_cast_1d","host","host","pageable","blocking",
+                     1,bytes,1,n),c.cq(),[&]() { ucl_copy(c,a,n,false); });
+    }
+  }
+};
+
+// --------------------------------------------------------------------------
+// - MAIN
+// --------------------------------------------------------------------------
+
+inline void copy_bench_usage(const char *name) {
+  std::cerr << "Usage: " << name << " [-platform p] [-device d] "
+            << "[-min bytes] [-max bytes] [-reps n] [-json]\n";
+}
+
+int main(int argc, char** argv) {
+  int platform=0, device=0, max_reps=1000;
+  size_t min_bytes=4, max_bytes=size_t(1) << 30;
+  bool json=false;
+
+  for (int i=1; i<argc; i++) {
+    std::string arg(argv[i]);
+    if (arg=="-json")
+      json=true;
+    else if (i+1<argc && arg=="-platform")
+      platform=atoi(argv[++i]);
+    else if (i+1<argc && arg=="-device")
+      device=atoi(argv[++i]);
+    else if (i+1<argc && arg=="-min")
+      min_bytes=strtoull(argv[++i],NULL,10);
+    else if (i+1<argc && arg=="-max")
+      max_bytes=strtoull(argv[++i],NULL,10);
+    else if (i+1<argc && arg=="-reps")
+      max_reps=atoi(argv[++i]);
+    else {
+      copy_bench_usage(argv[0]);
+      return 1;
+    }
+  }
+  if (min_bytes==0 || min_bytes>max_bytes || max_reps<1) {
+    copy_bench_usage(argv[0]);
+    return 1;
+  }
+
+  UCL_Device dev;
+  if (dev.num_platforms()==0 || dev.set_platform(platform)!=UCL_SUCCESS ||
+      dev.num_devices()==0 || dev.set(device)!=UCL_SUCCESS) {
+    std::cerr << "Could not initialize platform " << platform
+              << ", device " << device << ".\n";
+    return 1;
+  }
+  std::cerr << "Using " << dev.platform_name() << ": " << dev.name()
+            << std::endl;
+
+  CopyBenchOutput out(json);
+  CopyBench bench(dev,out,min_bytes,max_bytes,max_reps);
+  bench.run();
+  out.finish(dev);
+  return 0;
+}
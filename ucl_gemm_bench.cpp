@@ -0,0 +1,376 @@
+/***************************************************************************
+                              ucl_gemm_bench.cpp
+                             -------------------
+
+  Tiled GEMM/GEMV throughput compared with naive kernels
+
+ __________________________________________________________________________
+    This file is part of the Geryon Unified Coprocessor Library (UCL)
+ __________________________________________________________________________
+
+ ***************************************************************************/
+
+/* -----------------------------------------------------------------------
+   Copyright (2009) Sandia Corporation.  Under the terms of Contract
+   DE-AC04-94AL85000 with Sandia Corporation, the U.S. Government retains
+   certain rights in this software.  This software is distributed under
+   the Simplified BSD License.
+   ----------------------------------------------------------------------- */
+
+/***************************************************************************
+   Measures GFLOP/s for UCL_Gemm on pitched UCL_D_Mat storage against
+   naive kernels (one work-item per element of the result, no local
+   memory) for:
+
+     - gemm with square matrices
+     - gemv and transposed gemv with square matrices
+
+   in float and, when the device supports it, double precision. Sizes are
+   swept by powers of two from -min to -max; each size is also run with
+   one extra row and column so that partial tiles are exercised. Results of
+   the tiled kernels are checked against the naive kernels and the largest
+   relative difference is reported.
+
+   Usage:
+     ucl_gemm_bench [-platform p] [-device d] [-min n] [-max n] [-reps n]
+                    [-json]
+ ***************************************************************************/
+
+#define UCL_NO_EXIT
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "geryon/geryon.h"
+
+// --------------------------------------------------------------------------
+// - RESULT STORAGE AND OUTPUT
+// --------------------------------------------------------------------------
+
+struct GemmBenchResult {
+  std::string test, type, kernel;
+  int n, reps, tile, wpt;
+  double tmin;                   // seconds per call
+  double gflops, max_rel_diff;
+};
+
+class GemmBenchOutput {
+ public:
+  GemmBenchOutput(const bool json) : _json(json) {}
+
+  inline void add(const GemmBenchResult &r) {
+    _results.push_back(r);
+    if (!_json) {
+      if (_results.size()==1)
+        std::cout << "test,type,kernel,n,tile,wpt,reps,min_us,gflops,"
+                  << "max_rel_diff\n";
+      std::cout << r.test << ',' << r.type << ',' << r.kernel << ','
+                << r.n << ',' << r.tile << ',' << r.wpt << ',' << r.reps
+                << ',' << r.tmin*1e6 << ',' << r.gflops << ','
+                << r.max_rel_diff << std::endl;
+    }
+  }
+
+  inline void finish(UCL_Device &dev) {
+    if (!_json)
+      return;
+    std::cout << "{\n  \"platform\": \"" << dev.platform_name() << "\",\n"
+              << "  \"device\": \"" << dev.name() << "\",\n"
+              << "  \"results\": [\n";
+    for (size_t i=0; i<_results.size(); i++) {
+      const GemmBenchResult &r=_results[i];
+      std::cout << "    {\"test\": \"" << r.test << "\", \"type\": \""
+                << r.type << "\", \"kernel\": \"" << r.kernel
+                << "\", \"n\": " << r.n << ", \"tile\": " << r.tile
+                << ", \"wpt\": " << r.wpt << ", \"reps\": " << r.reps
+                << ", \"min_us\": " << r.tmin*1e6 << ", \"gflops\": "
+                << r.gflops << ", \"max_rel_diff\": " << r.max_rel_diff
+                << "}";
+      if (i+1<_results.size())
+        std::cout << ',';
+      std::cout << '\n';
+    }
+    std::cout << "  ]\n}\n";
+  }
+
+ private:
+  bool _json;
+  std::vector<GemmBenchResult> _results;
+};
+
+// --------------------------------------------------------------------------
+// - NAIVE KERNELS
+// --------------------------------------------------------------------------
+
+/// Naive kernels written with the portable names used by the primitives
+inline const char * gemm_bench_naive_source() {
+  return
+    "__kernel void naive_gemm(const int m, const int n, const int k,\n"
+    "                         const __global NUMTYP *a, const int lda,\n"
+    "                         const __global NUMTYP *b, const int ldb,\n"
+    "                         __global NUMTYP *c, const int ldc) {\n"
+    "  const int i=GLOBAL_ID_X;\n"
+    "  const int row=i/n, col=i%n;\n"
+    "  if (row<m) {\n"
+    "    NUMTYP s=(NUMTYP)0;\n"
+    "    for (int kk=0; kk<k; kk++)\n"
+    "      s+=a[row*lda+kk]*b[kk*ldb+col];\n"
+    "    c[row*ldc+col]=s;\n"
+    "  }\n"
+    "}\n"
+    "\n"
+    "__kernel void naive_gemv(const int m, const int n,\n"
+    "                         const __global NUMTYP *a, const int lda,\n"
+    "                         const __global NUMTYP *x,\n"
+    "                         __global NUMTYP *y, const int trans) {\n"
+    "  const int i=GLOBAL_ID_X;\n"
+    "  NUMTYP s=(NUMTYP)0;\n"
+    "  if (trans && i<n) {\n"
+    "    for (int r=0; r<m; r++)\n"
+    "      s+=a[r*lda+i]*x[r];\n"
+    "    y[i]=s;\n"
+    "  } else if (!trans && i<m) {\n"
+    "    for (int j=0; j<n; j++)\n"
+    "      s+=a[i*lda+j]*x[j];\n"
+    "    y[i]=s;\n"
+    "  }\n"
+    "}\n";
+}
+
+// --------------------------------------------------------------------------
+// - BENCHMARK DRIVER
+// --------------------------------------------------------------------------
+
+template <class numtyp>
+class GemmBench {
+ public:
+  GemmBench(UCL_Device &dev, GemmBenchOutput &out, const int min_n,
+            const int max_n, const int max_reps) :
+    _dev(dev), _out(out), _min_n(min_n), _max_n(max_n),
+    _max_reps(max_reps), _program(dev), _gemm(dev) {}
+
+  inline int run() {
+    std::ostringstream src;
+    src << "#define NUMTYP " << _UCL_DATA_ID<numtyp>::name() << "\n"
+        << gemm_bench_naive_source();
+    std::string log;
+    if (_ucl_prims_compile(_dev,_program,src.str(),&log)!=UCL_SUCCESS) {
+      std::cerr << "Could not compile naive kernels:\n" << log << std::endl;
+      return UCL_COMPILE_ERROR;
+    }
+    _naive_gemm.set_function(_program,"naive_gemm");
+    _naive_gemv.set_function(_program,"naive_gemv");
+
+    for (int n=_min_n; n<=_max_n; n*=2) {
+      bench_size(n);
+      bench_size(n+1);
+    }
+    return UCL_SUCCESS;
+  }
+
+ private:
+  UCL_Device &_dev;
+  GemmBenchOutput &_out;
+  int _min_n, _max_n, _max_reps;
+  UCL_Program _program;
+  UCL_Kernel _naive_gemm, _naive_gemv;
+  UCL_Gemm<numtyp> _gemm;
+
+  typedef std::chrono::high_resolution_clock clock_type;
+
+  /// Number of repetitions for a given flop count (at least 3)
+  inline int reps(const double flops) {
+    double r=1e10/flops;
+    if (r>_max_reps) r=_max_reps;
+    if (r<3) r=3;
+    return static_cast<int>(r);
+  }
+
+  /// Time op and return the minimum time per call in seconds
+  template <class op_type>
+  inline double time_op(const int nreps, op_type op) {
+    command_queue &cq=_dev.cq();
+    op();
+    ucl_sync(cq);
+    double tmin=1e30;
+    for (int i=0; i<nreps; i++) {
+      clock_type::time_point t0=clock_type::now();
+      op();
+      ucl_sync(cq);
+      double t=std::chrono::duration<double>(clock_type::now()-t0).count();
+      if (t<tmin) tmin=t;
+    }
+    return tmin;
+  }
+
+  /// Largest difference between two host vectors relative to the largest
+  /// magnitude in the reference
+  static inline double rel_diff(const UCL_H_Vec<numtyp> &ref,
+                                const UCL_H_Vec<numtyp> &x, const int rows,
+                                const int cols, const int ld) {
+    double dmax=0.0, rmax=0.0;
+    for (int i=0; i<rows; i++)
+      for (int j=0; j<cols; j++) {
+        double r=ref[i*ld+j];
+        double d=std::fabs(r-static_cast<double>(x[i*ld+j]));
+        if (d>dmax) dmax=d;
+        if (std::fabs(r)>rmax) rmax=std::fabs(r);
+      }
+    return (rmax>0.0) ? dmax/rmax : dmax;
+  }
+
+  inline void record(const char *test, const char *kernel, const int n,
+                     const double flops, const int nreps, const double t,
+                     const double diff) {
+    GemmBenchResult r;
+    r.test=test;
+    r.type=_UCL_DATA_ID<numtyp>::name();
+    r.kernel=kernel;
+    r.n=n;
+    r.reps=nreps;
+    r.tile=_gemm.tile();
+    r.wpt=_gemm.work_per_thread();
+    r.tmin=t;
+    r.gflops=(t>0.0) ? flops/t*1e-9 : 0.0;
+    r.max_rel_diff=diff;
+    _out.add(r);
+  }
+
+  inline void bench_size(int n) {
+    UCL_D_Mat<numtyp> a, b, c, cn;
+    UCL_D_Vec<numtyp> x, y, yn;
+    if (a.alloc(n,n,_dev)!=UCL_SUCCESS || b.alloc(n,n,_dev)!=UCL_SUCCESS ||
+        c.alloc(n,n,_dev)!=UCL_SUCCESS || cn.alloc(n,n,_dev)!=UCL_SUCCESS ||
+        x.alloc(n,_dev)!=UCL_SUCCESS || y.alloc(n,_dev)!=UCL_SUCCESS ||
+        yn.alloc(n,_dev)!=UCL_SUCCESS) {
+      std::cerr << "Skipping n=" << n << ": allocation failed.\n";
+      return;
+    }
+    int ld=static_cast<int>(a.row_size());
+    UCL_H_Vec<numtyp> h, hn;
+    h.alloc(n*ld,_dev);
+    hn.alloc(n*ld,_dev);
+    srand(n);
+    for (int i=0; i<n*ld; i++)
+      h[i]=static_cast<numtyp>(rand())/RAND_MAX-static_cast<numtyp>(0.5);
+    ucl_copy(a,h,n*ld,false);
+    for (int i=0; i<n*ld; i++)
+      h[i]=static_cast<numtyp>(rand())/RAND_MAX-static_cast<numtyp>(0.5);
+    ucl_copy(b,h,n*ld,false);
+    ucl_copy(x,h,n,false);
+    command_queue &cq=_dev.cq();
+
+    // GEMM
+    const double gflop=2.0*n*n*static_cast<double>(n);
+    const int greps=reps(gflop);
+    int m=n, k=n, lda=ld, ldb=static_cast<int>(b.row_size());
+    int ldc=static_cast<int>(c.row_size());
+    _naive_gemm.set_size((n*n+255)/256,256,cq);
+    _naive_gemm.clear_args();
+    _naive_gemm.add_arg(&m);
+    _naive_gemm.add_arg(&n);
+    _naive_gemm.add_arg(&k);
+    _naive_gemm.add_arg(&a);
+    _naive_gemm.add_arg(&lda);
+    _naive_gemm.add_arg(&b);
+    _naive_gemm.add_arg(&ldb);
+    _naive_gemm.add_arg(&cn);
+    _naive_gemm.add_arg(&ldc);
+    double tn=time_op(greps,[&]() { _naive_gemm.run(); });
+    double tt=time_op(greps,[&]() { _gemm.gemm(c,a,b,cq); });
+    ucl_copy(hn,cn,n*ldc,false);
+    ucl_copy(h,c,n*ldc,false);
+    double diff=rel_diff(hn,h,n,n,ldc);
+    record("gemm","naive",n,gflop,greps,tn,0.0);
+    record("gemm","tiled",n,gflop,greps,tt,diff);
+
+    // GEMV with and without transpose
+    const double vflop=2.0*n*static_cast<double>(n);
+    const int vreps=reps(vflop);
+    for (int trans=0; trans<2; trans++) {
+      _naive_gemv.set_size((n+255)/256,256,cq);
+      _naive_gemv.clear_args();
+      _naive_gemv.add_arg(&m);
+      _naive_gemv.add_arg(&n);
+      _naive_gemv.add_arg(&a);
+      _naive_gemv.add_arg(&lda);
+      _naive_gemv.add_arg(&x);
+      _naive_gemv.add_arg(&yn);
+      _naive_gemv.add_arg(&trans);
+      tn=time_op(vreps,[&]() { _naive_gemv.run(); });
+      tt=time_op(vreps,[&]() {
+        _gemm.gemv(y,a,x,cq,static_cast<numtyp>(1),static_cast<numtyp>(0),
+                   trans!=0);
+      });
+      ucl_copy(hn,yn,n,false);
+      ucl_copy(h,y,n,false);
+      diff=rel_diff(hn,h,1,n,n);
+      const char *test=trans ? "gemv_t" : "gemv";
+      record(test,"naive",n,vflop,vreps,tn,0.0);
+      record(test,"tiled",n,vflop,vreps,tt,diff);
+    }
+  }
+};
+
+// --------------------------------------------------------------------------
+// - MAIN
+// --------------------------------------------------------------------------
+
+inline void gemm_bench_usage(const char *name) {
+  std::cerr << "Usage: " << name << " [-platform p] [-device d] "
+            << "[-min n] [-max n] [-reps n] [-json]\n";
+}
+
+int main(int argc, char** argv) {
+  int platform=0, device=0, min_n=64, max_n=2048, max_reps=100;
+  bool json=false;
+
+  for (int i=1; i<argc; i++) {
+    std::string arg(argv[i]);
+    if (arg=="-json")
+      json=true;
+    else if (i+1<argc && arg=="-platform")
+      platform=atoi(argv[++i]);
+    else if (i+1<argc && arg=="-device")
+      device=atoi(argv[++i]);
+    else if (i+1<argc && arg=="-min")
+      min_n=atoi(argv[++i]);
+    else if (i+1<argc && arg=="-max")
+      max_n=atoi(argv[++i]);
+    else if (i+1<argc && arg=="-reps")
+      max_reps=atoi(argv[++i]);
+    else {
+      gemm_bench_usage(argv[0]);
+      return 1;
+    }
+  }
+  if (min_n<1 || min_n>max_n || max_reps<1) {
+    gemm_bench_usage(argv[0]);
+    return 1;
+  }
+
+  UCL_Device dev;
+  if (dev.num_platforms()==0 || dev.set_platform(platform)!=UCL_SUCCESS ||
+      dev.num_devices()==0 || dev.set(device)!=UCL_SUCCESS) {
+    std::cerr << "Could not initialize platform " << platform
+              << ", device " << device << ".\n";
+    return 1;
+  }
+  std::cerr << "Using " << dev.platform_name() << ": " << dev.name()
+            << std::endl;
+
+  GemmBenchOutput out(json);
+  GemmBench<float> fbench(dev,out,min_n,max_n,max_reps);
+  if (fbench.run()!=UCL_SUCCESS)
+    return 1;
+  if (dev.double_precision()) {
+    GemmBench<double> dbench(dev,out,min_n,max_n,max_reps);
+    if (dbench.run()!=UCL_SUCCESS)
+      return 1;
+  }
+  out.finish(dev);
+  return 0;
+}
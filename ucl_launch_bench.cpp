@@ -0,0 +1,408 @@
+/***************************************************************************
+                             ucl_launch_bench.cpp
+                             -------------------
+
+  Kernel launch overhead and host API cost microbenchmarks
+
+ __________________________________________________________________________
+    This file is part of the Geryon Unified Coprocessor Library (UCL)
+ __________________________________________________________________________
+
+ ***************************************************************************/
+
+/* -----------------------------------------------------------------------
+   Copyright (2009) Sandia Corporation.  Under the terms of Contract
+   DE-AC04-94AL85000 with Sandia Corporation, the U.S. Government retains
+   certain rights in this software.  This software is distributed under
+   the Simplified BSD License.
+   ----------------------------------------------------------------------- */
+
+/***************************************************************************
+   Measures the host cost per call and the end-to-end latency of the Geryon
+   calls that sit on the kernel launch path:
+
+     - UCL_Kernel::run with 0 to 32 arguments (host cost and run+sync)
+     - add_arg (scalar and container), set_arg and clear_args
+     - UCL_Timer start/stop/time
+     - container alloc/clear/resize (host pinned and device)
+     - ucl_sync on an idle queue
+     - _device_zero (through zero()) host cost and with sync
+
+   Each test is sampled in batches of calls; a sample is the batch time
+   divided by the batch size so that clock overhead does not dominate
+   calls that cost only a few ns. Work that must happen between batches
+   (draining the queue, releasing events) is not timed. Percentiles are
+   reported over all samples.
+
+   Kernels are empty functions generated at run time (OpenCL C for OpenCL,
+   PTX for CUDA) with alternating pointer and int arguments.
+
+   Usage:
+     ucl_launch_bench [-platform p] [-device d] [-iters n] [-sync_iters n]
+                      [-json]
+
+   -iters sets the number of calls for the host-cost tests (default 10^6);
+   -sync_iters sets the number for tests that synchronize or allocate on
+   every call (default 10^4).
+ ***************************************************************************/
+
+#define UCL_NO_EXIT
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "geryon/geryon.h"
+
+#define LAUNCH_BENCH_MAX_ARGS 32
+
+// --------------------------------------------------------------------------
+// - RESULT STORAGE AND OUTPUT
+// --------------------------------------------------------------------------
+
+struct LaunchBenchResult {
+  std::string test;
+  int args;
+  size_t calls, batch;
+  double pmin, p50, p90, p99, p999, pmax, mean;   // ns per call
+};
+
+class LaunchBenchOutput {
+ public:
+  LaunchBenchOutput(const bool json) : _json(json) {}
+
+  inline void add(const LaunchBenchResult &r) {
+    _results.push_back(r);
+    if (!_json) {
+      if (_results.size()==1)
+        std::cout << "test,args,calls,batch,min_ns,p50_ns,p90_ns,p99_ns,"
+                  << "p999_ns,max_ns,mean_ns\n";
+      std::cout << r.test << ',' << r.args << ',' << r.calls << ','
+                << r.batch << ',' << r.pmin << ',' << r.p50 << ','
+                << r.p90 << ',' << r.p99 << ',' << r.p999 << ','
+                << r.pmax << ',' << r.mean << std::endl;
+    }
+  }
+
+  inline void finish(UCL_Device &dev) {
+    if (!_json)
+      return;
+    std::cout << "{\n  \"platform\": \"" << dev.platform_name() << "\",\n"
+              << "  \"device\": \"" << dev.name() << "\",\n"
+              << "  \"results\": [\n";
+    for (size_t i=0; i<_results.size(); i++) {
+      const LaunchBenchResult &r=_results[i];
+      std::cout << "    {\"test\": \"" << r.test << "\", \"args\": "
+                << r.args << ", \"calls\": " << r.calls << ", \"batch\": "
+                << r.batch << ", \"min_ns\": " << r.pmin << ", \"p50_ns\": "
+                << r.p50 << ", \"p90_ns\": " << r.p90 << ", \"p99_ns\": "
+                << r.p99 << ", \"p999_ns\": " << r.p999 << ", \"max_ns\": "
+                << r.pmax << ", \"mean_ns\": " << r.mean << "}";
+      if (i+1<_results.size())
+        std::cout << ',';
+      std::cout << '\n';
+    }
+    std::cout << "  ]\n}\n";
+  }
+
+ private:
+  bool _json;
+  std::vector<LaunchBenchResult> _results;
+};
+
+// --------------------------------------------------------------------------
+// - KERNEL SOURCE GENERATION
+// --------------------------------------------------------------------------
+
+/// Source for empty kernels k0..kN with alternating pointer/int arguments
+inline std::string launch_bench_source(const int max_args) {
+  std::ostringstream src;
+  #if defined(USE_OPENCL) || defined(UCL_OPENCL)
+  for (int n=0; n<=max_args; n++) {
+    src << "__kernel void k" << n << "(";
+    for (int i=0; i<n; i++) {
+      if (i>0) src << ", ";
+      if (i%2==0)
+        src << "__global float *a" << i;
+      else
+        src << "const int a" << i;
+    }
+    src << ") { }\n";
+  }
+  #else
+  src << ".version 6.0\n.target sm_50\n.address_size 64\n\n";
+  for (int n=0; n<=max_args; n++) {
+    src << ".visible .entry k" << n << "(";
+    for (int i=0; i<n; i++) {
+      if (i>0) src << ", ";
+      if (i%2==0)
+        src << ".param .u64 a" << i;
+      else
+        src << ".param .u32 a" << i;
+    }
+    src << ")\n{\n  ret;\n}\n\n";
+  }
+  #endif
+  return src.str();
+}
+
+// --------------------------------------------------------------------------
+// - BENCHMARK DRIVER
+// --------------------------------------------------------------------------
+
+class LaunchBench {
+ public:
+  LaunchBench(UCL_Device &dev, LaunchBenchOutput &out, const size_t iters,
+              const size_t sync_iters) :
+    _dev(dev), _out(out), _iters(iters), _sync_iters(sync_iters) {}
+
+  inline int run() {
+    UCL_Program program(_dev);
+    std::string src=launch_bench_source(LAUNCH_BENCH_MAX_ARGS);
+    std::string log;
+    if (program.load_string(src.c_str(),"",&log)!=UCL_SUCCESS) {
+      std::cerr << "Could not compile benchmark kernels:\n" << log
+                << std::endl;
+      return UCL_COMPILE_ERROR;
+    }
+
+    _buf.alloc(_dev.group_size(),_dev,UCL_READ_WRITE);
+    _ival=1;
+
+    bench_launch(program);
+    bench_args(program);
+    bench_timer();
+    bench_alloc();
+    bench_sync_zero();
+    return UCL_SUCCESS;
+  }
+
+ private:
+  UCL_Device &_dev;
+  LaunchBenchOutput &_out;
+  size_t _iters, _sync_iters;
+  UCL_D_Vec<float> _buf;
+  int _ival;
+
+  typedef std::chrono::high_resolution_clock clock_type;
+
+  /// Add argument i to a kernel (pointer for even i, int for odd i)
+  inline void add_bench_arg(UCL_Kernel &k, const int i) {
+    if (i%2==0)
+      k.add_arg(&_buf);
+    else
+      k.add_arg(&_ival);
+  }
+
+  inline void set_args(UCL_Kernel &k, const int nargs) {
+    k.clear_args();
+    for (int i=0; i<nargs; i++)
+      add_bench_arg(k,i);
+  }
+
+  /// Time calls in batches and record percentiles of the per-call time
+  /** \param op Timed call, executed batch times per sample
+    * \param between Untimed work executed after each batch **/
+  template <class op_type, class between_type>
+  inline void measure(const std::string &test, const int args,
+                      const size_t calls, const size_t batch, op_type op,
+                      between_type between) {
+    size_t nsamples=calls/batch;
+    if (nsamples==0) nsamples=1;
+    std::vector<double> t(nsamples);
+    for (size_t i=0; i<batch; i++)
+      op();
+    between();
+    for (size_t s=0; s<nsamples; s++) {
+      clock_type::time_point t0=clock_type::now();
+      for (size_t i=0; i<batch; i++)
+        op();
+      clock_type::time_point t1=clock_type::now();
+      t[s]=std::chrono::duration<double,std::nano>(t1-t0).count()/batch;
+      between();
+    }
+
+    LaunchBenchResult r;
+    r.test=test;
+    r.args=args;
+    r.calls=nsamples*batch;
+    r.batch=batch;
+    r.mean=0.0;
+    for (size_t s=0; s<nsamples; s++)
+      r.mean+=t[s];
+    r.mean/=nsamples;
+    std::sort(t.begin(),t.end());
+    r.pmin=t.front();
+    r.pmax=t.back();
+    r.p50=percentile(t,0.5);
+    r.p90=percentile(t,0.9);
+    r.p99=percentile(t,0.99);
+    r.p999=percentile(t,0.999);
+    _out.add(r);
+  }
+
+  static inline double percentile(const std::vector<double> &t,
+                                  const double p) {
+    size_t i=static_cast<size_t>(p*(t.size()-1)+0.5);
+    return t[std::min(i,t.size()-1)];
+  }
+
+  // ------------------------------------------------------------------------
+  // - KERNEL LAUNCH
+  // ------------------------------------------------------------------------
+
+  inline void bench_launch(UCL_Program &program) {
+    for (int nargs=0; nargs<=LAUNCH_BENCH_MAX_ARGS;
+         nargs=(nargs==0) ? 1 : nargs*2) {
+      std::ostringstream name;
+      name << 'k' << nargs;
+      UCL_Kernel k(program,name.str().c_str());
+      set_args(k,nargs);
+      k.set_size(1,1);
+
+      // Host cost of enqueue; drain the queue between batches
+      measure("run",nargs,_iters,256,[&]() { k.run(); },
+              [&]() { ucl_sync(k.cq()); });
+      // End-to-end latency of a single launch
+      measure("run_sync",nargs,_sync_iters,1,
+              [&]() { k.run(); ucl_sync(k.cq()); },[]() {});
+      // Re-binding all arguments before each launch
+      measure("set_args_run",nargs,_iters,256,
+              [&]() { set_args(k,nargs); k.run(); },
+              [&]() { ucl_sync(k.cq()); });
+    }
+  }
+
+  // ------------------------------------------------------------------------
+  // - ARGUMENT BINDING
+  // ------------------------------------------------------------------------
+
+  inline void bench_args(UCL_Program &program) {
+    std::ostringstream name;
+    name << 'k' << LAUNCH_BENCH_MAX_ARGS;
+    UCL_Kernel k(program,name.str().c_str());
+    const int n=LAUNCH_BENCH_MAX_ARGS;
+
+    // One call is clear_args followed by n alternating add_arg calls
+    size_t calls=_iters/n;
+    if (calls==0) calls=1;
+    measure("clear_add_args",n,calls,64,[&]() { set_args(k,n); },[]() {});
+
+    set_args(k,n);
+    measure("set_arg_scalar",1,_iters,256,[&]() { k.set_arg(1,&_ival); },
+            []() {});
+    measure("set_arg_pointer",1,_iters,256,
+            [&]() { k.set_arg(0,&_buf.begin()); },[]() {});
+    measure("clear_args",0,_iters,256,[&]() { k.clear_args(); },[]() {});
+  }
+
+  // ------------------------------------------------------------------------
+  // - TIMER
+  // ------------------------------------------------------------------------
+
+  inline void bench_timer() {
+    UCL_Timer timer(_dev);
+    measure("timer_start",0,_sync_iters,1,[&]() { timer.start(); },
+            [&]() { timer.stop(); timer.time(); });
+    measure("timer_stop",0,_sync_iters,1,[&]() { timer.stop(); },
+            [&]() { timer.time(); timer.start(); });
+    measure("timer_start_stop_time",0,_sync_iters,1,
+            [&]() { timer.start(); timer.stop(); timer.time(); },[]() {});
+  }
+
+  // ------------------------------------------------------------------------
+  // - CONTAINER ALLOCATION
+  // ------------------------------------------------------------------------
+
+  inline void bench_alloc() {
+    const size_t n=1024;
+    UCL_D_Vec<float> d;
+    UCL_H_Vec<float> h;
+    UCL_D_Mat<float> dm;
+    measure("d_vec_alloc_clear",0,_sync_iters,1,
+            [&]() { d.alloc(n,_dev); d.clear(); },[]() {});
+    measure("h_vec_alloc_clear",0,_sync_iters,1,
+            [&]() { h.alloc(n,_dev); h.clear(); },[]() {});
+    measure("h_vec_alloc_clear_not_pinned",0,_sync_iters,1,
+            [&]() { h.alloc(n,_dev,UCL_NOT_PINNED); h.clear(); },[]() {});
+    measure("d_mat_alloc_clear",0,_sync_iters,1,
+            [&]() { dm.alloc(32,n/32,_dev); dm.clear(); },[]() {});
+
+    d.alloc(n,_dev);
+    h.alloc(n,_dev);
+    size_t i=0;
+    measure("d_vec_resize",0,_sync_iters,1,
+            [&]() { d.resize(n+(i++%2)); },[]() {});
+    measure("h_vec_resize",0,_sync_iters,1,
+            [&]() { h.resize(n+(i++%2)); },[]() {});
+  }
+
+  // ------------------------------------------------------------------------
+  // - SYNCHRONIZATION AND ZERO
+  // ------------------------------------------------------------------------
+
+  inline void bench_sync_zero() {
+    command_queue &cq=_dev.cq();
+    measure("ucl_sync_idle",0,_iters,256,[&]() { ucl_sync(cq); },[]() {});
+    measure("device_zero",0,_iters,256,[&]() { _buf.zero(); },
+            [&]() { ucl_sync(cq); });
+    measure("device_zero_sync",0,_sync_iters,1,
+            [&]() { _buf.zero(); ucl_sync(cq); },[]() {});
+  }
+};
+
+// --------------------------------------------------------------------------
+// - MAIN
+// --------------------------------------------------------------------------
+
+inline void launch_bench_usage(const char *name) {
+  std::cerr << "Usage: " << name << " [-platform p] [-device d] "
+            << "[-iters n] [-sync_iters n] [-json]\n";
+}
+
+int main(int argc, char** argv) {
+  int platform=0, device=0;
+  size_t iters=1000000, sync_iters=10000;
+  bool json=false;
+
+  for (int i=1; i<argc; i++) {
+    std::string arg(argv[i]);
+    if (arg=="-json")
+      json=true;
+    else if (i+1<argc && arg=="-platform")
+      platform=atoi(argv[++i]);
+    else if (i+1<argc && arg=="-device")
+      device=atoi(argv[++i]);
+    else if (i+1<argc && arg=="-iters")
+      iters=strtoull(argv[++i],NULL,10);
+    else if (i+1<argc && arg=="-sync_iters")
+      sync_iters=strtoull(argv[++i],NULL,10);
+    else {
+      launch_bench_usage(argv[0]);
+      return 1;
+    }
+  }
+  if (iters==0 || sync_iters==0) {
+    launch_bench_usage(argv[0]);
+    return 1;
+  }
+
+  UCL_Device dev;
+  if (dev.num_platforms()==0 || dev.set_platform(platform)!=UCL_SUCCESS ||
+      dev.num_devices()==0 || dev.set(device)!=UCL_SUCCESS) {
+    std::cerr << "Could not initialize platform " << platform
+              << ", device " << device << ".\n";
+    return 1;
+  }
+  std::cerr << "Using " << dev.platform_name() << ": " << dev.name()
+            << std::endl;
+
+  LaunchBenchOutput out(json);
+  LaunchBench bench(dev,out,iters,sync_iters);
+  if (bench.run()!=UCL_SUCCESS)
+    return 1;
+  out.finish(dev);
+  return 0;
+}